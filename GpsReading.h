@@ -0,0 +1,217 @@
+// one position reading in fixed point, see NmeaField.h for how NMEA text becomes one
+
+// which fields a reading has, and how many decimals of minutes the receiver
+// sent for latitude and longitude so the log can reproduce them
+#define GPS_READING_TIME        0b00000001
+#define GPS_READING_DATE        0b00000010
+#define GPS_READING_POSITION    0b00000100
+#define GPS_READING_ALTITUDE    0b00001000
+#define GPS_READING_SATELLITES  0b00010000
+#define GPS_READING_DECIMALS_SHIFT 5
+#define GPS_READING_DECIMALS_MASK  0b11100000
+
+// UTC date and time packed into 32 bits
+// yyyyyymm mmdddddh hhhhmmmm mmssssss, year counted from 2000
+#define GPS_DATETIME_YEAR_SHIFT   26
+#define GPS_DATETIME_MONTH_SHIFT  22
+#define GPS_DATETIME_DAY_SHIFT    17
+#define GPS_DATETIME_HOUR_SHIFT   12
+#define GPS_DATETIME_MINUTE_SHIFT 6
+#define GPS_DATETIME_DATE_MASK    0xfffe0000UL
+#define GPS_DATETIME_TIME_MASK    0x0001ffffUL
+
+struct GpsReading
+{
+    uint32_t dateTime;      // packed UTC, see GPS_DATETIME_*
+    int32_t latitude;       // 1e-7 degrees, north positive
+    int32_t longitude;      // 1e-7 degrees, east positive
+    int32_t altitude;       // centimeters above mean sea level
+    uint8_t satelliteCount;
+    uint8_t flags;          // GPS_READING_*
+};
+
+// the fields a build decodes, the time always is; TaskGps leaves the others
+// out of the parser and ReadingQueue out of its slots
+#ifndef GPS_READING_FIELDS
+#define GPS_READING_FIELDS (GPS_READING_DATE | GPS_READING_POSITION | GPS_READING_ALTITUDE | GPS_READING_SATELLITES)
+#endif
+
+// a GpsReading cut down to the fields FIELDS keeps, for readings waiting in
+// RAM; the parts left out are empty and take no space
+template <bool KEEP>
+struct GpsSlotPosition
+{
+    int32_t latitude;
+    int32_t longitude;
+
+    void NarrowPosition(const GpsReading& reading)
+    {
+        latitude = reading.latitude;
+        longitude = reading.longitude;
+    }
+
+    void WidenPosition(GpsReading& reading) const
+    {
+        reading.latitude = latitude;
+        reading.longitude = longitude;
+    }
+};
+
+template <>
+struct GpsSlotPosition<false>
+{
+    void NarrowPosition(const GpsReading&) {}
+    void WidenPosition(GpsReading& reading) const
+    {
+        reading.latitude = 0;
+        reading.longitude = 0;
+    }
+};
+
+template <bool KEEP>
+struct GpsSlotAltitude
+{
+    int32_t altitude;
+
+    void NarrowAltitude(const GpsReading& reading)
+    {
+        altitude = reading.altitude;
+    }
+
+    void WidenAltitude(GpsReading& reading) const
+    {
+        reading.altitude = altitude;
+    }
+};
+
+template <>
+struct GpsSlotAltitude<false>
+{
+    void NarrowAltitude(const GpsReading&) {}
+    void WidenAltitude(GpsReading& reading) const
+    {
+        reading.altitude = 0;
+    }
+};
+
+template <bool KEEP>
+struct GpsSlotSatellites
+{
+    uint8_t satelliteCount;
+
+    void NarrowSatellites(const GpsReading& reading)
+    {
+        satelliteCount = reading.satelliteCount;
+    }
+
+    void WidenSatellites(GpsReading& reading) const
+    {
+        reading.satelliteCount = satelliteCount;
+    }
+};
+
+template <>
+struct GpsSlotSatellites<false>
+{
+    void NarrowSatellites(const GpsReading&) {}
+    void WidenSatellites(GpsReading& reading) const
+    {
+        reading.satelliteCount = 0;
+    }
+};
+
+// the date shares dateTime with the time, so it is always there; first, so
+// the 32 bit fields line up without padding
+struct GpsSlotTime
+{
+    uint32_t dateTime;
+};
+
+template <uint8_t FIELDS>
+struct GpsSlotReadingT :
+    GpsSlotTime,
+    GpsSlotPosition<(FIELDS & GPS_READING_POSITION) != 0>,
+    GpsSlotAltitude<(FIELDS & GPS_READING_ALTITUDE) != 0>,
+    GpsSlotSatellites<(FIELDS & GPS_READING_SATELLITES) != 0>
+{
+    static constexpr uint8_t Fields = FIELDS;
+
+    uint8_t flags;
+
+    void Narrow(const GpsReading& reading)
+    {
+        dateTime = reading.dateTime;
+        flags = reading.flags;
+        this->NarrowPosition(reading);
+        this->NarrowAltitude(reading);
+        this->NarrowSatellites(reading);
+    }
+
+    // the fields left out are 0, their flags are never set
+    GpsReading Widen() const
+    {
+        GpsReading reading;
+        reading.dateTime = dateTime;
+        reading.flags = flags;
+        this->WidenPosition(reading);
+        this->WidenAltitude(reading);
+        this->WidenSatellites(reading);
+        return reading;
+    }
+};
+
+typedef GpsSlotReadingT<GPS_READING_FIELDS> GpsSlotReading;
+
+inline uint8_t GpsDateTimeYear(uint32_t dateTime)
+{
+    return dateTime >> GPS_DATETIME_YEAR_SHIFT;
+}
+
+inline uint8_t GpsDateTimeMonth(uint32_t dateTime)
+{
+    return (dateTime >> GPS_DATETIME_MONTH_SHIFT) & 0x0f;
+}
+
+inline uint8_t GpsDateTimeDay(uint32_t dateTime)
+{
+    return (dateTime >> GPS_DATETIME_DAY_SHIFT) & 0x1f;
+}
+
+inline uint8_t GpsDateTimeHour(uint32_t dateTime)
+{
+    return (dateTime >> GPS_DATETIME_HOUR_SHIFT) & 0x1f;
+}
+
+inline uint8_t GpsDateTimeMinute(uint32_t dateTime)
+{
+    return (dateTime >> GPS_DATETIME_MINUTE_SHIFT) & 0x3f;
+}
+
+inline uint8_t GpsDateTimeSecond(uint32_t dateTime)
+{
+    return dateTime & 0x3f;
+}
+
+const uint16_t GpsDaysBeforeMonth[] PROGMEM = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+// seconds since 2000-01-01 of a packed date and time, for spans across midnight
+inline uint32_t GpsDateTimeSeconds(uint32_t dateTime)
+{
+    uint32_t years = GpsDateTimeYear(dateTime);
+    uint8_t month = GpsDateTimeMonth(dateTime);
+    month = (month >= 1 && month <= 12) ? month : 1;
+    uint8_t day = GpsDateTimeDay(dateTime);
+
+    // 2000 is a leap year and 2100 is out of reach of the packed year
+    uint32_t days = years * 365 + (years + 3) / 4 + pgm_read_word(&GpsDaysBeforeMonth[month - 1]) +
+        ((month > 2 && years % 4 == 0) ? 1 : 0) + (day ? day - 1 : 0);
+    return days * 86400UL + GpsDateTimeHour(dateTime) * 3600UL + GpsDateTimeMinute(dateTime) * 60UL +
+        GpsDateTimeSecond(dateTime);
+}
+
+const uint32_t GpsPowersOfTen[] PROGMEM = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+inline uint32_t GpsPowerOfTen(uint8_t exponent)
+{
+    return pgm_read_dword(&GpsPowersOfTen[exponent]);
+}
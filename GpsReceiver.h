@@ -0,0 +1,214 @@
+// configuration commands for the GPS receiver, sent by TaskGps once it starts
+//
+// Out of the box receivers send every sentence they know, most of which the
+// logger never uses. The commands below leave only RMC and GGA every fix and
+// GSA for the fix type, and can raise the baud and fix rate. MTK receivers
+// (PMTK commands) answer with $PMTK001, u-blox receivers (UBX binary) with
+// ACK-ACK or ACK-NAK; a baud change is confirmed by a valid sentence at the
+// new speed instead, and refused by a receiver still sending at the old one.
+
+#define GPS_RECEIVER_NONE 0
+#define GPS_RECEIVER_MTK 1
+#define GPS_RECEIVER_UBLOX 2
+
+#ifndef GPS_RECEIVER
+#define GPS_RECEIVER GPS_RECEIVER_MTK
+#endif
+
+// the speed the receiver starts with
+#ifndef GPS_BAUD
+#define GPS_BAUD 9600
+#endif
+
+// switch to this speed once configured, 0 keeps GPS_BAUD
+#ifndef GPS_CONFIG_BAUD
+#define GPS_CONFIG_BAUD 0
+#endif
+
+// the speed the receiver runs at once configured
+#define GPS_LINE_BAUD (GPS_CONFIG_BAUD ? GPS_CONFIG_BAUD : GPS_BAUD)
+
+// time between fixes in ms, 0 keeps the receiver default of 1 Hz
+#ifndef GPS_CONFIG_INTERVAL_MS
+#define GPS_CONFIG_INTERVAL_MS 0
+#endif
+
+// GSA only feeds the fix LED, every 5th fix is plenty
+#ifndef GPS_CONFIG_GSA_EVERY
+#define GPS_CONFIG_GSA_EVERY 5
+#endif
+
+// cut the sentences down to the ones above, 0 leaves the receiver sending
+// what it does out of the box, as a raw capture is meant to keep it
+#ifndef GPS_CONFIG_SENTENCES
+    #if defined(GPS_RAW_CAPTURE) && GPS_RAW_CAPTURE
+        #define GPS_CONFIG_SENTENCES 0
+    #else
+        #define GPS_CONFIG_SENTENCES 1
+    #endif
+#endif
+
+// nothing left to send, the receiver is not configured at all
+#if !GPS_CONFIG_SENTENCES && !GPS_CONFIG_INTERVAL_MS && !GPS_CONFIG_BAUD
+    #undef GPS_RECEIVER
+    #define GPS_RECEIVER GPS_RECEIVER_NONE
+#endif
+
+// commands go out once the line has been quiet this long, between bursts,
+// as SoftwareSerial cannot receive while it sends
+#define GPS_CONFIG_QUIET_MS 20
+#define GPS_CONFIG_ACK_TIMEOUT_MS 1500
+#define GPS_CONFIG_TRIES 3
+
+// a receiver that ignored the baud command keeps sending at the old speed,
+// which reads as noise at the new one; this many bytes without a valid
+// sentence, two of the longest, and the old speed is back for good
+#define GPS_CONFIG_BAUD_PROBE_BYTES 164
+
+#define GPS_CONFIG_STRING(value) GPS_CONFIG_STRING_VALUE(value)
+#define GPS_CONFIG_STRING_VALUE(value) #value
+
+#if GPS_RECEIVER == GPS_RECEIVER_MTK
+
+inline char GpsHexDigit(uint8_t value)
+{
+    return (value < 10) ? '0' + value : 'A' + value - 10;
+}
+
+// between '$' and '*', the checksum is added when sending
+// PMTK314 rates: GLL, RMC, VTG, GGA, GSA, GSV, then 13 more nobody here needs
+const char GpsMtkSentences[] PROGMEM = "PMTK314,0,1,0,1," GPS_CONFIG_STRING(GPS_CONFIG_GSA_EVERY) ",0,0,0,0,0,0,0,0,0,0,0,0,0,0";
+#if GPS_CONFIG_INTERVAL_MS
+const char GpsMtkInterval[] PROGMEM = "PMTK220," GPS_CONFIG_STRING(GPS_CONFIG_INTERVAL_MS);
+#endif
+#if GPS_CONFIG_BAUD
+const char GpsMtkBaud[] PROGMEM = "PMTK251," GPS_CONFIG_STRING(GPS_CONFIG_BAUD);
+#endif
+
+const char* const GpsConfigCommands[] PROGMEM =
+{
+#if GPS_CONFIG_SENTENCES
+    GpsMtkSentences,
+#endif
+#if GPS_CONFIG_INTERVAL_MS
+    GpsMtkInterval,
+#endif
+#if GPS_CONFIG_BAUD
+    GpsMtkBaud,
+#endif
+};
+
+#define GPS_CONFIG_COMMAND_COUNT (sizeof(GpsConfigCommands) / sizeof(GpsConfigCommands[0]))
+
+inline void SendGpsConfigCommand(Print& port, uint8_t index)
+{
+    const char* command = reinterpret_cast<const char*>(pgm_read_ptr(&GpsConfigCommands[index]));
+    uint8_t checksum = 0;
+    port.write('$');
+    for (char value; (value = pgm_read_byte(command)) != '\0'; command++)
+    {
+        checksum ^= value;
+        port.write(value);
+    }
+    port.write('*');
+    port.write(GpsHexDigit(checksum >> 4));
+    port.write(GpsHexDigit(checksum & 0x0f));
+    port.write('\r');
+    port.write('\n');
+}
+
+// the command number $PMTK001 repeats when it answers
+inline uint16_t GpsConfigAckKey(uint8_t index)
+{
+    const char* command = reinterpret_cast<const char*>(pgm_read_ptr(&GpsConfigCommands[index]));
+    return (pgm_read_byte(command + 4) - '0') * 100 + (pgm_read_byte(command + 5) - '0') * 10 +
+        (pgm_read_byte(command + 6) - '0');
+}
+
+#elif GPS_RECEIVER == GPS_RECEIVER_UBLOX
+
+#define UBX_SYNC_1 0xb5
+#define UBX_SYNC_2 0x62
+#define UBX_CLASS_ACK 0x05
+#define UBX_ID_ACK_NAK 0x00
+#define UBX_ID_ACK_ACK 0x01
+#define UBX_CLASS_CFG 0x06
+#define UBX_ID_CFG_PRT 0x00
+#define UBX_ID_CFG_MSG 0x01
+#define UBX_ID_CFG_RATE 0x08
+#define UBX_CLASS_NMEA 0xf0
+
+// class, id, payload length, payload; CFG-MSG rates apply to the port it arrives on
+const uint8_t GpsUbxCommands[] PROGMEM =
+{
+#if GPS_CONFIG_SENTENCES
+    UBX_CLASS_CFG, UBX_ID_CFG_MSG, 3, UBX_CLASS_NMEA, 0x01, 0, // GLL off
+    UBX_CLASS_CFG, UBX_ID_CFG_MSG, 3, UBX_CLASS_NMEA, 0x03, 0, // GSV off
+    UBX_CLASS_CFG, UBX_ID_CFG_MSG, 3, UBX_CLASS_NMEA, 0x05, 0, // VTG off
+    UBX_CLASS_CFG, UBX_ID_CFG_MSG, 3, UBX_CLASS_NMEA, 0x02, GPS_CONFIG_GSA_EVERY,
+#endif
+#if GPS_CONFIG_INTERVAL_MS
+    UBX_CLASS_CFG, UBX_ID_CFG_RATE, 6,
+        GPS_CONFIG_INTERVAL_MS & 0xff, GPS_CONFIG_INTERVAL_MS >> 8, 1, 0, 1, 0,
+#endif
+#if GPS_CONFIG_BAUD
+    // UART1, 8N1, UBX and NMEA in, NMEA out
+    UBX_CLASS_CFG, UBX_ID_CFG_PRT, 20,
+        1, 0, 0, 0, 0xd0, 0x08, 0, 0,
+        GPS_CONFIG_BAUD & 0xff, (GPS_CONFIG_BAUD >> 8) & 0xff, (GPS_CONFIG_BAUD >> 16) & 0xff, 0,
+        0x07, 0, 0x02, 0, 0, 0, 0, 0,
+#endif
+};
+
+#define GPS_CONFIG_COMMAND_COUNT ((GPS_CONFIG_SENTENCES ? 4 : 0) + (GPS_CONFIG_INTERVAL_MS ? 1 : 0) + (GPS_CONFIG_BAUD ? 1 : 0))
+
+inline const uint8_t* GpsUbxCommand(uint8_t index)
+{
+    const uint8_t* command = GpsUbxCommands;
+    while (index--)
+    {
+        command += 3 + pgm_read_byte(command + 2);
+    }
+    return command;
+}
+
+inline void SendGpsConfigCommand(Print& port, uint8_t index)
+{
+    const uint8_t* command = GpsUbxCommand(index);
+    uint8_t length = pgm_read_byte(command + 2);
+
+    // Fletcher checksum over class, id, 16 bit length and payload
+    uint8_t checkA = 0;
+    uint8_t checkB = 0;
+    port.write(UBX_SYNC_1);
+    port.write(UBX_SYNC_2);
+    for (uint8_t offset = 0; offset < 4 + length; offset++)
+    {
+        uint8_t value = (offset < 3) ? pgm_read_byte(command + offset) :
+            (offset == 3) ? 0 : pgm_read_byte(command + offset - 1);
+        checkA += value;
+        checkB += checkA;
+        port.write(value);
+    }
+    port.write(checkA);
+    port.write(checkB);
+}
+
+// class and id ACK-ACK and ACK-NAK repeat
+inline uint16_t GpsConfigAckKey(uint8_t index)
+{
+    const uint8_t* command = GpsUbxCommand(index);
+    return (pgm_read_byte(command) << 8) | pgm_read_byte(command + 1);
+}
+
+#endif
+
+#if GPS_RECEIVER != GPS_RECEIVER_NONE
+
+// the baud command is always last, the receiver switches without answering
+inline bool IsGpsConfigBaudCommand(uint8_t index)
+{
+    return GPS_CONFIG_BAUD && index == GPS_CONFIG_COMMAND_COUNT - 1;
+}
+
+#endif
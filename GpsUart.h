@@ -0,0 +1,159 @@
+// GPS receiver on the hardware UART, received bytes queued by the RX interrupt
+//
+// SoftwareSerial keeps interrupts off for the whole of every byte it receives
+// or sends and only buffers 64 bytes, which a slow SD card write overruns at
+// 9600 baud already. The UART receives in hardware and the interrupt only
+// moves each byte into a SerialRing, sized to hold everything the receiver
+// can send while the sketch is stuck for GPS_RX_STALL_MS.
+//
+// On the Pro Mini this is USART0 on pins 0 and 1, the same as Serial, so the
+// debug output has to stay off.
+
+#include "SerialRing.h"
+
+#if defined(__AVR__) && (defined(SERIAL_DEBUG) || defined(SIMPLE_DEBUG))
+#error "GPS_PORT_UART shares USART0 with Serial, turn off SERIAL_DEBUG and SIMPLE_DEBUG"
+#endif
+
+// longest the sketch may leave the port unread, a worst case SD card write
+#ifndef GPS_RX_STALL_MS
+#define GPS_RX_STALL_MS 250
+#endif
+
+// smallest power of two holding bytes
+constexpr uint16_t GpsRxRingSize(uint32_t bytes, uint16_t size = 16)
+{
+    return (size >= bytes || size == 32768) ? size : GpsRxRingSize(bytes, size * 2);
+}
+
+// a byte is 10 bits on the line, 256 bytes at 9600 baud, 1024 at 38400
+#ifndef GPS_RX_RING_SIZE
+#define GPS_RX_RING_SIZE GpsRxRingSize(static_cast<uint32_t>(GPS_LINE_BAUD) / 10 * GPS_RX_STALL_MS / 1000)
+#endif
+
+typedef SerialRing<GPS_RX_RING_SIZE> GpsRxRing;
+
+// the one ring the interrupt fills, zeroed at startup
+inline GpsRxRing& GpsUartRing()
+{
+    static GpsRxRing ring;
+    return ring;
+}
+
+#if defined(__AVR__)
+
+ISR(USART_RX_vect)
+{
+    // reading UDR0 clears the interrupt, keep it even when the ring is full
+    GpsUartRing().Push(UDR0);
+}
+
+#else
+// host build, the stand-in moves bytes off the simulated line as they arrive
+#include <HostUart.h>
+#endif
+
+class GpsUart : public Stream
+{
+public:
+    // USART0 has fixed pins, the arguments keep SoftwareSerial's signature
+    GpsUart(uint8_t receivePin, uint8_t transmitPin) :
+        listening(false),
+        overflowedAtCheck(0)
+    {
+        (void)receivePin;
+        (void)transmitPin;
+    }
+
+    void begin(long speed)
+    {
+        #if defined(__AVR__)
+            // double speed mode, closer to 38400 and above from 8 and 16 MHz
+            UCSR0B = 0;
+            UCSR0A = _BV(U2X0);
+            UBRR0 = static_cast<uint16_t>((F_CPU / 4 / speed - 1) / 2);
+            UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+            UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+        #else
+            HostUart::Begin(static_cast<uint32_t>(speed));
+        #endif
+        listen();
+    }
+
+    bool listen()
+    {
+        bool wasListening = listening;
+        GpsUartRing().Clear();
+        listening = true;
+        #if defined(__AVR__)
+            UCSR0B |= _BV(RXCIE0);
+        #endif
+        return !wasListening;
+    }
+
+    bool stopListening()
+    {
+        #if defined(__AVR__)
+            UCSR0B &= ~_BV(RXCIE0);
+        #else
+            HostUart::Poll(GpsUartRing(), listening);
+        #endif
+        bool wasListening = listening;
+        listening = false;
+        return wasListening;
+    }
+
+    // true when bytes were dropped since the last call, like SoftwareSerial
+    bool overflow()
+    {
+        uint16_t overflowed = GpsUartRing().Overflowed();
+        bool result = overflowed != overflowedAtCheck;
+        overflowedAtCheck = overflowed;
+        return result;
+    }
+
+    virtual int available()
+    {
+        Poll();
+        return GpsUartRing().Available();
+    }
+
+    virtual int read()
+    {
+        Poll();
+        return GpsUartRing().Pop();
+    }
+
+    virtual int peek()
+    {
+        Poll();
+        return GpsUartRing().Peek();
+    }
+
+    using Print::write;
+
+    // polled, the receive interrupt keeps running while it waits
+    virtual size_t write(uint8_t value)
+    {
+        #if defined(__AVR__)
+            while (!(UCSR0A & _BV(UDRE0)))
+            {
+            }
+            UDR0 = value;
+        #else
+            HostUart::Write(GpsUartRing(), listening, value);
+        #endif
+        return 1;
+    }
+
+private:
+    bool listening;
+    uint16_t overflowedAtCheck;
+
+    void Poll()
+    {
+        #if !defined(__AVR__)
+            HostUart::Poll(GpsUartRing(), listening);
+        #endif
+    }
+};
@@ -2,13 +2,53 @@
 //#define SIMPLE_DEBUG
 //#define WEMOS_D1_MINI
 #define ARDUINO_PRO_MINI
+//#define LOG_FORMAT LOG_FORMAT_BIN
+//#define LOG_FORMAT LOG_FORMAT_TRK
+//#define GPS_PORT GPS_PORT_UART
+//#define LOG_JOURNAL 1
+//#define LOG_LAYOUT LOG_LAYOUT_FLAT
+//#define LOG_STATS 1
+//#define TASK_TICKLESS 1
+//#define LOG_THIN 1
+//#define GPS_RAW_CAPTURE 1
+//#define GPS_SENTENCES (GPS_SENTENCE(NMEA_SENTENCE_RMC) | GPS_SENTENCE(NMEA_SENTENCE_GGA))
+//#define LOG_TRIPS 1
 
 #include <SdFat.h>
 #include <Task.h>
 
-#include "TaskStatusLed.h"
 #include "TaskGps.h"
+#include "TaskStatusLed.h"
+#include "LogJournal.h"
+#include "TaskLogWriter.h"
 #include "TaskButton.h"
+#include "TaskSdCard.h"
+#include "LogFile.h"
+#include "LogFormat.h"
+#include "TrackFormat.h"
+#include "TripDetector.h"
+
+#ifndef LOG_FORMAT
+  #define LOG_FORMAT LOG_FORMAT_CSV
+#endif
+
+#ifndef LOG_LAYOUT
+  #define LOG_LAYOUT LOG_LAYOUT_MONTHS
+#endif
+
+#if GPS_RAW_CAPTURE
+  #define LOG_FILE_EXTENSION "RAW"
+  #define LOG_RECORD_SIZE 1
+#elif LOG_FORMAT == LOG_FORMAT_BIN
+  #define LOG_FILE_EXTENSION "BIN"
+  #define LOG_RECORD_SIZE BIN_RECORD_SIZE
+#elif LOG_FORMAT == LOG_FORMAT_TRK
+  #define LOG_FILE_EXTENSION "TRK"
+  #define LOG_RECORD_SIZE 1
+#else
+  #define LOG_FILE_EXTENSION "CSV"
+  #define LOG_RECORD_SIZE 1
+#endif
 
 
 #ifdef WEMOS_D1_MINI
@@ -25,19 +65,48 @@
 
 #endif
 
+// buttons by their index in buttonPins
+#define BUTTON_SAFE_EJECT 0
+#define BUTTON_COUNT 1
+
+const uint8_t buttonPins[BUTTON_COUNT] = { SAFE_EJECT_BUTTON_PIN };
+
 // foreward declare functions passed to task constructors
-void OnGpsReadingComplete(const GpsReading *readings, uint8_t count);
+void OnWriteReading(const GpsReading& reading);
+void OnBatchWritten();
 void OnGpsFixChanged(GPSFIXTYPE gpsFixType);
+void OnRawBytes(const uint8_t* bytes, uint8_t length);
+void OnCardMounted();
+void HandleButtonChange(uint8_t button, ButtonState state);
 void HandleSafeEjectButtonChange(ButtonState state);
 
 TaskManager taskManager;
+SdFat sd;
 
 TaskStatusLed taskStatusLed;
-TaskGps taskGps(OnGpsReadingComplete, OnGpsFixChanged);
-TaskButton AButtonTask(HandleSafeEjectButtonChange, SAFE_EJECT_BUTTON_PIN);
-
-SdFat sd;
-SdFile logFile;
+ReadingQueue readingQueue;
+TaskGps taskGps(readingQueue, OnGpsFixChanged);
+TaskLogWriter taskLogWriter(readingQueue, OnWriteReading, OnBatchWritten);
+TaskButtons<BUTTON_COUNT> taskButtons(HandleButtonChange, buttonPins);
+TaskSdCard taskSdCard(sd, SD_CHIP_SELECT, OnCardMounted);
+
+LogFile logFile(sd, LOG_RECORD_SIZE);
+#if LOG_FORMAT == LOG_FORMAT_TRK
+TrackEncoder trackEncoder;
+#endif
+#if LOG_STATS
+uint32_t lastStatsMs = 0;
+#endif
+#if GPS_RAW_CAPTURE
+uint16_t rawFileNumber = 0;
+bool rawFix = false;  // the fix type last reported is a fix
+#endif
+#if LOG_TRIPS
+TripDetector tripDetector;
+#endif
+// millis() when the first reading with a position went to the log, for a raw
+// capture the bytes that brought the first fix, 0 until then
+uint32_t firstFixLoggedMs = 0;
 
 void setup()
 {
@@ -68,20 +137,36 @@ void setup()
     Serial.println(F("Starting SD..."));
   #endif
 
-  while (!sd.begin(SD_CHIP_SELECT)) {};
-
-  #ifdef SIMPLE_DEBUG
-    Serial.println(F("SD started."));
-  #endif
-
+  // the card comes up alongside the receiver, TaskLogWriter once it has
   //taskStatusLed.StopShowing();
-  taskManager.StartTask(&AButtonTask);
+  taskManager.StartTask(&taskSdCard);
+  taskManager.StartTask(&taskButtons);
+  #if GPS_RAW_CAPTURE
+    taskGps.CaptureRaw(OnRawBytes);
+  #endif
   taskManager.StartTask(&taskGps);
 }
 
 void loop()
 {
   taskManager.Loop(WDTO_2S);
+
+  #if TASK_TICKLESS
+    // an interrupt ended the sleep, give whoever it was for their short interval back
+    taskGps.Wake();
+    taskButtons.Wake();
+    taskLogWriter.Wake();
+  #endif
+}
+
+void HandleButtonChange(uint8_t button, ButtonState state)
+{
+  switch (button)
+  {
+    case BUTTON_SAFE_EJECT:
+      HandleSafeEjectButtonChange(state);
+      break;
+  }
 }
 
 void HandleSafeEjectButtonChange(ButtonState state)
@@ -95,8 +180,9 @@ void HandleSafeEjectButtonChange(ButtonState state)
 
     if (taskGps.getTaskState() == TaskState_Stopped)
     {
-      // must reinit if a card was inserted
-      while (!sd.begin(SD_CHIP_SELECT)) {};
+      // must reinit if a card was inserted, nothing is left to write meanwhile
+      taskManager.StopTask(&taskLogWriter);
+      taskManager.StartTask(&taskSdCard);
 
       taskStatusLed.ShowStartRecording();
       taskManager.StartTask(&taskGps);
@@ -104,11 +190,43 @@ void HandleSafeEjectButtonChange(ButtonState state)
     else if (taskGps.getTaskState() == TaskState_Running)
     {
       taskManager.StopTask(&taskGps);
-      taskStatusLed.ShowSafeToEject();
+      // with readings still to write the last batch closes the file, without
+      // a card they wait for one and nothing is open
+      if (readingQueue.Empty() || !taskSdCard.Mounted())
+      {
+        #if LOG_STATS
+          WriteStatsFile();
+        #endif
+        #if LOG_TRIPS
+          if (tripDetector.Flush())
+          {
+            WriteTripFile();
+          }
+        #endif
+        logFile.Close();
+        taskStatusLed.ShowSafeToEject();
+      }
     }
   }
 }
 
+void OnCardMounted()
+{
+  taskManager.StopTask(&taskSdCard);
+
+  #if LOG_JOURNAL
+    // trim what a power cut left before anything is appended
+    logFile.Recover();
+  #endif
+  #if GPS_RAW_CAPTURE
+    // created before the bytes are written, the ring would not hold them meanwhile
+    OpenRawFile();
+  #endif
+
+  // whatever was queued meanwhile goes out in bulk
+  taskManager.StartTask(&taskLogWriter);
+}
+
 void OnGpsFixChanged(GPSFIXTYPE gpsFixType)
 {
   #ifdef SIMPLE_DEBUG
@@ -120,6 +238,11 @@ void OnGpsFixChanged(GPSFIXTYPE gpsFixType)
     Serial.print(F("GPS fix changing to "));
     Serial.println(gpsFixType);
   #endif
+
+  #if GPS_RAW_CAPTURE
+    // no readings are written, OnRawBytes() notes when the fix reaches the card
+    rawFix = gpsFixType != GPSFIXTYPE_NOFIX;
+  #endif
   
   switch (gpsFixType)
   {
@@ -135,99 +258,248 @@ void OnGpsFixChanged(GPSFIXTYPE gpsFixType)
   
 }
 
-void OnGpsReadingComplete(const GpsReading* readings, uint8_t readingCount)
+void OnWriteReading(const GpsReading& reading)
 {
-  #ifdef SIMPLE_DEBUG
-    Serial.print(F(">> "));
-  #endif
-
-  char lastHourWritten[] = {'x', 'x'};
-
-  for (int i = 0; i < readingCount; i++)
+  // skip empty times completely
+  if (!(reading.flags & GPS_READING_TIME))
   {
-    // skip empty times completely
-    if (readings[i].time[0] != '\0' && readings[i].time[1] != '\0')
-    {
-        if (readings[i].time[0] != lastHourWritten[0] || 
-                readings[i].time[1] != lastHourWritten[1])
-        {
-          logFile.close();
-          if (!OpenFile(readings[i].date, readings[i].time))
-          {
-              // blink red three times to indicate SD problem
+    return;
+  }
 
-              taskStatusLed.ShowFileOpenError();
+  // keeps the current file when the hour has not changed
+  if (!OpenFile(reading.dateTime))
+  {
+    // blink red three times to indicate SD problem
+    taskStatusLed.ShowFileOpenError();
 
     #ifdef SIMPLE_DEBUG
-            Serial.print(F(" open failed "));
+      Serial.print(F(" open failed "));
     #endif
-            continue; // skip tp next next reading
-          }
+    return;
+  }
 
-          lastHourWritten[0] = readings[i].time[0];
-          lastHourWritten[1] = readings[i].time[1];
-        }
+  #if LOG_TRIPS
+    uint32_t recordStart = logFile.Position();
+  #endif
 
-        #ifdef SERIAL_DEBUG
-            Serial.print(F("Writing reading "));
-            Serial.println(i);
-        #endif
+  #if LOG_FORMAT == LOG_FORMAT_BIN
+    uint8_t record[BIN_RECORD_SIZE];
+    PackBinReading(reading, record);
+    logFile.write(record, BIN_RECORD_SIZE);
+  #elif LOG_FORMAT == LOG_FORMAT_TRK
+    uint8_t record[TRACK_RECORD_MAX_SIZE];
+    uint8_t length = trackEncoder.Encode(reading, record);
+    logFile.write(record, length);
+  #else
+    char line[CSV_LINE_SIZE];
+    uint8_t length = FormatCsvReading(reading, line);
+    logFile.write(line, length);
+  #endif
 
-        logFile.print(readings[i].date);
-        logFile.print(',');
-        logFile.print(readings[i].time);
-        logFile.print(',');
-        logFile.print(readings[i].latitude);
-        logFile.print(',');
-        logFile.print(readings[i].latitudeDirection);
-        logFile.print(',');
-        logFile.print(readings[i].longitude);
-        logFile.print(',');
-        logFile.print(readings[i].longitudeDirection);
-        logFile.print(',');
-        logFile.print(readings[i].altitude);
-        logFile.print(',');
-        logFile.println(readings[i].satelliteCount);
-      }
+  if (!firstFixLoggedMs && (reading.flags & GPS_READING_POSITION))
+  {
+    firstFixLoggedMs = millis();
   }
 
-  logFile.close();
+  #if LOG_TRIPS
+    if (tripDetector.Add(reading, recordStart, logFile.Position()))
+    {
+      WriteTripFile();
+    }
+  #endif
+}
 
-  if (taskGps.getTaskState() == TaskState_Stopped)
+#if GPS_RAW_CAPTURE
+void OnRawBytes(const uint8_t* bytes, uint8_t length)
+{
+  // nowhere to keep them until the card is up
+  if (!taskSdCard.Mounted())
   {
-    taskStatusLed.ShowSafeToEject();
+    return;
   }
-  else
+  if (!logFile.IsOpen() && !OpenRawFile())
+  {
+    taskStatusLed.ShowFileOpenError();
+    return;
+  }
+
+  logFile.write(bytes, length);
+
+  if (!firstFixLoggedMs && rawFix)
+  {
+    firstFixLoggedMs = millis();
+  }
+
+  // full, straight on with the next file
+  if (logFile.Position() >= LOG_PREALLOCATE_BYTES)
   {
+    logFile.Close();
     taskStatusLed.ShowFileWritten();
+    OpenRawFile();
   }
+}
 
+// the first NMEAnnnn.RAW not on the card, preallocated
+bool OpenRawFile()
+{
+  char fileName[] = "NMEA0000." LOG_FILE_EXTENSION;
+  for (; rawFileNumber < 10000; rawFileNumber++)
+  {
+    uint16_t number = rawFileNumber;
+    for (uint8_t digit = 7; digit >= 4; digit--)
+    {
+      fileName[digit] = '0' + number % 10;
+      number /= 10;
+    }
+    if (!sd.exists(fileName))
+    {
+      return logFile.Open(fileName);
+    }
+  }
+  return false;
+}
+#endif
+
+void OnBatchWritten()
+{
   #ifdef SIMPLE_DEBUG
     Serial.println(F("<<"));
   #endif
+
+  #ifdef SERIAL_DEBUG
+    const GpsSentenceCounters& counters = taskGps.SentenceCounters();
+    Serial.print(F("Sentences accepted "));
+    Serial.print(counters.accepted);
+    Serial.print(F(" rejected "));
+    Serial.print(counters.rejected);
+    Serial.print(F(" truncated "));
+    Serial.print(counters.truncated);
+    Serial.print(F(" overflows "));
+    Serial.print(counters.overflows);
+    Serial.print(F(" readings dropped "));
+    Serial.println(readingQueue.Counters().dropped);
+  #endif
+
+  if (taskGps.getTaskState() == TaskState_Stopped && readingQueue.Empty())
+  {
+    // last batch before eject, leave the card consistent
+    #if LOG_STATS
+      WriteStatsFile();
+    #endif
+    #if LOG_TRIPS
+      if (tripDetector.Flush())
+      {
+        WriteTripFile();
+      }
+    #endif
+    logFile.Close();
+    taskStatusLed.ShowSafeToEject();
+  }
+  else
+  {
+    logFile.BatchWritten();
+    taskStatusLed.ShowFileWritten();
+
+    #if LOG_STATS
+      if (millis() - lastStatsMs >= LOG_STATS_INTERVAL_MS)
+      {
+        WriteStatsFile();
+      }
+    #endif
+  }
 }
 
-bool OpenFile(const char* date, const char* time)
+#if LOG_STATS
+void WriteStatsFile()
 {
-  char fileName[] = "000000-0.CSV";
+  lastStatsMs = millis();
 
-  EncodeFileName(fileName, date, time);
+  // next to the month directories, opened only for this
+  SdFile statsFile;
+  if (!statsFile.open("/STATS.CSV", O_WRITE | O_CREAT | O_AT_END))
+  {
+    return;
+  }
+  if (statsFile.fileSize() == 0)
+  {
+    statsFile.println(F("ms,kind,name,values"));
+  }
+  WriteStats(statsFile, lastStatsMs, taskGps.SentenceCounters().overflows, readingQueue.Counters().dropped,
+    firstFixLoggedMs);
+  statsFile.close();
+}
+#endif
 
-  #ifdef SIMPLE_DEBUG
-    Serial.print(fileName);
-    Serial.print(' ');
-  #endif
+#if LOG_TRIPS
+void WriteTripFile()
+{
+  // next to the month directories, opened only for this
+  SdFile tripsFile;
+  if (!tripsFile.open("/TRIPS.IDX", O_RDWR | O_CREAT))
+  {
+    return;
+  }
 
-  return logFile.open(fileName, O_WRITE | O_CREAT | O_AT_END);
+  // a record cut short by a power cut is written over
+  uint32_t end = tripsFile.fileSize();
+  end = (end < TRIP_RECORD_SIZE) ? 0 : end - end % TRIP_RECORD_SIZE;
+  tripsFile.seekSet(end);
+
+  uint8_t record[TRIP_RECORD_SIZE];
+  if (end == 0)
+  {
+    PackTripHeader(record);
+    tripsFile.write(record, TRIP_RECORD_SIZE);
+  }
+  PackTripRecord(tripDetector.Summary(), record);
+  tripsFile.write(record, TRIP_RECORD_SIZE);
+  tripsFile.close();
 }
+#endif
 
-void EncodeFileName(char* fileName, const char* date, const char* time)
+bool OpenFile(uint32_t dateTime)
 {
-  fileName[0] = date[4];
-  fileName[1] = date[5];
-  fileName[2] = date[2];
-  fileName[3] = date[3];
-  fileName[4] = date[0];
-  fileName[5] = date[1];
-  fileName[7] = ((time[0] - '0') * 10 + time[1] - '0') + 'A';
+  char fileName[] = "000000-0." LOG_FILE_EXTENSION;
+
+  EncodeLogFileName(fileName, dateTime);
+
+  if (logFile.IsCurrent(fileName))
+  {
+    return true;
+  }
+
+  #if LOG_LAYOUT == LOG_LAYOUT_MONTHS
+    // stays open while the month lasts
+    char directoryName[] = "/2000/00";
+    EncodeLogDirectory(directoryName, dateTime);
+    if (!logFile.OpenDirectory(directoryName))
+    {
+      return false;
+    }
+  #endif
+
+  if (!logFile.Open(fileName))
+  {
+    return false;
+  }
+
+  #if LOG_FORMAT == LOG_FORMAT_BIN
+    if (logFile.Position() == 0)
+    {
+      uint8_t header[BIN_RECORD_SIZE];
+      PackBinHeader(header);
+      logFile.write(header, BIN_RECORD_SIZE);
+    }
+  #elif LOG_FORMAT == LOG_FORMAT_TRK
+    if (logFile.Position() == 0)
+    {
+      uint8_t header[TRACK_HEADER_SIZE];
+      PackTrackHeader(header);
+      logFile.write(header, TRACK_HEADER_SIZE);
+    }
+    // deltas never span files or a restart
+    trackEncoder.Reset();
+  #endif
+
+  return true;
 }
@@ -0,0 +1,653 @@
+// hourly log file that stays open across reading batches
+//
+// A new file is created as one contiguous, erased run of clusters so appending
+// never has to search the FAT or link clusters, and the directory entry is only
+// rewritten when the sync policy asks for it. Erased blocks read back as 0x00 or
+// 0xFF and no written block consists of only those, so the real end of a file
+// that was not closed cleanly can still be found when it is reopened. Close()
+// truncates the file to what was actually written.
+//
+// Writes are collected in a sector buffer and handed to SdFat one aligned
+// 512 byte block at a time, which SdFat writes straight to the card without
+// copying through its cache. A partial sector stays in the buffer across
+// batches; a sync writes it out and the next full write of that sector
+// replaces it in place.
+//
+// With LOG_JOURNAL the file is made of journal sectors instead, see
+// LogJournal.h. A sync then only writes the sealed sector as one block, into
+// the block of its pair that does not hold the last copy, so a power cut
+// during the write takes no synced record with it. The directory entry and
+// FAT are left alone until Close(), and the end of a file is wherever its
+// journal ends. Each write() is one record. Recover() trims what a power cut
+// left behind, once at boot.
+//
+// Files are looked up and created in a directory that stays open across
+// files, the root unless OpenDirectory() picked another, so opening the next
+// hour only searches that one directory and never walks the path again.
+// EncodeLogDirectory() names the /YYYY/MM month directory of a reading, so
+// no directory grows past a month of hourly files however long the logger
+// runs, and the FAT16 root directory limit is never reached.
+//
+// TaskStats.h comes with TaskGps.h, include that first.
+
+#ifndef LOG_PREALLOCATE_BYTES
+    #if GPS_RAW_CAPTURE
+        // ten minutes of raw NMEA at 115200 baud, a RAW file is full then
+        #define LOG_PREALLOCATE_BYTES 6912000UL
+    #elif LOG_JOURNAL
+        // the same hour, every sector synced before it fills takes a pair of blocks
+        #define LOG_PREALLOCATE_BYTES 393216UL
+    #else
+        // an hour of 1 Hz CSV readings with some headroom
+        #define LOG_PREALLOCATE_BYTES 196608UL
+    #endif
+#endif
+
+// sync the file after this many batches, 0 only syncs on close
+#ifndef LOG_SYNC_BATCHES
+    #if LOG_JOURNAL
+        // a journal sync is one block write, TaskLogWriter times the batches
+        #define LOG_SYNC_BATCHES 1
+    #else
+        #define LOG_SYNC_BATCHES 6
+    #endif
+#endif
+
+// also sync when this long has passed since the last sync, 0 to disable
+#ifndef LOG_SYNC_INTERVAL_MS
+    #if LOG_JOURNAL
+        #define LOG_SYNC_INTERVAL_MS (LOG_JOURNAL_WINDOW_MS / 2)
+    #else
+        #define LOG_SYNC_INTERVAL_MS 60000UL
+    #endif
+#endif
+
+#define LOG_FILE_NAME_SIZE 13
+#define LOG_DIRECTORY_SIZE 9        // "/YYYY/MM"
+#define LOG_SECTOR_SIZE 512
+
+#define LOG_LAYOUT_FLAT 0       // every file in the root directory
+#define LOG_LAYOUT_MONTHS 1     // /YYYY/MM/YYMMDD-H.EXT
+
+// fills the date and hour of a reading into "000000-0.EXT"
+inline void EncodeLogFileName(char* fileName, uint32_t dateTime)
+{
+    uint8_t year = GpsDateTimeYear(dateTime);
+    uint8_t month = GpsDateTimeMonth(dateTime);
+    uint8_t day = GpsDateTimeDay(dateTime);
+
+    fileName[0] = '0' + year / 10;
+    fileName[1] = '0' + year % 10;
+    fileName[2] = '0' + month / 10;
+    fileName[3] = '0' + month % 10;
+    fileName[4] = '0' + day / 10;
+    fileName[5] = '0' + day % 10;
+    fileName[7] = GpsDateTimeHour(dateTime) + 'A';
+}
+
+// fills the month of a reading into "/2000/00"
+inline void EncodeLogDirectory(char* directoryName, uint32_t dateTime)
+{
+    uint8_t year = GpsDateTimeYear(dateTime);
+    uint8_t month = GpsDateTimeMonth(dateTime);
+
+    directoryName[3] = '0' + year / 10;
+    directoryName[4] = '0' + year % 10;
+    directoryName[6] = '0' + month / 10;
+    directoryName[7] = '0' + month % 10;
+}
+
+class LogFile : public Print
+{
+public:
+    // recordSize keeps a recovered end on a record boundary, 1 for text logs
+    LogFile(SdFat& sdFat, uint8_t logRecordSize = 1) :
+        sd(sdFat),
+        recordSize(logRecordSize),
+        preallocated(false),
+        batchesSinceSync(0),
+        lastSyncMs(0),
+        sectorStart(0),
+        sectorUsed(0)
+    {
+        fileName[0] = '\0';
+        directoryName[0] = '\0';
+    }
+
+    // where the files opened after this are, created with its parents if missing
+    bool OpenDirectory(const char* name)
+    {
+        if (directory.isOpen() && strcmp(name, directoryName) == 0)
+        {
+            return true;
+        }
+
+        // the open file keeps its own position in its directory
+        directory.close();
+        directoryName[0] = '\0';
+        if (!directory.open(name, O_READ) && (!sd.mkdir(name, true) || !directory.open(name, O_READ)))
+        {
+            return false;
+        }
+
+        strncpy(directoryName, name, LOG_DIRECTORY_SIZE - 1);
+        directoryName[LOG_DIRECTORY_SIZE - 1] = '\0';
+        return true;
+    }
+
+    // true when the named file is already the open one
+    bool IsCurrent(const char* name)
+    {
+        return file.isOpen() && strcmp(name, fileName) == 0;
+    }
+
+    // make the named file the current one, keeps the current file if it is the same
+    bool Open(const char* name)
+    {
+        if (IsCurrent(name))
+        {
+            return true;
+        }
+
+        CloseFile();
+        STATS_HISTOGRAM_SCOPE(sdOpen);
+
+        if (!directory.isOpen() && !OpenDirectory("/"))
+        {
+            return false;
+        }
+
+        // a new hour is the usual case, creating it is one search of the
+        // directory and fails on a file that is already there
+        preallocated = false;
+        if (file.createContiguous(&directory, name, LOG_PREALLOCATE_BYTES))
+        {
+            uint32_t firstBlock;
+            uint32_t lastBlock;
+            if (file.contiguousRange(&firstBlock, &lastBlock))
+            {
+                sd.card()->erase(firstBlock, lastBlock);
+            }
+            preallocated = true;
+        }
+        else if (file.open(&directory, name, O_RDWR))
+        {
+            uint32_t firstBlock;
+            uint32_t lastBlock;
+            preallocated = file.contiguousRange(&firstBlock, &lastBlock);
+            #if LOG_JOURNAL
+                // continue in the last valid sector, whatever follows it is lost
+                file.seekSet(FindJournalEnd());
+            #else
+                if (preallocated)
+                {
+                    // not closed cleanly, continue after the last written byte
+                    file.seekSet(FindWrittenEnd());
+                }
+                else
+                {
+                    file.seekEnd();
+                }
+            #endif
+        }
+        else if (!file.open(&directory, name, O_RDWR | O_CREAT | O_AT_END))
+        {
+            // card too full or fragmented for a contiguous run
+            return false;
+        }
+
+        LoadSector(file.curPosition());
+
+        #ifdef SIMPLE_DEBUG
+            Serial.print(name);
+            Serial.print(' ');
+        #endif
+
+        #ifdef SERIAL_DEBUG
+            Serial.print(F("Log file "));
+            Serial.print(name);
+            Serial.println(preallocated ? F(" preallocated") : F(" opened"));
+        #endif
+
+        strncpy(fileName, name, LOG_FILE_NAME_SIZE - 1);
+        fileName[LOG_FILE_NAME_SIZE - 1] = '\0';
+        batchesSinceSync = 0;
+        lastSyncMs = millis();
+        return true;
+    }
+
+    // called after each batch, syncs when the policy says so
+    void BatchWritten()
+    {
+        if (!file.isOpen())
+        {
+            return;
+        }
+
+        batchesSinceSync++;
+        if ((LOG_SYNC_BATCHES && batchesSinceSync >= LOG_SYNC_BATCHES) ||
+                (LOG_SYNC_INTERVAL_MS && (millis() - lastSyncMs) >= LOG_SYNC_INTERVAL_MS))
+        {
+            Sync();
+        }
+    }
+
+    void Sync()
+    {
+        if (file.isOpen())
+        {
+            WritePartialSector();
+            #if !LOG_JOURNAL
+                file.sync();
+            #endif
+            batchesSinceSync = 0;
+            lastSyncMs = millis();
+        }
+    }
+
+    // trims the unused preallocated space and closes the file and its directory
+    void Close()
+    {
+        CloseFile();
+        directory.close();
+        directoryName[0] = '\0';
+    }
+
+    bool IsOpen()
+    {
+        return file.isOpen();
+    }
+
+    // bytes written to the current file so far, of payload in a journal
+    uint32_t Position()
+    {
+        #if LOG_JOURNAL
+            return payloadBefore + sectorUsed - LOG_JOURNAL_HEADER_SIZE;
+        #else
+            return sectorStart + sectorUsed;
+        #endif
+    }
+
+#if LOG_JOURNAL
+    // trims the files a power cut left at their preallocated size back to
+    // their last valid sector, before anything is logged, returns how many
+    uint8_t Recover()
+    {
+        SdFile root;
+        if (file.isOpen() || !root.open("/", O_READ))
+        {
+            return 0;
+        }
+        uint8_t trimmed = RecoverDirectory(root, 2);
+        root.close();
+        return trimmed;
+    }
+#endif
+
+    virtual size_t write(uint8_t value)
+    {
+        return write(&value, 1);
+    }
+
+#if LOG_JOURNAL
+    // one record, a record that does not fit starts the next sector
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        if (size > LOG_JOURNAL_PAYLOAD_SIZE)
+        {
+            return 0;
+        }
+        if (sectorUsed + size > LOG_SECTOR_SIZE)
+        {
+            if (sectorRecords != writtenRecords && !WriteSector())
+            {
+                return 0;
+            }
+            // the next sector starts after the blocks of this one's pair
+            sectorStart += pairBlocks * LOG_SECTOR_SIZE;
+            payloadBefore += sectorUsed - LOG_JOURNAL_HEADER_SIZE;
+            sequence += sectorRecords;
+            sectorRecords = 0;
+            writtenRecords = 0;
+            pairSlot = 0;
+            pairBlocks = 0;
+            sectorUsed = LOG_JOURNAL_HEADER_SIZE;
+        }
+
+        memcpy(sector + sectorUsed, buffer, size);
+        sectorUsed += size;
+        sectorRecords++;
+        return size;
+    }
+#else
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (written < size)
+        {
+            uint16_t chunk = LOG_SECTOR_SIZE - sectorUsed;
+            if (chunk > size - written)
+            {
+                chunk = size - written;
+            }
+            memcpy(sector + sectorUsed, buffer + written, chunk);
+            sectorUsed += chunk;
+            written += chunk;
+
+            if (sectorUsed == LOG_SECTOR_SIZE)
+            {
+                // the file position is always at sectorStart
+                if (WriteToCard(sector, LOG_SECTOR_SIZE) != LOG_SECTOR_SIZE)
+                {
+                    file.seekSet(sectorStart);
+                    sectorUsed -= chunk;
+                    return written - chunk;
+                }
+                sectorStart += LOG_SECTOR_SIZE;
+                sectorUsed = 0;
+            }
+        }
+        return written;
+    }
+#endif
+
+    using Print::write;
+
+private:
+    SdFat& sd;
+    const uint8_t recordSize;
+    SdFile directory;
+    char directoryName[LOG_DIRECTORY_SIZE];
+    SdFile file;
+    char fileName[LOG_FILE_NAME_SIZE];
+    bool preallocated;
+    uint8_t batchesSinceSync;
+    uint32_t lastSyncMs;
+
+    // the sector being filled and where it goes in the file
+    uint8_t sector[LOG_SECTOR_SIZE];
+    uint32_t sectorStart;
+    uint16_t sectorUsed;
+#if LOG_JOURNAL
+    uint32_t sequence;          // of the first record in the sector
+    uint16_t sectorRecords;
+    uint16_t writtenRecords;    // in its last copy on the card
+    uint8_t pairSlot;           // block of the pair the next copy goes to
+    uint8_t pairBlocks;         // of the pair written so far
+    uint32_t payloadBefore;     // bytes in the sectors before it
+#endif
+
+    // every sector write, timed with LOG_STATS
+    size_t WriteToCard(const uint8_t* data, uint16_t size)
+    {
+        STATS_HISTOGRAM_SCOPE(sdWrite);
+        return file.write(data, size);
+    }
+
+    void CloseFile()
+    {
+        if (!file.isOpen())
+        {
+            return;
+        }
+
+        WritePartialSector();
+        #if LOG_JOURNAL
+            // whole blocks, the last pair's as far as it was written,
+            // whether or not the file still knows it was preallocated
+            uint32_t end = sectorStart + pairBlocks * LOG_SECTOR_SIZE;
+            if (file.fileSize() > end)
+            {
+                file.truncate(end);
+            }
+        #else
+            if (preallocated)
+            {
+                file.truncate(sectorStart + sectorUsed);
+            }
+        #endif
+        file.close();
+        fileName[0] = '\0';
+    }
+
+#if LOG_JOURNAL
+    // pick up the newest copy of the last sector so it can be completed in a
+    // new pair after end, where the journal ends; follows the journal from
+    // the start, the payload before the sector is only known that way
+    void LoadSector(uint32_t end)
+    {
+        LogJournalCursor cursor;
+        memset(&cursor, 0, sizeof(cursor));
+        uint32_t blocks = end / LOG_SECTOR_SIZE;
+        uint32_t newest = 0;
+        for (uint32_t block = 0; block < blocks; block++)
+        {
+            if (!IsJournalBlock(block))
+            {
+                continue;   // torn, the other block of its pair has the sector
+            }
+            LogJournalStep step = StepLogJournal(cursor, sector);
+            if (step == LogJournalStep_End)
+            {
+                blocks = block;
+                break;
+            }
+            if (step != LogJournalStep_Older)
+            {
+                newest = block;
+            }
+        }
+
+        sequence = cursor.sequence;
+        sectorRecords = cursor.records;
+        writtenRecords = cursor.records;
+        payloadBefore = cursor.payloadBefore;
+        sectorUsed = LOG_JOURNAL_HEADER_SIZE + cursor.used;
+        sectorStart = blocks * LOG_SECTOR_SIZE;
+        pairSlot = 0;
+        pairBlocks = 0;
+        if (cursor.records)
+        {
+            file.seekSet(newest * LOG_SECTOR_SIZE);
+            file.read(sector, LOG_SECTOR_SIZE);
+        }
+    }
+
+    // seal the sector and put it on the card as one block, in the block of
+    // its pair that does not hold the last copy
+    bool WriteSector()
+    {
+        memset(sector + sectorUsed, 0, LOG_SECTOR_SIZE - sectorUsed);
+        SealLogJournalSector(sector, sectorUsed - LOG_JOURNAL_HEADER_SIZE, sequence, sectorRecords);
+        file.seekSet(sectorStart + pairSlot * LOG_SECTOR_SIZE);
+        if (WriteToCard(sector, LOG_SECTOR_SIZE) != LOG_SECTOR_SIZE)
+        {
+            return false;
+        }
+        writtenRecords = sectorRecords;
+        pairBlocks = (pairSlot + 1 > pairBlocks) ? pairSlot + 1 : pairBlocks;
+        pairSlot ^= 1;
+        return true;
+    }
+
+    // the records not on the card yet, the buffer keeps the sector to be completed
+    void WritePartialSector()
+    {
+        if (sectorRecords != writtenRecords)
+        {
+            WriteSector();
+        }
+    }
+
+    bool IsJournalBlock(uint32_t block)
+    {
+        uint8_t* buffer = sector;
+        file.seekSet(block * LOG_SECTOR_SIZE);
+        return file.read(buffer, LOG_SECTOR_SIZE) == LOG_SECTOR_SIZE && IsLogJournalSector(buffer);
+    }
+
+    // the files in dir, then the newest of its year or month directories,
+    // down depth levels, the only ones written since the last boot
+    uint8_t RecoverDirectory(SdFile& dir, uint8_t depth)
+    {
+        uint8_t trimmed = 0;
+        char name[LOG_FILE_NAME_SIZE];
+        char newest[LOG_FILE_NAME_SIZE] = "";
+        while (file.openNext(&dir, O_READ))
+        {
+            // only the size is read from the directory entry, nothing else has to be
+            bool named = file.getName(name, sizeof(name));
+            bool candidate = named && file.isFile() && file.fileSize() == LOG_PREALLOCATE_BYTES;
+            if (named && depth && file.isDir() && name[0] >= '0' && name[0] <= '9' && strcmp(name, newest) > 0)
+            {
+                strcpy(newest, name);
+            }
+            file.close();
+            if (!candidate || !file.open(&dir, name, O_RDWR))
+            {
+                continue;
+            }
+
+            // a first sector still erased or torn is a log cut before its
+            // first sync, other files of this size are left alone
+            uint32_t end = FindJournalEnd();
+            if (end < file.fileSize() && (end || WrittenInBlock(0) == 0 || IsJournalStart()))
+            {
+                file.truncate(end);
+                trimmed++;
+
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Recovered "));
+                    Serial.print(name);
+                    Serial.print(F(" at "));
+                    Serial.println(end);
+                #endif
+            }
+            file.close();
+        }
+
+        SdFile child;
+        if (newest[0] && child.open(&dir, newest, O_READ))
+        {
+            trimmed += RecoverDirectory(child, depth - 1);
+            child.close();
+        }
+        return trimmed;
+    }
+
+    bool IsJournalStart()
+    {
+        uint8_t magic[2];
+        file.seekSet(0);
+        return file.read(magic, 2) == 2 && LogJournalValue(magic, 2) == LOG_JOURNAL_MAGIC;
+    }
+
+    // offset after the last valid block, the journal is a prefix of the
+    // file with at most a torn block before the other of its pair, and the
+    // sector buffer is free while this runs
+    uint32_t FindJournalEnd()
+    {
+        uint32_t blocks = file.fileSize() / LOG_SECTOR_SIZE;
+        uint32_t low = 0;
+        uint32_t high = blocks;
+        while (low < high)
+        {
+            uint32_t middle = (low + high) / 2;
+            if (IsJournalBlock(middle) || (middle + 1 < blocks && IsJournalBlock(middle + 1)))
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return low * LOG_SECTOR_SIZE;
+    }
+#else
+    // pick up a partially written last sector so it can be completed in place
+    void LoadSector(uint32_t end)
+    {
+        sectorStart = end - (end % LOG_SECTOR_SIZE);
+        sectorUsed = end - sectorStart;
+        file.seekSet(sectorStart);
+        if (sectorUsed)
+        {
+            file.read(sector, sectorUsed);
+            file.seekSet(sectorStart);
+        }
+    }
+
+    // put the buffered tail on the card, the buffer keeps it for the full write
+    void WritePartialSector()
+    {
+        if (sectorUsed)
+        {
+            WriteToCard(sector, sectorUsed);
+            file.seekSet(sectorStart);
+        }
+    }
+#endif
+
+    static bool IsErased(int value)
+    {
+        return value == 0x00 || value == 0xff;
+    }
+
+    // offset after the last byte in the block that is not erased, 0 if all are
+    uint16_t WrittenInBlock(uint32_t block)
+    {
+        uint16_t written = 0;
+        file.seekSet(block * 512);
+        for (uint16_t offset = 0; offset < 512; offset++)
+        {
+            int value = file.read();
+            if (value < 0)
+            {
+                break;
+            }
+            if (!IsErased(value))
+            {
+                written = offset + 1;
+            }
+        }
+        return written;
+    }
+
+    // position after the last record written to a preallocated file
+    uint32_t FindWrittenEnd()
+    {
+        uint32_t blocks = (file.fileSize() + 511) / 512;
+
+        // first block that is still erased, written blocks are always a
+        // prefix of the file
+        uint32_t low = 0;
+        uint32_t high = blocks;
+        while (low < high)
+        {
+            uint32_t middle = (low + high) / 2;
+            if (WrittenInBlock(middle) == 0)
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle + 1;
+            }
+        }
+
+        if (low == 0)
+        {
+            return 0;
+        }
+
+        // records may end in erased looking bytes, round up to a whole record
+        uint32_t end = (low - 1) * 512 + WrittenInBlock(low - 1);
+        end = ((end + recordSize - 1) / recordSize) * recordSize;
+        if (end > file.fileSize())
+        {
+            end = file.fileSize();
+        }
+        return end;
+    }
+};
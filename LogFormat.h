@@ -0,0 +1,181 @@
+// formats readings into log records
+
+#define LOG_FORMAT_CSV 0    // YYMMDD-H.CSV, one text line per reading
+#define LOG_FORMAT_BIN 1    // YYMMDD-H.BIN, fixed size binary records
+#define LOG_FORMAT_TRK 2    // YYMMDD-H.TRK, delta encoded records, see TrackFormat.h
+
+// longest CSV line, every field at its full width plus separators and CR LF
+#define CSV_LINE_SIZE 72
+
+// binary record, all values little endian
+//  0 uint32 packed UTC date and time, see GPS_DATETIME_*
+//  4 int32  latitude, 1e-7 degrees
+//  8 int32  longitude, 1e-7 degrees
+// 12 int32  altitude, centimeters
+// 16 uint8  satellites
+// 17 uint8  GPS_READING_* flags
+// the file starts with one record sized header, "GLB", format version, record size
+#define BIN_RECORD_SIZE 18
+#define BIN_FORMAT_VERSION 1
+
+inline char* AppendCsvDigits(char* line, uint32_t value, uint8_t width)
+{
+    char* end = line + width;
+    while (width--)
+    {
+        line[width] = '0' + value % 10;
+        value /= 10;
+    }
+    return end;
+}
+
+inline char* AppendCsvNumber(char* line, uint32_t value)
+{
+    uint8_t width = 1;
+    for (uint32_t scan = value; scan >= 10; scan /= 10)
+    {
+        width++;
+    }
+    return AppendCsvDigits(line, value, width);
+}
+
+// (d)ddmm.mmmmm with the decimals the receiver sent, then the hemisphere
+inline char* AppendCsvCoordinate(char* line, int32_t value, uint8_t degreeDigits,
+    uint8_t decimals, char positive, char negative)
+{
+    uint32_t magnitude = (value < 0) ? -value : value;
+    uint32_t degrees = magnitude / 10000000UL;
+    uint32_t scale = GpsPowerOfTen(7 - decimals);
+    uint32_t minutes = ((magnitude % 10000000UL) * 60 + scale / 2) / scale;
+
+    // rounding can carry into the next degree
+    if (minutes >= 60 * GpsPowerOfTen(decimals))
+    {
+        minutes -= 60 * GpsPowerOfTen(decimals);
+        degrees++;
+    }
+
+    line = AppendCsvDigits(line, degrees, degreeDigits);
+    line = AppendCsvDigits(line, minutes / GpsPowerOfTen(decimals), 2);
+    if (decimals)
+    {
+        *line++ = '.';
+        line = AppendCsvDigits(line, minutes % GpsPowerOfTen(decimals), decimals);
+    }
+    *line++ = ',';
+    *line++ = (value < 0) ? negative : positive;
+    return line;
+}
+
+// one reading as a CSV line in a single buffer, returns the length
+// date,time,latitude,N/S,longitude,E/W,altitude,satellites
+inline uint8_t FormatCsvReading(const GpsReading& reading, char* line)
+{
+    char* end = line;
+
+    if (reading.flags & GPS_READING_DATE)
+    {
+        end = AppendCsvDigits(end, GpsDateTimeDay(reading.dateTime), 2);
+        end = AppendCsvDigits(end, GpsDateTimeMonth(reading.dateTime), 2);
+        end = AppendCsvDigits(end, GpsDateTimeYear(reading.dateTime), 2);
+    }
+    *end++ = ',';
+
+    if (reading.flags & GPS_READING_TIME)
+    {
+        end = AppendCsvDigits(end, GpsDateTimeHour(reading.dateTime), 2);
+        end = AppendCsvDigits(end, GpsDateTimeMinute(reading.dateTime), 2);
+        end = AppendCsvDigits(end, GpsDateTimeSecond(reading.dateTime), 2);
+    }
+    *end++ = ',';
+
+    if (reading.flags & GPS_READING_POSITION)
+    {
+        uint8_t decimals = (reading.flags & GPS_READING_DECIMALS_MASK) >> GPS_READING_DECIMALS_SHIFT;
+        end = AppendCsvCoordinate(end, reading.latitude, 2, decimals, 'N', 'S');
+        *end++ = ',';
+        end = AppendCsvCoordinate(end, reading.longitude, 3, decimals, 'E', 'W');
+        *end++ = ',';
+    }
+    else
+    {
+        memcpy(end, ",,,,", 4);
+        end += 4;
+    }
+
+    if (reading.flags & GPS_READING_ALTITUDE)
+    {
+        // receivers report altitude with one decimal
+        uint32_t magnitude = (reading.altitude < 0) ? -reading.altitude : reading.altitude;
+        if (reading.altitude < 0)
+        {
+            *end++ = '-';
+        }
+        end = AppendCsvNumber(end, magnitude / 100);
+        *end++ = '.';
+        end = AppendCsvDigits(end, (magnitude % 100) / 10, 1);
+    }
+    *end++ = ',';
+
+    if (reading.flags & GPS_READING_SATELLITES)
+    {
+        end = AppendCsvDigits(end, reading.satelliteCount, 2);
+    }
+    *end++ = '\r';
+    *end++ = '\n';
+
+    return end - line;
+}
+
+inline uint8_t* PackBinValue(uint8_t* record, uint32_t value)
+{
+    record[0] = value;
+    record[1] = value >> 8;
+    record[2] = value >> 16;
+    record[3] = value >> 24;
+    return record + 4;
+}
+
+inline uint32_t UnpackBinValue(const uint8_t* record)
+{
+    return static_cast<uint32_t>(record[0]) |
+        (static_cast<uint32_t>(record[1]) << 8) |
+        (static_cast<uint32_t>(record[2]) << 16) |
+        (static_cast<uint32_t>(record[3]) << 24);
+}
+
+inline void PackBinReading(const GpsReading& reading, uint8_t* record)
+{
+    record = PackBinValue(record, reading.dateTime);
+    record = PackBinValue(record, reading.latitude);
+    record = PackBinValue(record, reading.longitude);
+    record = PackBinValue(record, reading.altitude);
+    record[0] = reading.satelliteCount;
+    record[1] = reading.flags;
+}
+
+inline void UnpackBinReading(const uint8_t* record, GpsReading& reading)
+{
+    reading.dateTime = UnpackBinValue(record);
+    reading.latitude = UnpackBinValue(record + 4);
+    reading.longitude = UnpackBinValue(record + 8);
+    reading.altitude = UnpackBinValue(record + 12);
+    reading.satelliteCount = record[16];
+    reading.flags = record[17];
+}
+
+inline void PackBinHeader(uint8_t* record)
+{
+    memset(record, 0, BIN_RECORD_SIZE);
+    record[0] = 'G';
+    record[1] = 'L';
+    record[2] = 'B';
+    record[3] = BIN_FORMAT_VERSION;
+    record[4] = BIN_RECORD_SIZE;
+}
+
+inline bool IsBinHeader(const uint8_t* record)
+{
+    return record[0] == 'G' && record[1] == 'L' && record[2] == 'B' &&
+        record[3] == BIN_FORMAT_VERSION && record[4] == BIN_RECORD_SIZE;
+}
@@ -0,0 +1,161 @@
+// journal sectors, a log file cut into 512 byte sectors that each say what they hold
+//
+// Every sector starts with a header naming the sequence number of its first
+// record, how many records and payload bytes follow, and a CRC over both. A
+// record never spans two sectors. A sector torn while being written fails
+// its CRC.
+//
+// A block that holds synced records is never written again. Each sector
+// has a pair of blocks. Every sync seals the sector so far into the block
+// of the pair that does not hold the last copy, and the next sector starts
+// after the pair. Reading the file in order, a block with the first record
+// of the block before is another copy of that sector, and the copy with more
+// records is the later one. A torn block is skipped when the block after it
+// is valid, since the other block of its pair still has the sector. After a
+// power cut the journal is the prefix of the file that made it to the card,
+// whatever the directory entry says. LogJournalCursor follows it.
+//
+// header, all values little endian
+//  0 uint16 LOG_JOURNAL_MAGIC
+//  2 uint16 payload bytes used
+//  4 uint32 sequence number of the first record, counted from 0 per file
+//  8 uint16 records in the sector
+// 10 uint16 CRC-16/CCITT of the header before it and the used payload
+// the rest of the sector is zero
+
+// LogFile writes journal sectors when this is 1, see there
+#ifndef LOG_JOURNAL
+#define LOG_JOURNAL 0
+#endif
+
+// readings a power cut may cost, those that came in at most this long ago;
+// TaskLogWriter holds them in RAM for half of it and the batch is synced as
+// soon as it is written, the other half covers a slow card or a new file
+#ifndef LOG_JOURNAL_WINDOW_MS
+#define LOG_JOURNAL_WINDOW_MS 5000UL
+#endif
+
+#define LOG_JOURNAL_MAGIC 0x4a4c    // "LJ"
+#define LOG_JOURNAL_SECTOR_SIZE 512
+#define LOG_JOURNAL_HEADER_SIZE 12
+#define LOG_JOURNAL_PAYLOAD_SIZE (LOG_JOURNAL_SECTOR_SIZE - LOG_JOURNAL_HEADER_SIZE)
+
+// one nibble at a time, a 32 byte table instead of 512
+const uint16_t LogJournalCrcTable[16] PROGMEM =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+inline uint16_t LogJournalCrc(const uint8_t* data, uint16_t length, uint16_t crc = 0xffff)
+{
+    while (length--)
+    {
+        uint8_t value = *data++;
+        crc = (crc << 4) ^ pgm_read_word(&LogJournalCrcTable[(crc >> 12) ^ (value >> 4)]);
+        crc = (crc << 4) ^ pgm_read_word(&LogJournalCrcTable[(crc >> 12) ^ (value & 0x0f)]);
+    }
+    return crc;
+}
+
+inline uint32_t LogJournalValue(const uint8_t* data, uint8_t size)
+{
+    uint32_t value = 0;
+    while (size--)
+    {
+        value = (value << 8) | data[size];
+    }
+    return value;
+}
+
+inline void PackLogJournalValue(uint8_t* data, uint32_t value, uint8_t size)
+{
+    while (size--)
+    {
+        *data++ = value;
+        value >>= 8;
+    }
+}
+
+inline uint16_t LogJournalUsed(const uint8_t* sector)
+{
+    return LogJournalValue(sector + 2, 2);
+}
+
+inline uint32_t LogJournalSequence(const uint8_t* sector)
+{
+    return LogJournalValue(sector + 4, 4);
+}
+
+inline uint16_t LogJournalRecords(const uint8_t* sector)
+{
+    return LogJournalValue(sector + 8, 2);
+}
+
+// fills in the header of a sector whose payload is in place
+inline void SealLogJournalSector(uint8_t* sector, uint16_t used, uint32_t sequence, uint16_t records)
+{
+    PackLogJournalValue(sector, LOG_JOURNAL_MAGIC, 2);
+    PackLogJournalValue(sector + 2, used, 2);
+    PackLogJournalValue(sector + 4, sequence, 4);
+    PackLogJournalValue(sector + 8, records, 2);
+    uint16_t crc = LogJournalCrc(sector, 10);
+    crc = LogJournalCrc(sector + LOG_JOURNAL_HEADER_SIZE, used, crc);
+    PackLogJournalValue(sector + 10, crc, 2);
+}
+
+// header and payload as they were sealed
+inline bool IsLogJournalSector(const uint8_t* sector)
+{
+    uint16_t used = LogJournalUsed(sector);
+    if (LogJournalValue(sector, 2) != LOG_JOURNAL_MAGIC || used > LOG_JOURNAL_PAYLOAD_SIZE)
+    {
+        return false;
+    }
+    uint16_t crc = LogJournalCrc(sector, 10);
+    crc = LogJournalCrc(sector + LOG_JOURNAL_HEADER_SIZE, used, crc);
+    return crc == LogJournalValue(sector + 10, 2);
+}
+
+// a valid block's part in the journal, read in file order
+enum LogJournalStep
+{
+    LogJournalStep_Next,        // the sector after the current one
+    LogJournalStep_Newer,       // a later copy of the current sector
+    LogJournalStep_Older,       // an earlier copy, skipped
+    LogJournalStep_End          // not part of the journal
+};
+
+// the sector a reader is at, its newest copy so far; zeroed to start
+struct LogJournalCursor
+{
+    uint32_t sequence;          // of the first record in the sector
+    uint16_t records;
+    uint16_t used;              // payload bytes
+    uint32_t payloadBefore;     // in the sectors before it
+};
+
+inline LogJournalStep StepLogJournal(LogJournalCursor& cursor, const uint8_t* sector)
+{
+    uint32_t sequence = LogJournalSequence(sector);
+    uint16_t records = LogJournalRecords(sector);
+    if (cursor.records && sequence == cursor.sequence)
+    {
+        if (records < cursor.records)
+        {
+            return LogJournalStep_Older;
+        }
+        cursor.records = records;
+        cursor.used = LogJournalUsed(sector);
+        return LogJournalStep_Newer;
+    }
+    if (sequence != cursor.sequence + cursor.records)
+    {
+        return LogJournalStep_End;
+    }
+    cursor.payloadBefore += cursor.used;
+    cursor.sequence = sequence;
+    cursor.records = records;
+    cursor.used = LogJournalUsed(sector);
+    return LogJournalStep_Next;
+}
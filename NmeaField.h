@@ -0,0 +1,271 @@
+// one NMEA field decoded while its characters arrive, no text is kept
+//
+// TaskGps knows which field comes next before its first character does, so
+// it picks how the characters are taken: numbers accumulate their digits
+// (times and dates as BCD, so no division splits them up again), letters
+// keep the first character and the address keeps up to eight for the
+// sentence lookup. Anything longer or malformed only sets a flag, nothing is
+// ever written past the field. The getters convert the finished field into
+// reading units and return false when it was empty or malformed.
+
+enum NMEA_FIELD
+{
+    NMEA_FIELD_Skip,        // counted, not kept
+    NMEA_FIELD_Address,     // talker and type, up to NMEA_FIELD_TEXT_SIZE characters
+    NMEA_FIELD_Letter,      // the first character, status, direction, flags
+    NMEA_FIELD_Clock,       // hhmmss[.sss] or ddmmyy, whole digits as BCD
+    NMEA_FIELD_Number       // [-]digits[.digits]
+};
+
+#define NMEA_FIELD_TEXT_SIZE 8
+
+// most digits kept, more whole digits make the field malformed, more
+// fraction digits are ignored
+#define NMEA_FIELD_WHOLE_DIGITS 9
+#define NMEA_FIELD_CLOCK_DIGITS 6
+#define NMEA_FIELD_FRACTION_DIGITS 7
+
+#define NMEA_FIELD_NEGATIVE  0b00000001
+#define NMEA_FIELD_DOT       0b00000010
+#define NMEA_FIELD_MALFORMED 0b00000100
+
+class NmeaField
+{
+public:
+    void Begin(NMEA_FIELD fieldKind)
+    {
+        kind = fieldKind;
+        length = 0;
+        wholeDigits = 0;
+        fractionDigits = 0;
+        state = 0;
+        value.number.whole = 0;
+        value.number.fraction = 0;
+    }
+
+    void Read(char character)
+    {
+        uint8_t index = length;
+        if (length != 255)
+        {
+            length++;
+        }
+
+        // most fields are skipped, numbers are most of the rest
+        if (kind == NMEA_FIELD_Skip)
+        {
+            return;
+        }
+        if (kind >= NMEA_FIELD_Clock)
+        {
+            ReadNumber(character, index);
+        }
+        else if (index < NMEA_FIELD_TEXT_SIZE && (kind == NMEA_FIELD_Address || index == 0))
+        {
+            value.text[index] = character;
+        }
+    }
+
+    uint8_t Length() const
+    {
+        return length;
+    }
+
+    // the address as read, Length() tells whether it was cut short
+    const char* Text() const
+    {
+        return value.text;
+    }
+
+    // the first character, '\0' for an empty field
+    char Letter() const
+    {
+        return length ? value.text[0] : '\0';
+    }
+
+    // hhmmss[.sss] into the time of reading, fractions of a second into milliseconds
+    bool Time(GpsReading& reading, uint16_t* milliseconds) const
+    {
+        reading.dateTime &= GPS_DATETIME_DATE_MASK;
+        reading.flags &= ~GPS_READING_TIME;
+        *milliseconds = 0;
+
+        // a leap second is 60
+        uint8_t first, second, third;
+        if (!ClockPairs(&first, &second, &third) || first > 23 || second > 59 || third > 60)
+        {
+            return false;
+        }
+        reading.dateTime |= (static_cast<uint32_t>(first) << GPS_DATETIME_HOUR_SHIFT) |
+            (static_cast<uint32_t>(second) << GPS_DATETIME_MINUTE_SHIFT) | third;
+        reading.flags |= GPS_READING_TIME;
+
+        if (fractionDigits <= 3)
+        {
+            *milliseconds = value.number.fraction * GpsPowerOfTen(3 - fractionDigits);
+        }
+        else
+        {
+            *milliseconds = value.number.fraction / GpsPowerOfTen(fractionDigits - 3);
+        }
+        return true;
+    }
+
+    // ddmmyy into the date of reading
+    bool Date(GpsReading& reading) const
+    {
+        reading.dateTime &= GPS_DATETIME_TIME_MASK;
+        reading.flags &= ~GPS_READING_DATE;
+
+        uint8_t first, second, third;
+        // the packed year ends with 2063
+        if (!ClockPairs(&first, &second, &third) || (state & NMEA_FIELD_DOT) ||
+                first < 1 || first > 31 || second < 1 || second > 12 || third > 63)
+        {
+            return false;
+        }
+        reading.dateTime |= (static_cast<uint32_t>(first) << GPS_DATETIME_DAY_SHIFT) |
+            (static_cast<uint32_t>(second) << GPS_DATETIME_MONTH_SHIFT) |
+            (static_cast<uint32_t>(third) << GPS_DATETIME_YEAR_SHIFT);
+        reading.flags |= GPS_READING_DATE;
+        return true;
+    }
+
+    // (d)ddmm.mmmmm into 1e-7 degrees, decimals receives the count of minute decimals,
+    // 90 or 180 degrees at most
+    bool Coordinate(int32_t* coordinate, uint8_t* decimals, uint8_t maxDegrees) const
+    {
+        uint32_t whole = value.number.whole;
+        if (!Unsigned() || wholeDigits < 3 || wholeDigits > 5 || whole % 100 > 59 ||
+                whole / 100 > maxDegrees || (whole / 100 == maxDegrees && (whole % 100 || value.number.fraction)))
+        {
+            return false;
+        }
+
+        // minutes scaled by 10^decimals, at most 60e7 after scaling to 1e7 / 60
+        uint32_t minutes = (whole % 100) * GpsPowerOfTen(fractionDigits) + value.number.fraction;
+        *coordinate = static_cast<int32_t>((whole / 100) * 10000000UL +
+            (minutes * GpsPowerOfTen(7 - fractionDigits) + 30) / 60);
+        *decimals = fractionDigits;
+        return true;
+    }
+
+    // signed decimal in hundredths, meters into centimeters, knots, degrees or HDOP
+    // into hundredths of them, further decimals are dropped
+    bool Hundredths(int32_t* hundredths) const
+    {
+        if (kind != NMEA_FIELD_Number || !wholeDigits || (state & NMEA_FIELD_MALFORMED) ||
+                value.number.whole > 20000000UL)
+        {
+            return false;
+        }
+
+        int32_t result = static_cast<int32_t>(value.number.whole) * 100;
+        if (fractionDigits <= 2)
+        {
+            result += value.number.fraction * GpsPowerOfTen(2 - fractionDigits);
+        }
+        else
+        {
+            result += value.number.fraction / GpsPowerOfTen(fractionDigits - 2);
+        }
+        *hundredths = (state & NMEA_FIELD_NEGATIVE) ? -result : result;
+        return true;
+    }
+
+    // whole digits only, satellite counts, fix quality, command numbers
+    bool Integer(uint16_t* integer) const
+    {
+        if (!Unsigned() || !wholeDigits || (state & NMEA_FIELD_DOT) || value.number.whole > 0xffff)
+        {
+            return false;
+        }
+        *integer = static_cast<uint16_t>(value.number.whole);
+        return true;
+    }
+
+private:
+    union
+    {
+        struct
+        {
+            uint32_t whole;     // binary, BCD for NMEA_FIELD_Clock
+            uint32_t fraction;  // the fraction digits kept, binary
+        } number;
+        char text[NMEA_FIELD_TEXT_SIZE];
+    } value;
+    uint8_t kind;           // NMEA_FIELD
+    uint8_t length;         // characters read, stops at 255
+    uint8_t wholeDigits;
+    uint8_t fractionDigits;
+    uint8_t state;          // NMEA_FIELD_NEGATIVE, _DOT and _MALFORMED
+
+    void ReadNumber(char character, uint8_t index)
+    {
+        uint8_t digit = static_cast<uint8_t>(character - '0');
+        if (digit <= 9)
+        {
+            if (state & NMEA_FIELD_DOT)
+            {
+                if (fractionDigits < NMEA_FIELD_FRACTION_DIGITS)
+                {
+                    value.number.fraction = value.number.fraction * 10 + digit;
+                    fractionDigits++;
+                }
+            }
+            else if (kind == NMEA_FIELD_Clock)
+            {
+                if (wholeDigits < NMEA_FIELD_CLOCK_DIGITS)
+                {
+                    value.number.whole = (value.number.whole << 4) | digit;
+                    wholeDigits++;
+                }
+                else
+                {
+                    state |= NMEA_FIELD_MALFORMED;
+                }
+            }
+            else if (wholeDigits < NMEA_FIELD_WHOLE_DIGITS)
+            {
+                value.number.whole = value.number.whole * 10 + digit;
+                wholeDigits++;
+            }
+            else
+            {
+                state |= NMEA_FIELD_MALFORMED;
+            }
+        }
+        else if (character == '.' && !(state & NMEA_FIELD_DOT))
+        {
+            state |= NMEA_FIELD_DOT;
+        }
+        else if (character == '-' && index == 0 && kind == NMEA_FIELD_Number)
+        {
+            state |= NMEA_FIELD_NEGATIVE;
+        }
+        else
+        {
+            state |= NMEA_FIELD_MALFORMED;
+        }
+    }
+
+    bool Unsigned() const
+    {
+        return kind == NMEA_FIELD_Number && !(state & (NMEA_FIELD_NEGATIVE | NMEA_FIELD_MALFORMED));
+    }
+
+    // the three two digit pairs of a clock field
+    bool ClockPairs(uint8_t* first, uint8_t* second, uint8_t* third) const
+    {
+        if (kind != NMEA_FIELD_Clock || wholeDigits != NMEA_FIELD_CLOCK_DIGITS || (state & NMEA_FIELD_MALFORMED))
+        {
+            return false;
+        }
+
+        uint32_t bcd = value.number.whole;
+        *first = ((bcd >> 20) & 0x0f) * 10 + ((bcd >> 16) & 0x0f);
+        *second = ((bcd >> 12) & 0x0f) * 10 + ((bcd >> 8) & 0x0f);
+        *third = ((bcd >> 4) & 0x0f) * 10 + (bcd & 0x0f);
+        return true;
+    }
+};
@@ -0,0 +1,142 @@
+// identifies NMEA sentences from their address field, talker and type
+//
+// The five characters after '$' are two talker and three type characters.
+// Both are looked up in small hash tables kept in PROGMEM: the hash picks the
+// only slot the characters can be in and a single compare confirms it. The
+// tables are filled in by the compiler from the lists below, which also fails
+// the build if two entries ever land in the same slot.
+
+// sentence kinds, whichever constellation the talker is
+enum NMEA_SENTENCE
+{
+    NMEA_SENTENCE_Unknown = -1,
+    NMEA_SENTENCE_RMC,  // time, date, position, course and speed
+    NMEA_SENTENCE_GGA,  // time, position and fix related data
+    NMEA_SENTENCE_GSA,  // satellites used for the fix, fix type
+    NMEA_SENTENCE_GSV,  // satellites in view
+    NMEA_SENTENCE_GLL,  // position, time and fix status
+    NMEA_SENTENCE_VTG,  // course and speed over ground
+    NMEA_SENTENCE_ZDA,  // time and date
+    NMEA_SENTENCE_GNS,  // fix data for multiple constellations
+    NMEA_SENTENCE_GST,  // position error statistics
+    NMEA_SENTENCE_GBS,  // satellite fault detection
+    NMEA_SENTENCE_TXT,  // text messages
+    NMEA_SENTENCE_COUNT
+};
+
+// in NMEA_SENTENCE order
+constexpr char NmeaSentenceTypes[NMEA_SENTENCE_COUNT][4] =
+{
+    "RMC", "GGA", "GSA", "GSV", "GLL", "VTG", "ZDA", "GNS", "GST", "GBS", "TXT"
+};
+
+// GPS, GLONASS, Galileo, BeiDou, QZSS, NavIC and combined solutions
+#define NMEA_TALKER_COUNT 9
+constexpr char NmeaTalkers[NMEA_TALKER_COUNT][3] =
+{
+    "GP", "GL", "GA", "GB", "BD", "GQ", "QZ", "GI", "GN"
+};
+
+#define NMEA_LOOKUP_SLOTS 32
+
+constexpr uint8_t NmeaTypeSlot(char first, char second, char third)
+{
+    return (first ^ second ^ third) & (NMEA_LOOKUP_SLOTS - 1);
+}
+
+constexpr uint8_t NmeaTalkerSlot(char first, char second)
+{
+    return (first + second) & (NMEA_LOOKUP_SLOTS - 1);
+}
+
+// the kind whose type hashes to slot, searching from kind onwards
+constexpr int8_t NmeaKindInSlot(uint8_t slot, int8_t kind = 0)
+{
+    return (kind == NMEA_SENTENCE_COUNT) ? NMEA_SENTENCE_Unknown :
+        (NmeaTypeSlot(NmeaSentenceTypes[kind][0], NmeaSentenceTypes[kind][1], NmeaSentenceTypes[kind][2]) == slot) ? kind :
+        NmeaKindInSlot(slot, kind + 1);
+}
+
+constexpr int8_t NmeaTalkerInSlot(uint8_t slot, int8_t talker = 0)
+{
+    return (talker == NMEA_TALKER_COUNT) ? -1 :
+        (NmeaTalkerSlot(NmeaTalkers[talker][0], NmeaTalkers[talker][1]) == slot) ? talker :
+        NmeaTalkerInSlot(slot, talker + 1);
+}
+
+// every entry has to be the first one found in its own slot
+constexpr bool NmeaTypesCollide(int8_t kind = 0)
+{
+    return (kind < NMEA_SENTENCE_COUNT) &&
+        (NmeaKindInSlot(NmeaTypeSlot(NmeaSentenceTypes[kind][0], NmeaSentenceTypes[kind][1], NmeaSentenceTypes[kind][2])) != kind ||
+        NmeaTypesCollide(kind + 1));
+}
+
+constexpr bool NmeaTalkersCollide(int8_t talker = 0)
+{
+    return (talker < NMEA_TALKER_COUNT) &&
+        (NmeaTalkerInSlot(NmeaTalkerSlot(NmeaTalkers[talker][0], NmeaTalkers[talker][1])) != talker ||
+        NmeaTalkersCollide(talker + 1));
+}
+
+static_assert(!NmeaTypesCollide(), "two sentence types share a lookup slot, change NmeaTypeSlot");
+static_assert(!NmeaTalkersCollide(), "two talkers share a lookup slot, change NmeaTalkerSlot");
+
+constexpr char NmeaTypeCharInSlot(uint8_t slot, uint8_t index)
+{
+    return (NmeaKindInSlot(slot) < 0) ? '\0' : NmeaSentenceTypes[NmeaKindInSlot(slot)][index];
+}
+
+constexpr char NmeaTalkerCharInSlot(uint8_t slot, uint8_t index)
+{
+    return (NmeaTalkerInSlot(slot) < 0) ? '\0' : NmeaTalkers[NmeaTalkerInSlot(slot)][index];
+}
+
+struct NmeaTypeEntry
+{
+    char type[3];
+    int8_t kind;
+};
+
+#define NMEA_TYPE_ENTRY(slot) { { NmeaTypeCharInSlot(slot, 0), NmeaTypeCharInSlot(slot, 1), NmeaTypeCharInSlot(slot, 2) }, NmeaKindInSlot(slot) }
+#define NMEA_TALKER_ENTRY(slot) { NmeaTalkerCharInSlot(slot, 0), NmeaTalkerCharInSlot(slot, 1) }
+
+#define NMEA_LOOKUP_ROW(ENTRY, row) ENTRY(row), ENTRY(row + 1), ENTRY(row + 2), ENTRY(row + 3), \
+    ENTRY(row + 4), ENTRY(row + 5), ENTRY(row + 6), ENTRY(row + 7)
+
+const NmeaTypeEntry NmeaTypeTable[NMEA_LOOKUP_SLOTS] PROGMEM =
+{
+    NMEA_LOOKUP_ROW(NMEA_TYPE_ENTRY, 0), NMEA_LOOKUP_ROW(NMEA_TYPE_ENTRY, 8),
+    NMEA_LOOKUP_ROW(NMEA_TYPE_ENTRY, 16), NMEA_LOOKUP_ROW(NMEA_TYPE_ENTRY, 24)
+};
+
+const char NmeaTalkerTable[NMEA_LOOKUP_SLOTS][2] PROGMEM =
+{
+    NMEA_LOOKUP_ROW(NMEA_TALKER_ENTRY, 0), NMEA_LOOKUP_ROW(NMEA_TALKER_ENTRY, 8),
+    NMEA_LOOKUP_ROW(NMEA_TALKER_ENTRY, 16), NMEA_LOOKUP_ROW(NMEA_TALKER_ENTRY, 24)
+};
+
+// address is the field between '$' and the first ',' with its length
+inline NMEA_SENTENCE IdentifyNmeaSentence(const char* address, uint8_t length)
+{
+    if (length != 5)
+    {
+        // proprietary sentences and anything garbled
+        return NMEA_SENTENCE_Unknown;
+    }
+
+    const char* talker = NmeaTalkerTable[NmeaTalkerSlot(address[0], address[1])];
+    if (pgm_read_byte(&talker[0]) != address[0] || pgm_read_byte(&talker[1]) != address[1])
+    {
+        return NMEA_SENTENCE_Unknown;
+    }
+
+    const NmeaTypeEntry* entry = &NmeaTypeTable[NmeaTypeSlot(address[2], address[3], address[4])];
+    if (pgm_read_byte(&entry->type[0]) != address[2] ||
+            pgm_read_byte(&entry->type[1]) != address[3] ||
+            pgm_read_byte(&entry->type[2]) != address[4])
+    {
+        return NMEA_SENTENCE_Unknown;
+    }
+    return static_cast<NMEA_SENTENCE>(static_cast<int8_t>(pgm_read_byte(&entry->kind)));
+}
@@ -0,0 +1,211 @@
+// raw NMEA capture, the receiver's stream written to the card byte for byte
+//
+// With GPS_RAW_CAPTURE TaskGps stops decoding sentences once the receiver is
+// configured and hands every byte it receives to the sketch, which writes
+// them through LogFile's sector buffer, whole 512 byte blocks, to a
+// preallocated NMEAnnnn.RAW. Configuring still needs the parser to see the
+// answers, the bytes of that time are captured as well. The fix status for
+// the LED comes from NmeaFixScanner, which only looks at GSA, GGA and RMC.
+// The receiver is left sending all its sentences, GPS_CONFIG_SENTENCES.
+//
+// A RAW file is a capture the host benchmarks replay as is. NMEA is text, so
+// a file cut short by a power loss ends where its erased blocks start.
+//
+// At 115200 baud that is 23 blocks a second, the receiver belongs on the
+// UART with a ring holding what arrives during a block write.
+
+#ifndef GPS_RAW_CAPTURE
+#define GPS_RAW_CAPTURE 0
+#endif
+
+#if GPS_RAW_CAPTURE
+    #if defined(LOG_JOURNAL) && LOG_JOURNAL
+    #error "GPS_RAW_CAPTURE writes plain sectors, turn off LOG_JOURNAL"
+    #endif
+
+    // no readings are made, the queue only has to exist
+    #ifndef READING_SLOTS
+    #define READING_SLOTS 2
+    #endif
+    #ifndef READING_SLOT_SIZE
+    #define READING_SLOT_SIZE 1
+    #endif
+#endif
+
+// bytes handed over at a time
+#ifndef GPS_RAW_CHUNK_SIZE
+#define GPS_RAW_CHUNK_SIZE 32
+#endif
+
+typedef void(*GpsRawBytes)(const uint8_t* bytes, uint8_t length);
+
+// the fix of sentences that pass their checksum, as TaskGps decodes it: the
+// type from GSA, and from the GGA fix quality and the RMC status whether
+// there is one at all, as GSA may come only every few fixes or not at all.
+// A fix they report makes no fix a 2D one and leaves a GSA 3D as it is.
+class NmeaFixScanner
+{
+public:
+    NmeaFixScanner() :
+        field(-1),
+        fixType(1)
+    {
+    }
+
+    void Reset()
+    {
+        field = -1;
+        fixType = 1;
+    }
+
+    // 1 no fix, 2 2D or 3 3D at the end of a GSA, GGA or RMC sentence with a fix field, 0 otherwise
+    uint8_t Scan(char value)
+    {
+        if (value == '$')
+        {
+            field = 0;
+            length = 0;
+            checksum = 0;
+            digits = -1;
+            sentence = NMEA_SENTENCE_Unknown;
+            status = 0;
+            return 0;
+        }
+        if (field < 0)
+        {
+            return 0;
+        }
+        if (value == '\r' || value == '\n')
+        {
+            field = -1;
+            return 0;
+        }
+        if (digits >= 0)
+        {
+            return ScanChecksumDigit(value);
+        }
+        if (value == '*')
+        {
+            digits = 0;
+            return 0;
+        }
+
+        checksum ^= value;
+        if (value == ',')
+        {
+            if (field == 0)
+            {
+                sentence = IdentifyNmeaSentence(address, length);
+                if (sentence != NMEA_SENTENCE_GSA && sentence != NMEA_SENTENCE_GGA && sentence != NMEA_SENTENCE_RMC)
+                {
+                    // nothing to look at in this one
+                    field = -1;
+                    return 0;
+                }
+            }
+            if (field < 7)
+            {
+                field++;
+            }
+            length = 0;
+            return 0;
+        }
+
+        if (field == 0 && length < sizeof(address))
+        {
+            address[length] = value;
+        }
+        else if (length == 0 && field == StatusField())
+        {
+            status = value;
+        }
+        if (length < 255)
+        {
+            length++;
+        }
+        return 0;
+    }
+
+private:
+    int8_t field;       // -1 between sentences
+    uint8_t length;     // characters of the field so far
+    uint8_t checksum;
+    int8_t digits;      // of the checksum, -1 before the '*'
+    char address[5];
+    NMEA_SENTENCE sentence;
+    char status;        // first character of the field with the fix, 0 if empty
+    uint8_t fixType;    // as last reported, 1 no fix, 2 2D or 3 3D
+
+    // GSA fix type, GGA fix quality, RMC status
+    int8_t StatusField() const
+    {
+        return (sentence == NMEA_SENTENCE_GGA) ? 6 : 2;
+    }
+
+    uint8_t ScanChecksumDigit(char digit)
+    {
+        uint8_t value;
+        if (digit >= '0' && digit <= '9')
+        {
+            value = digit - '0';
+        }
+        else if (digit >= 'A' && digit <= 'F')
+        {
+            value = digit - 'A' + 10;
+        }
+        else
+        {
+            field = -1;
+            return 0;
+        }
+
+        // high nibble first
+        if ((digits == 0 ? (checksum >> 4) : (checksum & 0x0f)) != value)
+        {
+            field = -1;
+            return 0;
+        }
+        if (++digits < 2)
+        {
+            return 0;
+        }
+        field = -1;
+        return Complete();
+    }
+
+    uint8_t Complete()
+    {
+        if (sentence == NMEA_SENTENCE_GSA)
+        {
+            if (status < '1' || status > '3')
+            {
+                return 0;
+            }
+            fixType = status - '0';
+            return fixType;
+        }
+
+        bool fix;
+        if (sentence == NMEA_SENTENCE_GGA && status >= '0' && status <= '9')
+        {
+            fix = status != '0';
+        }
+        else if (sentence == NMEA_SENTENCE_RMC && (status == 'A' || status == 'V'))
+        {
+            fix = status == 'A';
+        }
+        else
+        {
+            return 0;
+        }
+        if (!fix)
+        {
+            fixType = 1;
+        }
+        else if (fixType == 1)
+        {
+            fixType = 2;
+        }
+        return fixType;
+    }
+};
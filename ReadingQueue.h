@@ -0,0 +1,228 @@
+// slots of readings handed from TaskGps to TaskLogWriter
+//
+// TaskGps fills one slot while TaskLogWriter writes out the oldest full one,
+// so a slow card write or a file being opened no longer holds up parsing.
+// Both run from TaskManager, one after the other, so nothing here needs
+// to be atomic. Full slots are kept in order in a short list of slot numbers.
+// A slot holds GpsSlotReading, only the fields the build decodes, the writer
+// widens each back to a GpsReading.
+//
+// When every slot is full the policy decides what gives:
+//   READING_OVERFLOW_DROP_NEWEST  new readings are dropped until a slot is
+//                                 written, what was queued stays complete
+//   READING_OVERFLOW_DROP_OLDEST  the oldest readings nobody has started to
+//                                 write are dropped, the log keeps up to date
+
+#define READING_OVERFLOW_DROP_NEWEST 0
+#define READING_OVERFLOW_DROP_OLDEST 1
+
+#ifndef READING_OVERFLOW
+#define READING_OVERFLOW READING_OVERFLOW_DROP_NEWEST
+#endif
+
+// three slots of 12 take the SRAM the single 36 reading batch did: one
+// filling, one being written and one for an hour change opening a new file
+#ifndef READING_SLOTS
+#define READING_SLOTS 3
+#endif
+
+#ifndef READING_SLOT_SIZE
+#define READING_SLOT_SIZE 12
+#endif
+
+struct ReadingQueueCounters
+{
+    uint32_t published;     // slots handed to the writer
+    uint32_t dropped;       // readings lost to the overflow policy
+    uint8_t peakQueued;     // most slots waiting at once
+};
+
+// SLOTS of SLOT_SIZE readings kept as SLOT, a GpsSlotReadingT, ReadingQueue
+// is the one sized by READING_SLOTS with the fields of GPS_READING_FIELDS
+template <uint8_t SLOTS, uint8_t SLOT_SIZE, class SLOT = GpsSlotReading>
+class ReadingQueueT
+{
+public:
+    static_assert(SLOTS >= 2 && SLOTS <= 8, "a reading queue has 2 to 8 slots");
+    static constexpr uint8_t Slots = SLOTS;
+    static constexpr uint8_t SlotSize = SLOT_SIZE;
+    static constexpr uint8_t Fields = SLOT::Fields;
+    typedef SLOT Slot;
+
+    ReadingQueueT() :
+        fillSlot(0),
+        fillCount(0),
+        queued(0),
+        drainIndex(0),
+        flushing(false)
+    {
+        memset(counts, 0, sizeof(counts));
+        memset(order, 0, sizeof(order));
+        memset(&counters, 0, sizeof(counters));
+    }
+
+    // parser side, false when the reading was dropped
+    bool Add(const GpsReading& reading)
+    {
+        if (fillCount == SLOT_SIZE && !Publish())
+        {
+            #if READING_OVERFLOW == READING_OVERFLOW_DROP_OLDEST
+                // frees a queued slot or starts the filling one over
+                if (DropOldest())
+                {
+                    Publish();
+                }
+            #else
+                counters.dropped++;
+                return false;
+            #endif
+        }
+
+        slots[fillSlot][fillCount++].Narrow(reading);
+        if (fillCount == SLOT_SIZE)
+        {
+            // hand it over straight away, the writer may be idle
+            Publish();
+        }
+        return true;
+    }
+
+    // hand over a partly filled slot when the parser stops, as soon as
+    // there is room if there is none now
+    bool Flush()
+    {
+        if (fillCount == 0 || Publish())
+        {
+            return true;
+        }
+        flushing = true;
+        return false;
+    }
+
+    // writer side, the oldest full slot or NULL, Widen() each reading
+    const Slot* Oldest(uint8_t* count) const
+    {
+        if (!queued)
+        {
+            return NULL;
+        }
+        *count = counts[order[0]];
+        return slots[order[0]];
+    }
+
+    // the writer keeps its place in the oldest slot here, a slot with
+    // readings written is never dropped
+    uint8_t DrainIndex() const
+    {
+        return drainIndex;
+    }
+
+    void SetDrainIndex(uint8_t index)
+    {
+        drainIndex = index;
+    }
+
+    // the oldest slot is written, its space is free again
+    void Release()
+    {
+        if (!queued)
+        {
+            return;
+        }
+        queued--;
+        memmove(order, order + 1, queued);
+        drainIndex = 0;
+
+        // a slot that could not be handed over gets its turn now
+        if (fillCount == SLOT_SIZE || (flushing && fillCount))
+        {
+            Publish();
+        }
+    }
+
+    // nothing waiting to be written, neither queued nor being filled
+    bool Empty() const
+    {
+        return queued == 0 && fillCount == 0;
+    }
+
+    uint8_t Queued() const
+    {
+        return queued;
+    }
+
+    // readings in the slot being filled
+    uint8_t Filling() const
+    {
+        return fillCount;
+    }
+
+    const ReadingQueueCounters& Counters() const
+    {
+        return counters;
+    }
+
+private:
+    Slot slots[SLOTS][SLOT_SIZE];
+    uint8_t counts[SLOTS];
+    uint8_t order[SLOTS];           // full slots, oldest first
+    uint8_t fillSlot;
+    uint8_t fillCount;
+    uint8_t queued;
+    uint8_t drainIndex;             // readings of the oldest slot already written
+    bool flushing;                  // a partly filled slot waits for room
+    ReadingQueueCounters counters;
+
+    // queue the filling slot and start on a free one
+    bool Publish()
+    {
+        if (queued == SLOTS - 1)
+        {
+            // the others are all queued
+            return false;
+        }
+
+        counts[fillSlot] = fillCount;
+        order[queued++] = fillSlot;
+        counters.published++;
+        if (queued > counters.peakQueued)
+        {
+            counters.peakQueued = queued;
+        }
+
+        // the free slot is the one neither filling nor queued
+        for (uint8_t slot = 0; slot < SLOTS; slot++)
+        {
+            if (!memchr(order, slot, queued))
+            {
+                fillSlot = slot;
+                break;
+            }
+        }
+        fillCount = 0;
+        flushing = false;
+        return true;
+    }
+
+#if READING_OVERFLOW == READING_OVERFLOW_DROP_OLDEST
+    // free the oldest queued slot the writer has not started on
+    bool DropOldest()
+    {
+        uint8_t index = (drainIndex == 0) ? 0 : 1;
+        if (index >= queued)
+        {
+            // nothing queued to give up, start the filling slot over instead
+            counters.dropped += fillCount;
+            fillCount = 0;
+            return false;
+        }
+
+        counters.dropped += counts[order[index]];
+        queued--;
+        memmove(order + index, order + index + 1, queued - index);
+        return true;
+    }
+#endif
+};
+
+typedef ReadingQueueT<READING_SLOTS, READING_SLOT_SIZE> ReadingQueue;
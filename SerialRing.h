@@ -0,0 +1,152 @@
+// byte ring filled by an interrupt and emptied by the main loop
+//
+// One producer (the receive interrupt) only ever moves head, one consumer
+// (TaskGps) only ever moves tail, so neither side needs a lock. Both indices
+// run freely and wrap at their type's size; the slot is the index masked to
+// SIZE, which has to be a power of two. Rings of up to 128 bytes use 8 bit
+// indices the AVR reads in one instruction, larger ones 16 bit indices that
+// are read and written with interrupts off so the other side never sees half
+// of an update.
+//
+// There are no constructors, a ring at namespace or function scope is zeroed
+// before anything runs and needs no guard.
+
+#if defined(__AVR__)
+#include <util/atomic.h>
+#endif
+
+template <bool SMALL> struct SerialRingIndex
+{
+    typedef uint16_t Type;
+};
+
+template <> struct SerialRingIndex<true>
+{
+    typedef uint8_t Type;
+};
+
+template <uint16_t SIZE> class SerialRing
+{
+    static_assert(SIZE >= 16 && SIZE <= 32768 && (SIZE & (SIZE - 1)) == 0, "SerialRing SIZE must be a power of two from 16 to 32768");
+
+public:
+    typedef typename SerialRingIndex<(SIZE <= 128)>::Type Index;
+
+    // producer side, from the interrupt; false and counted when full
+    bool Push(uint8_t value)
+    {
+        Index next = head;
+        Index used = static_cast<Index>(next - Load(tail));
+        if (used >= SIZE)
+        {
+            Store(overflowed, static_cast<uint16_t>(overflowed + 1));
+            return false;
+        }
+        if (used >= peak)
+        {
+            Store(peak, static_cast<uint16_t>(used + 1));
+        }
+        buffer[next & (SIZE - 1)] = value;
+        Store(head, static_cast<Index>(next + 1));
+        return true;
+    }
+
+    // producer side, room left
+    uint16_t Free() const
+    {
+        return SIZE - static_cast<Index>(head - Load(tail));
+    }
+
+    // consumer side
+    uint16_t Available() const
+    {
+        return static_cast<Index>(Load(head) - tail);
+    }
+
+    int Peek() const
+    {
+        return (Load(head) == tail) ? -1 : buffer[tail & (SIZE - 1)];
+    }
+
+    int Pop()
+    {
+        Index current = tail;
+        if (Load(head) == current)
+        {
+            return -1;
+        }
+        uint8_t value = buffer[current & (SIZE - 1)];
+        Store(tail, static_cast<Index>(current + 1));
+        return value;
+    }
+
+    // drop whatever is waiting
+    void Clear()
+    {
+        Store(tail, Load(head));
+    }
+
+    // bytes the producer could not store, only the producer writes it
+    uint16_t Overflowed() const
+    {
+        return Load(overflowed);
+    }
+
+    // most bytes ever waiting, to size the ring against real stalls
+    uint16_t Peak() const
+    {
+        return Load(peak);
+    }
+
+    static uint16_t Size()
+    {
+        return SIZE;
+    }
+
+private:
+    uint8_t buffer[SIZE];
+    volatile Index head;
+    volatile Index tail;
+    volatile uint16_t overflowed;
+    volatile uint16_t peak;
+
+#if defined(__AVR__)
+    template <typename T> static T Load(const volatile T& value)
+    {
+        if (sizeof(T) == 1)
+        {
+            return value;
+        }
+        T result;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            result = value;
+        }
+        return result;
+    }
+
+    template <typename T> static void Store(volatile T& target, T value)
+    {
+        if (sizeof(T) == 1)
+        {
+            target = value;
+            return;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            target = value;
+        }
+    }
+#else
+    // acquire and release so the buffer byte is visible before the index that publishes it
+    template <typename T> static T Load(const volatile T& value)
+    {
+        return __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+    }
+
+    template <typename T> static void Store(volatile T& target, T value)
+    {
+        __atomic_store_n(&target, value, __ATOMIC_RELEASE);
+    }
+#endif
+};
@@ -1,4 +1,20 @@
-// button should be attached to any io pin, and when pressed, it should connect the pin to ground
+// buttons should be attached to any io pins, and when pressed, they should connect the pin to ground
+//
+// One task debounces all of them. A change on any button pin raises the
+// shared pin change flag from its interrupt, the next update samples every
+// pin and starts one shared debounce window; once no pin has changed for
+// the window the buttons that differ from their debounced state report
+// Pressed or Released. Held buttons report AutoRepeat after the repeat
+// delay and then at the repeat rate, on one timer shared by every button
+// held, restarted whenever one is pressed. Per button state is two bits,
+// sampled and debounced, in packed arrays. With nothing pressed, settling
+// or polled, an update is a flag test, and with TASK_TICKLESS the task
+// sleeps until the interrupt.
+//
+// On the AVR with the receiver on the UART any pin works through the pin
+// change interrupts. SoftwareSerial owns those vectors, so with it only
+// pins with an external interrupt (2 and 3 on the Pro Mini) wake the task,
+// others are polled every 2 ms. TaskGps.h comes first.
 
 enum ButtonState
 {
@@ -8,107 +24,228 @@ enum ButtonState
     ButtonState_Tracking =   0b10000001
 };
 
-class TaskButton : public Task
+// raised by the pin change interrupt of any button pin
+inline volatile uint8_t& ButtonPinChanged()
 {
+    static volatile uint8_t changed;
+    return changed;
+}
+
+inline void TASK_WAKE_ISR_ATTR OnButtonPinChange()
+{
+    ButtonPinChanged() = 1;
+}
+
+#if defined(__AVR__) && GPS_PORT == GPS_PORT_UART
+    #define BUTTON_PIN_CHANGE_VECTORS 1
+
+ISR(PCINT0_vect)
+{
+    OnButtonPinChange();
+}
+ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
+
+#else
+    #define BUTTON_PIN_CHANGE_VECTORS 0
+#endif
+
+template <uint8_t COUNT> class TaskButtons : public Task
+{
+    static_assert(COUNT >= 1, "TaskButtons needs a button");
+
 public:
-    typedef void(*action)(ButtonState state);
+    // button is the index of its pin in pins
+    typedef void(*action)(uint8_t button, ButtonState state);
 
-    TaskButton(action function, uint8_t pin) :
-        Task(MsToTaskTime(2)), // check every three millisecond, 1-10 ms should be ok
-        _buttonPin(pin),
+    // pins has to stay around, a const array at namespace scope
+    TaskButtons(action function, const uint8_t* pins) :
+        Task(MsToTaskTime(2)), // check every 2 ms while anything is going on, 1-10 ms should be ok
+        _buttonPins(pins),
         _callback(function)
-    { 
+    {
     };
 
+#if TASK_TICKLESS
+    // from loop(), a pin changed while the task was idle
+    void Wake()
+    {
+        if (_idle && ButtonPinChanged())
+        {
+            _idle = false;
+            setTimeInterval(MsToTaskTime(2));
+        }
+    }
+#endif
+
 private:
     static const uint16_t _debouceMs = 50; // (30-100) are good values
     static const uint16_t _repeatDelayMs = 600; // (400 - 1200) are reasonable values
     static const uint16_t _repeatRateMs = 50; // (40-1000) are reasonable
-    const uint8_t _buttonPin;
+    static const uint8_t _bytes = (COUNT + 7) / 8;
+    const uint8_t* const _buttonPins;
     const action _callback;
-    uint16_t _timer;
-    ButtonState _state;
+    uint8_t _sampled[_bytes];   // pressed when last read
+    uint8_t _pressed[_bytes];   // debounced
+    uint8_t _anyPolled;         // a pin without an interrupt
+    uint8_t _anyPressed;
+    bool _settling;             // a pin changed less than the debounce ago
+    uint16_t _changeMs;         // when the last change was sampled
+    uint16_t _repeatMs;         // when the held buttons next repeat
+#if TASK_TICKLESS
+    bool _idle;
+#endif
 
-    virtual bool OnStart()
+    static bool Bit(const uint8_t* bits, uint8_t button)
     {
-        pinMode(_buttonPin, INPUT_PULLUP);
-        _state = ButtonState_Released;
-        return true;
+        return (bits[button >> 3] >> (button & 7)) & 1;
     }
 
-    virtual void OnUpdate(uint32_t deltaTime)
+    static void SetBit(uint8_t* bits, uint8_t button, bool value)
+    {
+        if (value)
+        {
+            bits[button >> 3] |= (1 << (button & 7));
+        }
+        else
+        {
+            bits[button >> 3] &= ~(1 << (button & 7));
+        }
+    }
+
+    virtual bool OnStart()
     {
-        uint16_t deltaTimeMs = TaskTimeToMs(deltaTime);
-        ButtonState pinState = (digitalRead(_buttonPin) == LOW) ? ButtonState_Pressed : ButtonState_Released;
+        memset(_sampled, 0, sizeof(_sampled));
+        memset(_pressed, 0, sizeof(_pressed));
+        _anyPolled = 0;
+        _anyPressed = 0;
+        _settling = false;
 
-        if (pinState != (_state & ButtonState_Pressed))
+        for (uint8_t button = 0; button < COUNT; button++)
         {
-            if (pinState == ButtonState_Pressed)
+            uint8_t pin = _buttonPins[button];
+            pinMode(pin, INPUT_PULLUP);
+
+        #if BUTTON_PIN_CHANGE_VECTORS
+            if (digitalPinToPCICR(pin))
             {
-                // just read button down and start timer
-                _timer = _debouceMs;
-                _state = ButtonState_Tracking;
+                *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+                *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+                continue;
             }
-            else
+        #else
+            if (digitalPinToInterrupt(pin) != NOT_AN_INTERRUPT)
             {
-                if ((_state & ButtonState_Tracking) == ButtonState_Pressed) // not tracking
-                {
-                    // triggered released
-                    _callback(ButtonState_Released);
-                }
-                _state = ButtonState_Released;
+                attachInterrupt(digitalPinToInterrupt(pin), OnButtonPinChange, CHANGE);
+                continue;
             }
+        #endif
+            _anyPolled = 1;
         }
-        else
+
+        // a button held at start reports once it has settled
+        ButtonPinChanged() = 1;
+    #if TASK_TICKLESS
+        _idle = false;
+        setTimeInterval(MsToTaskTime(2));
+    #endif
+        return true;
+    }
+
+    virtual void OnUpdate(uint32_t deltaTime)
+    {
+        (void)deltaTime;
+
+        if (ButtonPinChanged() || _anyPolled || _settling)
         {
-            switch (_state)
+            Sample();
+        }
+        if (_anyPressed)
+        {
+            Repeat();
+        }
+
+    #if TASK_TICKLESS
+        // sleep until a pin changes, or the held buttons repeat
+        uint16_t sleepMs = 2;
+        _idle = !_anyPolled && !_settling && !ButtonPinChanged();
+        if (_idle)
+        {
+            int16_t dueMs = _repeatMs - static_cast<uint16_t>(millis());
+            sleepMs = !_anyPressed ? TASK_IDLE_MS : (dueMs > 2 ? dueMs : 2);
+        }
+        setTimeInterval(MsToTaskTime(sleepMs));
+    #endif
+    }
+
+    // reads the pins, reports the buttons that changed once they all settled
+    void Sample()
+    {
+        uint16_t now = millis();
+        ButtonPinChanged() = 0;
+
+        bool changed = false;
+        for (uint8_t button = 0; button < COUNT; button++)
+        {
+            bool pressed = digitalRead(_buttonPins[button]) == LOW;
+            if (pressed != Bit(_sampled, button))
             {
-            case ButtonState_Tracking:
-                if (deltaTimeMs >= _timer)
-                {
-                    // press debounced 
-                    _state = ButtonState_Pressed;
-                    _timer = _repeatDelayMs;
-                    _callback(ButtonState_Pressed);
-                }
-                else
-                {
-                    _timer -= deltaTimeMs;
-                }
-                break;
+                SetBit(_sampled, button, pressed);
+                changed = true;
+            }
+        }
+        if (changed)
+        {
+            _changeMs = now;
+            _settling = true;
+            return;
+        }
+        if (!_settling || static_cast<uint16_t>(now - _changeMs) < _debouceMs)
+        {
+            return;
+        }
 
-            case ButtonState_Pressed:
-                if (deltaTimeMs >= _timer)
-                {
-					// auto repeat started
-                    _state = ButtonState_AutoRepeat;
-                    _timer = _repeatRateMs;
-                    _callback(ButtonState_AutoRepeat);
-                }
-                else
+        // debounced
+        _settling = false;
+        _anyPressed = 0;
+        for (uint8_t index = 0; index < _bytes; index++)
+        {
+            uint8_t flipped = _sampled[index] ^ _pressed[index];
+            _pressed[index] = _sampled[index];
+            _anyPressed |= _pressed[index];
+            for (uint8_t bit = 0; flipped; bit++, flipped >>= 1)
+            {
+                if (flipped & 1)
                 {
-                    _timer -= deltaTimeMs;
+                    uint8_t button = (index << 3) + bit;
+                    bool pressed = Bit(_pressed, button);
+                    if (pressed)
+                    {
+                        // every held button starts its repeat over
+                        _repeatMs = now + _repeatDelayMs;
+                    }
+                    _callback(button, pressed ? ButtonState_Pressed : ButtonState_Released);
                 }
-                break;
+            }
+        }
+    }
 
-            case ButtonState_AutoRepeat:
-                if (deltaTimeMs >= _timer)
-                {
-                    // auto repeat triggered again
-                    _timer += _repeatRateMs;
-                    _callback(ButtonState_AutoRepeat);
-                }
-                else
-                {
-                    _timer -= deltaTimeMs;
-                }
-                break;
+    void Repeat()
+    {
+        uint16_t now = millis();
+        if (static_cast<int16_t>(now - _repeatMs) < 0)
+        {
+            return;
+        }
 
-            default:
-                // no way to get here due to previous if, but
-                // added to suppress the warning
-                break;
+        // auto repeat started, or triggered again
+        _repeatMs += _repeatRateMs;
+        for (uint8_t button = 0; button < COUNT; button++)
+        {
+            if (Bit(_pressed, button))
+            {
+                _callback(button, ButtonState_AutoRepeat);
             }
         }
     }
-};
\ No newline at end of file
+};
@@ -1,8 +1,51 @@
 
-#include <SoftwareSerial.h>
+#include "GpsReading.h"
+#include "NmeaSentence.h"
+#include "NmeaField.h"
+#include "GpsReceiver.h"
+#include "RawCapture.h"
+#include "ReadingQueue.h"
+#include "TrackThinner.h"
+#include "TaskStats.h"
+#include "TaskSleep.h"
 
-#define READINGS_SIZE 10
-#define NMEA_MESSAGE_BUFFER_SIZE 13
+// where the receiver is connected: SoftwareSerial on any two pins, or the
+// hardware UART with an interrupt fed ring that survives long SD card writes
+#define GPS_PORT_SOFTWARE 0
+#define GPS_PORT_UART 1
+#ifndef GPS_PORT
+#define GPS_PORT GPS_PORT_SOFTWARE
+#endif
+
+#if GPS_PORT == GPS_PORT_UART
+    #include "GpsUart.h"
+    typedef GpsUart GpsPort;
+#else
+    #include <SoftwareSerial.h>
+    typedef SoftwareSerial GpsPort;
+#endif
+
+#if GPS_PORT == GPS_PORT_UART
+    #define GPS_RX_BUFFER_SIZE GPS_RX_RING_SIZE
+#elif defined(_SS_MAX_RX_BUFF)
+    #define GPS_RX_BUFFER_SIZE _SS_MAX_RX_BUFF
+#else
+    #define GPS_RX_BUFFER_SIZE 64
+#endif
+
+// tickless, how long TaskGps leaves the port once a byte woke it, half the
+// receive buffer at the line speed so the other half covers a late update
+#ifndef GPS_WAKE_MS
+#define GPS_WAKE_MS (GPS_RX_BUFFER_SIZE / 2 * 10000UL / GPS_LINE_BAUD)
+#endif
+
+// sentences that have to arrive with the same UTC time before a reading is
+// made from them, RMC brings date, position and status, GGA altitude and satellites
+#define GPS_EPOCH_RMC 0b00000001
+#define GPS_EPOCH_GGA 0b00000010
+#ifndef GPS_EPOCH_SENTENCES
+#define GPS_EPOCH_SENTENCES (GPS_EPOCH_RMC | GPS_EPOCH_GGA)
+#endif
 
 #ifdef WEMOS_D1_MINI
     #define NMEA_MESSAGE_READ_PIN D4
@@ -20,78 +63,316 @@ enum GPSFIXTYPE
     GPSFIXTYPE_3DFIX
 };
 
-enum NMEA_SENTENCE
+
+
+// sentences seen since the task started
+struct GpsSentenceCounters
+{
+    uint32_t accepted;  // checksum matched, fields committed
+    uint32_t rejected;  // checksum missing a digit or not matching
+    uint32_t truncated; // cut off by a new '$' or a line end
+    uint32_t overflows; // updates that found bytes dropped by the serial port
+};
+
+// epochs, the readings assembled from sentences sharing a UTC time
+struct GpsEpochCounters
 {
-    NMEA_SENTENCE_Unknown = -1,
-    NMEA_SENTENCE_GPRMC,
-    NMEA_SENTENCE_GPVTG,
-    NMEA_SENTENCE_GPGGA,
-    NMEA_SENTENCE_GPGSA,
-    NMEA_SENTENCE_GPGSV,
-    NMEA_SENTENCE_GPGLL,
-    NMEA_SENTENCE_GNGLL,
-    NMEA_SENTENCE_BDGSA,
-    NMEA_SENTENCE_BDGSV,
-    NMEA_SENTENCE_GNRMC,
-    NMEA_SENTENCE_GNGGA,
-    NMEA_SENTENCE_GNVTG,
-    NMEA_SENTENCE_GNGSV,
-    NMEA_SENTENCE_GNGSA
+    uint32_t completed; // all required sentences arrived with a valid fix, reading made
+    uint32_t voided;    // complete but RMC status V or GGA fix quality 0, dropped
+    uint32_t abandoned; // a new time arrived before all required sentences did
 };
 
+// receiver configuration commands, see GpsReceiver.h
+struct GpsConfigCounters
+{
+    uint8_t acked;      // acknowledged, or a sentence arrived at the new baud
+    uint8_t refused;    // answered with a failure or kept the old baud, the receiver does not support it
+    uint8_t timedOut;   // no answer after GPS_CONFIG_TRIES
+};
+
+// course, speed and accuracy from the last sentences that had them
+#define GPS_MOTION_SPEED    0b00000001
+#define GPS_MOTION_COURSE   0b00000010
+#define GPS_MOTION_HDOP     0b00000100
+#define GPS_MOTION_QUALITY  0b00001000
+
+struct GpsMotion
+{
+    uint16_t speed;         // hundredths of a knot, RMC
+    uint16_t course;        // hundredths of a degree true, RMC
+    uint16_t hdop;          // hundredths, GGA
+    uint8_t fixQuality;     // GGA, 0 no fix, 1 GPS, 2 differential
+    uint8_t flags;          // GPS_MOTION_*
+};
+
+// the motion of the sentence being read and of the last one committed,
+// nothing at all in a build that decodes none
+template <bool KEEP>
+struct GpsMotionState
+{
+    GpsMotion pending;
+    GpsMotion current;
+
+    void Reset()
+    {
+        memset(&pending, 0, sizeof(pending));
+        memset(&current, 0, sizeof(current));
+    }
+
+    void Begin()
+    {
+        pending = current;
+    }
+
+    void Commit()
+    {
+        current = pending;
+    }
+
+    GpsMotion* Pending()
+    {
+        return &pending;
+    }
+};
 
-struct GpsReading 
+template <>
+struct GpsMotionState<false>
 {
-    char date[7];
-    char time[11];
-    char latitude[16];
-    char latitudeDirection[2];
-    char longitude[17];
-    char longitudeDirection[2];
-    char altitude[8];
-    char satelliteCount[3];
+    void Reset() {}
+    void Begin() {}
+    void Commit() {}
+
+    // only reached behind KeepsMotion(), which is false
+    GpsMotion* Pending()
+    {
+        return NULL;
+    }
 };
 
-typedef void(*GpsReadingComplete)(const GpsReading* readings, uint8_t count);
 typedef void(*GpsFixChanged)(GPSFIXTYPE gpsFixType);
 
-class TaskGps : public Task
+// sentences decoded, by NMEA_SENTENCE; with GSA left out the fix type for the
+// LED comes from the GGA fix quality, without GGA as well from the RMC status
+#define GPS_SENTENCE(kind) (1U << (kind))
+#ifndef GPS_SENTENCES
+#define GPS_SENTENCES (GPS_SENTENCE(NMEA_SENTENCE_RMC) | GPS_SENTENCE(NMEA_SENTENCE_GGA) | GPS_SENTENCE(NMEA_SENTENCE_GSA))
+#endif
+
+// GpsReading fields decoded, GPS_READING_FIELDS, comes with GpsReading.h
+
+// GpsMotion fields decoded
+#ifndef GPS_MOTION_FIELDS
+#define GPS_MOTION_FIELDS (GPS_MOTION_SPEED | GPS_MOTION_COURSE | GPS_MOTION_HDOP | GPS_MOTION_QUALITY)
+#endif
+
+// what a TaskGpsT is built for. The masks are constants, so the sentences
+// and fields left out are compiled out of the parser; a reading never gets
+// the flags of a field that is not decoded. FixChanged is anything callable
+// with a GPSFIXTYPE, Queue a ReadingQueueT of any depth.
+struct GpsConfig
+{
+    static constexpr uint16_t Sentences = GPS_SENTENCES;
+    static constexpr uint8_t Fields = GPS_READING_FIELDS;
+    static constexpr uint8_t MotionFields = GPS_MOTION_FIELDS;
+    static constexpr uint8_t EpochSentences = GPS_EPOCH_SENTENCES;
+    static constexpr uint8_t ReadPin = NMEA_MESSAGE_READ_PIN;
+    static constexpr uint8_t WritePin = NMEA_MESSAGE_WRITE_PIN;
+    typedef ReadingQueue Queue;
+    typedef GpsFixChanged FixChanged;
+};
+
+template <class CONFIG>
+class TaskGpsT : public Task
 {
 public:
-    TaskGps(GpsReadingComplete gpsReadingCompleteFunction, GpsFixChanged gpsFixChangedCallbackFunction) : // pass any custom arguments you need
+    typedef typename CONFIG::Queue Queue;
+    typedef typename CONFIG::FixChanged FixChanged;
+
+    static_assert(CONFIG::EpochSentences, "an epoch needs RMC or GGA");
+    static_assert(!(CONFIG::EpochSentences & GPS_EPOCH_RMC) || (CONFIG::Sentences & GPS_SENTENCE(NMEA_SENTENCE_RMC)),
+        "the epoch waits for RMC, decode it");
+    static_assert(!(CONFIG::EpochSentences & GPS_EPOCH_GGA) || (CONFIG::Sentences & GPS_SENTENCE(NMEA_SENTENCE_GGA)),
+        "the epoch waits for GGA, decode it");
+    static_assert(!(CONFIG::Fields & ~Queue::Fields), "the queue slots leave out fields the config decodes");
+
+    // completed readings go to readingQueue, TaskLogWriter writes them out
+    TaskGpsT(Queue& readingQueue, FixChanged gpsFixChangedCallbackFunction) : // pass any custom arguments you need
         Task(MsToTaskTime(2)), // check every 2 ms
-        gpsReadingCompleteCallback(gpsReadingCompleteFunction),
+        queue(readingQueue),
         gpsFixChangedCallback(gpsFixChangedCallbackFunction),
-        gps(NMEA_MESSAGE_READ_PIN, NMEA_MESSAGE_WRITE_PIN),
-        activeReadingIndex(0),
-        bufferIndex(0),
+        gps(CONFIG::ReadPin, CONFIG::WritePin),
         segment(-1),
         sentence(NMEA_SENTENCE_Unknown),
-        gpsFixType(GPSFIXTYPE_NOFIX)
+        gpsFixType(GPSFIXTYPE_NOFIX),
+        pendingFixType(GPSFIXTYPE_NOFIX),
+        pendingMilliseconds(0),
+        pendingVoid(false),
+        epochSentences(0),
+        epochTime(0),
+        epochVoid(false),
+        queueBackedUp(false),
+    #if GPS_RAW_CAPTURE
+        rawBytesCallback(NULL),
+        rawCaptured(0),
+    #endif
+    #if TASK_TICKLESS
+        idle(false),
+    #endif
+        checksum(0),
+        checksumDigits(-1)
+    #if GPS_RECEIVER != GPS_RECEIVER_NONE
+        ,
+        configIndex(0),
+        configTries(0),
+        configSent(false),
+        configSentMs(0),
+        lastByteMs(0),
+        acceptedAtSend(0),
+        baudBytes(0)
+    #endif
     { 
-        memset(readings, 0, sizeof(readings));
+        memset(&pending, 0, sizeof(pending));
+        motion.Reset();
+        memset(&epoch, 0, sizeof(epoch));
+        memset(&counters, 0, sizeof(counters));
+        memset(&epochCounters, 0, sizeof(epochCounters));
+        memset(&configCounters, 0, sizeof(configCounters));
 
-        gps.begin(9600);
+        gps.begin(GPS_BAUD);
     };
 
+    const GpsSentenceCounters& SentenceCounters() const
+    {
+        return counters;
+    }
+
+    const GpsEpochCounters& EpochCounters() const
+    {
+        return epochCounters;
+    }
+
+    // only in a build that decodes some of it
+    const GpsMotion& Motion() const
+    {
+        return motion.current;
+    }
+
+    const GpsConfigCounters& ConfigCounters() const
+    {
+        return configCounters;
+    }
+
+#if LOG_THIN
+    const TrackThinCounters& ThinCounters() const
+    {
+        return thinner.Counters();
+    }
+#endif
+
+#if GPS_RAW_CAPTURE
+    // every byte received goes to rawBytes, set before the task starts
+    void CaptureRaw(GpsRawBytes rawBytes)
+    {
+        rawBytesCallback = rawBytes;
+    }
+
+    uint32_t RawCaptured() const
+    {
+        return rawCaptured;
+    }
+#endif
+
+#if TASK_TICKLESS
+    // from loop(), a byte has arrived while the task was idle
+    void Wake()
+    {
+        if (idle && getTaskState() == TaskState_Running && gps.available())
+        {
+            idle = false;
+            setTimeInterval(MsToTaskTime(GPS_WAKE_MS));
+        }
+    }
+#endif
+
+    // still sending commands to the receiver
+    bool Configuring() const
+    {
+    #if GPS_RECEIVER != GPS_RECEIVER_NONE
+        return configIndex < GPS_CONFIG_COMMAND_COUNT;
+    #else
+        return false;
+    #endif
+    }
 
 
 private:
     // put member variables here that are scoped to this object
-    GpsReadingComplete gpsReadingCompleteCallback;
-    GpsFixChanged gpsFixChangedCallback;
+    Queue& queue;
+    FixChanged gpsFixChangedCallback;
 
-    SoftwareSerial gps;
+    GpsPort gps;
    
-    GpsReading readings[READINGS_SIZE];
-    uint8_t activeReadingIndex;
-
-    char segmentBuffer[NMEA_MESSAGE_BUFFER_SIZE];
-    int8_t bufferIndex;
+    NmeaField field;        // the field being read, decoded as it arrives
     int8_t segment;
     NMEA_SENTENCE sentence;
     GPSFIXTYPE gpsFixType;
 
+    // fields of the sentence being read, committed once its checksum matches
+    GpsReading pending;
+    GPSFIXTYPE pendingFixType;
+    uint16_t pendingMilliseconds;
+    bool pendingVoid;
+    GpsMotionState<CONFIG::MotionFields != 0> motion;
+
+    // the reading being assembled from the sentences of one UTC time
+    GpsReading epoch;
+    uint8_t epochSentences;     // GPS_EPOCH_* received so far
+    uint32_t epochTime;         // packed time and milliseconds of the epoch
+    bool epochVoid;
+    bool queueBackedUp;         // an epoch went to the last free slot, the writer goes next
+#if TASK_TICKLESS
+    bool idle;                  // the port was empty, sleeping until a byte arrives
+#endif
+    GpsEpochCounters epochCounters;
+#if LOG_THIN
+    TrackThinner thinner;   // between the epochs and the queue
+#endif
+#if GPS_RAW_CAPTURE
+    GpsRawBytes rawBytesCallback;
+    NmeaFixScanner fixScanner;
+    uint32_t rawCaptured;
+#endif
+
+    uint8_t checksum;       // running XOR of the characters between '$' and '*'
+    int8_t checksumDigits;  // hex digits read after '*', -1 before it
+    GpsSentenceCounters counters;
+
+    GpsConfigCounters configCounters;
+#if GPS_RECEIVER != GPS_RECEIVER_NONE
+    // receiver configuration, once after power up as the receiver keeps it
+    uint8_t configIndex;        // command being sent
+    uint8_t configTries;
+    bool configSent;            // waiting for the answer
+    uint32_t configSentMs;
+    uint32_t lastByteMs;
+    uint32_t acceptedAtSend;
+    uint16_t baudBytes;         // received since the last command went out
+#endif
+#if GPS_RECEIVER == GPS_RECEIVER_MTK
+    // $PMTK001,command,flag
+    bool mtkAck;
+    uint16_t ackCommand;
+    char ackFlag;
+#elif GPS_RECEIVER == GPS_RECEIVER_UBLOX
+    // UBX frame being read, only two byte ACK payloads are kept
+    uint8_t ubxIndex;           // bytes read, sync included, 0 outside a frame
+    uint8_t ubxClass;
+    uint8_t ubxId;
+    uint8_t ubxPayload[2];
+    uint8_t ubxCheckA;
+    uint8_t ubxCheckB;
+#endif
+
     virtual bool OnStart() // optional
     {
         #ifdef SIMPLE_DEBUG
@@ -105,11 +386,34 @@ private:
         #endif
 
         // init state 
-        activeReadingIndex = 0;
-        bufferIndex = 0;
         segment = -1;
         sentence = NMEA_SENTENCE_Unknown;
         gpsFixType = GPSFIXTYPE_NOFIX;
+        checksumDigits = -1;
+        epochSentences = 0;
+        memset(&counters, 0, sizeof(counters));
+        memset(&epochCounters, 0, sizeof(epochCounters));
+        #if LOG_THIN
+            thinner.Reset();
+        #endif
+        #if GPS_RAW_CAPTURE
+            fixScanner.Reset();
+            rawCaptured = 0;
+        #endif
+
+        #if GPS_RECEIVER != GPS_RECEIVER_NONE
+            configSent = false;
+            lastByteMs = millis();
+        #endif
+        #if GPS_RECEIVER == GPS_RECEIVER_MTK
+            mtkAck = false;
+        #elif GPS_RECEIVER == GPS_RECEIVER_UBLOX
+            ubxIndex = 0;
+        #endif
+        #if TASK_TICKLESS
+            idle = false;
+            setTimeInterval(MsToTaskTime(2));
+        #endif
 
         return true;
     }
@@ -126,345 +430,866 @@ private:
             Serial.println(F("GPS task stopped."));
         #endif
         
-        // if we have any readings when asked to stop
-        if (activeReadingIndex)
-        {
-            // inform gpsReadingCompleteCallback on number of readings we have
-            gpsReadingCompleteCallback(readings, activeReadingIndex);
-            memset(readings, 0, sizeof(readings));
-        }
+        #if LOG_THIN
+            thinner.Flush();
+            QueueThinned();
+        #endif
+
+        // the writer takes the readings collected so far as a last batch
+        queue.Flush();
     }
 
     virtual void OnUpdate(uint32_t deltaTime)
     {
-        while (gps.available()) 
+        STATS_TASK_SCOPE(gpsUpdate, deltaTime);
+
+        #if GPS_RECEIVER != GPS_RECEIVER_NONE
+            if (gps.available())
+            {
+                lastByteMs = millis();
+            }
+            if (configIndex < GPS_CONFIG_COMMAND_COUNT)
+            {
+                Configure();
+            }
+        #endif
+
+        if (gps.overflow())
+        {
+            counters.overflows++;
+        }
+
+        #if GPS_RAW_CAPTURE
+            if (!Configuring())
+            {
+                ReadRaw();
+                #if TASK_TICKLESS
+                    idle = !gps.available();
+                    setTimeInterval(MsToTaskTime(idle ? TASK_IDLE_MS : 2));
+                #endif
+                return;
+            }
+        #endif
+
+        #if GPS_RAW_CAPTURE
+            // the answers to the configuration are captured too, in chunks
+            // as ReadRaw() does, and the scanner keeps up for when it takes over
+            uint8_t chunk[GPS_RAW_CHUNK_SIZE];
+            uint8_t chunkLength = 0;
+        #endif
+
+        queueBackedUp = false;
+        while (!queueBackedUp && gps.available()) 
         {
             char lastChar = gps.read();
 
-            if (lastChar == ',' || lastChar == '*') 
+            #if GPS_RECEIVER != GPS_RECEIVER_NONE && GPS_CONFIG_BAUD
+                baudBytes++;
+            #endif
+
+            #if GPS_RAW_CAPTURE
+                chunk[chunkLength++] = lastChar;
+                if (chunkLength == GPS_RAW_CHUNK_SIZE)
+                {
+                    CaptureChunk(chunk, chunkLength);
+                    chunkLength = 0;
+                }
+                fixScanner.Scan(lastChar);
+            #endif
+
+            #if GPS_RECEIVER == GPS_RECEIVER_UBLOX
+                if (ubxIndex || (segment < 0 && static_cast<uint8_t>(lastChar) == UBX_SYNC_1))
+                {
+                    ReadUbxByte(lastChar);
+                    continue;
+                }
+            #endif
+
+            if (lastChar == '$') 
+            {
+                if (segment >= 0)
+                {
+                    // the previous sentence never got to its checksum
+                    counters.truncated++;
+                }
+
+                // start of a new sentence
+                sentence = NMEA_SENTENCE_Unknown;
+                segment = 0;
+                field.Begin(NMEA_FIELD_Address);
+                checksum = 0;
+                checksumDigits = -1;
+            }
+            else if (segment < 0)
+            {
+                // line ends and noise between sentences
+            }
+            else if (lastChar == '\r' || lastChar == '\n')
+            {
+                if (checksumDigits != 0)
+                {
+                    counters.truncated++;
+                }
+                else
+                {
+                    // '*' without any digits
+                    counters.rejected++;
+                }
+                segment = -1;
+            }
+            else if (checksumDigits >= 0)
             {
+                ReadChecksumDigit(lastChar);
+            }
+            else if (lastChar == ',' || lastChar == '*') 
+            {
+                if (lastChar == ',')
+                {
+                    checksum ^= lastChar;
+                }
+                else
+                {
+                    checksumDigits = 0;
+                }
+
                 // end of segment
                 if (segment == 0)
                 {
-                    if (IdentifiedSentence())
-                    {
-                        activeReadingIndex++;
-                        if (activeReadingIndex == READINGS_SIZE)
-                        {
-                            activeReadingIndex = 0;
-                            gpsReadingCompleteCallback(readings, READINGS_SIZE);
-                            memset(readings, 0, sizeof(readings));
-                        }
-                    }
+                    BeginSentence();
                 }
                 else
                 {
-                    segmentBuffer[bufferIndex] = '\0'; // null terminate current segment for str use
-                    ProcessSegmentBuffer();
+                    ProcessField();
                 }
 
-                segment++;
-                bufferIndex = 0;
+                // a sentence with more fields than any known one stays on its last
+                if (segment < 127)
+                {
+                    segment++;
+                }
+                field.Begin(FieldKind());
             }
-            else if (lastChar == '$') 
+            else
             {
-                // start of a new sentence
-                sentence = NMEA_SENTENCE_Unknown;
-                segment = 0;
-                bufferIndex = 0;
+                // decoded straight away, nothing to buffer
+                checksum ^= lastChar;
+                field.Read(lastChar);
             }
-            else 
+        }
+
+        #if GPS_RAW_CAPTURE
+            if (chunkLength)
             {
-                // buffer chars for segment decoding
-                segmentBuffer[bufferIndex] = lastChar;
-                bufferIndex++;
+                CaptureChunk(chunk, chunkLength);
             }
+        #endif
+
+        #if TASK_TICKLESS
+            // configuring runs on timeouts, a backed up queue leaves bytes behind
+            idle = !Configuring() && !gps.available();
+            setTimeInterval(MsToTaskTime(idle ? TASK_IDLE_MS : 2));
+        #endif
+    }
+
+#if GPS_RAW_CAPTURE
+    // the port as it is to the sketch, in chunks, only GSA, GGA and RMC looked at for the fix
+    void ReadRaw()
+    {
+        uint8_t chunk[GPS_RAW_CHUNK_SIZE];
+        while (gps.available())
+        {
+            uint8_t length = 0;
+            while (length < GPS_RAW_CHUNK_SIZE && gps.available())
+            {
+                char value = gps.read();
+                chunk[length++] = value;
+
+                uint8_t fixType = fixScanner.Scan(value);
+                if (fixType && fixType != gpsFixType)
+                {
+                    gpsFixType = static_cast<GPSFIXTYPE>(fixType);
+                    gpsFixChangedCallback(gpsFixType);
+                }
+            }
+            CaptureChunk(chunk, length);
         }
     }
 
-    bool IdentifiedSentence()
+    void CaptureChunk(const uint8_t* chunk, uint8_t length)
     {
-        #ifdef SERIAL_DEBUG
-            Serial.print(F("Sentence start: "));
-            for (int index = 0; index < 5; index++)
+        rawBytesCallback(chunk, length);
+        rawCaptured += length;
+    }
+#endif
+
+    void ReadChecksumDigit(char digit)
+    {
+        uint8_t value;
+        if (digit >= '0' && digit <= '9')
+        {
+            value = digit - '0';
+        }
+        else if (digit >= 'A' && digit <= 'F')
+        {
+            value = digit - 'A' + 10;
+        }
+        else
+        {
+            counters.rejected++;
+            segment = -1;
+            return;
+        }
+
+        // high nibble first
+        if ((checksumDigits == 0 ? (checksum >> 4) : (checksum & 0x0f)) != value)
+        {
+            counters.rejected++;
+            segment = -1;
+            return;
+        }
+
+        checksumDigits++;
+        if (checksumDigits == 2)
+        {
+            counters.accepted++;
+            CommitSentence();
+            segment = -1;
+        }
+    }
+
+#if GPS_RECEIVER != GPS_RECEIVER_NONE
+    // sends the current command when the line is quiet and waits for its answer
+    void Configure()
+    {
+        uint32_t now = millis();
+        if (!configSent)
+        {
+            if (now - lastByteMs < GPS_CONFIG_QUIET_MS)
             {
-                Serial.print(segmentBuffer[index]);
+                return;
             }
-            Serial.println();
-        #endif
 
-        if (segmentBuffer[0] == 'B')
+            #ifdef SERIAL_DEBUG
+                Serial.print(F("GPS config command "));
+                Serial.println(configIndex);
+            #endif
+
+            SendGpsConfigCommand(gps, configIndex);
+            if (IsGpsConfigBaudCommand(configIndex))
+            {
+                gps.begin(GPS_CONFIG_BAUD);
+            }
+            configSent = true;
+            configSentMs = millis();
+            acceptedAtSend = counters.accepted;
+            baudBytes = 0;
+        }
+        else if (IsGpsConfigBaudCommand(configIndex) && counters.accepted != acceptedAtSend)
+        {
+            // a valid sentence at the new speed
+            configCounters.acked++;
+            NextConfigCommand();
+        }
+        else if (IsGpsConfigBaudCommand(configIndex) && baudBytes >= GPS_CONFIG_BAUD_PROBE_BYTES)
         {
-            // BD sentence
-            if (segmentBuffer[1] == 'N')
+            // still talking at the old speed, trying again would cost a fix each time
+            gps.begin(GPS_BAUD);
+            configCounters.refused++;
+            NextConfigCommand();
+        }
+        else if (now - configSentMs >= GPS_CONFIG_ACK_TIMEOUT_MS)
+        {
+            if (IsGpsConfigBaudCommand(configIndex))
+            {
+                gps.begin(GPS_BAUD);
+            }
+            configSent = false;
+            configTries++;
+            if (configTries >= GPS_CONFIG_TRIES)
             {
+                configCounters.timedOut++;
+                NextConfigCommand();
+            }
+        }
+    }
 
+    void NextConfigCommand()
+    {
+        configIndex++;
+        configTries = 0;
+        configSent = false;
+    }
+
+    void ConfigAnswered(uint16_t key, bool success)
+    {
+        if (configSent && configIndex < GPS_CONFIG_COMMAND_COUNT && key == GpsConfigAckKey(configIndex))
+        {
+            #ifdef SERIAL_DEBUG
+                Serial.print(F("GPS config answer "));
+                Serial.println(success);
+            #endif
+
+            if (success)
+            {
+                configCounters.acked++;
             }
+            else
+            {
+                configCounters.refused++;
+            }
+            NextConfigCommand();
+        }
+    }
+#endif
+
+#if GPS_RECEIVER == GPS_RECEIVER_UBLOX
+    void ReadUbxByte(uint8_t value)
+    {
+        if (ubxIndex == 0)
+        {
+            // first sync byte
+            ubxCheckA = 0;
+            ubxCheckB = 0;
+            ubxIndex = 1;
+            return;
+        }
+        if (ubxIndex == 1)
+        {
+            ubxIndex = (value == UBX_SYNC_2) ? 2 : 0;
+            return;
         }
-        else if (segmentBuffer[0] == 'G')
+
+        if (ubxIndex < 8)
         {
-            // GPS sentence
-            if (segmentBuffer[1] == 'P')
+            // class, id, length and payload are checksummed
+            ubxCheckA += value;
+            ubxCheckB += ubxCheckA;
+            switch (ubxIndex)
             {
-                if (segmentBuffer[2] == 'R')
-                {
-                    // $GPRMC: Time, date, position, course and speed data
-                    sentence = NMEA_SENTENCE_GPRMC;
-                    #ifdef SERIAL_DEBUG
-                        Serial.println(F("Interpreting NMEA_SENTENCE_GPRMC"));
-                    #endif
-                }
-                else if (segmentBuffer[2] == 'G')
-                {
-                    if (segmentBuffer[3] == 'G')
-                    {
-                        // $GPGGA: Time, position, and fix related data of the receiver.
-                        sentence = NMEA_SENTENCE_GPGGA;
-                        #ifdef SERIAL_DEBUG
-                            Serial.println(F("Interpreting NMEAIAL_DEBUG_GPGGA"));
-                        #endif
-                    }
-                    else if (segmentBuffer[3] == 'S')
-                    {
-                        if (segmentBuffer[4] == 'A')
-                        {
-                            // $GPGSA: IDs of satellites which are used for position fix.
-                            sentence = NMEA_SENTENCE_GPGSA;
-                            #ifdef SERIAL_DEBUG
-                                Serial.println(F("Interpreting NMEA_SENTENCE_GPGSA"));
-                            #endif
-                        }
-                        else if (segmentBuffer[4] == 'V')
-                        {
-                            // $GPGSV: Satellite information about elevation, azimuth and CNR.
-                            sentence = NMEA_SENTENCE_GPGSV;
-                            #ifdef SERIAL_DEBUG
-                                Serial.println(F("Interpreting NMEA_SENTENCE_GPGSV"));
-                            #endif
-                        }
-                    }
-                    else if (segmentBuffer[3] == 'L')
-                    {
-                        // $GPGLL: Position, time and fix status.
-                        sentence = NMEA_SENTENCE_GPGLL;
-                        #ifdef SERIAL_DEBUG
-                            Serial.println(F("Interpreting NMEA_SENTENCE_GPGLL"));
-                        #endif
-                    }
-                }
-                else if (segmentBuffer[2] == 'V')
+            case 2:
+                ubxClass = value;
+                break;
+            case 3:
+                ubxId = value;
+                break;
+            case 4:
+            case 5:
+                if (value != ((ubxIndex == 4) ? 2 : 0))
                 {
-                    // $GPVTG: Course and speed relative to the ground.
-                    sentence = NMEA_SENTENCE_GPVTG;
-                    #ifdef SERIAL_DEBUG
-                        Serial.println(F("Interpreting NMEAIAL_DEBUG_GPVTG"));
-                    #endif
+                    // not an ACK, nothing else is enabled on the port
+                    ubxIndex = 0;
+                    return;
                 }
+                break;
+            default:
+                ubxPayload[ubxIndex - 6] = value;
+                break;
             }
-            else if (segmentBuffer[1] == 'N')
+            ubxIndex++;
+            return;
+        }
+
+        if (ubxIndex == 8)
+        {
+            ubxIndex = (value == ubxCheckA) ? 9 : 0;
+            return;
+        }
+
+        ubxIndex = 0;
+        if (value == ubxCheckB && ubxClass == UBX_CLASS_ACK)
+        {
+            ConfigAnswered((ubxPayload[0] << 8) | ubxPayload[1], ubxId == UBX_ID_ACK_ACK);
+        }
+    }
+#endif
+
+    // the address is known, fields go to pending until the checksum is read
+    void BeginSentence()
+    {
+        IdentifiedSentence();
+        #if GPS_RECEIVER == GPS_RECEIVER_MTK
+            mtkAck = (field.Length() == 7 && strncmp_P(field.Text(), PSTR("PMTK001"), 7) == 0);
+        #endif
+        memset(&pending, 0, sizeof(pending));
+        pendingFixType = gpsFixType;
+        pendingMilliseconds = 0;
+        pendingVoid = false;
+        motion.Begin();
+    }
+
+    void CommitSentence()
+    {
+        #if GPS_RECEIVER == GPS_RECEIVER_MTK
+            if (mtkAck)
             {
-                if (segmentBuffer[2] == 'R')
-                {
-                    // $GPRMC: Time, date, position, course and speed data
-                    sentence = NMEA_SENTENCE_GNRMC;
-                    #ifdef SERIAL_DEBUG
-                        Serial.println(F("Interpreting NMEA_SENTENCE_GPRMC"));
-                    #endif
-                }
-                else if (segmentBuffer[2] == 'G')
-                {
-                    if (segmentBuffer[3] == 'G')
-                    {
-                        // $GPGGA: Time, position, and fix related data of the receiver.
-                        sentence = NMEA_SENTENCE_GNGGA;
-                        #ifdef SERIAL_DEBUG
-                            Serial.println(F("Interpreting NMEAIAL_DEBUG_GPGGA"));
-                        #endif
-                        return true;  // start of a new reading, for now we trigger on this
-// $REVIEW - need to trigger after the last sentence we require has been fully read
+                ConfigAnswered(ackCommand, ackFlag == '3');
+                return;
+            }
+        #endif
 
-                    }
-                    else if (segmentBuffer[3] == 'S')
-                    {
-                        if (segmentBuffer[4] == 'A')
-                        {
-                            // $GPGSA: IDs of satellites which are used for position fix.
-                            sentence = NMEA_SENTENCE_GNGSA;
-                            #ifdef SERIAL_DEBUG
-                                Serial.println(F("Interpreting NMEA_SENTENCE_GPGSA"));
-                            #endif
-                        }
-                        else if (segmentBuffer[4] == 'V')
-                        {
-                            // $GPGSV: Satellite information about elevation, azimuth and CNR.
-                            sentence = NMEA_SENTENCE_GNGSV;
-                            #ifdef SERIAL_DEBUG
-                                Serial.println(F("Interpreting NMEA_SENTENCE_GPGSV"));
-                            #endif
-                        }
-                    }
-                    else if (segmentBuffer[3] == 'L')
-                    {
-                        // $GPGLL: Position, time and fix status.
-                        sentence = NMEA_SENTENCE_GNGLL;
-                        #ifdef SERIAL_DEBUG
-                            Serial.println(F("Interpreting NMEA_SENTENCE_GPGLL"));
-                        #endif
-                    }
-                }
-                else if (segmentBuffer[2] == 'V')
-                {
-                    // $GPVTG: Course and speed relative to the ground.
-                    sentence = NMEA_SENTENCE_GNVTG;
-                    #ifdef SERIAL_DEBUG
-                        Serial.println(F("Interpreting NMEAIAL_DEBUG_GPVTG"));
-                    #endif
-                }
+        motion.Commit();
+        if (pendingFixType != gpsFixType)
+        {
+            gpsFixChangedCallback(pendingFixType);
+            gpsFixType = pendingFixType;
+        }
+
+        uint8_t epochSentence = 0;
+        if (sentence == NMEA_SENTENCE_RMC)
+        {
+            epochSentence = GPS_EPOCH_RMC;
+        }
+        else if (sentence == NMEA_SENTENCE_GGA)
+        {
+            epochSentence = GPS_EPOCH_GGA;
+        }
+        if (!(epochSentence & CONFIG::EpochSentences) || !(pending.flags & GPS_READING_TIME))
+        {
+            return;
+        }
+
+        uint32_t time = ((pending.dateTime & GPS_DATETIME_TIME_MASK) << 10) | pendingMilliseconds;
+        if (epochSentences && time != epochTime)
+        {
+            // the receiver moved on without sending everything we need
+            epochCounters.abandoned++;
+            epochSentences = 0;
+        }
+        if (!epochSentences)
+        {
+            memset(&epoch, 0, sizeof(epoch));
+            epoch.dateTime = pending.dateTime & GPS_DATETIME_TIME_MASK;
+            epoch.flags = GPS_READING_TIME;
+            epochTime = time;
+            epochVoid = false;
+        }
+
+        MergeReading(pending);
+        epochVoid = epochVoid || pendingVoid;
+        epochSentences |= epochSentence;
+
+        if (epochSentences == CONFIG::EpochSentences)
+        {
+            epochSentences = 0;
+            CompleteEpoch();
+        }
+    }
+
+    // the fields the sentence had into the epoch reading
+    void MergeReading(const GpsReading& reading)
+    {
+        if (Keeps(GPS_READING_DATE) && (reading.flags & GPS_READING_DATE))
+        {
+            epoch.dateTime = (epoch.dateTime & GPS_DATETIME_TIME_MASK) | (reading.dateTime & GPS_DATETIME_DATE_MASK);
+        }
+        if (Keeps(GPS_READING_POSITION) && (reading.flags & GPS_READING_POSITION))
+        {
+            epoch.latitude = reading.latitude;
+            epoch.longitude = reading.longitude;
+            epoch.flags &= ~GPS_READING_DECIMALS_MASK;
+        }
+        if (Keeps(GPS_READING_ALTITUDE) && (reading.flags & GPS_READING_ALTITUDE))
+        {
+            epoch.altitude = reading.altitude;
+        }
+        if (Keeps(GPS_READING_SATELLITES) && (reading.flags & GPS_READING_SATELLITES))
+        {
+            epoch.satelliteCount = reading.satelliteCount;
+        }
+        epoch.flags |= reading.flags;
+    }
+
+    void CompleteEpoch()
+    {
+        STATS_SCOPE(gpsEpoch);
+
+        if (epochVoid)
+        {
+            // no fix, nothing worth writing
+            epochCounters.voided++;
+            return;
+        }
+
+        epochCounters.completed++;
+    #if LOG_THIN
+        if (thinner.Add(epoch))
+        {
+            QueueThinned();
+        }
+    #else
+        queue.Add(epoch);
+    #endif
+
+        // leave the rest in the port for the next update, the writer
+        // catches up with a whole slot in between
+        queueBackedUp = queue.Queued() >= Queue::Slots - 1;
+    }
+
+#if LOG_THIN
+    void QueueThinned()
+    {
+        while (const GpsReading* reading = thinner.Next())
+        {
+            queue.Add(*reading);
+        }
+    }
+#endif
+
+    static constexpr bool Decodes(NMEA_SENTENCE kind)
+    {
+        return CONFIG::Sentences & GPS_SENTENCE(kind);
+    }
+
+    static constexpr bool Keeps(uint8_t readingFlag)
+    {
+        return CONFIG::Fields & readingFlag;
+    }
+
+    static constexpr bool KeepsMotion(uint8_t motionFlag)
+    {
+        return CONFIG::MotionFields & motionFlag;
+    }
+
+    void IdentifiedSentence()
+    {
+        #ifdef SERIAL_DEBUG
+            Serial.print(F("Sentence start: "));
+            for (uint8_t index = 0; index < field.Length() && index < NMEA_FIELD_TEXT_SIZE; index++)
+            {
+                Serial.print(field.Text()[index]);
             }
+            Serial.println();
+        #endif
+
+        sentence = IdentifyNmeaSentence(field.Text(), field.Length());
+        if (sentence != NMEA_SENTENCE_Unknown && !Decodes(sentence))
+        {
+            // skipped like the sentences nobody decodes
+            sentence = NMEA_SENTENCE_Unknown;
         }
 
-        return false;
+        #ifdef SERIAL_DEBUG
+            Serial.print(F("Interpreting kind "));
+            Serial.println(sentence);
+        #endif
     }
 
-    void ProcessSegmentBuffer()
+    // how the field about to start is read, sentence and segment are known by now
+    NMEA_FIELD FieldKind() const
+    {
+        #if GPS_RECEIVER == GPS_RECEIVER_MTK
+            if (mtkAck)
+            {
+                // $PMTK001,command,flag
+                return (segment == 1) ? NMEA_FIELD_Number : NMEA_FIELD_Letter;
+            }
+        #endif
+
+        // fields not decoded are skipped, a sentence not decoded never gets here
+        switch (sentence)
+        {
+        case NMEA_SENTENCE_RMC:
+            // $GPRMC,074318.000,A,4735.41382,N,12212.35088,W,0.030,,170617,,,A*63
+            //        ^^^^^^^^^^ ^ ^^^^^^^^^^ ^ ^^^^^^^^^^^ ^ ^^^^^ ^ ^^^^^^
+            //        time       s latitude   d longitude   d speed c date
+            if (!Decodes(NMEA_SENTENCE_RMC))
+            {
+                break;
+            }
+            switch (segment)
+            {
+            case 1:
+                return NMEA_FIELD_Clock;
+            case 2:
+                return NMEA_FIELD_Letter;
+            case 3:
+            case 5:
+                return Keeps(GPS_READING_POSITION) ? NMEA_FIELD_Number : NMEA_FIELD_Skip;
+            case 4:
+            case 6:
+                return Keeps(GPS_READING_POSITION) ? NMEA_FIELD_Letter : NMEA_FIELD_Skip;
+            case 7:
+                return KeepsMotion(GPS_MOTION_SPEED) ? NMEA_FIELD_Number : NMEA_FIELD_Skip;
+            case 8:
+                return KeepsMotion(GPS_MOTION_COURSE) ? NMEA_FIELD_Number : NMEA_FIELD_Skip;
+            case 9:
+                return Keeps(GPS_READING_DATE) ? NMEA_FIELD_Clock : NMEA_FIELD_Skip;
+            }
+            break;
+
+        case NMEA_SENTENCE_GGA:
+            // $GPGGA,074318.000,4735.41382,N,12212.35088,W,1,08,1.01,57.2,M,-18.6,M,,*5C
+            //        ^^^^^^^^^^                            ^ ^^ ^^^^ ^^^^
+            //        time                      quality, satellites, HDOP, altitude
+            if (!Decodes(NMEA_SENTENCE_GGA))
+            {
+                break;
+            }
+            switch (segment)
+            {
+            case 1:
+                return NMEA_FIELD_Clock;
+            case 6:
+                return NMEA_FIELD_Number;
+            case 7:
+                return Keeps(GPS_READING_SATELLITES) ? NMEA_FIELD_Number : NMEA_FIELD_Skip;
+            case 8:
+                return KeepsMotion(GPS_MOTION_HDOP) ? NMEA_FIELD_Number : NMEA_FIELD_Skip;
+            case 9:
+                return Keeps(GPS_READING_ALTITUDE) ? NMEA_FIELD_Number : NMEA_FIELD_Skip;
+            }
+            break;
+
+        case NMEA_SENTENCE_GSA:
+            if (Decodes(NMEA_SENTENCE_GSA) && segment == 2)
+            {
+                // fix type
+                return NMEA_FIELD_Number;
+            }
+            break;
+
+        default:
+            break;
+        }
+        return NMEA_FIELD_Skip;
+    }
+
+    // the field just ended into pending, committed with the checksum
+    void ProcessField()
     {
         #ifdef SERIAL_DEBUG
             Serial.print(F("Sentence "));
             Serial.print(sentence);
             Serial.print(F(" segment "));
             Serial.print(segment);
-            Serial.print(F(": "));
-            Serial.println(segmentBuffer);
+            Serial.print(F(" length "));
+            Serial.println(field.Length());
         #endif
 
-        switch (sentence) 
-        {
-            case NMEA_SENTENCE_GNRMC:
-            case NMEA_SENTENCE_GPRMC: 
-                // $GPRMC,074318.000,A,4735.41382,N,12212.35088,W,0.030,,170617,,,A*63
-                //        ^^^^^^^^^^   ^^^^^^^^^^ ^ ^^^^^^^^^^^ ^        ^^^^^^
-                //        time        latitude   d longitude   d        date
-                switch (segment) 
-                {
-                    case 1: // time
-                        strncpy(readings[activeReadingIndex].time, segmentBuffer, 6);
-                        #ifdef SERIAL_DEBUG
-                            Serial.print(F("Time = "));
-                            Serial.println(segmentBuffer);
-                        #endif
-                        break;
-                    case 2: // fix quality
-                        break;
-                    case 3: // latitude
-                        strcpy(readings[activeReadingIndex].latitude, segmentBuffer);
-                        #ifdef SERIAL_DEBUG
-                            Serial.print(F("Latitude = "));
-                            Serial.println(segmentBuffer);
-                        #endif
-                        break;
-                    case 4: // latitude direction
-                        strcpy(readings[activeReadingIndex].latitudeDirection, segmentBuffer);
-                        #ifdef SERIAL_DEBUG
-                            Serial.print(F("Latitude direction = "));
-                            Serial.println(segmentBuffer);
-                        #endif
-                        break;
-                    case 5: // longitude
-                        strcpy(readings[activeReadingIndex].longitude, segmentBuffer);
-                        #ifdef SERIAL_DEBUG
-                            Serial.print(F("Longitude = "));
-                            Serial.println(segmentBuffer);
-                        #endif
-                        break;
-                    case 6: // longitude direction
-                        strcpy(readings[activeReadingIndex].longitudeDirection, segmentBuffer);
-                        #ifdef SERIAL_DEBUG
-                            Serial.print(F("Longitude direction = "));
-                            Serial.println(segmentBuffer);
-                        #endif
-                        break;
-                    case 7: // ?
-                    case 8: // ?
-                        break;
-                    case 9: // date
-                        strcpy(readings[activeReadingIndex].date, segmentBuffer);
-                        #ifdef SERIAL_DEBUG
-                            Serial.print(F("Date = "));
-                            Serial.println(segmentBuffer);
-                        #endif
-                        break;
-
-                    default:
-                        break;
+        #if GPS_RECEIVER == GPS_RECEIVER_MTK
+            if (mtkAck)
+            {
+                if (segment == 1)
+                {
+                    if (!field.Integer(&ackCommand))
+                    {
+                        ackCommand = 0;
+                    }
                 }
+                else if (segment == 2)
+                {
+                    ackFlag = field.Letter();
+                }
+                return;
+            }
+        #endif
 
-            break;
-
-        case NMEA_SENTENCE_GNVTG:
-            break;
-
-        case NMEA_SENTENCE_GNGGA:
-        case NMEA_SENTENCE_GPGGA:
+        // the constant tests leave out the code of what is not decoded
+        switch (sentence) 
+        {
+        case NMEA_SENTENCE_RMC:
+            if (!Decodes(NMEA_SENTENCE_RMC))
+            {
+                break;
+            }
             switch (segment) 
             {
-                case 1: // time
-                case 5: // longitude direction
-                case 6: // ?
-                    break;
-                case 7: // number of satellites
-                    strcpy(readings[activeReadingIndex].satelliteCount, segmentBuffer);
-                    #ifdef SERIAL_DEBUG
-                        Serial.print(F("Satellites = "));
-                        Serial.println(segmentBuffer);
-                    #endif
-                    break;
-                case 8: // ?
-                    break;
-                case 9: // altitude
-                    strcpy(readings[activeReadingIndex].altitude, segmentBuffer);
-                    #ifdef SERIAL_DEBUG
-                        Serial.print(F("Altitude = "));
-                        Serial.println(segmentBuffer);
-                    #endif
+            case 1: // time
+                field.Time(pending, &pendingMilliseconds);
+                break;
+            case 2: // status, A active or V void
+                pendingVoid = (field.Letter() != 'A');
+                if (!Decodes(NMEA_SENTENCE_GSA) && !Decodes(NMEA_SENTENCE_GGA))
+                {
+                    // a fix of some kind
+                    pendingFixType = pendingVoid ? GPSFIXTYPE_NOFIX : GPSFIXTYPE_2DFIX;
+                }
+                break;
+            case 3: // latitude
+            {
+                if (!Keeps(GPS_READING_POSITION))
+                {
                     break;
-                case 10:// altitude unit
-                case 11: // ?
-                case 12: // ?
+                }
+                uint8_t decimals;
+
+                pending.flags &= ~(GPS_READING_POSITION | GPS_READING_DECIMALS_MASK);
+                if (field.Coordinate(&pending.latitude, &decimals, 90))
+                {
+                    pending.flags |= GPS_READING_POSITION | (decimals << GPS_READING_DECIMALS_SHIFT);
+                }
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Latitude = "));
+                    Serial.println(pending.latitude);
+                #endif
+                break;
+            }
+            case 4: // latitude direction
+                if (Keeps(GPS_READING_POSITION) && field.Letter() == 'S')
+                {
+                    pending.latitude = -pending.latitude;
+                }
+                break;
+            case 5: // longitude
+            {
+                if (!Keeps(GPS_READING_POSITION))
+                {
                     break;
+                }
+                uint8_t decimals;
 
-                default:
+                if (!field.Coordinate(&pending.longitude, &decimals, 180))
+                {
+                    pending.flags &= ~(GPS_READING_POSITION | GPS_READING_DECIMALS_MASK);
+                }
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Longitude = "));
+                    Serial.println(pending.longitude);
+                #endif
+                break;
+            }
+            case 6: // longitude direction
+                if (Keeps(GPS_READING_POSITION) && field.Letter() == 'W')
+                {
+                    pending.longitude = -pending.longitude;
+                }
+                break;
+            case 7: // speed over ground, knots
+                if (KeepsMotion(GPS_MOTION_SPEED))
+                {
+                    ProcessMotion(&motion.Pending()->speed, GPS_MOTION_SPEED);
+                }
+                break;
+            case 8: // course over ground, degrees true
+                if (KeepsMotion(GPS_MOTION_COURSE))
+                {
+                    ProcessMotion(&motion.Pending()->course, GPS_MOTION_COURSE);
+                }
+                break;
+            case 9: // date
+                if (!Keeps(GPS_READING_DATE))
+                {
                     break;
+                }
+                field.Date(pending);
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Date = "));
+                    Serial.println(pending.dateTime, HEX);
+                #endif
+                break;
             }
             break;
 
-        case NMEA_SENTENCE_GPGSA:
-            switch (segment)
+        case NMEA_SENTENCE_GGA:
+            if (!Decodes(NMEA_SENTENCE_GGA))
             {
-                case 2: // Fix type
-                {
-                    #ifdef SERIAL_DEBUG
-                        Serial.print(F("Fix type = "));
-                        Serial.println(segmentBuffer[0]);
-                    #endif
+                break;
+            }
+            switch (segment) 
+            {
+            case 1: // time
+                field.Time(pending, &pendingMilliseconds);
+                break;
+            case 6: // fix quality, 0 is no fix
+            {
+                uint16_t quality;
 
-                    GPSFIXTYPE newGpsFixType = static_cast<GPSFIXTYPE>(segmentBuffer[0] - '0');
+                pendingVoid = !field.Integer(&quality) || quality == 0 || quality > 255;
+                if (KeepsMotion(GPS_MOTION_QUALITY))
+                {
+                    motion.Pending()->fixQuality = pendingVoid ? 0 : quality;
+                    motion.Pending()->flags |= GPS_MOTION_QUALITY;
+                }
+                if (!Decodes(NMEA_SENTENCE_GSA))
+                {
+                    // a fix of some kind
+                    pendingFixType = pendingVoid ? GPSFIXTYPE_NOFIX : GPSFIXTYPE_2DFIX;
+                }
+                break;
+            }
+            case 7: // number of satellites
+            {
+                if (!Keeps(GPS_READING_SATELLITES))
+                {
+                    break;
+                }
+                uint16_t satellites;
 
-                    if (newGpsFixType != gpsFixType)
-                    {
-                        gpsFixChangedCallback(newGpsFixType);
-                        gpsFixType = newGpsFixType;
-                    }
+                pending.flags &= ~GPS_READING_SATELLITES;
+                if (field.Integer(&satellites) && satellites <= 255)
+                {
+                    pending.satelliteCount = satellites;
+                    pending.flags |= GPS_READING_SATELLITES;
+                }
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Satellites = "));
+                    Serial.println(pending.satelliteCount);
+                #endif
+                break;
+            }
+            case 8: // horizontal dilution of precision
+                if (KeepsMotion(GPS_MOTION_HDOP))
+                {
+                    ProcessMotion(&motion.Pending()->hdop, GPS_MOTION_HDOP);
+                }
+                break;
+            case 9: // altitude, meters
+                if (!Keeps(GPS_READING_ALTITUDE))
+                {
                     break;
                 }
+                if (field.Hundredths(&pending.altitude))
+                {
+                    pending.flags |= GPS_READING_ALTITUDE;
+                }
+                else
+                {
+                    pending.flags &= ~GPS_READING_ALTITUDE;
+                }
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Altitude = "));
+                    Serial.println(pending.altitude);
+                #endif
+                break;
             }
             break;
 
-        case NMEA_SENTENCE_GPGSV:
-        case NMEA_SENTENCE_GPGLL:
+        case NMEA_SENTENCE_GSA:
+            if (Decodes(NMEA_SENTENCE_GSA) && segment == 2)
+            {
+                // fix type
+                uint16_t newGpsFixType;
+
+                if (field.Integer(&newGpsFixType) && newGpsFixType >= GPSFIXTYPE_NOFIX && newGpsFixType <= GPSFIXTYPE_3DFIX)
+                {
+                    pendingFixType = static_cast<GPSFIXTYPE>(newGpsFixType);
+                }
+                #ifdef SERIAL_DEBUG
+                    Serial.print(F("Fix type = "));
+                    Serial.println(pendingFixType);
+                #endif
+            }
             break;
 
         default:
             break;
         }
     }
+
+    // hundredths of a speed, course or HDOP, the flag says whether the field had one
+    void ProcessMotion(uint16_t* value, uint8_t flag)
+    {
+        int32_t hundredths;
+        if (field.Hundredths(&hundredths) && hundredths >= 0 && hundredths <= 0xffff)
+        {
+            *value = hundredths;
+            motion.Pending()->flags |= flag;
+        }
+        else
+        {
+            motion.Pending()->flags &= ~flag;
+        }
+    }
 };
+
+typedef TaskGpsT<GpsConfig> TaskGps;
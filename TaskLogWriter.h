@@ -0,0 +1,152 @@
+// writes the readings TaskGps queued, a few per update
+//
+// Every update writes at most LOG_WRITER_READINGS_PER_UPDATE readings of the
+// oldest full slot, then gives TaskManager back so TaskGps can empty the
+// serial port before the next ones. When the queue backs up, with no slot
+// left to fill after the next, the whole oldest slot goes in one update so
+// the parser does not have to drop readings. A slot written out completes a
+// batch. The first reading after the task starts does not wait for its
+// slot to fill, so a cold start has its first fix on the card straight
+// away. ReadingQueue.h comes with TaskGps.h, include that first, and
+// LogJournal.h too for a journaled log.
+
+// one reading is one short append to the sector buffer, now and then a block write
+#ifndef LOG_WRITER_READINGS_PER_UPDATE
+#define LOG_WRITER_READINGS_PER_UPDATE 1
+#endif
+
+// a partly filled slot is written when nothing has been for this long, so
+// readings do not wait in RAM for a whole slot, 0 to always wait
+#ifndef LOG_WRITER_FLUSH_MS
+    #if defined(LOG_JOURNAL) && LOG_JOURNAL
+        // half the window a power cut may cost, the batch is synced once written
+        #define LOG_WRITER_FLUSH_MS (LOG_JOURNAL_WINDOW_MS / 2)
+    #else
+        #define LOG_WRITER_FLUSH_MS 0
+    #endif
+#endif
+
+// counted per slot, a batch
+struct LogWriterCounters
+{
+    uint32_t written;   // readings handed to the write function
+    uint32_t batches;   // slots written out
+};
+
+class TaskLogWriter : public Task
+{
+public:
+    typedef void(*ReadingWrite)(const GpsReading& reading);
+    typedef void(*BatchWritten)();
+
+    TaskLogWriter(ReadingQueue& readingQueue, ReadingWrite readingWriteFunction, BatchWritten batchWrittenFunction) :
+        Task(MsToTaskTime(2)),
+        queue(readingQueue),
+        readingWrite(readingWriteFunction),
+        batchWritten(batchWrittenFunction),
+        lastBatchMs(0),
+        started(false)
+    #if TASK_TICKLESS
+        ,
+        idle(false)
+    #endif
+    {
+        memset(&counters, 0, sizeof(counters));
+    };
+
+    const LogWriterCounters& Counters() const
+    {
+        return counters;
+    }
+
+#if TASK_TICKLESS
+    // from loop(), TaskGps queued a slot, or the first reading, while the task was idle
+    void Wake()
+    {
+        if (idle && (queue.Queued() || (!started && queue.Filling())))
+        {
+            idle = false;
+            setTimeInterval(MsToTaskTime(2));
+        }
+    }
+#endif
+
+private:
+    ReadingQueue& queue;
+    const ReadingWrite readingWrite;
+    const BatchWritten batchWritten;
+    LogWriterCounters counters;
+    uint32_t lastBatchMs;
+    bool started;       // a batch was written since the task started
+#if TASK_TICKLESS
+    bool idle;          // nothing queued, sleeping until a slot is or a flush is due
+#endif
+
+    virtual bool OnStart()
+    {
+        started = false;
+        return true;
+    }
+
+    virtual void OnUpdate(uint32_t deltaTime)
+    {
+        STATS_TASK_SCOPE(writerUpdate, deltaTime);
+
+        uint8_t count;
+        const ReadingQueue::Slot* readings = queue.Oldest(&count);
+        if (!readings)
+        {
+            if (queue.Filling() && (!started ||
+                    (LOG_WRITER_FLUSH_MS && millis() - lastBatchMs >= LOG_WRITER_FLUSH_MS)))
+            {
+                // nothing is queued, so there is room to hand the slot over
+                queue.Flush();
+                lastBatchMs = millis();
+            }
+        #if TASK_TICKLESS
+            else
+            {
+                Idle();
+            }
+        #endif
+            return;
+        }
+
+        uint8_t index = queue.DrainIndex();
+        uint8_t limit = (queue.Queued() >= ReadingQueue::Slots - 1) ? count : LOG_WRITER_READINGS_PER_UPDATE;
+        for (uint8_t step = 0; step < limit && index < count; step++)
+        {
+            readingWrite(readings[index++].Widen());
+            counters.written++;
+        }
+        queue.SetDrainIndex(index);
+
+        if (index == count)
+        {
+            queue.Release();
+            started = true;
+            counters.batches++;
+            lastBatchMs = millis();
+            batchWritten();
+        }
+    }
+
+#if TASK_TICKLESS
+    void Idle()
+    {
+        uint32_t sleepMs = TASK_IDLE_MS;
+        if (LOG_WRITER_FLUSH_MS && queue.Filling())
+        {
+            // back when the partly filled slot is due
+            uint32_t sinceMs = millis() - lastBatchMs;
+            uint32_t dueMs = (sinceMs < LOG_WRITER_FLUSH_MS) ? LOG_WRITER_FLUSH_MS - sinceMs : 0;
+            if (dueMs < sleepMs)
+            {
+                sleepMs = dueMs ? dueMs : 2;
+            }
+        }
+        idle = true;
+        setTimeInterval(MsToTaskTime(sleepMs));
+    }
+#endif
+};
@@ -0,0 +1,99 @@
+// brings up the SD card without holding up the other tasks
+//
+// Every update tries sd.begin() once. After a failure the next try waits
+// twice as long as the last, from SD_MOUNT_RETRY_MS up to
+// SD_MOUNT_RETRY_MAX_MS, so a missing card costs a begin now and then
+// instead of the whole loop. Once the card answers the mounted function
+// runs; the sketch starts TaskLogWriter from there and stops this task
+// until a card is inserted again. Meanwhile TaskGps parses from power up
+// and its readings wait in the ReadingQueue, written in bulk once the
+// writer starts; what does not fit the queue goes by its overflow policy.
+
+#ifndef SD_MOUNT_RETRY_MS
+#define SD_MOUNT_RETRY_MS 100
+#endif
+
+#ifndef SD_MOUNT_RETRY_MAX_MS
+#define SD_MOUNT_RETRY_MAX_MS 5000
+#endif
+
+class TaskSdCard : public Task
+{
+public:
+    typedef void(*CardMounted)();
+
+    TaskSdCard(SdFat& sdFat, uint8_t chipSelectPin, CardMounted cardMountedFunction) :
+        Task(MsToTaskTime(1)),
+        sd(sdFat),
+        chipSelect(chipSelectPin),
+        cardMounted(cardMountedFunction),
+        mounted(false),
+        retryMs(SD_MOUNT_RETRY_MS),
+        attempts(0),
+        mountedMs(0)
+    {
+    };
+
+    bool Mounted() const
+    {
+        return mounted;
+    }
+
+    // begin() calls since the task started
+    uint16_t Attempts() const
+    {
+        return attempts;
+    }
+
+    // millis() when the card last mounted
+    uint32_t MountedMs() const
+    {
+        return mountedMs;
+    }
+
+private:
+    SdFat& sd;
+    const uint8_t chipSelect;
+    const CardMounted cardMounted;
+    bool mounted;
+    uint16_t retryMs;       // until the next try after a failure
+    uint16_t attempts;
+    uint32_t mountedMs;
+
+    virtual bool OnStart()
+    {
+        // a reinserted card may be another one
+        mounted = false;
+        retryMs = SD_MOUNT_RETRY_MS;
+        attempts = 0;
+        setTimeInterval(MsToTaskTime(1));
+        return true;
+    }
+
+    virtual void OnUpdate(uint32_t deltaTime)
+    {
+        (void)deltaTime;
+
+        if (mounted)
+        {
+            return;
+        }
+
+        attempts++;
+        if (sd.begin(chipSelect))
+        {
+            #ifdef SIMPLE_DEBUG
+                Serial.println(F("SD started."));
+            #endif
+
+            mounted = true;
+            mountedMs = millis();
+            setTimeInterval(MsToTaskTime(SD_MOUNT_RETRY_MAX_MS));
+            cardMounted();
+            return;
+        }
+
+        setTimeInterval(MsToTaskTime(retryMs));
+        retryMs = (retryMs < SD_MOUNT_RETRY_MAX_MS / 2) ? retryMs * 2 : SD_MOUNT_RETRY_MAX_MS;
+    }
+};
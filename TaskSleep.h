@@ -0,0 +1,29 @@
+// tickless scheduling, compiled in with TASK_TICKLESS
+//
+// Polling every task every few ms keeps the board awake all the time for a
+// receiver that talks for a few hundred ms a second and a button that is
+// almost never pressed. With TASK_TICKLESS a task with nothing to do sets
+// its interval to TASK_IDLE_MS, so TaskManager sleeps until the next task
+// that really is due, and loop() hands a task its short interval back when
+// something it waits for has happened: a byte on the GPS port, the button
+// pin changing, a slot in the reading queue. The RX and pin interrupts are
+// what wakes the board early for those. A slot TaskGps queues in the same
+// pass the writer went idle in waits for the next wake, at most
+// TASK_IDLE_MS, which is also how long a safe eject may take to close the
+// file. TaskGps.h includes this.
+
+#ifndef TASK_TICKLESS
+#define TASK_TICKLESS 0
+#endif
+
+// longest an idle task sleeps, a heartbeat for anything a wake source misses
+#ifndef TASK_IDLE_MS
+#define TASK_IDLE_MS 1000
+#endif
+
+// pin change handlers have to live in IRAM on the ESP8266
+#if defined(ESP8266)
+    #define TASK_WAKE_ISR_ATTR ICACHE_RAM_ATTR
+#else
+    #define TASK_WAKE_ISR_ATTR
+#endif
@@ -0,0 +1,211 @@
+// hot path timings for tuning with field data, compiled in with LOG_STATS
+//
+// STATS_TASK_SCOPE at the top of a task update and STATS_SCOPE at the top of
+// any other function add the micros() until it returns to a StatsTiming, a
+// task update also how much later than its interval the scheduler ran it.
+// SD opens and writes go into log2 histograms, bucket n counts calls that
+// took 2^(n-1) up to 2^n - 1 us, the last bucket everything longer.
+// STATS_COUNT counts an event, like the LED strip being sent a color.
+// WriteStats() prints what was counted since the last call as STATS.CSV
+// lines and starts over. Without LOG_STATS the scopes are empty and
+// nothing is kept. TaskGps.h includes this.
+
+#ifndef LOG_STATS
+#define LOG_STATS 0
+#endif
+
+// how often the sketch appends to STATS.CSV
+#ifndef LOG_STATS_INTERVAL_MS
+#define LOG_STATS_INTERVAL_MS 60000UL
+#endif
+
+#define STATS_HISTOGRAM_BUCKETS 16  // the last one from 16 ms on
+
+#if LOG_STATS
+
+struct StatsTiming
+{
+    uint32_t count;
+    uint32_t totalUs;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t lateTotalMs;   // task updates only
+    uint16_t lateMaxMs;
+};
+
+struct StatsHistogram
+{
+    uint16_t buckets[STATS_HISTOGRAM_BUCKETS];
+};
+
+struct LoggerStats
+{
+    StatsTiming gpsUpdate;      // TaskGps::OnUpdate
+    StatsTiming gpsEpoch;       // TaskGps::CompleteEpoch, a reading handed to the queue
+    StatsTiming ledUpdate;      // TaskStatusLed::OnUpdate
+    StatsTiming writerUpdate;   // TaskLogWriter::OnUpdate
+    StatsHistogram sdOpen;      // LogFile::Open
+    StatsHistogram sdWrite;     // LogFile sector writes
+    uint32_t ledShows;          // strip.Show() calls, interrupts off for each
+};
+
+// one instance however many translation units include this, the host tools
+// build the tasks into more than one
+inline LoggerStats& Stats()
+{
+    static LoggerStats stats;
+    return stats;
+}
+
+inline void ResetStats()
+{
+    memset(&Stats(), 0, sizeof(LoggerStats));
+}
+
+class StatsScope
+{
+public:
+    StatsScope(StatsTiming& statsTiming) :
+        timing(statsTiming),
+        startUs(micros())
+    {
+    }
+
+    // deltaTime and interval in task time, as OnUpdate gets them
+    StatsScope(StatsTiming& statsTiming, uint32_t deltaTime, uint32_t interval) :
+        timing(statsTiming),
+        startUs(micros())
+    {
+        if (deltaTime > interval)
+        {
+            uint32_t lateMs = TaskTimeToMs(deltaTime - interval);
+            timing.lateTotalMs += lateMs;
+            if (lateMs > timing.lateMaxMs)
+            {
+                timing.lateMaxMs = lateMs > 0xffff ? 0xffff : lateMs;
+            }
+        }
+    }
+
+    ~StatsScope()
+    {
+        uint32_t us = micros() - startUs;
+        if (!timing.count || us < timing.minUs)
+        {
+            timing.minUs = us;
+        }
+        timing.count++;
+        timing.totalUs += us;
+        if (us > timing.maxUs)
+        {
+            timing.maxUs = us;
+        }
+    }
+
+private:
+    StatsTiming& timing;
+    const uint32_t startUs;
+};
+
+class StatsHistogramScope
+{
+public:
+    StatsHistogramScope(StatsHistogram& statsHistogram) :
+        histogram(statsHistogram),
+        startUs(micros())
+    {
+    }
+
+    ~StatsHistogramScope()
+    {
+        uint8_t bucket = 0;
+        for (uint32_t us = micros() - startUs; us && bucket < STATS_HISTOGRAM_BUCKETS - 1; us >>= 1)
+        {
+            bucket++;
+        }
+        if (histogram.buckets[bucket] != 0xffff)
+        {
+            histogram.buckets[bucket]++;
+        }
+    }
+
+private:
+    StatsHistogram& histogram;
+    const uint32_t startUs;
+};
+
+#define STATS_SCOPE(timing) StatsScope statsScope(Stats().timing)
+#define STATS_TASK_SCOPE(timing, deltaTime) StatsScope statsScope(Stats().timing, deltaTime, getTimeInterval())
+#define STATS_HISTOGRAM_SCOPE(histogram) StatsHistogramScope statsScope(Stats().histogram)
+#define STATS_COUNT(counter) Stats().counter++
+
+// ms,timing,name,count,min_us,mean_us,max_us,late_total_ms,late_max_ms
+inline void WriteStatsTiming(Print& out, uint32_t ms, const __FlashStringHelper* name, const StatsTiming& timing)
+{
+    out.print(ms);
+    out.print(F(",timing,"));
+    out.print(name);
+    out.print(',');
+    out.print(timing.count);
+    out.print(',');
+    out.print(timing.minUs);
+    out.print(',');
+    out.print(timing.count ? timing.totalUs / timing.count : 0);
+    out.print(',');
+    out.print(timing.maxUs);
+    out.print(',');
+    out.print(timing.lateTotalMs);
+    out.print(',');
+    out.println(timing.lateMaxMs);
+}
+
+// ms,histogram,name,bucket 0,...,bucket 15
+inline void WriteStatsHistogram(Print& out, uint32_t ms, const __FlashStringHelper* name, const StatsHistogram& histogram)
+{
+    out.print(ms);
+    out.print(F(",histogram,"));
+    out.print(name);
+    for (uint8_t bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++)
+    {
+        out.print(',');
+        out.print(histogram.buckets[bucket]);
+    }
+    out.println();
+}
+
+// the interval since the last call, overflows and dropped are the totals so far,
+// led_shows per minute with the default interval, first_fix_logged_ms since power up
+inline void WriteStats(Print& out, uint32_t ms, uint32_t serialOverflows, uint32_t readingsDropped,
+    uint32_t firstFixLoggedMs)
+{
+    WriteStatsTiming(out, ms, F("gps_update"), Stats().gpsUpdate);
+    WriteStatsTiming(out, ms, F("gps_epoch"), Stats().gpsEpoch);
+    WriteStatsTiming(out, ms, F("led_update"), Stats().ledUpdate);
+    WriteStatsTiming(out, ms, F("writer_update"), Stats().writerUpdate);
+    WriteStatsHistogram(out, ms, F("sd_open_us_log2"), Stats().sdOpen);
+    WriteStatsHistogram(out, ms, F("sd_write_us_log2"), Stats().sdWrite);
+
+    out.print(ms);
+    out.print(F(",counter,led_shows,"));
+    out.println(Stats().ledShows);
+    out.print(ms);
+    out.print(F(",counter,serial_overflows,"));
+    out.println(serialOverflows);
+    out.print(ms);
+    out.print(F(",counter,readings_dropped,"));
+    out.println(readingsDropped);
+    out.print(ms);
+    out.print(F(",counter,first_fix_logged_ms,"));
+    out.println(firstFixLoggedMs);
+
+    ResetStats();
+}
+
+#else
+
+#define STATS_SCOPE(timing)
+#define STATS_TASK_SCOPE(timing, deltaTime)
+#define STATS_HISTOGRAM_SCOPE(histogram)
+#define STATS_COUNT(counter)
+
+#endif
@@ -1,3 +1,13 @@
+// status LED, patterns of 16 steps of NEOPIXEL_BLINK_MS played from a table in flash
+//
+// Every status has a pattern and a priority. Repeating ones (no fix, safe
+// to eject) are the background that plays whenever nothing else does,
+// one-shots wait in a small queue ordered by priority and play before the
+// background comes back; fix and start recording end the background they
+// answer. A status outranking the pattern playing starts straight away,
+// others at the end of it; a one-shot cut short goes back to the queue. The strip is only sent a new color when the
+// pixel actually changes, Show() bit-bangs the WS2813 with interrupts off
+// and costs received GPS bytes on the Pro Mini.
 
 #include <NeoPixelBus.h>
 
@@ -13,13 +23,66 @@
 
 #define COLOR_SATURATION 64
 
-RgbColor angryRed(255, 0, 0);
-RgbColor red(COLOR_SATURATION, 0, 0);
-RgbColor yellow(COLOR_SATURATION, COLOR_SATURATION, 0);
-RgbColor green(0, COLOR_SATURATION, 0);
-RgbColor blue(0, 0, COLOR_SATURATION);
-RgbColor white(COLOR_SATURATION);
-RgbColor black(0);
+enum LedColor
+{
+    LedColor_Black,
+    LedColor_AngryRed,
+    LedColor_Red,
+    LedColor_Yellow,
+    LedColor_Green,
+    LedColor_Blue,
+    LedColor_White
+};
+
+// R, G, B by LedColor
+const uint8_t LedColors[][3] PROGMEM =
+{
+    { 0, 0, 0 },
+    { 255, 0, 0 },
+    { COLOR_SATURATION, 0, 0 },
+    { COLOR_SATURATION, COLOR_SATURATION, 0 },
+    { 0, COLOR_SATURATION, 0 },
+    { 0, 0, COLOR_SATURATION },
+    { COLOR_SATURATION, COLOR_SATURATION, COLOR_SATURATION }
+};
+
+enum LedStatus
+{
+    LedStatus_PowerUp,
+    LedStatus_FileWritten,
+    LedStatus_FileOpenError,
+    LedStatus_SafeToEject,
+    LedStatus_NoFix,
+    LedStatus_Fix,
+    LedStatus_StartRecording,
+    LedStatus_Count
+};
+
+#define LED_PATTERN_PRIORITY 0b00001111 // higher goes first
+#define LED_PATTERN_REPEAT   0b01000000 // the background until replaced or ended
+#define LED_PATTERN_ENDS     0b10000000 // ends the background
+
+struct LedPattern
+{
+    uint16_t steps;     // msb first, a set bit shows the color for a step
+    uint8_t color;      // LedColor
+    uint8_t flags;      // LED_PATTERN_*
+};
+
+// by LedStatus
+const LedPattern LedPatterns[LedStatus_Count] PROGMEM =
+{
+    { 0b1000000000000000, LedColor_White, 2 },
+    { 0b1100000000000000, LedColor_Red, 1 },
+    { 0b1100011000000000, LedColor_AngryRed, 6 },
+    { 0b1100000000000000, LedColor_Green, 5 | LED_PATTERN_REPEAT },
+    { 0b1100011000110000, LedColor_Blue, 3 | LED_PATTERN_REPEAT },
+    { 0b1100011000110000, LedColor_Green, 3 | LED_PATTERN_ENDS },
+    { 0b1100110011001100, LedColor_Red, 5 | LED_PATTERN_ENDS }
+};
+
+// one-shots waiting, a status is queued once however often it is shown
+#define LED_QUEUE_SIZE 4
 
 class TaskStatusLed : public Task
 {
@@ -27,131 +90,241 @@ public:
     TaskStatusLed() : // pass any custom arguments you need
         Task(MsToTaskTime(NEOPIXEL_BLINK_MS)),
         strip(NEOPIXEL_COUNT, NEOPIXEL_PIN), // initialize members here
-        flashColor(black),
-        patternIndex(-1),
-        pattern(0),
-        repeat(false)
+        playing(-1),
+        background(-1),
+        queued(0),
+        step(-1),
+        shownColor(LedColor_Black),
+        shows(0)
     { };
 
     void ShowPowerUp()
     {
-        // we want immediate color change as 
+        // we want immediate color change as
         // other initialization could extend how long this stays on
-        pattern = 0b0;
-        repeat = false;
-        patternIndex = 15;
-        strip.SetPixelColor(0, white);
-        strip.Show();
+        Show(LedStatus_PowerUp);
+        Step();
     }
 
     void ShowFileWritten()
     {
-        if (!repeat) // do not reset any repeating states
-        {
-            pattern = 0b1100000000000000;
-            repeat = false;
-            patternIndex = 15;
-            flashColor = red;
-        }
+        Show(LedStatus_FileWritten);
     }
 
     void ShowFileOpenError()
     {
-        if (!repeat) // do not reset any repeating states
-        {
-            pattern = 0b1100011000000000;
-            repeat = false;
-            patternIndex = 15;
-            flashColor = angryRed;
-        }
+        Show(LedStatus_FileOpenError);
     }
 
     void ShowSafeToEject()
     {
-        pattern = 0b1100000000000000;
-        repeat = true;
-        patternIndex = 15;
-        flashColor = green;
+        Show(LedStatus_SafeToEject);
     }
 
     void ShowNoFix()
     {
-        pattern = 0b1100011000110000;
-        repeat = true;
-        patternIndex = 15;
-        flashColor = blue;
+        Show(LedStatus_NoFix);
     }
 
     void ShowFix()
     {
-        pattern = 0b1100011000110000;
-        repeat = false;
-        patternIndex = 15;
-        flashColor = green;
+        Show(LedStatus_Fix);
     }
 
     void ShowStartRecording()
     {
-        pattern = 0b1100110011001100;
-        repeat = false;
-        patternIndex = 15;
-        flashColor = red;
+        Show(LedStatus_StartRecording);
     }
 
     void StopShowing()
     {
-        pattern = 0;
-        repeat = false;
-        patternIndex = 0;
-        flashColor = black;
+        playing = -1;
+        background = -1;
+        queued = 0;
+        step = -1;
+        SetColor(LedColor_Black);
+    }
+
+    // strip.Show() calls so far
+    uint32_t ShowCount() const
+    {
+        return shows;
     }
 
 private:
     // put member variables here that are scoped to this object
     NeoPixelBus<NeoGrbwFeature, NeoWs2813Method> strip;
-    RgbColor flashColor;
-    int8_t patternIndex;
-    uint16_t pattern;
-    bool repeat;
+    int8_t playing;             // LedStatus, -1 when off
+    int8_t background;          // repeating LedStatus, -1 for none
+    uint8_t queue[LED_QUEUE_SIZE];  // one-shots, highest priority first
+    uint8_t queued;
+    int8_t step;                // of the playing pattern, 15 down to 0
+    LedPattern pattern;         // the playing one, out of flash
+    uint8_t shownColor;         // LedColor the pixel has
+    uint32_t shows;
+
+    static LedPattern Pattern(uint8_t status)
+    {
+        LedPattern pattern;
+        memcpy_P(&pattern, &LedPatterns[status], sizeof(pattern));
+        return pattern;
+    }
+
+    static uint8_t Priority(uint8_t status)
+    {
+        return Pattern(status).flags & LED_PATTERN_PRIORITY;
+    }
+
+    void Show(uint8_t status)
+    {
+        uint8_t flags = Pattern(status).flags;
+        if (flags & LED_PATTERN_REPEAT)
+        {
+            background = status;
+        }
+        else
+        {
+            if (flags & LED_PATTERN_ENDS)
+            {
+                background = -1;
+            }
+            Enqueue(status);
+        }
+
+        if (playing < 0 || Priority(playing) < (flags & LED_PATTERN_PRIORITY))
+        {
+            if (playing >= 0 && !(pattern.flags & LED_PATTERN_REPEAT))
+            {
+                // plays again from the start, unless the queue is full of more urgent ones
+                Enqueue(playing, true);
+            }
+            Next();
+        }
+        Blink();
+    }
+
+    // in priority order, equal ones in the order shown, the lowest dropped when
+    // full; one cut short was shown before the equal ones and goes ahead of them
+    void Enqueue(uint8_t status, bool cutShort = false)
+    {
+        uint8_t priority = Priority(status);
+        uint8_t index = 0;
+        for (; index < queued; index++)
+        {
+            if (queue[index] == status)
+            {
+                return;
+            }
+        }
+        for (index = 0; index < queued && (Priority(queue[index]) > priority ||
+            (!cutShort && Priority(queue[index]) == priority)); index++)
+        {
+        }
+        if (index == LED_QUEUE_SIZE)
+        {
+            return;
+        }
+        if (queued < LED_QUEUE_SIZE)
+        {
+            queued++;
+        }
+        for (uint8_t move = queued - 1; move > index; move--)
+        {
+            queue[move] = queue[move - 1];
+        }
+        queue[index] = status;
+    }
+
+    // the queued one-shot that goes first, otherwise the background
+    void Next()
+    {
+        if (queued)
+        {
+            playing = queue[0];
+            queued--;
+            memmove(queue, queue + 1, queued);
+        }
+        else
+        {
+            playing = background;
+        }
+        step = 15;
+        if (playing >= 0)
+        {
+            pattern = Pattern(playing);
+        }
+    }
+
+    void Step()
+    {
+        if (playing < 0)
+        {
+            return;
+        }
+
+        SetColor(((pattern.steps >> step) & 1) ? pattern.color : LedColor_Black);
+        step--;
+        if (step < 0)
+        {
+            Next();
+        }
+    }
+
+    // to the strip only when the pixel changes
+    void SetColor(uint8_t color)
+    {
+        if (color == shownColor)
+        {
+            return;
+        }
+        shownColor = color;
+        strip.SetPixelColor(0, RgbColor(pgm_read_byte(&LedColors[color][0]),
+            pgm_read_byte(&LedColors[color][1]),
+            pgm_read_byte(&LedColors[color][2])));
+        strip.Show();
+        shows++;
+        STATS_COUNT(ledShows);
+    }
+
+    // a pattern to show, back to the blink interval if the task was idle
+    void Blink()
+    {
+    #if TASK_TICKLESS
+        if (getTimeInterval() != MsToTaskTime(NEOPIXEL_BLINK_MS))
+        {
+            setTimeInterval(MsToTaskTime(NEOPIXEL_BLINK_MS));
+        }
+    #endif
+    }
 
     virtual bool OnStart() // optional
     {
         // put code here that will be run when the task starts
         strip.Begin();
         strip.Show();
+        shows++;
 
-        pattern = 0;
-        patternIndex = -1;
-        repeat = false;
-        flashColor = black;
+        playing = -1;
+        background = -1;
+        queued = 0;
+        step = -1;
+        shownColor = LedColor_Black;
 
         return true;
     }
 
     virtual void OnUpdate(uint32_t deltaTime)
     {
-        if (patternIndex >= 0)
-        {
-            RgbColor color;
-
-            if (((pattern >> patternIndex) & 1) > 0)
-            {
-                color = flashColor;
-            }
-            else
-            {
-                color = black;
-            }
+        STATS_TASK_SCOPE(ledUpdate, deltaTime);
 
-            strip.SetPixelColor(0, color);
-            strip.Show();
-            
-            patternIndex--;
+        Step();
 
-            if (repeat && patternIndex == -1)
-            {
-                patternIndex = 15;
-            }
+    #if TASK_TICKLESS
+        if (playing < 0)
+        {
+            // nothing to show until the next Show call
+            setTimeInterval(MsToTaskTime(TASK_IDLE_MS));
         }
+    #endif
     }
 };
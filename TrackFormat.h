@@ -0,0 +1,262 @@
+// delta encoded track records, YYMMDD-H.TRK
+//
+// Each record is a tag byte followed by zig-zag varints of the fields that
+// changed since the previous reading, in tag bit order. A keyframe is the same
+// record taken against an all zero reading, so it carries absolute values and
+// lets a reader start over after a damaged or missing part of the file.
+//
+// Fields that did not change are left out instead of written as a zero, so
+// the last byte of a record is the final byte of a non zero varint and never
+// reads as erased (0x00 or 0xFF). LogFile relies on that to find the end of a
+// file that was not closed. A reading identical to the previous one is the
+// single tag TRACK_TAG_REPEAT.
+//
+// The file starts with "GLT" and the format version.
+
+#define TRACK_FORMAT_VERSION 1
+#define TRACK_HEADER_SIZE 4
+
+// absolute values again after this many delta records
+#ifndef TRACK_KEYFRAME_INTERVAL
+#define TRACK_KEYFRAME_INTERVAL 60
+#endif
+
+#define TRACK_TAG_TIME       0b00000001
+#define TRACK_TAG_LATITUDE   0b00000010
+#define TRACK_TAG_LONGITUDE  0b00000100
+#define TRACK_TAG_ALTITUDE   0b00001000
+#define TRACK_TAG_SATELLITES 0b00010000
+#define TRACK_TAG_FLAGS      0b00100000
+#define TRACK_TAG_KEYFRAME   0b01000000
+#define TRACK_TAG_REPEAT     0b10000000
+
+// tag, four 32 bit fields of up to 5 bytes, satellites and flags of up to 2
+#define TRACK_RECORD_MAX_SIZE 25
+
+inline uint32_t TrackZigZag(int32_t value)
+{
+    return (value < 0) ? ~(static_cast<uint32_t>(value) << 1) : (static_cast<uint32_t>(value) << 1);
+}
+
+inline int32_t TrackUnZigZag(uint32_t value)
+{
+    return (value & 1) ? static_cast<int32_t>(~(value >> 1)) : static_cast<int32_t>(value >> 1);
+}
+
+inline uint8_t* AppendTrackVarint(uint8_t* record, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *record++ = value | 0x80;
+        value >>= 7;
+    }
+    *record++ = value;
+    return record;
+}
+
+// returns NULL when the varint runs past end or is longer than 5 bytes
+inline const uint8_t* ReadTrackVarint(const uint8_t* data, const uint8_t* end, uint32_t* value)
+{
+    uint32_t result = 0;
+    for (uint8_t shift = 0; shift < 35 && data < end; shift += 7)
+    {
+        uint8_t part = *data++;
+        result |= static_cast<uint32_t>(part & 0x7f) << shift;
+        if (!(part & 0x80))
+        {
+            *value = result;
+            return data;
+        }
+    }
+    return NULL;
+}
+
+inline void PackTrackHeader(uint8_t* header)
+{
+    header[0] = 'G';
+    header[1] = 'L';
+    header[2] = 'T';
+    header[3] = TRACK_FORMAT_VERSION;
+}
+
+inline bool IsTrackHeader(const uint8_t* header)
+{
+    return header[0] == 'G' && header[1] == 'L' && header[2] == 'T' &&
+        header[3] == TRACK_FORMAT_VERSION;
+}
+
+class TrackEncoder
+{
+public:
+    TrackEncoder(uint16_t interval = TRACK_KEYFRAME_INTERVAL) :
+        keyframeInterval(interval)
+    {
+        Reset();
+    }
+
+    // next record is a keyframe, call whenever a new or reopened file starts
+    void Reset()
+    {
+        memset(&previous, 0, sizeof(previous));
+        sinceKeyframe = keyframeInterval;
+    }
+
+    // record must hold TRACK_RECORD_MAX_SIZE bytes, returns the length used
+    uint8_t Encode(const GpsReading& reading, uint8_t* record)
+    {
+        uint8_t tag = 0;
+        if (sinceKeyframe >= keyframeInterval)
+        {
+            memset(&previous, 0, sizeof(previous));
+            tag = TRACK_TAG_KEYFRAME;
+            sinceKeyframe = 0;
+        }
+        else
+        {
+            sinceKeyframe++;
+        }
+
+        uint8_t* end = record + 1;
+        uint32_t value;
+
+        value = TrackZigZag(static_cast<int32_t>(reading.dateTime - previous.dateTime));
+        if (value)
+        {
+            tag |= TRACK_TAG_TIME;
+            end = AppendTrackVarint(end, value);
+        }
+
+        value = TrackZigZag(static_cast<int32_t>(static_cast<uint32_t>(reading.latitude) - static_cast<uint32_t>(previous.latitude)));
+        if (value)
+        {
+            tag |= TRACK_TAG_LATITUDE;
+            end = AppendTrackVarint(end, value);
+        }
+
+        value = TrackZigZag(static_cast<int32_t>(static_cast<uint32_t>(reading.longitude) - static_cast<uint32_t>(previous.longitude)));
+        if (value)
+        {
+            tag |= TRACK_TAG_LONGITUDE;
+            end = AppendTrackVarint(end, value);
+        }
+
+        value = TrackZigZag(static_cast<int32_t>(static_cast<uint32_t>(reading.altitude) - static_cast<uint32_t>(previous.altitude)));
+        if (value)
+        {
+            tag |= TRACK_TAG_ALTITUDE;
+            end = AppendTrackVarint(end, value);
+        }
+
+        value = TrackZigZag(static_cast<int32_t>(reading.satelliteCount) - previous.satelliteCount);
+        if (value)
+        {
+            tag |= TRACK_TAG_SATELLITES;
+            end = AppendTrackVarint(end, value);
+        }
+
+        value = reading.flags ^ previous.flags;
+        if (value)
+        {
+            tag |= TRACK_TAG_FLAGS;
+            end = AppendTrackVarint(end, value);
+        }
+
+        record[0] = tag ? tag : TRACK_TAG_REPEAT;
+        previous = reading;
+        return end - record;
+    }
+
+private:
+    const uint16_t keyframeInterval;
+    uint16_t sinceKeyframe;
+    GpsReading previous;
+};
+
+class TrackDecoder
+{
+public:
+    TrackDecoder() :
+        synced(false)
+    {
+        memset(&previous, 0, sizeof(previous));
+    }
+
+    // false until the first keyframe, delta records before it are skipped
+    bool Synced()
+    {
+        return synced;
+    }
+
+    // decodes one record, returns the bytes it used or 0 when the record is
+    // cut short or malformed; reading is only valid while Synced()
+    uint8_t Decode(const uint8_t* data, const uint8_t* end, GpsReading& reading)
+    {
+        if (data >= end)
+        {
+            return 0;
+        }
+
+        const uint8_t* start = data;
+        uint8_t tag = *data++;
+        if (tag & TRACK_TAG_REPEAT)
+        {
+            if (tag != TRACK_TAG_REPEAT)
+            {
+                return 0;
+            }
+            reading = previous;
+            return 1;
+        }
+
+        GpsReading next = previous;
+        if (tag & TRACK_TAG_KEYFRAME)
+        {
+            memset(&next, 0, sizeof(next));
+            synced = true;
+        }
+
+        uint32_t value;
+        for (uint8_t bit = TRACK_TAG_TIME; bit < TRACK_TAG_KEYFRAME; bit <<= 1)
+        {
+            if (!(tag & bit))
+            {
+                continue;
+            }
+            data = ReadTrackVarint(data, end, &value);
+            if (!data)
+            {
+                return 0;
+            }
+
+            switch (bit)
+            {
+            case TRACK_TAG_TIME:
+                next.dateTime += TrackUnZigZag(value);
+                break;
+            case TRACK_TAG_LATITUDE:
+                next.latitude = static_cast<int32_t>(static_cast<uint32_t>(next.latitude) + TrackUnZigZag(value));
+                break;
+            case TRACK_TAG_LONGITUDE:
+                next.longitude = static_cast<int32_t>(static_cast<uint32_t>(next.longitude) + TrackUnZigZag(value));
+                break;
+            case TRACK_TAG_ALTITUDE:
+                next.altitude = static_cast<int32_t>(static_cast<uint32_t>(next.altitude) + TrackUnZigZag(value));
+                break;
+            case TRACK_TAG_SATELLITES:
+                next.satelliteCount += TrackUnZigZag(value);
+                break;
+            case TRACK_TAG_FLAGS:
+                next.flags ^= value;
+                break;
+            }
+        }
+
+        previous = next;
+        reading = next;
+        return data - start;
+    }
+
+private:
+    bool synced;
+    GpsReading previous;
+};
@@ -0,0 +1,326 @@
+// thins the track between TaskGps and the reading queue, include after GpsReading.h
+//
+// Two stages, both streaming and in integer math. The dead-band drops a fix
+// within the tolerance of the last one accepted, so a parked logger stops
+// writing the same spot every second. Fixes that moved go into a window of
+// LOG_THIN_WINDOW, which is simplified with Douglas-Peucker from the last
+// kept fix once it is full: a fix is dropped when it lies within the
+// tolerance of the line through the fixes kept around it. The newest fix of
+// a window is always kept and anchors the next one, so a fix is at most a
+// window late. A fix without a position, one LOG_THIN_GAP_S after the last
+// accepted one or too far from the anchor for the window is kept as is,
+// after the window ahead of it; the gap rule leaves a parked logger one fix
+// a minute.
+//
+// Positions are projected onto a plane at the anchor in units of 1e-6
+// degrees of latitude, about 11 cm, longitude scaled by a cosine table
+// per degree. Altitude is not looked at.
+
+#ifndef LOG_THIN
+#define LOG_THIN 0
+#endif
+
+#ifndef LOG_THIN_TOLERANCE_M
+#define LOG_THIN_TOLERANCE_M 5
+#endif
+
+#ifndef LOG_THIN_WINDOW
+#define LOG_THIN_WINDOW 8
+#endif
+
+#ifndef LOG_THIN_GAP_S
+#define LOG_THIN_GAP_S 60
+#endif
+
+static_assert(LOG_THIN_WINDOW >= 2 && LOG_THIN_WINDOW <= 16, "LOG_THIN_WINDOW must be 2 to 16");
+static_assert(LOG_THIN_TOLERANCE_M >= 1 && LOG_THIN_TOLERANCE_M <= 1000, "LOG_THIN_TOLERANCE_M must be 1 to 1000");
+
+// projected units per meter, 1e-6 degrees of latitude are 0.1112 m
+#define THIN_UNITS_PER_M 9
+
+// furthest a window reaches from its anchor along either axis, about 900 m,
+// keeps the products of the distance test in 32 bits
+#define THIN_SPAN 8192
+
+// cos(latitude) * 256 by whole degree
+const uint8_t ThinCosines[] PROGMEM =
+{
+    255, 255, 255, 255, 255, 255, 255, 254, 254, 253, 252, 251, 250, 249, 248, 247,
+    246, 245, 243, 242, 241, 239, 237, 236, 234, 232, 230, 228, 226, 224, 222, 219,
+    217, 215, 212, 210, 207, 204, 202, 199, 196, 193, 190, 187, 184, 181, 178, 175,
+    171, 168, 165, 161, 158, 154, 150, 147, 143, 139, 136, 132, 128, 124, 120, 116,
+    112, 108, 104, 100, 96, 92, 88, 83, 79, 75, 71, 66, 62, 58, 53, 49,
+    44, 40, 36, 31, 27, 22, 18, 13, 9, 4, 0
+};
+
+// floor of the square root, bit by bit
+inline uint16_t IntegerSquareRoot(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+struct TrackThinCounters
+{
+    uint32_t kept;          // handed on
+    uint32_t deadBand;      // within the tolerance of the last accepted fix
+    uint32_t simplified;    // dropped by the window simplification
+};
+
+class TrackThinner
+{
+public:
+    TrackThinner(uint16_t toleranceM = LOG_THIN_TOLERANCE_M) :
+        tolerance(toleranceM * THIN_UNITS_PER_M)
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        anchored = false;
+        count = 0;
+        released = 0;
+        emitted = 0;
+        keep = 0;
+        holding = false;
+        memset(&counters, 0, sizeof(counters));
+    }
+
+    // true when readings are ready, take all of them with Next() before the next Add()
+    bool Add(const GpsReading& reading)
+    {
+        if (!anchored || !(reading.flags & GPS_READING_POSITION))
+        {
+            Release();
+            Hold(reading);
+            return true;
+        }
+
+        const GpsReading& last = count ? window[count - 1] : anchor;
+        int16_t x;
+        int16_t y;
+        if (Gap(last, reading) || !Offset(anchor, reading, x, y))
+        {
+            Release();
+            Hold(reading);
+            return true;
+        }
+        if (Offset(last, reading, x, y) && Square(x) + Square(y) < Square(tolerance))
+        {
+            counters.deadBand++;
+            return false;
+        }
+
+        window[count++] = reading;
+        if (count == LOG_THIN_WINDOW)
+        {
+            Release();
+            return true;
+        }
+        return false;
+    }
+
+    // simplifies what the window holds, at the end of a log
+    bool Flush()
+    {
+        Release();
+        return released != 0;
+    }
+
+    // the readings kept, in order, NULL when done
+    const GpsReading* Next()
+    {
+        while (emitted < released)
+        {
+            uint8_t index = emitted++;
+            if ((keep >> index) & 1)
+            {
+                counters.kept++;
+                return &window[index];
+            }
+        }
+        released = 0;
+        emitted = 0;
+        if (holding)
+        {
+            holding = false;
+            counters.kept++;
+            return &held;
+        }
+        return NULL;
+    }
+
+    const TrackThinCounters& Counters() const
+    {
+        return counters;
+    }
+
+private:
+    const uint16_t tolerance;           // projected units
+    GpsReading anchor;                  // last fix kept with a position
+    GpsReading window[LOG_THIN_WINDOW]; // accepted since the anchor
+    GpsReading held;                    // kept as is after the window released
+    uint16_t keep;                      // by window index, of the released ones
+    uint8_t count;
+    uint8_t released;                   // window entries Next() goes through
+    uint8_t emitted;
+    bool anchored;
+    bool holding;
+    TrackThinCounters counters;
+
+    static int32_t Square(int32_t value)
+    {
+        return value * value;
+    }
+
+    static uint32_t SecondOfDay(uint32_t dateTime)
+    {
+        return GpsDateTimeHour(dateTime) * 3600UL + GpsDateTimeMinute(dateTime) * 60 + GpsDateTimeSecond(dateTime);
+    }
+
+    static bool Gap(const GpsReading& from, const GpsReading& to)
+    {
+        if ((from.dateTime & GPS_DATETIME_DATE_MASK) != (to.dateTime & GPS_DATETIME_DATE_MASK))
+        {
+            return true;
+        }
+        uint32_t fromSecond = SecondOfDay(from.dateTime);
+        uint32_t toSecond = SecondOfDay(to.dateTime);
+        return toSecond < fromSecond || toSecond - fromSecond >= LOG_THIN_GAP_S;
+    }
+
+    // to relative to from in projected units, false when further than THIN_SPAN
+    bool Offset(const GpsReading& from, const GpsReading& to, int16_t& x, int16_t& y) const
+    {
+        int32_t north = (to.latitude - from.latitude) / 10;
+        int32_t east = (to.longitude - from.longitude) / 10;
+        if (north <= -THIN_SPAN || north >= THIN_SPAN || east <= -THIN_SPAN * 2 || east >= THIN_SPAN * 2)
+        {
+            return false;
+        }
+        int32_t latitude = anchor.latitude < 0 ? -anchor.latitude : anchor.latitude;
+        uint8_t degree = latitude / 10000000L;
+        east = east * pgm_read_byte(&ThinCosines[degree > 90 ? 90 : degree]) / 256;
+        if (east <= -THIN_SPAN || east >= THIN_SPAN)
+        {
+            return false;
+        }
+        x = east;
+        y = north;
+        return true;
+    }
+
+    void Hold(const GpsReading& reading)
+    {
+        held = reading;
+        holding = true;
+        if (reading.flags & GPS_READING_POSITION)
+        {
+            anchor = reading;
+            anchored = true;
+        }
+    }
+
+    // Douglas-Peucker over the anchor and the window, the newest fix anchors the next window
+    void Release()
+    {
+        if (!count)
+        {
+            return;
+        }
+
+        // point 0 is the anchor, point n window entry n - 1
+        int16_t xs[LOG_THIN_WINDOW + 1];
+        int16_t ys[LOG_THIN_WINDOW + 1];
+        xs[0] = 0;
+        ys[0] = 0;
+        for (uint8_t index = 0; index < count; index++)
+        {
+            // every entry was within the span of the anchor when accepted
+            Offset(anchor, window[index], xs[index + 1], ys[index + 1]);
+        }
+
+        uint32_t kept = 1UL | (1UL << count);
+        uint8_t stack[LOG_THIN_WINDOW + 1][2];
+        uint8_t depth = 0;
+        stack[depth][0] = 0;
+        stack[depth][1] = count;
+        depth++;
+        while (depth)
+        {
+            depth--;
+            uint8_t first = stack[depth][0];
+            uint8_t last = stack[depth][1];
+            if (last - first < 2)
+            {
+                continue;
+            }
+
+            int32_t dx = xs[last] - xs[first];
+            int32_t dy = ys[last] - ys[first];
+            uint8_t farthest = 0;
+            int32_t farthestDistance = -1;
+            for (uint8_t point = first + 1; point < last; point++)
+            {
+                int32_t px = xs[point] - xs[first];
+                int32_t py = ys[point] - ys[first];
+                // twice the triangle area grows with the distance to the line, or
+                // the squared distance to the first point when both ends meet
+                int32_t distance = (dx || dy) ? dx * py - dy * px : Square(px) + Square(py);
+                if (distance < 0)
+                {
+                    distance = -distance;
+                }
+                if (distance > farthestDistance)
+                {
+                    farthestDistance = distance;
+                    farthest = point;
+                }
+            }
+
+            bool within = (dx || dy) ?
+                farthestDistance <= static_cast<int32_t>(tolerance) * IntegerSquareRoot(Square(dx) + Square(dy)) :
+                farthestDistance <= Square(tolerance);
+            if (within)
+            {
+                continue;
+            }
+            kept |= 1UL << farthest;
+            stack[depth][0] = first;
+            stack[depth][1] = farthest;
+            depth++;
+            stack[depth][0] = farthest;
+            stack[depth][1] = last;
+            depth++;
+        }
+
+        keep = kept >> 1;
+        for (uint8_t index = 0; index < count; index++)
+        {
+            counters.simplified += !((keep >> index) & 1);
+        }
+        anchor = window[count - 1];
+        released = count;
+        emitted = 0;
+        count = 0;
+    }
+};
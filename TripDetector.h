@@ -0,0 +1,388 @@
+// splits the logged readings into trips and sums each up for TRIPS.IDX, include after
+// TrackThinner.h and LogFormat.h
+//
+// Fed every reading as it goes to the log, with where its record starts and
+// ends in the log file. A trip opens once LOG_TRIP_START_FIXES fixes in a
+// row each came LOG_TRIP_START_CMS or faster from the one before, and starts
+// at the fix before the first of them. It goes on while fixes keep coming
+// LOG_TRIP_MOVING_CMS or faster and ends at the last of those when none has
+// for LOG_TRIP_STOP_S, when the fixes stop for LOG_TRIP_GAP_S or at the end
+// of logging. Trips shorter than LOG_TRIP_MIN_M are forgotten, a parked
+// receiver's wander is not a trip. A fix faster than LOG_TRIP_GLITCH_CMS
+// from the last one is a glitch and left out, so is a fix in the same second
+// as the last one counted, the speeds are measured over whole seconds.
+//
+// Distances are equirectangular in integer math: decimeters north, and east
+// scaled by ThinCosines at the latitude of the fix before, 1e-7 degrees
+// being 0.1112 dm. Fixes further apart than about 23 km along either axis
+// count as a gap. Longitudes are differenced the short way round, so a trip
+// goes on across the antimeridian, and its box is kept east and west of its
+// first fix and comes out with west > east when it crosses.
+
+#ifndef LOG_TRIPS
+#define LOG_TRIPS 0
+#endif
+
+#ifndef LOG_TRIP_START_CMS
+#define LOG_TRIP_START_CMS 250      // 9 km/h
+#endif
+
+#ifndef LOG_TRIP_START_FIXES
+#define LOG_TRIP_START_FIXES 3
+#endif
+
+#ifndef LOG_TRIP_MOVING_CMS
+#define LOG_TRIP_MOVING_CMS 100
+#endif
+
+#ifndef LOG_TRIP_STOP_S
+#define LOG_TRIP_STOP_S 180
+#endif
+
+#ifndef LOG_TRIP_GAP_S
+#define LOG_TRIP_GAP_S 300
+#endif
+
+#ifndef LOG_TRIP_MIN_M
+#define LOG_TRIP_MIN_M 200
+#endif
+
+#ifndef LOG_TRIP_GLITCH_CMS
+#define LOG_TRIP_GLITCH_CMS 10000   // 360 km/h
+#endif
+
+static_assert(LOG_TRIP_START_FIXES >= 1, "LOG_TRIP_START_FIXES must be 1 or more");
+static_assert(LOG_TRIP_MOVING_CMS <= LOG_TRIP_START_CMS, "a trip must keep going at the speed it opens at");
+static_assert(LOG_TRIP_GLITCH_CMS < 65536, "the top speed is kept in 16 bits");
+
+// the TRIPS.IDX header and every record after it, the header "GLI", unlike
+// the "GLT" of a track log
+#define TRIP_RECORD_SIZE 40
+#define TRIP_FORMAT_VERSION 1
+
+// furthest apart two fixes are measured along either axis, 1e-7 degrees;
+// keeps the scaling to decimeters in 32 bits
+#define TRIP_SPAN (1L << 21)
+
+// half way round, 1e-7 degrees
+#define TRIP_HALF_TURN 1800000000L
+
+#define TRIP_FAR 0xffffffffUL
+
+struct TripSummary
+{
+    uint32_t startDateTime;
+    uint32_t endDateTime;
+    int32_t south;          // 1e-7 degrees
+    int32_t west;           // greater than east when the box crosses the antimeridian
+    int32_t north;
+    int32_t east;
+    uint32_t distanceM;
+    uint32_t startOffset;   // of the first reading's record, in the log named for startDateTime
+    uint32_t endOffset;     // past the last reading's record, in the log named for endDateTime
+    uint16_t maxSpeedCms;
+};
+
+// little endian, the reserved bytes zero
+inline void PackTripRecord(const TripSummary& trip, uint8_t* record)
+{
+    record = PackBinValue(record, trip.startDateTime);
+    record = PackBinValue(record, trip.endDateTime);
+    record = PackBinValue(record, trip.south);
+    record = PackBinValue(record, trip.west);
+    record = PackBinValue(record, trip.north);
+    record = PackBinValue(record, trip.east);
+    record = PackBinValue(record, trip.distanceM);
+    record = PackBinValue(record, trip.startOffset);
+    record = PackBinValue(record, trip.endOffset);
+    record[0] = trip.maxSpeedCms;
+    record[1] = trip.maxSpeedCms >> 8;
+    record[2] = 0;
+    record[3] = 0;
+}
+
+inline void UnpackTripRecord(const uint8_t* record, TripSummary& trip)
+{
+    trip.startDateTime = UnpackBinValue(record);
+    trip.endDateTime = UnpackBinValue(record + 4);
+    trip.south = UnpackBinValue(record + 8);
+    trip.west = UnpackBinValue(record + 12);
+    trip.north = UnpackBinValue(record + 16);
+    trip.east = UnpackBinValue(record + 20);
+    trip.distanceM = UnpackBinValue(record + 24);
+    trip.startOffset = UnpackBinValue(record + 28);
+    trip.endOffset = UnpackBinValue(record + 32);
+    trip.maxSpeedCms = record[36] | (record[37] << 8);
+}
+
+inline void PackTripHeader(uint8_t* record)
+{
+    memset(record, 0, TRIP_RECORD_SIZE);
+    record[0] = 'G';
+    record[1] = 'L';
+    record[2] = 'I';
+    record[3] = TRIP_FORMAT_VERSION;
+    record[4] = TRIP_RECORD_SIZE;
+}
+
+inline bool IsTripHeader(const uint8_t* record)
+{
+    return record[0] == 'G' && record[1] == 'L' && record[2] == 'I' &&
+        record[3] == TRIP_FORMAT_VERSION && record[4] == TRIP_RECORD_SIZE;
+}
+
+class TripDetector
+{
+public:
+    TripDetector()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        hasLast = false;
+        moving = false;
+        fastFixes = 0;
+    }
+
+    // a reading as logged, its record from start to end in the log file;
+    // true when it ended a trip, Summary() has it
+    bool Add(const GpsReading& reading, uint32_t start, uint32_t end)
+    {
+        const uint8_t needed = GPS_READING_POSITION | GPS_READING_DATE | GPS_READING_TIME;
+        if ((reading.flags & needed) != needed)
+        {
+            return false;
+        }
+
+        Fix fix;
+        fix.seconds = GpsDateTimeSeconds(reading.dateTime);
+        fix.dateTime = reading.dateTime;
+        fix.latitude = reading.latitude;
+        fix.longitude = reading.longitude;
+        fix.start = start;
+        fix.end = end;
+        if (!hasLast)
+        {
+            last = fix;
+            hasLast = true;
+            return false;
+        }
+
+        uint32_t elapsed = fix.seconds - last.seconds;
+        uint32_t distance = Distance(last, fix);
+        if (fix.seconds < last.seconds || elapsed >= LOG_TRIP_GAP_S || distance == TRIP_FAR)
+        {
+            bool ended = Close();
+            last = fix;
+            return ended;
+        }
+        if (!elapsed)
+        {
+            return false;
+        }
+        uint32_t speed = distance * 10 / elapsed;
+        if (speed > LOG_TRIP_GLITCH_CMS)
+        {
+            return false;
+        }
+
+        bool ended = false;
+        if (moving)
+        {
+            // a stop at the lights belongs to the trip once it moves on
+            pendingDm += distance;
+            Grow(pendingBox, fix);
+            if (speed >= LOG_TRIP_MOVING_CMS)
+            {
+                Move(fix, pendingDm, speed);
+                Merge(box, pendingBox);
+                pendingDm = 0;
+                EmptyBox(pendingBox);
+            }
+            else if (fix.seconds - lastMove.seconds >= LOG_TRIP_STOP_S)
+            {
+                ended = Close();
+            }
+        }
+        else if (speed >= LOG_TRIP_START_CMS)
+        {
+            if (!fastFixes)
+            {
+                Open(last);
+            }
+            Move(fix, distance, speed);
+            moving = ++fastFixes >= LOG_TRIP_START_FIXES;
+        }
+        else
+        {
+            fastFixes = 0;
+        }
+        last = fix;
+        return ended;
+    }
+
+    // ends the trip under way, at the end of logging; true when there was one
+    bool Flush()
+    {
+        return Close();
+    }
+
+    const TripSummary& Summary() const
+    {
+        return trip;
+    }
+
+private:
+    struct Fix
+    {
+        uint32_t seconds;
+        uint32_t dateTime;
+        int32_t latitude;
+        int32_t longitude;
+        uint32_t start;
+        uint32_t end;
+    };
+
+    // west and east of the trip's first fix
+    struct Box
+    {
+        int32_t south;
+        int32_t west;
+        int32_t north;
+        int32_t east;
+    };
+
+    Fix last;               // the last fix counted
+    Fix first;              // where the trip under way started
+    Fix lastMove;           // its last fix that was moving, where it ends
+    TripSummary trip;       // the last one ended
+    uint32_t distanceDm;
+    uint32_t pendingDm;     // since lastMove
+    uint16_t maxSpeed;
+    Box box;
+    Box pendingBox;         // of the fixes since lastMove
+    uint8_t fastFixes;      // in a row towards opening a trip
+    bool hasLast;
+    bool moving;
+
+    // east from one longitude to the other the short way round, across the
+    // antimeridian when that is shorter; the halves keep it in 32 bits
+    static int32_t LongitudeDifference(int32_t to, int32_t from)
+    {
+        if (from > 0 && to < from - TRIP_HALF_TURN)
+        {
+            return (to + TRIP_HALF_TURN) - (from - TRIP_HALF_TURN);
+        }
+        if (from < 0 && to > from + TRIP_HALF_TURN)
+        {
+            return (to - TRIP_HALF_TURN) - (from + TRIP_HALF_TURN);
+        }
+        return to - from;
+    }
+
+    // a longitude moved east, back within the half turns either side
+    static int32_t AddLongitude(int32_t longitude, int32_t east)
+    {
+        if (east > 0 && longitude > TRIP_HALF_TURN - east)
+        {
+            return (longitude - TRIP_HALF_TURN) + (east - TRIP_HALF_TURN);
+        }
+        if (east < 0 && longitude < -TRIP_HALF_TURN - east)
+        {
+            return (longitude + TRIP_HALF_TURN) + (east + TRIP_HALF_TURN);
+        }
+        return longitude + east;
+    }
+
+    // decimeters from one fix to the other, TRIP_FAR past TRIP_SPAN
+    static uint32_t Distance(const Fix& from, const Fix& to)
+    {
+        int32_t north = to.latitude - from.latitude;
+        int32_t east = LongitudeDifference(to.longitude, from.longitude);
+        if (north <= -TRIP_SPAN || north >= TRIP_SPAN || east <= -TRIP_SPAN || east >= TRIP_SPAN)
+        {
+            return TRIP_FAR;
+        }
+        int32_t latitude = from.latitude < 0 ? -from.latitude : from.latitude;
+        uint8_t degree = latitude / 10000000L;
+        north = north * 911 / 8192;
+        east = east * 911 / 8192 * pgm_read_byte(&ThinCosines[degree > 90 ? 90 : degree]) / 256;
+
+        // halved until the squares fit in 32 bits, a few decimeters off on a long hop
+        uint8_t shift = 0;
+        while (north <= -32768 || north >= 32768 || east <= -32768 || east >= 32768)
+        {
+            north /= 2;
+            east /= 2;
+            shift++;
+        }
+        return static_cast<uint32_t>(IntegerSquareRoot(north * north + east * east)) << shift;
+    }
+
+    static void EmptyBox(Box& box)
+    {
+        box.south = INT32_MAX;
+        box.west = INT32_MAX;
+        box.north = INT32_MIN;
+        box.east = INT32_MIN;
+    }
+
+    void Grow(Box& box, const Fix& fix) const
+    {
+        int32_t east = LongitudeDifference(fix.longitude, first.longitude);
+        box.south = fix.latitude < box.south ? fix.latitude : box.south;
+        box.north = fix.latitude > box.north ? fix.latitude : box.north;
+        box.west = east < box.west ? east : box.west;
+        box.east = east > box.east ? east : box.east;
+    }
+
+    static void Merge(Box& box, const Box& other)
+    {
+        box.south = other.south < box.south ? other.south : box.south;
+        box.north = other.north > box.north ? other.north : box.north;
+        box.west = other.west < box.west ? other.west : box.west;
+        box.east = other.east > box.east ? other.east : box.east;
+    }
+
+    void Open(const Fix& fix)
+    {
+        first = fix;
+        distanceDm = 0;
+        pendingDm = 0;
+        maxSpeed = 0;
+        EmptyBox(box);
+        EmptyBox(pendingBox);
+        Grow(box, fix);
+    }
+
+    void Move(const Fix& fix, uint32_t distance, uint32_t speed)
+    {
+        lastMove = fix;
+        distanceDm += distance;
+        maxSpeed = speed > maxSpeed ? speed : maxSpeed;
+        Grow(box, fix);
+    }
+
+    bool Close()
+    {
+        bool ended = moving && distanceDm >= LOG_TRIP_MIN_M * 10UL;
+        if (ended)
+        {
+            trip.startDateTime = first.dateTime;
+            trip.endDateTime = lastMove.dateTime;
+            trip.south = box.south;
+            trip.west = AddLongitude(first.longitude, box.west);
+            trip.north = box.north;
+            trip.east = AddLongitude(first.longitude, box.east);
+            trip.distanceM = distanceDm / 10;
+            trip.startOffset = first.start;
+            trip.endOffset = lastMove.end;
+            trip.maxSpeedCms = maxSpeed;
+        }
+        moving = false;
+        fastFixes = 0;
+        return ended;
+    }
+};
@@ -0,0 +1,40 @@
+// Host timing helpers shared by the benchmarks.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+inline uint64_t BenchCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+inline uint64_t BenchNanos()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// 64 bit FNV-1a, used to fingerprint benchmark output across parser changes
+inline uint64_t BenchDigest(uint64_t digest, const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t index = 0; index < length; index++)
+    {
+        digest ^= bytes[index];
+        digest *= 1099511628211ull;
+    }
+    return digest;
+}
+
+const uint64_t BenchDigestSeed = 14695981039346656037ull;
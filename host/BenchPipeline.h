@@ -0,0 +1,45 @@
+// TaskGps and a TaskLogWriter sharing a ReadingQueue, wired as the sketch does
+// but with the bench's own functions receiving the readings. Include after
+// TaskGps.h, the firmware headers have no include guards.
+
+#pragma once
+
+#include "TaskLogWriter.h"
+
+class BenchPipeline
+{
+public:
+    BenchPipeline(TaskLogWriter::ReadingWrite readingWrite, TaskLogWriter::BatchWritten batchWritten,
+            GpsFixChanged fixChanged) :
+        taskGps(queue, fixChanged),
+        writer(queue, readingWrite, batchWritten)
+    {
+    }
+
+    void Start()
+    {
+        taskManager.StartTask(&writer);
+        taskManager.StartTask(&taskGps);
+    }
+
+    void Loop()
+    {
+        taskManager.Loop(WDTO_2S);
+    }
+
+    // stop parsing and write out whatever is still queued, like a safe eject
+    void Finish()
+    {
+        taskManager.StopTask(&taskGps);
+        Loop();
+        while (!queue.Empty())
+        {
+            Loop();
+        }
+    }
+
+    TaskManager taskManager;
+    ReadingQueue queue;
+    TaskGps taskGps;
+    TaskLogWriter writer;
+};
@@ -0,0 +1,232 @@
+// Drives TaskButtons with bouncing contacts and checks what it reports.
+//
+//   button_bench
+//
+// Three buttons on pins 2, 3 and 5. Presses and releases bounce for a few
+// ms, a glitch shorter than the debounce has to be ignored, a long hold has
+// to auto repeat, and two buttons pressed close together both have to
+// report. Prints the reports with their simulated time, then how many
+// updates the task got over a quiet minute, each of them only a test of
+// the pin change flag. button_bench_tickless is built with TASK_TICKLESS,
+// the task sleeping through the quiet minute instead. Last, TaskStatusLed
+// has a one-shot cut short by a more urgent one, which has to play again
+// once that is done.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+
+#include "TaskGps.h"
+#include "TaskButton.h"
+#include "TaskStatusLed.h"
+
+namespace
+{
+    const uint8_t Pins[] = { 2, 3, 5 };
+
+    struct Report
+    {
+        uint32_t ms;
+        uint8_t button;
+        ButtonState state;
+    };
+
+    std::vector<Report> s_reports;
+
+    void OnButton(uint8_t button, ButtonState state)
+    {
+        Report report = { static_cast<uint32_t>(millis()), button, state };
+        s_reports.push_back(report);
+    }
+
+    TaskManager s_taskManager;
+    TaskButtons<3> s_buttons(OnButton, Pins);
+    TaskStatusLed s_led;
+
+    // a letter per blink, by LedColor: off, angry red, red, yellow, green, blue, white
+    std::string s_blinks;
+
+    void RunUntilMs(uint32_t ms)
+    {
+        while (millis() < ms)
+        {
+            s_taskManager.Loop();
+        #if TASK_TICKLESS
+            s_buttons.Wake();
+        #endif
+        }
+    }
+
+    // the blinks of the LED on the way, each time it lights up in a color
+    void RunLedUntilMs(uint32_t ms)
+    {
+        RgbColor last = HostSim::NeoPixelShown();
+        while (millis() < ms)
+        {
+            s_taskManager.Loop();
+            RgbColor shown = HostSim::NeoPixelShown();
+            if (shown != last && shown != RgbColor())
+            {
+                for (uint8_t color = LedColor_AngryRed; color <= LedColor_White; color++)
+                {
+                    if (shown == RgbColor(LedColors[color][0], LedColors[color][1], LedColors[color][2]))
+                    {
+                        s_blinks += ".ArygbW"[color];
+                    }
+                }
+            }
+            last = shown;
+        }
+    }
+
+    // contacts chatter for a few ms before they settle at level
+    void Bounce(uint8_t pin, uint8_t level, uint32_t atMs)
+    {
+        for (uint8_t step = 0; step < 5; step++)
+        {
+            HostSim::SchedulePinLevel(pin, (step & 1) ? !level : level, (atMs + step) * 1000ULL);
+        }
+    }
+
+    const char* StateName(ButtonState state)
+    {
+        switch (state)
+        {
+        case ButtonState_Pressed:
+            return "pressed";
+        case ButtonState_AutoRepeat:
+            return "repeat";
+        case ButtonState_Released:
+            return "released";
+        default:
+            return "?";
+        }
+    }
+
+    // reports from fromMs on, without the repeats, "button state" joined by spaces
+    std::string Sequence(uint32_t fromMs, uint32_t toMs)
+    {
+        std::string sequence;
+        for (size_t index = 0; index < s_reports.size(); index++)
+        {
+            if (s_reports[index].ms < fromMs || s_reports[index].ms >= toMs ||
+                s_reports[index].state == ButtonState_AutoRepeat)
+            {
+                continue;
+            }
+            char entry[32];
+            snprintf(entry, sizeof(entry), "%s%u %s", sequence.empty() ? "" : " ",
+                s_reports[index].button, StateName(s_reports[index].state));
+            sequence += entry;
+        }
+        return sequence;
+    }
+
+    size_t Repeats(uint32_t fromMs, uint32_t toMs, uint8_t button)
+    {
+        size_t count = 0;
+        for (size_t index = 0; index < s_reports.size(); index++)
+        {
+            count += (s_reports[index].ms >= fromMs && s_reports[index].ms < toMs &&
+                s_reports[index].button == button && s_reports[index].state == ButtonState_AutoRepeat);
+        }
+        return count;
+    }
+
+    struct Case
+    {
+        const char* label;
+        uint32_t fromMs;
+        uint32_t toMs;
+        const char* expected;
+        uint8_t repeatButton;
+        size_t minRepeats;
+        size_t maxRepeats;
+    };
+
+    bool Check(const Case& check)
+    {
+        std::string sequence = Sequence(check.fromMs, check.toMs);
+        size_t repeats = Repeats(check.fromMs, check.toMs, check.repeatButton);
+        bool passed = sequence == check.expected && repeats >= check.minRepeats && repeats <= check.maxRepeats;
+        printf("%-18s %-4s %s, %zu repeats\n", check.label, passed ? "ok" : "FAIL", sequence.c_str(), repeats);
+        if (!passed)
+        {
+            printf("%-18s      expected %s, %zu to %zu repeats\n", "", check.expected, check.minRepeats, check.maxRepeats);
+        }
+        return passed;
+    }
+}
+
+const Case Cases[] =
+{
+    { "press", 1000, 2000, "0 pressed 0 released", 0, 0, 0 },
+    { "glitch", 2000, 3000, "", 1, 0, 0 },
+    { "hold", 3000, 5000, "2 pressed 2 released", 2, 7, 9 },
+    { "chord", 5000, 6000, "0 pressed 1 pressed 0 released 1 released", 0, 0, 0 },
+};
+
+int main()
+{
+    HostSim::SetInterruptWake(true);
+    s_taskManager.StartTask(&s_buttons);
+
+    // a bouncy press held 200 ms
+    Bounce(2, LOW, 1000);
+    Bounce(2, HIGH, 1200);
+
+    // shorter than the debounce
+    HostSim::SchedulePinLevel(3, LOW, 2000000);
+    HostSim::SchedulePinLevel(3, HIGH, 2020000);
+
+    // held a second, repeats from 600 ms on every 50 ms
+    Bounce(5, LOW, 3000);
+    Bounce(5, HIGH, 4000);
+
+    // two buttons 20 ms apart settle together
+    Bounce(2, LOW, 5000);
+    Bounce(3, LOW, 5020);
+    Bounce(2, HIGH, 5300);
+    Bounce(3, HIGH, 5300);
+
+    RunUntilMs(6000);
+
+    int failures = 0;
+    for (size_t index = 0; index < sizeof(Cases) / sizeof(Cases[0]); index++)
+    {
+        failures += !Check(Cases[index]);
+    }
+    for (size_t index = 0; index < s_reports.size(); index++)
+    {
+        printf("  %6u ms  button %u %s\n", s_reports[index].ms, s_reports[index].button, StateName(s_reports[index].state));
+    }
+
+    // a quiet minute
+    uint64_t updates = s_taskManager.UpdateCount();
+    RunUntilMs(66000);
+    printf("quiet minute       %llu updates\n", static_cast<unsigned long long>(s_taskManager.UpdateCount() - updates));
+
+    // a file written, its red blink cut short by an open error, red again after the two angry ones
+    // the tickless minute may have slept past its end
+    uint32_t ledMs = millis();
+    s_taskManager.StartTask(&s_led);
+    s_led.ShowFileWritten();
+    RunLedUntilMs(ledMs + 100);
+    s_led.ShowFileOpenError();
+    RunLedUntilMs(ledMs + 3000);
+    bool replayed = s_blinks == "rAAr";
+    printf("%-18s %-4s %s\n", "led cut short", replayed ? "ok" : "FAIL", s_blinks.c_str());
+    if (!replayed)
+    {
+        printf("%-18s      expected rAAr\n", "");
+    }
+    failures += !replayed;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+// Replays a recorded NMEA capture onto the simulated GPS serial line.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "Capture.h"
+
+int32_t NmeaTimeOfDayMs(const char* field, size_t length)
+{
+    if (length < 6)
+    {
+        return -1;
+    }
+    for (size_t index = 0; index < 6; index++)
+    {
+        if (field[index] < '0' || field[index] > '9')
+        {
+            return -1;
+        }
+    }
+
+    int32_t hours = (field[0] - '0') * 10 + (field[1] - '0');
+    int32_t minutes = (field[2] - '0') * 10 + (field[3] - '0');
+    int32_t seconds = (field[4] - '0') * 10 + (field[5] - '0');
+    int32_t millis = 0;
+    if (length > 7 && field[6] == '.')
+    {
+        int32_t scale = 100;
+        for (size_t index = 7; index < length && scale > 0; index++, scale /= 10)
+        {
+            millis += (field[index] - '0') * scale;
+        }
+    }
+    return ((hours * 60 + minutes) * 60 + seconds) * 1000 + millis;
+}
+
+namespace
+{
+    // field holding the UTC time for sentence types that carry one
+    int TimeFieldOf(const char* type)
+    {
+        if (!strncmp(type, "RMC", 3) || !strncmp(type, "GGA", 3) || !strncmp(type, "ZDA", 3) ||
+                !strncmp(type, "GNS", 3) || !strncmp(type, "GST", 3))
+        {
+            return 1;
+        }
+        if (!strncmp(type, "GLL", 3))
+        {
+            return 5;
+        }
+        return -1;
+    }
+}
+
+CaptureLine::CaptureLine() :
+    _next(0),
+    _baud(9600),
+    _flood(false),
+    _timed(false),
+    _startUs(0)
+{
+}
+
+bool CaptureLine::Load(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        bytes.insert(bytes.end(), chunk, chunk + got);
+    }
+    fclose(file);
+
+    Append(bytes);
+    return true;
+}
+
+void CaptureLine::Append(const std::vector<uint8_t>& bytes)
+{
+    _bytes.insert(_bytes.end(), bytes.begin(), bytes.end());
+    _timed = false;
+}
+
+void CaptureLine::SetBaud(uint32_t baud)
+{
+    _baud = baud;
+    _timed = false;
+}
+
+void CaptureLine::SetFlood(bool flood)
+{
+    _flood = flood;
+}
+
+void CaptureLine::SetStartUs(uint64_t startUs)
+{
+    _startUs = startUs;
+    _timed = false;
+}
+
+void CaptureLine::Rewind()
+{
+    _next = 0;
+}
+
+size_t CaptureLine::Corrupt(uint32_t every, uint32_t seed)
+{
+    BuildTiming();
+
+    size_t corrupted = 0;
+    uint32_t state = seed ? seed : 1;
+    size_t index = 0;
+    while (every)
+    {
+        // xorshift32, steps average out to every bytes
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        index += 1 + state % (2 * every);
+        if (index >= _bytes.size())
+        {
+            break;
+        }
+        _bytes[index] ^= 1 + (state >> 8) % 255;
+        corrupted++;
+    }
+    return corrupted;
+}
+
+size_t CaptureLine::SentenceCount() const
+{
+    size_t count = 0;
+    for (size_t index = 0; index < _bytes.size(); index++)
+    {
+        count += (_bytes[index] == '$');
+    }
+    return count;
+}
+
+uint64_t CaptureLine::EndUs()
+{
+    BuildTiming();
+    return _arrivalUs.empty() ? _startUs : _arrivalUs.back();
+}
+
+void CaptureLine::BuildTiming()
+{
+    if (_timed)
+    {
+        return;
+    }
+
+    _arrivalUs.resize(_bytes.size());
+
+    // bit time in nanoseconds, 8N1 framing is ten bits per byte
+    uint64_t byteNs = 10000000000ull / _baud;
+    uint64_t lineNs = _startUs * 1000;   // when the transmitter is free again
+    int64_t firstEpochMs = -1;
+    int64_t lastEpochMs = -1;
+    int64_t dayOffsetMs = 0;
+    uint64_t burstStartNs = lineNs;
+
+    size_t index = 0;
+    while (index < _bytes.size())
+    {
+        // find the sentence bounds
+        size_t end = index;
+        while (end < _bytes.size() && _bytes[end] != '\n')
+        {
+            end++;
+        }
+        if (end < _bytes.size())
+        {
+            end++;
+        }
+
+        // sentences carrying a new UTC time open a new burst
+        if (_bytes[index] == '$' && end - index > 7)
+        {
+            const char* sentence = reinterpret_cast<const char*>(&_bytes[index]);
+            int timeField = TimeFieldOf(sentence + 3);
+            if (timeField > 0)
+            {
+                size_t scan = index;
+                int field = 0;
+                while (scan < end && field < timeField)
+                {
+                    field += (_bytes[scan++] == ',');
+                }
+                size_t fieldEnd = scan;
+                while (fieldEnd < end && _bytes[fieldEnd] != ',' && _bytes[fieldEnd] != '*')
+                {
+                    fieldEnd++;
+                }
+
+                int32_t timeMs = NmeaTimeOfDayMs(reinterpret_cast<const char*>(&_bytes[scan]), fieldEnd - scan);
+                if (timeMs >= 0)
+                {
+                    int64_t epochMs = timeMs + dayOffsetMs;
+                    if (lastEpochMs >= 0 && epochMs < lastEpochMs - 43200000)
+                    {
+                        // past midnight
+                        dayOffsetMs += 86400000;
+                        epochMs += 86400000;
+                    }
+                    if (firstEpochMs < 0)
+                    {
+                        firstEpochMs = epochMs;
+                    }
+                    if (epochMs != lastEpochMs)
+                    {
+                        lastEpochMs = epochMs;
+                        burstStartNs = _startUs * 1000 + static_cast<uint64_t>(epochMs - firstEpochMs) * 1000000;
+                    }
+                }
+            }
+        }
+
+        if (lineNs < burstStartNs)
+        {
+            lineNs = burstStartNs;
+        }
+        for (; index < end; index++)
+        {
+            lineNs += byteNs;
+            _arrivalUs[index] = lineNs / 1000;
+        }
+    }
+
+    _timed = true;
+}
+
+bool CaptureLine::Receive(uint64_t nowUs, uint8_t* value)
+{
+    if (_next >= _bytes.size())
+    {
+        return false;
+    }
+    if (!_flood)
+    {
+        BuildTiming();
+        if (_arrivalUs[_next] > nowUs)
+        {
+            return false;
+        }
+    }
+    *value = _bytes[_next++];
+    return true;
+}
+
+uint64_t CaptureLine::NextArrivalUs(uint64_t afterUs)
+{
+    if (_flood || _next >= _bytes.size())
+    {
+        return UINT64_MAX;
+    }
+    BuildTiming();
+    std::vector<uint64_t>::const_iterator next = std::upper_bound(_arrivalUs.begin() + _next, _arrivalUs.end(), afterUs);
+    return (next == _arrivalUs.end()) ? UINT64_MAX : *next;
+}
+
+bool CaptureLine::HoldsWhenFull() const
+{
+    return _flood;
+}
+
+bool CaptureLine::Finished() const
+{
+    return _next >= _bytes.size();
+}
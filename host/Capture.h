@@ -0,0 +1,70 @@
+// Replays a recorded NMEA capture onto the simulated GPS serial line.
+//
+// Captures carry no timestamps, so byte timing is rebuilt from the sentences:
+// a receiver emits each epoch as one burst starting at the epoch's UTC time
+// and clocks it out back to back at the line baud. A burst that does not fit
+// into its epoch pushes the next one back, just like the receiver's own
+// transmit queue would.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "HostSim.h"
+
+class CaptureLine : public HostSim::UartLine
+{
+public:
+    CaptureLine();
+
+    bool Load(const std::string& path);
+    void Append(const std::vector<uint8_t>& bytes);
+
+    // baud the receiver transmits with
+    void SetBaud(uint32_t baud);
+
+    // deliver every byte immediately and hold them while the serial buffer
+    // is full, used to measure raw parser throughput
+    void SetFlood(bool flood);
+
+    // simulated time the first epoch starts at
+    void SetStartUs(uint64_t startUs);
+
+    virtual bool Receive(uint64_t nowUs, uint8_t* value);
+    virtual bool HoldsWhenFull() const;
+    virtual uint64_t NextArrivalUs(uint64_t afterUs);
+    virtual bool Finished() const;
+
+    const std::vector<uint8_t>& Bytes() const
+    {
+        return _bytes;
+    }
+
+    size_t SentenceCount() const;
+
+    // arrival time of the last byte
+    uint64_t EndUs();
+
+    void Rewind();
+
+    // flip bits in about one byte of every `every`, after the timing is
+    // taken from the clean text so sentences still arrive when they did
+    size_t Corrupt(uint32_t every, uint32_t seed);
+
+private:
+    std::vector<uint8_t> _bytes;
+    std::vector<uint64_t> _arrivalUs;
+    size_t _next;
+    uint32_t _baud;
+    bool _flood;
+    bool _timed;
+    uint64_t _startUs;
+
+    void BuildTiming();
+};
+
+// milliseconds since midnight of an NMEA hhmmss[.sss] field, -1 if empty
+int32_t NmeaTimeOfDayMs(const char* field, size_t length);
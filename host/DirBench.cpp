@@ -0,0 +1,215 @@
+// Compares how long opening the next hourly log takes as the card fills up.
+//
+//   dir_bench [--out DIR] [--days N]
+//
+// Opens one log per hour through LogFile for N days (default 90) and writes a
+// reading into each, once with every file in the root directory and once in
+// /YYYY/MM month directories kept open across files, on a FAT32 card and on
+// a FAT16 card whose root directory holds 512 entries. Reports the simulated
+// time of each open around a few file counts, the directory blocks read for
+// it, and where a layout stops being able to create files. The logs are
+// preallocated small so the host does not write gigabytes.
+
+#define ARDUINO_PRO_MINI
+#define LOG_PREALLOCATE_BYTES 4096UL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "SdFat.h"
+
+#include "GpsReading.h"
+#include "TaskStats.h"
+#include "LogFile.h"
+#include "LogFormat.h"
+
+namespace
+{
+    const uint32_t Checkpoints[] = { 24, 168, 720, 2160, 8760 };
+
+    // the opens averaged at each checkpoint, the day before it
+    const uint32_t Window = 24;
+
+    struct Layout
+    {
+        const char* label;
+        bool months;
+        uint16_t rootEntryLimit;
+    };
+
+    const Layout Layouts[] =
+    {
+        { "flat FAT32", false, 0 },
+        { "flat FAT16", false, 512 },
+        { "months FAT32", true, 0 },
+        { "months FAT16", true, 512 },
+    };
+
+    uint8_t DaysInMonth(uint8_t year, uint8_t month)
+    {
+        static const uint8_t days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        return (month == 2 && year % 4 == 0) ? 29 : days[month - 1];
+    }
+
+    uint32_t PackDateTime(uint8_t year, uint8_t month, uint8_t day, uint8_t hour)
+    {
+        return (static_cast<uint32_t>(year) << GPS_DATETIME_YEAR_SHIFT) |
+            (static_cast<uint32_t>(month) << GPS_DATETIME_MONTH_SHIFT) |
+            (static_cast<uint32_t>(day) << GPS_DATETIME_DAY_SHIFT) |
+            (static_cast<uint32_t>(hour) << GPS_DATETIME_HOUR_SHIFT);
+    }
+
+    struct Sample
+    {
+        uint64_t openUs;
+        uint64_t dirBlocks;
+    };
+
+    // one file per hour from 2017-06-01 on, returns the files opened
+    uint32_t RunLayout(const Layout& layout, const std::string& root, uint32_t files, std::vector<Sample>& samples)
+    {
+        std::string command = "rm -rf '" + root + "'";
+        if (system(command.c_str()) != 0)
+        {
+            return 0;
+        }
+        HostSd::SetRoot(root.c_str());
+        HostSd::Timings().rootEntryLimit = layout.rootEntryLimit;
+        SdFat sd;
+        sd.begin();
+
+        LogFile logFile(sd);
+        uint8_t year = 17;
+        uint8_t month = 6;
+        uint8_t day = 1;
+        uint8_t hour = 0;
+        uint32_t opened = 0;
+        samples.clear();
+        for (; opened < files; opened++)
+        {
+            uint32_t dateTime = PackDateTime(year, month, day, hour);
+            char fileName[] = "000000-0.CSV";
+            EncodeLogFileName(fileName, dateTime);
+
+            HostSd::ResetCounters();
+            uint64_t startUs = HostSim::NowUs();
+            bool open = true;
+            if (layout.months)
+            {
+                char directoryName[] = "/2000/00";
+                EncodeLogDirectory(directoryName, dateTime);
+                open = logFile.OpenDirectory(directoryName);
+            }
+            open = open && logFile.Open(fileName);
+            Sample sample = { HostSim::NowUs() - startUs, HostSd::Counters().dirBlocksScanned };
+            if (!open)
+            {
+                break;
+            }
+            samples.push_back(sample);
+
+            GpsReading reading;
+            memset(&reading, 0, sizeof(reading));
+            reading.dateTime = dateTime;
+            reading.flags = GPS_READING_TIME | GPS_READING_DATE;
+            char line[CSV_LINE_SIZE];
+            logFile.write(reinterpret_cast<const uint8_t*>(line), FormatCsvReading(reading, line));
+
+            if (++hour == 24)
+            {
+                hour = 0;
+                if (++day > DaysInMonth(year, month))
+                {
+                    day = 1;
+                    if (++month > 12)
+                    {
+                        month = 1;
+                        year++;
+                    }
+                }
+            }
+        }
+        logFile.Close();
+        HostSd::Timings().rootEntryLimit = 0;
+        return opened;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string outDir = "dir-card";
+    uint32_t days = 90;
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--out") && index + 1 < argc)
+        {
+            outDir = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--days") && index + 1 < argc)
+        {
+            days = static_cast<uint32_t>(atoi(argv[++index]));
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--out DIR] [--days N]\n", argv[0]);
+            return 2;
+        }
+    }
+    uint32_t files = days * 24;
+
+    printf("open of the next hourly file, mean of the %u opens before each count\n", Window);
+    printf("%-13s", "files");
+    for (size_t index = 0; index < sizeof(Checkpoints) / sizeof(Checkpoints[0]) && Checkpoints[index] <= files; index++)
+    {
+        printf(" %17u", Checkpoints[index]);
+    }
+    printf("   max open\n");
+
+    bool monthsFailed = false;
+    for (size_t index = 0; index < sizeof(Layouts) / sizeof(Layouts[0]); index++)
+    {
+        const Layout& layout = Layouts[index];
+        std::vector<Sample> samples;
+        uint32_t opened = RunLayout(layout, outDir, files, samples);
+
+        printf("%-13s", layout.label);
+        uint64_t maxUs = 0;
+        for (size_t sample = 0; sample < samples.size(); sample++)
+        {
+            if (samples[sample].openUs > maxUs)
+            {
+                maxUs = samples[sample].openUs;
+            }
+        }
+        for (size_t point = 0; point < sizeof(Checkpoints) / sizeof(Checkpoints[0]) && Checkpoints[point] <= files; point++)
+        {
+            uint32_t count = Checkpoints[point];
+            if (count > opened)
+            {
+                printf(" %17s", "-");
+                continue;
+            }
+            uint64_t openUs = 0;
+            uint64_t dirBlocks = 0;
+            for (uint32_t sample = count - Window; sample < count; sample++)
+            {
+                openUs += samples[sample].openUs;
+                dirBlocks += samples[sample].dirBlocks;
+            }
+            printf("  %6.2f ms %3.0f blk", openUs / 1e3 / Window, static_cast<double>(dirBlocks) / Window);
+        }
+        printf("  %6.2f ms", maxUs / 1e3);
+        if (opened < files)
+        {
+            printf("  stops after %u files", opened);
+            monthsFailed = monthsFailed || layout.months;
+        }
+        printf("\n");
+    }
+    return monthsFailed ? 1 : 0;
+}
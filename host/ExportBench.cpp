@@ -0,0 +1,151 @@
+// Measures log ingestion and export on a synthetic card.
+//
+//   export_bench [--mb N] [--threads N] [--out DIR] [--keep]
+//
+// Writes N MB of SyntheticCard.h's hourly logs into DIR, 256 MB by default,
+// --mb 4096 for a few years of logging. Then:
+//   - ingests the card with the reference CSV parser and with the word at a
+//     time one on a single thread, and again on N threads (4 or the cores
+//     there are, whichever is more)
+//   - exports GPX and GeoJSON on one and on N threads
+// and fails unless every ingestion fingerprints as the readings generated
+// and the outputs of one and of N threads are the same bytes. The card is
+// removed afterwards unless --keep.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LogIngest.h"
+#include "SyntheticCard.h"
+#include "BenchClock.h"
+
+namespace
+{
+    uint64_t FileDigest(const std::string& path)
+    {
+        MappedFile file;
+        if (!file.Open(path.c_str()))
+        {
+            return 0;
+        }
+        return BenchDigest(BenchDigestSeed, file.Data(), file.Size());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = 256;
+    unsigned threads = std::thread::hardware_concurrency();
+    threads = threads > 4 ? threads : 4;
+    std::string root = "build/export-card";
+    bool keep = false;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--mb") && index + 1 < argc)
+        {
+            megabytes = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--threads") && index + 1 < argc)
+        {
+            threads = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--out") && index + 1 < argc)
+        {
+            root = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--keep"))
+        {
+            keep = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--mb N] [--threads N] [--out DIR] [--keep]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!megabytes || !threads)
+    {
+        fprintf(stderr, "--mb and --threads take a count\n");
+        return 2;
+    }
+
+    std::filesystem::remove_all(root);
+    uint64_t startNs = BenchNanos();
+    SyntheticCard card;
+    if (!WriteSyntheticCard(root, megabytes * 1000000, card))
+    {
+        return 1;
+    }
+    printf("card     %zu logs, %zu readings in %.1f s\n", card.files, card.readings, (BenchNanos() - startNs) / 1e9);
+
+    std::vector<std::string> paths(1, root);
+    std::vector<LogInput> logs = FindLogs(paths);
+    bool ok = logs.size() == card.files;
+
+    struct Run
+    {
+        const char* label;
+        unsigned threads;
+        bool scalar;
+    };
+    const Run runs[] =
+    {
+        { "scalar", 1, true },
+        { "swar", 1, false },
+        { "swar", threads, false }
+    };
+    IngestResult result;
+    for (size_t index = 0; index < sizeof(runs) / sizeof(runs[0]); index++)
+    {
+        WorkPool pool(runs[index].threads);
+        startNs = BenchNanos();
+        IngestLogs(logs, pool, 300, runs[index].scalar, result);
+        uint64_t ingestNs = BenchNanos() - startNs;
+        uint64_t digest = ReadingsDigest(result.readings);
+        bool same = digest == card.digest && result.readings.size() == card.readings;
+        ok = ok && same;
+        printf("ingest   %-6s %2u threads  %7.1f ms  %6.0f MB/s  %5.1f ns/reading  %zu tracks  %zu rejected  "
+            "%zu trailing  %zu stolen  %s\n",
+            runs[index].label, runs[index].threads, ingestNs / 1e6, result.bytes * 1e3 / ingestNs,
+            ingestNs / static_cast<double>(result.readings.size()), result.tracks.size(), result.counters.rejected,
+            result.counters.trailing, pool.Steals(), same ? "ok" : "MISMATCH");
+    }
+
+    static const char* const names[] = { "gpx", "geojson" };
+    for (int format = ExportFormat_Gpx; format <= ExportFormat_GeoJson; format++)
+    {
+        uint64_t digests[2];
+        for (int run = 0; run < 2; run++)
+        {
+            WorkPool pool(run ? threads : 1);
+            std::string path = root + "/export-" + std::to_string(pool.Threads()) + "." + names[format];
+            startNs = BenchNanos();
+            size_t written = ExportTracks(result, static_cast<ExportFormat>(format), path.c_str(), pool);
+            uint64_t exportNs = BenchNanos() - startNs;
+            digests[run] = FileDigest(path);
+            printf("export   %-7s %2u threads  %7.1f ms  %6.0f MB/s out  %.1f MB\n", names[format], pool.Threads(),
+                exportNs / 1e6, written * 1e3 / exportNs, written / 1e6);
+            ok = ok && written;
+            std::filesystem::remove(path);
+        }
+        if (digests[0] != digests[1])
+        {
+            printf("export   %s differs between 1 and %u threads\n", names[format], threads);
+            ok = false;
+        }
+    }
+
+    if (!keep)
+    {
+        std::filesystem::remove_all(root);
+    }
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,874 @@
+// Measures and fuzzes the streaming NMEA field decoder.
+//
+//   field_bench [--repeat N] [--fuzz N] [--seed N] capture.nmea...
+//
+// Every field TaskGps decodes in the captures (RMC and GGA time, position,
+// speed, course, date, fix quality, satellites, HDOP and altitude) is decoded
+// by NmeaField and by a copy of the text parsers TaskGps used before it,
+// which buffered each field and converted it at the next comma. Reports
+// whether both agree and host cycles per byte for both ways of walking the
+// capture.
+//
+// --fuzz N feeds N damaged sentences through TaskGps, about half of them with
+// their checksum fixed up so the damage reaches the field decoders, plus N
+// random fields straight into NmeaField. Every reading and decoded value has
+// to stay in range. field_fuzz is this bench built with the address and
+// undefined behaviour sanitizers, which catch anything written out of bounds.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+
+#include "TaskGps.h"
+#include "BenchPipeline.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+
+namespace
+{
+    // the text parsers TaskGps used on its 13 character segment buffer
+    const uint8_t LegacyBufferSize = 13;
+
+    uint8_t LegacyTwoDigits(const char* text)
+    {
+        return (text[0] - '0') * 10 + (text[1] - '0');
+    }
+
+    bool LegacyIsDigits(const char* text, uint8_t count)
+    {
+        for (uint8_t index = 0; index < count; index++)
+        {
+            if (text[index] < '0' || text[index] > '9')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool LegacyTime(const char* text, GpsReading& reading, uint16_t* milliseconds)
+    {
+        reading.dateTime &= GPS_DATETIME_DATE_MASK;
+        *milliseconds = 0;
+        if (!LegacyIsDigits(text, 6))
+        {
+            return false;
+        }
+        reading.dateTime |= (static_cast<uint32_t>(LegacyTwoDigits(text)) << GPS_DATETIME_HOUR_SHIFT) |
+            (static_cast<uint32_t>(LegacyTwoDigits(text + 2)) << GPS_DATETIME_MINUTE_SHIFT) |
+            LegacyTwoDigits(text + 4);
+        if (text[6] == '.')
+        {
+            text += 7;
+            for (uint16_t scale = 100; scale && *text >= '0' && *text <= '9'; scale /= 10)
+            {
+                *milliseconds += (*text++ - '0') * scale;
+            }
+        }
+        return true;
+    }
+
+    bool LegacyDate(const char* text, GpsReading& reading)
+    {
+        reading.dateTime &= GPS_DATETIME_TIME_MASK;
+        if (!LegacyIsDigits(text, 6))
+        {
+            return false;
+        }
+        reading.dateTime |= (static_cast<uint32_t>(LegacyTwoDigits(text)) << GPS_DATETIME_DAY_SHIFT) |
+            (static_cast<uint32_t>(LegacyTwoDigits(text + 2)) << GPS_DATETIME_MONTH_SHIFT) |
+            (static_cast<uint32_t>(LegacyTwoDigits(text + 4)) << GPS_DATETIME_YEAR_SHIFT);
+        return true;
+    }
+
+    bool LegacyCoordinate(const char* text, int32_t* value, uint8_t* decimals)
+    {
+        uint32_t whole = 0;
+        uint8_t wholeDigits = 0;
+        while (*text >= '0' && *text <= '9')
+        {
+            whole = whole * 10 + (*text++ - '0');
+            wholeDigits++;
+        }
+        if (wholeDigits < 3 || wholeDigits > 5)
+        {
+            return false;
+        }
+
+        uint32_t fraction = 0;
+        uint8_t fractionDigits = 0;
+        if (*text == '.')
+        {
+            text++;
+            while (*text >= '0' && *text <= '9')
+            {
+                if (fractionDigits < 7)
+                {
+                    fraction = fraction * 10 + (*text - '0');
+                    fractionDigits++;
+                }
+                text++;
+            }
+        }
+
+        uint32_t minutes = (whole % 100) * GpsPowerOfTen(fractionDigits) + fraction;
+        *value = static_cast<int32_t>((whole / 100) * 10000000UL +
+            (minutes * GpsPowerOfTen(7 - fractionDigits) + 30) / 60);
+        *decimals = fractionDigits;
+        return true;
+    }
+
+    bool LegacyHundredths(const char* text, int32_t* value)
+    {
+        bool negative = (*text == '-');
+        if (negative)
+        {
+            text++;
+        }
+        if (*text < '0' || *text > '9')
+        {
+            return false;
+        }
+
+        int32_t hundredths = 0;
+        while (*text >= '0' && *text <= '9')
+        {
+            hundredths = hundredths * 10 + (*text++ - '0');
+        }
+        hundredths *= 100;
+        if (*text == '.')
+        {
+            text++;
+            if (*text >= '0' && *text <= '9')
+            {
+                hundredths += (*text++ - '0') * 10;
+                if (*text >= '0' && *text <= '9')
+                {
+                    hundredths += *text - '0';
+                }
+            }
+        }
+
+        *value = negative ? -hundredths : hundredths;
+        return true;
+    }
+
+    bool LegacyInteger(const char* text, uint16_t* value)
+    {
+        if (!LegacyIsDigits(text, 1))
+        {
+            return false;
+        }
+        *value = static_cast<uint16_t>(atoi(text));
+        return true;
+    }
+
+    // what a field is decoded as
+    enum Check
+    {
+        Check_None,
+        Check_Time,
+        Check_Date,
+        Check_Latitude,
+        Check_Longitude,
+        Check_Hundredths,
+        Check_Integer
+    };
+
+    // the fields TaskGps::FieldKind decodes
+    Check FieldCheck(NMEA_SENTENCE sentence, int segment)
+    {
+        if (sentence == NMEA_SENTENCE_RMC)
+        {
+            switch (segment)
+            {
+            case 1: return Check_Time;
+            case 3: return Check_Latitude;
+            case 5: return Check_Longitude;
+            case 7:
+            case 8: return Check_Hundredths;
+            case 9: return Check_Date;
+            }
+        }
+        else if (sentence == NMEA_SENTENCE_GGA)
+        {
+            switch (segment)
+            {
+            case 1: return Check_Time;
+            case 6:
+            case 7: return Check_Integer;
+            case 8:
+            case 9: return Check_Hundredths;
+            }
+        }
+        return Check_None;
+    }
+
+    NMEA_FIELD CheckKind(Check check)
+    {
+        switch (check)
+        {
+        case Check_Time:
+        case Check_Date:
+            return NMEA_FIELD_Clock;
+        case Check_None:
+            return NMEA_FIELD_Skip;
+        default:
+            return NMEA_FIELD_Number;
+        }
+    }
+
+    // one decoded field, the same for both decoders when they agree
+    struct Decoded
+    {
+        bool valid;
+        int32_t value;
+        uint32_t extra;
+    };
+
+    Decoded DecodeLegacy(Check check, const char* text)
+    {
+        Decoded decoded = { false, 0, 0 };
+        GpsReading reading;
+        memset(&reading, 0, sizeof(reading));
+        uint16_t integer = 0;
+        uint8_t decimals = 0;
+        switch (check)
+        {
+        case Check_Time:
+            decoded.valid = LegacyTime(text, reading, &integer);
+            decoded.value = reading.dateTime;
+            decoded.extra = integer;
+            break;
+        case Check_Date:
+            decoded.valid = LegacyDate(text, reading);
+            decoded.value = reading.dateTime;
+            break;
+        case Check_Latitude:
+        case Check_Longitude:
+            decoded.valid = LegacyCoordinate(text, &decoded.value, &decimals);
+            decoded.extra = decimals;
+            break;
+        case Check_Hundredths:
+            decoded.valid = LegacyHundredths(text, &decoded.value);
+            break;
+        case Check_Integer:
+            decoded.valid = LegacyInteger(text, &integer);
+            decoded.value = integer;
+            break;
+        default:
+            break;
+        }
+        return decoded;
+    }
+
+    Decoded DecodeField(Check check, const NmeaField& field)
+    {
+        Decoded decoded = { false, 0, 0 };
+        GpsReading reading;
+        memset(&reading, 0, sizeof(reading));
+        uint16_t integer = 0;
+        uint8_t decimals = 0;
+        switch (check)
+        {
+        case Check_Time:
+            decoded.valid = field.Time(reading, &integer);
+            decoded.value = reading.dateTime;
+            decoded.extra = integer;
+            break;
+        case Check_Date:
+            decoded.valid = field.Date(reading);
+            decoded.value = reading.dateTime;
+            break;
+        case Check_Latitude:
+        case Check_Longitude:
+            decoded.valid = field.Coordinate(&decoded.value, &decimals, check == Check_Latitude ? 90 : 180);
+            decoded.extra = decimals;
+            break;
+        case Check_Hundredths:
+            decoded.valid = field.Hundredths(&decoded.value);
+            break;
+        case Check_Integer:
+            decoded.valid = field.Integer(&integer);
+            decoded.value = integer;
+            break;
+        default:
+            break;
+        }
+        return decoded;
+    }
+
+    // walks sentences field by field, the same way for both decoders
+    struct FieldWalk
+    {
+        NMEA_SENTENCE sentence;
+        int segment;
+        uint8_t length;
+        char address[NMEA_FIELD_TEXT_SIZE];
+
+        void Start()
+        {
+            sentence = NMEA_SENTENCE_Unknown;
+            segment = 0;
+            length = 0;
+        }
+    };
+
+    struct Walked
+    {
+        uint64_t fields;
+        uint64_t valid;
+        uint64_t sum;
+    };
+
+    void Tally(Walked& walked, const Decoded& decoded)
+    {
+        walked.fields++;
+        if (decoded.valid)
+        {
+            walked.valid++;
+            walked.sum += static_cast<uint32_t>(decoded.value) + decoded.extra;
+        }
+    }
+
+    // the former way, characters into a buffer, converted at the separator
+    Walked WalkLegacy(const std::vector<uint8_t>& bytes)
+    {
+        Walked walked = { 0, 0, 0 };
+        FieldWalk walk;
+        walk.Start();
+        walk.segment = -1;
+        char buffer[LegacyBufferSize];
+        uint8_t bufferIndex = 0;
+
+        for (size_t index = 0; index < bytes.size(); index++)
+        {
+            char character = static_cast<char>(bytes[index]);
+            if (character == '$')
+            {
+                walk.Start();
+                bufferIndex = 0;
+            }
+            else if (walk.segment < 0)
+            {
+            }
+            else if (character == ',' || character == '*')
+            {
+                buffer[bufferIndex] = '\0';
+                if (walk.segment == 0)
+                {
+                    walk.sentence = IdentifyNmeaSentence(buffer, bufferIndex);
+                }
+                else
+                {
+                    Check check = FieldCheck(walk.sentence, walk.segment);
+                    if (check != Check_None)
+                    {
+                        Tally(walked, DecodeLegacy(check, buffer));
+                    }
+                }
+                walk.segment = (character == '*') ? -1 : walk.segment + 1;
+                bufferIndex = 0;
+            }
+            else if (character == '\r' || character == '\n')
+            {
+                walk.segment = -1;
+            }
+            else if (bufferIndex < LegacyBufferSize - 1)
+            {
+                buffer[bufferIndex++] = character;
+            }
+            else
+            {
+                walk.segment = -1;
+            }
+        }
+        return walked;
+    }
+
+    // NmeaField, decoded as the characters arrive
+    Walked WalkStreaming(const std::vector<uint8_t>& bytes)
+    {
+        Walked walked = { 0, 0, 0 };
+        NmeaField field;
+        FieldWalk walk;
+        walk.Start();
+        walk.segment = -1;
+        Check check = Check_None;
+
+        for (size_t index = 0; index < bytes.size(); index++)
+        {
+            char character = static_cast<char>(bytes[index]);
+            if (character == '$')
+            {
+                walk.Start();
+                field.Begin(NMEA_FIELD_Address);
+            }
+            else if (walk.segment < 0)
+            {
+            }
+            else if (character == ',' || character == '*')
+            {
+                if (walk.segment == 0)
+                {
+                    walk.sentence = IdentifyNmeaSentence(field.Text(), field.Length());
+                }
+                else if (check != Check_None)
+                {
+                    Tally(walked, DecodeField(check, field));
+                }
+                walk.segment = (character == '*') ? -1 : walk.segment + 1;
+                check = FieldCheck(walk.sentence, walk.segment);
+                field.Begin(CheckKind(check));
+            }
+            else if (character == '\r' || character == '\n')
+            {
+                walk.segment = -1;
+            }
+            else
+            {
+                field.Read(character);
+            }
+        }
+        return walked;
+    }
+
+    // every decoded field of the captures through both decoders
+    size_t CompareFields(const std::vector<uint8_t>& bytes, size_t* fields)
+    {
+        size_t disagree = 0;
+        *fields = 0;
+        size_t index = 0;
+        while (index < bytes.size())
+        {
+            if (bytes[index] != '$')
+            {
+                index++;
+                continue;
+            }
+
+            size_t end = index + 1;
+            while (end < bytes.size() && bytes[end] != '*' && bytes[end] != '\r' && bytes[end] != '\n')
+            {
+                end++;
+            }
+            std::string sentence(bytes.begin() + index + 1, bytes.begin() + end);
+            index = end;
+
+            std::vector<std::string> parts;
+            size_t start = 0;
+            for (size_t comma = sentence.find(','); ; comma = sentence.find(',', start))
+            {
+                parts.push_back(sentence.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+                if (comma == std::string::npos)
+                {
+                    break;
+                }
+                start = comma + 1;
+            }
+
+            NMEA_SENTENCE kind = IdentifyNmeaSentence(parts[0].c_str(), static_cast<uint8_t>(parts[0].size()));
+            for (size_t segment = 1; segment < parts.size(); segment++)
+            {
+                Check check = FieldCheck(kind, static_cast<int>(segment));
+                if (check == Check_None || parts[segment].size() >= LegacyBufferSize)
+                {
+                    continue;
+                }
+
+                NmeaField field;
+                field.Begin(CheckKind(check));
+                for (size_t character = 0; character < parts[segment].size(); character++)
+                {
+                    field.Read(parts[segment][character]);
+                }
+                Decoded legacy = DecodeLegacy(check, parts[segment].c_str());
+                Decoded streamed = DecodeField(check, field);
+                (*fields)++;
+                if (legacy.valid != streamed.valid ||
+                        (legacy.valid && (legacy.value != streamed.value || legacy.extra != streamed.extra)))
+                {
+                    if (disagree < 5)
+                    {
+                        printf("  disagree on \"%s\" field %zu \"%s\"\n", parts[0].c_str(), segment, parts[segment].c_str());
+                    }
+                    disagree++;
+                }
+            }
+        }
+        return disagree;
+    }
+
+    // the fastest of a few rounds, the host is shared with other work
+    template <typename Walk>
+    double CyclesPerByte(const std::vector<uint8_t>& bytes, int repeat, Walk walk, Walked* walked)
+    {
+        *walked = walk(bytes);
+        double best = 0;
+        for (int round = 0; round < 5; round++)
+        {
+            uint64_t sum = 0;
+            uint64_t startCycles = BenchCycles();
+            for (int pass = 0; pass < repeat; pass++)
+            {
+                sum += walk(bytes).sum;
+            }
+            double cycles = static_cast<double>(BenchCycles() - startCycles) / (static_cast<double>(bytes.size()) * repeat);
+            if (sum != walked->sum * repeat)
+            {
+                printf("  walks differ between passes\n");
+            }
+            if (round == 0 || cycles < best)
+            {
+                best = cycles;
+            }
+        }
+        return best;
+    }
+
+    // ------------------------------------------------------------- fuzzing
+
+    std::mt19937 s_random;
+
+    uint32_t Random(uint32_t below)
+    {
+        return std::uniform_int_distribution<uint32_t>(0, below - 1)(s_random);
+    }
+
+    bool Fail(const char* what, const std::string& input)
+    {
+        printf("  FAILED: %s on \"%s\"\n", what, input.c_str());
+        return false;
+    }
+
+    // characters numbers are made of, and some that never belong in one
+    char RandomFieldCharacter()
+    {
+        static const char alphabet[] = "0123456789012345678901234567890123456789..--+ENSWAV*$,\x80\xff";
+        return alphabet[Random(sizeof(alphabet) - 1)];
+    }
+
+    bool FuzzField(std::string& input)
+    {
+        static const NMEA_FIELD kinds[] =
+        {
+            NMEA_FIELD_Skip, NMEA_FIELD_Address, NMEA_FIELD_Letter, NMEA_FIELD_Clock, NMEA_FIELD_Number
+        };
+        NMEA_FIELD kind = kinds[Random(sizeof(kinds) / sizeof(kinds[0]))];
+
+        // mostly short fields, now and then one longer than the length counter
+        size_t length = Random(8) ? Random(24) : Random(400);
+        input.clear();
+        for (size_t index = 0; index < length; index++)
+        {
+            input.push_back(RandomFieldCharacter());
+        }
+
+        NmeaField field;
+        field.Begin(kind);
+        for (size_t index = 0; index < input.size(); index++)
+        {
+            field.Read(input[index]);
+        }
+        if (field.Length() != (input.size() < 255 ? input.size() : 255))
+        {
+            return Fail("length", input);
+        }
+
+        GpsReading reading;
+        memset(&reading, 0, sizeof(reading));
+        uint16_t milliseconds;
+        if (field.Time(reading, &milliseconds) &&
+                (GpsDateTimeHour(reading.dateTime) > 23 || GpsDateTimeMinute(reading.dateTime) > 59 ||
+                GpsDateTimeSecond(reading.dateTime) > 60 || milliseconds > 999 || reading.dateTime & GPS_DATETIME_DATE_MASK))
+        {
+            return Fail("time out of range", input);
+        }
+        memset(&reading, 0, sizeof(reading));
+        if (field.Date(reading) &&
+                (GpsDateTimeMonth(reading.dateTime) < 1 || GpsDateTimeMonth(reading.dateTime) > 12 ||
+                GpsDateTimeDay(reading.dateTime) < 1 || reading.dateTime & GPS_DATETIME_TIME_MASK))
+        {
+            return Fail("date out of range", input);
+        }
+
+        int32_t coordinate;
+        uint8_t decimals;
+        if (field.Coordinate(&coordinate, &decimals, 90) && (coordinate < 0 || coordinate > 900000000 || decimals > 7))
+        {
+            return Fail("latitude out of range", input);
+        }
+        if (field.Coordinate(&coordinate, &decimals, 180) && (coordinate < 0 || coordinate > 1800000000 || decimals > 7))
+        {
+            return Fail("longitude out of range", input);
+        }
+
+        int32_t hundredths;
+        if (field.Hundredths(&hundredths) && (hundredths > 2000000099 || hundredths < -2000000099))
+        {
+            return Fail("hundredths out of range", input);
+        }
+        uint16_t integer;
+        if (field.Integer(&integer) && kind != NMEA_FIELD_Number)
+        {
+            return Fail("integer from a field that is no number", input);
+        }
+        return true;
+    }
+
+    // sentences of the captures, without line ends
+    std::vector<std::string> Sentences(const std::vector<uint8_t>& bytes)
+    {
+        std::vector<std::string> sentences;
+        size_t index = 0;
+        while (index < bytes.size())
+        {
+            size_t end = index;
+            while (end < bytes.size() && bytes[end] != '\r' && bytes[end] != '\n')
+            {
+                end++;
+            }
+            if (end > index && bytes[index] == '$')
+            {
+                sentences.push_back(std::string(bytes.begin() + index, bytes.begin() + end));
+            }
+            index = end + 1;
+        }
+        return sentences;
+    }
+
+    void FixChecksum(std::string& sentence)
+    {
+        size_t star = sentence.rfind('*');
+        if (star == std::string::npos || star + 3 > sentence.size() || sentence.empty() || sentence[0] != '$')
+        {
+            return;
+        }
+        uint8_t checksum = 0;
+        for (size_t index = 1; index < star; index++)
+        {
+            checksum ^= static_cast<uint8_t>(sentence[index]);
+        }
+        static const char hex[] = "0123456789ABCDEF";
+        sentence[star + 1] = hex[checksum >> 4];
+        sentence[star + 2] = hex[checksum & 0x0f];
+    }
+
+    std::string Damage(std::string sentence)
+    {
+        size_t changes = 1 + Random(3);
+        for (size_t change = 0; change < changes && !sentence.empty(); change++)
+        {
+            size_t at = Random(static_cast<uint32_t>(sentence.size()));
+            switch (Random(5))
+            {
+            case 0:
+                sentence[at] = static_cast<char>(Random(256));
+                break;
+            case 1:
+                sentence[at] = RandomFieldCharacter();
+                break;
+            case 2:
+                sentence.erase(at, 1 + Random(4));
+                break;
+            case 3:
+                // a field far longer than any the receiver sends
+                sentence.insert(at, std::string(1 + Random(300), static_cast<char>('0' + Random(10))));
+                break;
+            default:
+                sentence.insert(at, std::string(1 + Random(200), ','));
+                break;
+            }
+        }
+        if (Random(2))
+        {
+            FixChecksum(sentence);
+        }
+        return sentence;
+    }
+
+    struct FuzzResult
+    {
+        uint64_t readings;
+        uint64_t bad;
+    };
+
+    FuzzResult s_fuzz;
+
+    void OnFuzzReading(const GpsReading& reading)
+    {
+        s_fuzz.readings++;
+        bool bad = GpsDateTimeHour(reading.dateTime) > 23 || GpsDateTimeMinute(reading.dateTime) > 59 ||
+            GpsDateTimeSecond(reading.dateTime) > 60;
+        if (reading.flags & GPS_READING_DATE)
+        {
+            bad = bad || GpsDateTimeMonth(reading.dateTime) < 1 || GpsDateTimeMonth(reading.dateTime) > 12 ||
+                GpsDateTimeDay(reading.dateTime) < 1;
+        }
+        if (reading.flags & GPS_READING_POSITION)
+        {
+            bad = bad || reading.latitude > 900000000 || reading.latitude < -900000000 ||
+                reading.longitude > 1800000000 || reading.longitude < -1800000000 ||
+                (reading.flags >> GPS_READING_DECIMALS_SHIFT) > 7;
+        }
+        if (bad)
+        {
+            if (s_fuzz.bad < 5)
+            {
+                printf("  reading out of range %08x %d %d\n", static_cast<unsigned>(reading.dateTime),
+                    static_cast<int>(reading.latitude), static_cast<int>(reading.longitude));
+            }
+            s_fuzz.bad++;
+        }
+    }
+
+    void OnFuzzBatch()
+    {
+    }
+
+    void OnFuzzFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+    }
+
+    // damaged sentences among clean ones through TaskGps, sanitizers watching
+    bool FuzzTaskGps(const std::vector<std::string>& sentences, size_t damaged)
+    {
+        std::vector<uint8_t> stream;
+        size_t dollars = 0;
+        for (size_t count = 0; count < damaged; count++)
+        {
+            const std::string& clean = sentences[Random(static_cast<uint32_t>(sentences.size()))];
+            std::string sentence = Random(4) ? Damage(clean) : clean;
+            stream.insert(stream.end(), sentence.begin(), sentence.end());
+            stream.push_back('\r');
+            stream.push_back('\n');
+            for (size_t index = 0; index < sentence.size(); index++)
+            {
+                dollars += (sentence[index] == '$');
+            }
+        }
+
+        CaptureLine line;
+        line.Append(stream);
+        line.SetFlood(true);
+        HostSim::SetNowUs(0);
+        memset(&HostSim::Uart(), 0, sizeof(HostSim::Uart()));
+        HostSim::SetUartLine(&line);
+        memset(&s_fuzz, 0, sizeof(s_fuzz));
+
+        BenchPipeline pipeline(OnFuzzReading, OnFuzzBatch, OnFuzzFixChanged);
+        pipeline.Start();
+        while (!line.Finished())
+        {
+            pipeline.Loop();
+        }
+        pipeline.Finish();
+        HostSim::SetUartLine(NULL);
+
+        const GpsSentenceCounters& counters = pipeline.taskGps.SentenceCounters();
+        printf("fuzz sentences       %zu, %zu bytes\n", damaged, stream.size());
+        printf("  accepted/rejected/truncated  %lu/%lu/%lu\n", static_cast<unsigned long>(counters.accepted),
+            static_cast<unsigned long>(counters.rejected), static_cast<unsigned long>(counters.truncated));
+        printf("  readings           %llu, out of range %llu\n",
+            static_cast<unsigned long long>(s_fuzz.readings), static_cast<unsigned long long>(s_fuzz.bad));
+
+        bool ok = s_fuzz.bad == 0;
+        if (counters.accepted + counters.rejected + counters.truncated > dollars)
+        {
+            printf("  FAILED: more sentences counted than started\n");
+            ok = false;
+        }
+        return ok;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<uint8_t> bytes;
+    int repeat = 20;
+    size_t fuzz = 0;
+    uint32_t seed = 1;
+
+    for (int index = 1; index < argc; index++)
+    {
+        CaptureLine line;
+        if (!strcmp(argv[index], "--repeat") && index + 1 < argc)
+        {
+            repeat = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--fuzz") && index + 1 < argc)
+        {
+            fuzz = strtoul(argv[++index], NULL, 10);
+        }
+        else if (!strcmp(argv[index], "--seed") && index + 1 < argc)
+        {
+            seed = strtoul(argv[++index], NULL, 10);
+        }
+        else if (line.Load(argv[index]))
+        {
+            bytes.insert(bytes.end(), line.Bytes().begin(), line.Bytes().end());
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s\n", argv[index]);
+            return 1;
+        }
+    }
+    if (bytes.empty())
+    {
+        fprintf(stderr, "usage: %s [--repeat N] [--fuzz N] [--seed N] capture...\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    if (!fuzz)
+    {
+        size_t fields;
+        size_t disagree = CompareFields(bytes, &fields);
+        printf("fields decoded       %zu, decoders disagree on %zu\n", fields, disagree);
+        ok = (disagree == 0);
+
+        Walked legacy, streaming;
+        double legacyCycles = CyclesPerByte(bytes, repeat, WalkLegacy, &legacy);
+        double streamingCycles = CyclesPerByte(bytes, repeat, WalkStreaming, &streaming);
+        printf("buffered  %6.2f cycles/byte  %llu fields, %llu valid  RAM %zu bytes\n", legacyCycles,
+            static_cast<unsigned long long>(legacy.fields), static_cast<unsigned long long>(legacy.valid),
+            static_cast<size_t>(LegacyBufferSize + 1));
+        printf("streaming %6.2f cycles/byte  %llu fields, %llu valid  RAM %zu bytes\n", streamingCycles,
+            static_cast<unsigned long long>(streaming.fields), static_cast<unsigned long long>(streaming.valid),
+            sizeof(NmeaField));
+        if (legacy.sum != streaming.sum || legacy.valid != streaming.valid)
+        {
+            printf("  FAILED: the walks decoded different values\n");
+            ok = false;
+        }
+    }
+    else
+    {
+        s_random.seed(seed);
+        std::string input;
+        size_t fields = 0;
+        for (; fields < fuzz && FuzzField(input); fields++)
+        {
+        }
+        printf("fuzz fields          %zu of %zu in range\n", fields, fuzz);
+        ok = (fields == fuzz);
+
+        std::vector<std::string> sentences = Sentences(bytes);
+        ok &= FuzzTaskGps(sentences, fuzz);
+    }
+
+    printf("%s\n", ok ? "fields ok" : "fields FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+// Measures bounding box and time range queries against the size of the card indexed.
+//
+//   index_bench [--mb N[,N...]] [--runs N] [--zoom Z] [--threads N] [--out DIR] [--keep]
+//
+// For each size writes N MB of SyntheticCard.h's hourly logs into DIR, 16,
+// 64 and 256 MB by default, --mb 1024,4096 for years of logging, indexes
+// them and asks the queries below of the index, the best of --runs (5) with
+// the mapping warm, and once of the logs themselves, reading only the ones
+// named for the hours of the range. Fails unless both give the same
+// readings for every query. The card is removed afterwards unless --keep.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LogIndex.h"
+#include "SyntheticCard.h"
+#include "BenchClock.h"
+
+namespace
+{
+    struct BenchQuery
+    {
+        const char* name;
+        int32_t latitudeSpan;   // 1e-7 degrees either side of where the drive starts, 0 for all of it
+        int32_t longitudeSpan;
+        uint32_t startHours;    // after the first reading
+        uint32_t hours;         // 0 for all of the card
+    };
+
+    const BenchQuery Queries[] =
+    {
+        { "street, a day", 50000, 75000, 0, 24 },
+        { "street, ever", 50000, 75000, 0, 0 },
+        { "town, a week", 500000, 750000, 0, 24 * 7 },
+        { "drive, an hour", 0, 0, 50, 1 },
+        { "drive, a month", 0, 0, 24, 24 * 30 },
+    };
+
+    const size_t QueryCount = sizeof(Queries) / sizeof(Queries[0]);
+
+    LogQuery MakeQuery(const BenchQuery& bench, const SyntheticCard& card, const GpsReading& start)
+    {
+        LogQuery query;
+        if (bench.latitudeSpan)
+        {
+            query.box.south = start.latitude - bench.latitudeSpan;
+            query.box.north = start.latitude + bench.latitudeSpan;
+            query.box.west = start.longitude - bench.longitudeSpan;
+            query.box.east = start.longitude + bench.longitudeSpan;
+        }
+        else
+        {
+            query.box.south = SYNTHETIC_LATITUDE;
+            query.box.north = SYNTHETIC_LATITUDE + 10000000L;
+            query.box.west = SYNTHETIC_LONGITUDE - 10000000L;
+            query.box.east = SYNTHETIC_LONGITUDE;
+        }
+        query.from = card.firstSeconds + bench.startHours * 3600;
+        query.to = bench.hours ? query.from + bench.hours * 3600 - 1 : card.lastSeconds;
+        return query;
+    }
+
+    std::vector<size_t> ParseSizes(const char* text)
+    {
+        std::vector<size_t> sizes;
+        while (*text)
+        {
+            char* end;
+            size_t size = strtoul(text, &end, 10);
+            if (end == text || !size || (*end && *end != ','))
+            {
+                return std::vector<size_t>();
+            }
+            sizes.push_back(size);
+            text = *end ? end + 1 : end;
+        }
+        return sizes;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> sizes;
+    sizes.push_back(16);
+    sizes.push_back(64);
+    sizes.push_back(256);
+    unsigned runs = 5;
+    int zoom = LOG_INDEX_ZOOM;
+    unsigned threads = std::thread::hardware_concurrency();
+    std::string root = "build/index-card";
+    bool keep = false;
+
+    bool usage = false;
+    for (int index = 1; index < argc && !usage; index++)
+    {
+        if (!strcmp(argv[index], "--mb") && index + 1 < argc)
+        {
+            sizes = ParseSizes(argv[++index]);
+            usage = sizes.empty();
+        }
+        else if (!strcmp(argv[index], "--runs") && index + 1 < argc)
+        {
+            runs = atoi(argv[++index]);
+            usage = !runs;
+        }
+        else if (!strcmp(argv[index], "--zoom") && index + 1 < argc)
+        {
+            zoom = atoi(argv[++index]);
+            usage = zoom < 0 || zoom > LOG_INDEX_MAX_ZOOM;
+        }
+        else if (!strcmp(argv[index], "--threads") && index + 1 < argc)
+        {
+            threads = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--out") && index + 1 < argc)
+        {
+            root = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--keep"))
+        {
+            keep = true;
+        }
+        else
+        {
+            usage = true;
+        }
+    }
+    if (usage)
+    {
+        fprintf(stderr, "usage: %s [--mb N[,N...]] [--runs N] [--zoom Z] [--threads N] [--out DIR] [--keep]\n",
+            argv[0]);
+        return 2;
+    }
+
+    WorkPool pool(threads);
+    bool ok = true;
+    std::vector<std::vector<double> > latencies(QueryCount);
+    for (size_t size = 0; size < sizes.size(); size++)
+    {
+        std::filesystem::remove_all(root);
+        SyntheticCard card;
+        if (!WriteSyntheticCard(root, sizes[size] * 1000000, card))
+        {
+            return 1;
+        }
+
+        uint64_t startNs = BenchNanos();
+        std::vector<LogInput> logs = FindLogs(std::vector<std::string>(1, root));
+        IngestResult result;
+        IngestLogs(logs, pool, UINT32_MAX, false, result);
+        uint64_t ingestNs = BenchNanos() - startNs;
+        startNs = BenchNanos();
+        std::string indexPath = root + "/INDEX.GLX";
+        size_t indexBytes = BuildLogIndex(result, logs, zoom, indexPath.c_str(), pool);
+        uint64_t buildNs = BenchNanos() - startNs;
+
+        LogIndexReader reader;
+        startNs = BenchNanos();
+        if (!indexBytes || !reader.Open(indexPath.c_str()))
+        {
+            fprintf(stderr, "cannot index %s\n", root.c_str());
+            return 1;
+        }
+        uint64_t openNs = BenchNanos() - startNs;
+        printf("card   %4zu MB  %6zu logs  %9zu readings  ingest %7.1f ms  index %6.1f MB in %6.1f ms, "
+            "opened in %.3f ms\n", card.bytes / 1000000, card.files, result.readings.size(), ingestNs / 1e6,
+            indexBytes / 1e6, buildNs / 1e6, openNs / 1e6);
+
+        GpsReading start = result.readings[0];
+        for (size_t index = 0; index < result.readings.size(); index++)
+        {
+            if (result.readings[index].flags & GPS_READING_POSITION)
+            {
+                start = result.readings[index];
+                break;
+            }
+        }
+        result = IngestResult();
+
+        for (size_t bench = 0; bench < QueryCount; bench++)
+        {
+            LogQuery query = MakeQuery(Queries[bench], card, start);
+            std::vector<GpsReading> found;
+            LogQueryStats stats;
+            uint64_t bestNs = UINT64_MAX;
+            for (unsigned run = 0; run < runs; run++)
+            {
+                startNs = BenchNanos();
+                ok = reader.Query(query, found, stats) && ok;
+                bestNs = std::min<uint64_t>(bestNs, BenchNanos() - startNs);
+            }
+
+            std::vector<GpsReading> scanned;
+            size_t skipped;
+            startNs = BenchNanos();
+            ScanLogs(logs, query, pool, scanned, &skipped);
+            uint64_t scanNs = BenchNanos() - startNs;
+
+            bool same = ReadingsDigest(found) == ReadingsDigest(scanned) && found.size() == scanned.size();
+            ok = ok && same;
+            latencies[bench].push_back(bestNs / 1e6);
+            printf("  %-15s %8zu found  index %8.3f ms, %4zu hours %5zu blocks %8zu points %7.2f MB read  "
+                "scan %8.1f ms, %5zu logs skipped  %s\n", Queries[bench].name, found.size(), bestNs / 1e6,
+                stats.hours, stats.blocks, stats.points, stats.bytes / 1e6, scanNs / 1e6, skipped,
+                same ? "ok" : "MISMATCH");
+        }
+    }
+
+    printf("index latency ms by card size\n  %-15s", "");
+    for (size_t size = 0; size < sizes.size(); size++)
+    {
+        printf(" %7zu MB", sizes[size]);
+    }
+    printf("\n");
+    for (size_t bench = 0; bench < QueryCount; bench++)
+    {
+        printf("  %-15s", Queries[bench].name);
+        for (size_t size = 0; size < latencies[bench].size(); size++)
+        {
+            printf(" %10.3f", latencies[bench][size]);
+        }
+        printf("\n");
+    }
+
+    if (!keep)
+    {
+        std::filesystem::remove_all(root);
+    }
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
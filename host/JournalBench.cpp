@@ -0,0 +1,376 @@
+// Pulls the power on a journaled log at every block write and checks what survives.
+//
+//   journal_bench [--out DIR] capture.nmea...
+//
+// Built with LOG_JOURNAL. The capture is replayed in real time through TaskGps
+// and TaskLogWriter into a journaled CSV log, once without a cut for reference,
+// then once per block write with the power failing while that block is
+// written, torn after 0, 12 and 511 bytes. After each cut the card gets
+// power back, LogFile::Recover() runs like setup() does, and the file is
+// reopened, appended to and closed. The recovered records have to be a prefix
+// of the reference with contiguous sequence numbers, and every record synced
+// before the cut has to be there, only those written since may be missing.
+// Fails too when what a cut costs, the records lost plus how long they can
+// wait in RAM before TaskLogWriter writes them, spans more than
+// LOG_JOURNAL_WINDOW_MS. Reports the worst loss and what the reference run
+// cost in directory entry writes, syncs and block writes.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+#include "SdFat.h"
+
+#include "TaskGps.h"
+#include "LogJournal.h"
+#include "BenchPipeline.h"
+#include "LogFile.h"
+#include "LogFormat.h"
+
+#include "Capture.h"
+
+#if !LOG_JOURNAL
+#error journal_bench needs LOG_JOURNAL
+#endif
+
+namespace
+{
+    const char* const LogName = "JOURNAL.CSV";
+
+    const uint16_t TornBytes[] = { 0, 12, 511 };
+
+    // the log the pipeline writes into, and what it was handed
+    LogFile* s_logFile;
+    std::vector<uint32_t> s_writtenMs;  // when each record was handed over
+    uint32_t s_synced;                  // records handed over before the last sync
+    uint32_t s_lastBatchMs;
+    uint32_t s_longestBatchGapMs;
+
+    void OnBenchReading(const GpsReading& reading)
+    {
+        if (!(reading.flags & GPS_READING_TIME) || HostSd::PowerCut())
+        {
+            return;
+        }
+        char line[CSV_LINE_SIZE];
+        uint8_t length = FormatCsvReading(reading, line);
+        if (s_logFile->write(line, length) == length)
+        {
+            s_writtenMs.push_back(millis());
+        }
+    }
+
+    void OnBenchBatch()
+    {
+        if (HostSd::PowerCut())
+        {
+            return;
+        }
+        s_logFile->BatchWritten();
+        if (!HostSd::PowerCut())
+        {
+            s_synced = s_writtenMs.size();
+        }
+        uint32_t now = millis();
+        if (now - s_lastBatchMs > s_longestBatchGapMs)
+        {
+            s_longestBatchGapMs = now - s_lastBatchMs;
+        }
+        s_lastBatchMs = now;
+    }
+
+    void OnBenchFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+    }
+
+    std::vector<uint8_t> ReadHostFile(const std::string& path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file)
+        {
+            int value;
+            while ((value = fgetc(file)) != EOF)
+            {
+                bytes.push_back(static_cast<uint8_t>(value));
+            }
+            fclose(file);
+        }
+        return bytes;
+    }
+
+    // the journal in a file, the newest copy of each sector as log_to_csv unwraps them
+    struct Journal
+    {
+        std::vector<uint8_t> payload;
+        uint32_t records;
+        size_t blocks;          // the journal takes up
+        bool contiguous;        // it ends at a block that is not valid, not at a gap in the sequence
+    };
+
+    Journal Unwrap(const std::vector<uint8_t>& log)
+    {
+        Journal journal;
+        journal.blocks = 0;
+        journal.contiguous = true;
+        LogJournalCursor cursor;
+        memset(&cursor, 0, sizeof(cursor));
+        size_t blocks = log.size() / LOG_JOURNAL_SECTOR_SIZE;
+        for (size_t block = 0; block < blocks; block++)
+        {
+            const uint8_t* sector = &log[block * LOG_JOURNAL_SECTOR_SIZE];
+            if (!IsLogJournalSector(sector))
+            {
+                if (block + 1 < blocks && IsLogJournalSector(sector + LOG_JOURNAL_SECTOR_SIZE))
+                {
+                    continue;
+                }
+                break;
+            }
+            LogJournalStep step = StepLogJournal(cursor, sector);
+            if (step == LogJournalStep_End)
+            {
+                journal.contiguous = false;
+                break;
+            }
+            if (step != LogJournalStep_Older)
+            {
+                journal.payload.resize(cursor.payloadBefore);
+                journal.payload.insert(journal.payload.end(), sector + LOG_JOURNAL_HEADER_SIZE,
+                    sector + LOG_JOURNAL_HEADER_SIZE + cursor.used);
+            }
+            journal.blocks = block + 1;
+        }
+        journal.records = cursor.sequence + cursor.records;
+        return journal;
+    }
+
+    struct Run
+    {
+        bool cut;
+        uint32_t cutMs;
+        uint32_t written;       // records handed to LogFile before the cut
+        uint32_t synced;
+    };
+
+    // the whole capture in real time, the power failing at blockWrites if not 0
+    Run ReplayCapture(SdFat& sd, CaptureLine& line, uint64_t blockWrites, uint16_t tornBytes)
+    {
+        Run run = { false, 0, 0, 0 };
+        sd.remove(LogName);
+        HostSim::SetNowUs(0);
+        line.Rewind();
+
+        LogFile logFile(sd);
+        s_logFile = &logFile;
+        s_writtenMs.clear();
+        s_synced = 0;
+        s_lastBatchMs = 0;
+        s_longestBatchGapMs = 0;
+        logFile.Open(LogName);
+
+        HostSd::ResetCounters();
+        HostSd::CutPowerAfter(blockWrites, tornBytes);
+        {
+            BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+            pipeline.Start();
+            while (!line.Finished())
+            {
+                pipeline.Loop();
+                if (HostSd::PowerCut() && !run.cut)
+                {
+                    run.cut = true;
+                    run.cutMs = millis();
+                    run.written = s_writtenMs.size();
+                    run.synced = s_synced;
+                }
+            }
+            pipeline.Finish();
+        }
+
+        // closing once the power is gone writes nothing
+        logFile.Close();
+        if (HostSd::PowerCut() && !run.cut)
+        {
+            run.cut = true;
+            run.cutMs = millis();
+            run.written = s_writtenMs.size();
+            run.synced = s_synced;
+        }
+        HostSd::RestorePower();
+        return run;
+    }
+
+    struct Loss
+    {
+        uint32_t cuts;
+        uint32_t failures;
+        uint32_t maxLost;           // records handed to LogFile and not recovered
+        uint32_t maxLostUnsynced;   // of them handed over after the last sync
+        uint32_t maxWindowMs;       // cut time minus when the first lost record was handed over
+    };
+
+    bool CheckRecovery(SdFat& sd, const std::string& outDir, const Journal& reference,
+        const Run& run, uint16_t tornBytes, uint64_t blockWrites, Loss& loss)
+    {
+        // boot after the cut
+        sd.begin();
+        {
+            LogFile recovery(sd);
+            recovery.Recover();
+        }
+
+        std::vector<uint8_t> log = ReadHostFile(outDir + "/" + LogName);
+        Journal recovered = Unwrap(log);
+        const char* failure = NULL;
+        if (log.size() != recovered.blocks * LOG_JOURNAL_SECTOR_SIZE)
+        {
+            failure = "not trimmed to its journal";
+        }
+        else if (!recovered.contiguous)
+        {
+            failure = "sequence numbers not contiguous";
+        }
+        else if (recovered.payload.size() > reference.payload.size() ||
+            !std::equal(recovered.payload.begin(), recovered.payload.end(), reference.payload.begin()))
+        {
+            failure = "not a prefix of the reference";
+        }
+        else if (recovered.records > run.written)
+        {
+            failure = "more records than were written";
+        }
+        else if (recovered.records < run.synced)
+        {
+            failure = "lost records synced before the cut";
+        }
+
+        // carry on logging into the recovered file
+        if (!failure)
+        {
+            LogFile logFile(sd);
+            const char extra[] = "reopened\r\n";
+            logFile.Open(LogName);
+            logFile.write(reinterpret_cast<const uint8_t*>(extra), sizeof(extra) - 1);
+            logFile.Close();
+
+            Journal reopened = Unwrap(ReadHostFile(outDir + "/" + LogName));
+            std::vector<uint8_t> expected = recovered.payload;
+            expected.insert(expected.end(), extra, extra + sizeof(extra) - 1);
+            if (!reopened.contiguous || reopened.records != recovered.records + 1 || reopened.payload != expected)
+            {
+                failure = "appending after recovery went wrong";
+            }
+        }
+
+        if (failure)
+        {
+            printf("cut at block write %llu torn after %u bytes: %s\n",
+                static_cast<unsigned long long>(blockWrites), tornBytes, failure);
+            loss.failures++;
+            return false;
+        }
+
+        uint32_t lost = run.written - recovered.records;
+        uint32_t unsynced = run.written - run.synced;
+        if (lost > loss.maxLost)
+        {
+            loss.maxLost = lost;
+        }
+        if ((lost < unsynced ? lost : unsynced) > loss.maxLostUnsynced)
+        {
+            loss.maxLostUnsynced = lost < unsynced ? lost : unsynced;
+        }
+        if (lost && run.cutMs - s_writtenMs[recovered.records] > loss.maxWindowMs)
+        {
+            loss.maxWindowMs = run.cutMs - s_writtenMs[recovered.records];
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string outDir = "journal-card";
+    CaptureLine line;
+    bool haveCapture = false;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--out") && index + 1 < argc)
+        {
+            outDir = argv[++index];
+        }
+        else if (line.Load(argv[index]))
+        {
+            haveCapture = true;
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s\n", argv[index]);
+            return 1;
+        }
+    }
+    if (!haveCapture)
+    {
+        fprintf(stderr, "usage: %s [--out DIR] capture...\n", argv[0]);
+        return 2;
+    }
+
+    HostSim::SetUartLine(&line);
+    HostSd::SetRoot(outDir.c_str());
+    SdFat sd;
+    sd.begin();
+
+    Run uncut = ReplayCapture(sd, line, 0, 0);
+    HostSd::Stats stats = HostSd::Counters();
+    Journal reference = Unwrap(ReadHostFile(outDir + "/" + LogName));
+    if (uncut.cut || !reference.contiguous || reference.records != s_writtenMs.size())
+    {
+        printf("reference journal of %u records does not match the %zu written\n",
+            reference.records, s_writtenMs.size());
+        return 1;
+    }
+
+    printf("reference      %u records in %zu blocks, flush after %lu ms, longest batch gap %u ms\n",
+        reference.records, reference.blocks, static_cast<unsigned long>(LOG_WRITER_FLUSH_MS), s_longestBatchGapMs);
+    printf("sd             %llu dir entry writes  %llu syncs  %llu block writes  %.3f s busy\n",
+        static_cast<unsigned long long>(stats.dirEntryWrites),
+        static_cast<unsigned long long>(stats.syncs),
+        static_cast<unsigned long long>(stats.blockWrites),
+        stats.busyUs / 1e6);
+
+    Loss loss = { 0, 0, 0, 0, 0 };
+    for (size_t torn = 0; torn < sizeof(TornBytes) / sizeof(TornBytes[0]); torn++)
+    {
+        for (uint64_t blockWrites = 1; ; blockWrites++)
+        {
+            Run run = ReplayCapture(sd, line, blockWrites, TornBytes[torn]);
+            if (!run.cut)
+            {
+                break;
+            }
+            loss.cuts++;
+            CheckRecovery(sd, outDir, reference, run, TornBytes[torn], blockWrites, loss);
+        }
+    }
+
+    printf("power cuts     %u  failed %u\n", loss.cuts, loss.failures);
+    printf("worst loss     %u records, %u of them after the last sync, first handed over %u ms before the cut\n",
+        loss.maxLost, loss.maxLostUnsynced, loss.maxWindowMs);
+
+    // a lost record waited in RAM for at most the flush before it was handed over
+    uint32_t windowMs = loss.maxWindowMs + LOG_WRITER_FLUSH_MS;
+    bool withinWindow = windowMs <= LOG_JOURNAL_WINDOW_MS;
+    printf("loss window    %u ms of %lu ms  %s\n", windowMs, static_cast<unsigned long>(LOG_JOURNAL_WINDOW_MS),
+        withinWindow ? "ok" : "EXCEEDED");
+    return (loss.failures || !withinWindow) ? 1 : 0;
+}
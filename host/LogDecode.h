@@ -0,0 +1,768 @@
+// Decodes the logs the sketch writes back into readings, shared by the host tools.
+//
+// Every format the card can hold: CSV lines, BIN records and TRK deltas, any
+// of them journaled (LOG_JOURNAL), and RAW NMEA captures (GPS_RAW_CAPTURE).
+// The CSV parser splits a line with word at a time comparisons and converts
+// its digits eight at a time; DecodeCsvLogScalar feeds the same fields to
+// the firmware's NmeaField instead and is the reference it has to match.
+// Both take a reading for every line with a valid time, a field that is
+// empty or malformed leaves its flag clear the way the firmware getters do.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <vector>
+
+#include "Arduino.h"
+
+#include "GpsReading.h"
+#include "NmeaField.h"
+#include "NmeaSentence.h"
+#include "LogJournal.h"
+#include "LogFormat.h"
+#include "TrackFormat.h"
+#include "TrackThinner.h"
+#include "TripDetector.h"
+
+enum LogKind
+{
+    LogKind_Csv,
+    LogKind_Bin,
+    LogKind_Track,
+    LogKind_Raw,
+    LogKind_TripIndex   // TRIPS.IDX, not a log
+};
+
+struct LogDecodeCounters
+{
+    size_t readings;
+    size_t rejected;    // lines or sentences without a valid time or checksum
+    size_t trailing;    // bytes after the last whole record or line
+};
+
+// the payloads of the sectors of a journaled log, the newest copy of each,
+// stops where the journal does, returns the blocks it takes up
+inline size_t UnwrapLogJournal(const uint8_t* log, size_t size, std::vector<uint8_t>& payload, unsigned long* records)
+{
+    LogJournalCursor cursor;
+    memset(&cursor, 0, sizeof(cursor));
+    size_t blocks = size / LOG_JOURNAL_SECTOR_SIZE;
+    size_t used = 0;
+    payload.clear();
+    for (size_t block = 0; block < blocks; block++)
+    {
+        const uint8_t* sector = log + block * LOG_JOURNAL_SECTOR_SIZE;
+        if (!IsLogJournalSector(sector))
+        {
+            if (block + 1 < blocks && IsLogJournalSector(sector + LOG_JOURNAL_SECTOR_SIZE))
+            {
+                continue;   // torn, the other block of its pair has the sector
+            }
+            break;
+        }
+        LogJournalStep step = StepLogJournal(cursor, sector);
+        if (step == LogJournalStep_End)
+        {
+            break;
+        }
+        if (step != LogJournalStep_Older)
+        {
+            payload.resize(cursor.payloadBefore);
+            payload.insert(payload.end(), sector + LOG_JOURNAL_HEADER_SIZE,
+                sector + LOG_JOURNAL_HEADER_SIZE + cursor.used);
+        }
+        used = block + 1;
+    }
+    *records = cursor.sequence + cursor.records;
+    return used;
+}
+
+// the first block, or the second when the first was torn rewriting its pair
+inline bool IsLogJournal(const uint8_t* log, size_t size)
+{
+    if (size >= LOG_JOURNAL_SECTOR_SIZE && IsLogJournalSector(log))
+    {
+        return true;
+    }
+    const uint8_t* second = log + LOG_JOURNAL_SECTOR_SIZE;
+    return size >= 2 * LOG_JOURNAL_SECTOR_SIZE && IsLogJournalSector(second) && LogJournalSequence(second) == 0;
+}
+
+// by the header of the (unwrapped) log, RAW by the name, CSV otherwise
+inline LogKind IdentifyLog(const uint8_t* log, size_t size, const char* name)
+{
+    if (size >= TRIP_RECORD_SIZE && IsTripHeader(log))
+    {
+        return LogKind_TripIndex;
+    }
+    if (size >= BIN_RECORD_SIZE && IsBinHeader(log))
+    {
+        return LogKind_Bin;
+    }
+    if (size >= TRACK_HEADER_SIZE && IsTrackHeader(log))
+    {
+        return LogKind_Track;
+    }
+    size_t length = strlen(name);
+    if (length >= 4 && !strcasecmp(name + length - 4, ".RAW"))
+    {
+        return LogKind_Raw;
+    }
+    return LogKind_Csv;
+}
+
+inline void DecodeBinLog(const uint8_t* log, size_t size, std::vector<GpsReading>& readings, LogDecodeCounters& counters)
+{
+    size_t offset = BIN_RECORD_SIZE;
+    for (; offset + BIN_RECORD_SIZE <= size; offset += BIN_RECORD_SIZE)
+    {
+        GpsReading reading;
+        UnpackBinReading(log + offset, reading);
+        readings.push_back(reading);
+        counters.readings++;
+    }
+    counters.trailing += size - (offset < size ? offset : size);
+}
+
+inline void DecodeTrackLog(const uint8_t* log, size_t size, std::vector<GpsReading>& readings, LogDecodeCounters& counters)
+{
+    TrackDecoder decoder;
+    const uint8_t* data = log + TRACK_HEADER_SIZE;
+    const uint8_t* end = log + size;
+    while (data < end)
+    {
+        GpsReading reading;
+        uint8_t length = decoder.Decode(data, end, reading);
+        if (!length)
+        {
+            break;
+        }
+        data += length;
+        if (decoder.Synced())
+        {
+            readings.push_back(reading);
+            counters.readings++;
+        }
+    }
+    counters.trailing += end - data;
+}
+
+// CSV fields, date,time,latitude,N/S,longitude,E/W,altitude,satellites
+#define CSV_FIELDS 8
+
+// a line padded to whole words, the longest CSV line and a word to spare
+#define CSV_PADDED_SIZE 88
+
+const uint64_t CsvOnes = 0x0101010101010101ULL;
+
+// 0x80 in every byte of word equal to value, nothing carries between bytes
+inline uint64_t CsvBytesEqual(uint64_t word, uint8_t value)
+{
+    uint64_t bytes = word ^ (CsvOnes * value);
+    return ~(((bytes & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | bytes | 0x7f7f7f7f7f7f7f7fULL);
+}
+
+// the 0x80 markers of the eight bytes as eight bits, byte n to bit n
+inline uint8_t CsvByteMask(uint64_t markers)
+{
+    return ((markers >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+// count (1 to 8) ASCII digits as a number, false when any is not a digit
+inline bool CsvDigits(const char* text, uint8_t count, uint32_t* value)
+{
+    uint64_t word;
+    memcpy(&word, text, 8);
+    if (count < 8)
+    {
+        // the digits into the top bytes, zeros ahead of them
+        word = (word << (8 * (8 - count))) | (0x3030303030303030ULL >> (8 * count));
+    }
+    if (((word & 0xf0f0f0f0f0f0f0f0ULL) | (((word + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) !=
+            0x3333333333333333ULL)
+    {
+        return false;
+    }
+    word -= 0x3030303030303030ULL;
+    word = (word * 10 + (word >> 8)) & 0x00ff00ff00ff00ffULL;
+    word = (word * 100 + (word >> 16)) & 0x0000ffff0000ffffULL;
+    *value = static_cast<uint32_t>((word * 10000 + (word >> 32)) & 0xffffffffULL);
+    return true;
+}
+
+// hhmmss or ddmmyy as its three pairs
+inline bool CsvClock(const char* text, uint8_t length, uint8_t* first, uint8_t* second, uint8_t* third)
+{
+    uint32_t value;
+    if (length != 6 || !CsvDigits(text, 6, &value))
+    {
+        return false;
+    }
+    *first = value / 10000;
+    *second = value / 100 % 100;
+    *third = value % 100;
+    return true;
+}
+
+// [-]whole[.fraction] as NmeaField reads a number, fraction digits past 7 ignored
+inline bool CsvNumber(const char* text, uint8_t length, bool* negative, uint32_t* whole, uint8_t* wholeDigits,
+    uint32_t* fraction, uint8_t* fractionDigits)
+{
+    *negative = length && text[0] == '-';
+    uint8_t start = *negative ? 1 : 0;
+    const char* dot = static_cast<const char*>(memchr(text + start, '.', length - start));
+    uint8_t end = dot ? dot - text : length;
+
+    *wholeDigits = end - start;
+    *whole = 0;
+    if (*wholeDigits > NMEA_FIELD_WHOLE_DIGITS)
+    {
+        return false;
+    }
+    const char* digits = text + start;
+    uint8_t count = *wholeDigits;
+    if (count > 8)
+    {
+        // the ninth ahead of a word of eight
+        uint8_t digit = static_cast<uint8_t>(*digits++ - '0');
+        if (digit > 9)
+        {
+            return false;
+        }
+        *whole = digit * 100000000UL;
+        count--;
+    }
+    uint32_t low;
+    if (count && !CsvDigits(digits, count, &low))
+    {
+        return false;
+    }
+    *whole += count ? low : 0;
+    *fractionDigits = 0;
+    *fraction = 0;
+    if (dot)
+    {
+        uint8_t fractionLength = length - end - 1;
+        *fractionDigits = fractionLength < NMEA_FIELD_FRACTION_DIGITS ? fractionLength : NMEA_FIELD_FRACTION_DIGITS;
+        if (fractionLength && !CsvDigits(dot + 1, *fractionDigits, fraction))
+        {
+            return false;
+        }
+        for (uint8_t index = *fractionDigits; index < fractionLength; index++)
+        {
+            if (static_cast<uint8_t>(dot[1 + index] - '0') > 9)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// the conversion and limits of NmeaField::Coordinate
+inline bool CsvCoordinate(const char* text, uint8_t length, int32_t* coordinate, uint8_t* decimals, uint8_t maxDegrees)
+{
+    bool negative;
+    uint32_t whole, fraction;
+    uint8_t wholeDigits, fractionDigits;
+    if (!CsvNumber(text, length, &negative, &whole, &wholeDigits, &fraction, &fractionDigits) || negative ||
+            wholeDigits < 3 || wholeDigits > 5 || whole % 100 > 59 ||
+            whole / 100 > maxDegrees || (whole / 100 == maxDegrees && (whole % 100 || fraction)))
+    {
+        return false;
+    }
+    uint32_t minutes = (whole % 100) * GpsPowerOfTen(fractionDigits) + fraction;
+    *coordinate = static_cast<int32_t>((whole / 100) * 10000000UL +
+        (minutes * GpsPowerOfTen(7 - fractionDigits) + 30) / 60);
+    *decimals = fractionDigits;
+    return true;
+}
+
+// the line from text to its line feed into reading, false without a valid time
+inline bool ParseCsvLine(const char* text, uint8_t length, GpsReading& reading)
+{
+    // comma positions, a word at a time
+    uint8_t starts[CSV_FIELDS + 1];
+    uint8_t fields = 1;
+    starts[0] = 0;
+    for (uint8_t offset = 0; offset < length && fields < CSV_FIELDS; offset += 8)
+    {
+        uint64_t word;
+        memcpy(&word, text + offset, 8);
+        uint8_t commas = CsvByteMask(CsvBytesEqual(word, ','));
+        while (commas && fields < CSV_FIELDS)
+        {
+            uint8_t position = offset + __builtin_ctz(commas);
+            if (position >= length)
+            {
+                break;
+            }
+            starts[fields++] = position + 1;
+            commas &= commas - 1;
+        }
+    }
+    if (fields != CSV_FIELDS)
+    {
+        return false;
+    }
+    // the last field ends at the carriage return or the line feed
+    uint8_t end = length;
+    while (end > starts[CSV_FIELDS - 1] && (text[end - 1] == '\r' || text[end - 1] == '\n'))
+    {
+        end--;
+    }
+    starts[CSV_FIELDS] = end + 1;
+
+    #define CSV_FIELD(index) text + starts[index], static_cast<uint8_t>(starts[(index) + 1] - 1 - starts[index])
+
+    memset(&reading, 0, sizeof(reading));
+    uint8_t first, second, third;
+    if (!CsvClock(CSV_FIELD(1), &first, &second, &third) || first > 23 || second > 59 || third > 60)
+    {
+        return false;
+    }
+    reading.dateTime = (static_cast<uint32_t>(first) << GPS_DATETIME_HOUR_SHIFT) |
+        (static_cast<uint32_t>(second) << GPS_DATETIME_MINUTE_SHIFT) | third;
+    reading.flags = GPS_READING_TIME;
+
+    if (CsvClock(CSV_FIELD(0), &first, &second, &third) &&
+        first >= 1 && first <= 31 && second >= 1 && second <= 12 && third <= 63)
+    {
+        reading.dateTime |= (static_cast<uint32_t>(first) << GPS_DATETIME_DAY_SHIFT) |
+            (static_cast<uint32_t>(second) << GPS_DATETIME_MONTH_SHIFT) |
+            (static_cast<uint32_t>(third) << GPS_DATETIME_YEAR_SHIFT);
+        reading.flags |= GPS_READING_DATE;
+    }
+
+    uint8_t decimals, longitudeDecimals;
+    if (CsvCoordinate(CSV_FIELD(2), &reading.latitude, &decimals, 90) &&
+        CsvCoordinate(CSV_FIELD(4), &reading.longitude, &longitudeDecimals, 180))
+    {
+        if (text[starts[3]] == 'S')
+        {
+            reading.latitude = -reading.latitude;
+        }
+        if (text[starts[5]] == 'W')
+        {
+            reading.longitude = -reading.longitude;
+        }
+        reading.flags |= GPS_READING_POSITION | (decimals << GPS_READING_DECIMALS_SHIFT);
+    }
+    else
+    {
+        reading.latitude = 0;
+        reading.longitude = 0;
+    }
+
+    bool negative;
+    uint32_t whole, fraction;
+    uint8_t wholeDigits, fractionDigits;
+    if (CsvNumber(CSV_FIELD(6), &negative, &whole, &wholeDigits, &fraction, &fractionDigits) && wholeDigits &&
+        whole <= 20000000UL)
+    {
+        int32_t hundredths = static_cast<int32_t>(whole) * 100 + (fractionDigits <= 2 ?
+            fraction * GpsPowerOfTen(2 - fractionDigits) : fraction / GpsPowerOfTen(fractionDigits - 2));
+        reading.altitude = negative ? -hundredths : hundredths;
+        reading.flags |= GPS_READING_ALTITUDE;
+    }
+    if (CsvNumber(CSV_FIELD(7), &negative, &whole, &wholeDigits, &fraction, &fractionDigits) && !negative &&
+        wholeDigits && !memchr(text + starts[7], '.', starts[8] - 1 - starts[7]) && whole <= 255)
+    {
+        reading.satelliteCount = whole;
+        reading.flags |= GPS_READING_SATELLITES;
+    }
+
+    #undef CSV_FIELD
+    return true;
+}
+
+// lines of the log, the last one padded into a copy so no load passes the end
+inline void DecodeCsvLog(const uint8_t* log, size_t size, std::vector<GpsReading>& readings, LogDecodeCounters& counters)
+{
+    const char* text = reinterpret_cast<const char*>(log);
+    const char* end = text + size;
+    while (text < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(text, '\n', end - text));
+        if (!lineEnd)
+        {
+            // erased blocks after a power loss, or a line cut short
+            counters.trailing += end - text;
+            break;
+        }
+        size_t length = lineEnd + 1 - text;
+        GpsReading reading;
+        bool parsed;
+        if (length > CSV_LINE_SIZE)
+        {
+            parsed = false;
+        }
+        else if (end - text >= CSV_PADDED_SIZE)
+        {
+            parsed = ParseCsvLine(text, length, reading);
+        }
+        else
+        {
+            char padded[CSV_PADDED_SIZE];
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, text, length);
+            parsed = ParseCsvLine(padded, length, reading);
+        }
+        if (parsed)
+        {
+            readings.push_back(reading);
+            counters.readings++;
+        }
+        else
+        {
+            counters.rejected++;
+        }
+        text = lineEnd + 1;
+    }
+}
+
+// a CSV field through NmeaField, as TaskGps feeds it the characters of NMEA
+inline void ReadCsvField(NmeaField& field, NMEA_FIELD kind, const char* text, const char* end)
+{
+    field.Begin(kind);
+    for (; text < end; text++)
+    {
+        field.Read(*text);
+    }
+}
+
+// the reference: a character at a time through the firmware's decoders
+inline void DecodeCsvLogScalar(const uint8_t* log, size_t size, std::vector<GpsReading>& readings,
+    LogDecodeCounters& counters)
+{
+    const char* text = reinterpret_cast<const char*>(log);
+    const char* end = text + size;
+    while (text < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(text, '\n', end - text));
+        if (!lineEnd)
+        {
+            counters.trailing += end - text;
+            break;
+        }
+        const char* fields[CSV_FIELDS + 1];
+        uint8_t count = 1;
+        fields[0] = text;
+        for (const char* scan = text; scan < lineEnd && count < CSV_FIELDS; scan++)
+        {
+            if (*scan == ',')
+            {
+                fields[count++] = scan + 1;
+            }
+        }
+        const char* last = lineEnd;
+        while (count == CSV_FIELDS && last > fields[CSV_FIELDS - 1] && (last[-1] == '\r'))
+        {
+            last--;
+        }
+        fields[CSV_FIELDS] = last + 1;
+        text = lineEnd + 1;
+        if (lineEnd + 1 - fields[0] > CSV_LINE_SIZE || count != CSV_FIELDS)
+        {
+            counters.rejected++;
+            continue;
+        }
+
+        NmeaField field;
+        GpsReading reading;
+        uint16_t milliseconds;
+        memset(&reading, 0, sizeof(reading));
+        ReadCsvField(field, NMEA_FIELD_Clock, fields[1], fields[2] - 1);
+        if (!field.Time(reading, &milliseconds) || field.Length() != 6)
+        {
+            counters.rejected++;
+            continue;
+        }
+        ReadCsvField(field, NMEA_FIELD_Clock, fields[0], fields[1] - 1);
+        if (field.Length() == 6)
+        {
+            field.Date(reading);
+        }
+
+        uint8_t decimals, longitudeDecimals;
+        ReadCsvField(field, NMEA_FIELD_Number, fields[2], fields[3] - 1);
+        bool position = field.Coordinate(&reading.latitude, &decimals, 90);
+        ReadCsvField(field, NMEA_FIELD_Number, fields[4], fields[5] - 1);
+        position = position && field.Coordinate(&reading.longitude, &longitudeDecimals, 180);
+        if (position)
+        {
+            if (*fields[3] == 'S')
+            {
+                reading.latitude = -reading.latitude;
+            }
+            if (*fields[5] == 'W')
+            {
+                reading.longitude = -reading.longitude;
+            }
+            reading.flags |= GPS_READING_POSITION | (decimals << GPS_READING_DECIMALS_SHIFT);
+        }
+        else
+        {
+            reading.latitude = 0;
+            reading.longitude = 0;
+        }
+
+        ReadCsvField(field, NMEA_FIELD_Number, fields[6], fields[7] - 1);
+        if (field.Hundredths(&reading.altitude))
+        {
+            reading.flags |= GPS_READING_ALTITUDE;
+        }
+        else
+        {
+            reading.altitude = 0;
+        }
+        uint16_t satellites;
+        ReadCsvField(field, NMEA_FIELD_Number, fields[7], fields[8] - 1);
+        if (field.Integer(&satellites) && satellites <= 255)
+        {
+            reading.satelliteCount = satellites;
+            reading.flags |= GPS_READING_SATELLITES;
+        }
+        readings.push_back(reading);
+        counters.readings++;
+    }
+}
+
+// RAW captures: RMC and GGA of the same time make a reading, as TaskGps
+// does with the default GPS_EPOCH_SENTENCES; checksums are verified and
+// epochs with a void status or no fix quality are dropped
+class RawLogDecoder
+{
+public:
+    RawLogDecoder() :
+        epochSentences(0),
+        epochTime(0),
+        epochVoid(false)
+    {
+        memset(&epoch, 0, sizeof(epoch));
+    }
+
+    void Decode(const uint8_t* log, size_t size, std::vector<GpsReading>& readings, LogDecodeCounters& counters)
+    {
+        const char* text = reinterpret_cast<const char*>(log);
+        const char* end = text + size;
+        while (text < end)
+        {
+            const char* dollar = static_cast<const char*>(memchr(text, '$', end - text));
+            if (!dollar)
+            {
+                break;
+            }
+            const char* star = dollar + 1;
+            uint8_t checksum = 0;
+            while (star < end && *star != '*' && *star != '$' && *star != '\r' && *star != '\n')
+            {
+                checksum ^= *star++;
+            }
+            if (star + 3 > end)
+            {
+                counters.trailing += end - dollar;
+                break;
+            }
+            text = star;
+            if (*star != '*' || HexDigit(star[1]) < 0 || HexDigit(star[2]) < 0 ||
+                    (HexDigit(star[1]) << 4 | HexDigit(star[2])) != checksum)
+            {
+                counters.rejected++;
+                continue;
+            }
+            text = star + 3;
+            Sentence(dollar + 1, star, readings, counters);
+        }
+    }
+
+private:
+    GpsReading epoch;
+    uint8_t epochSentences;
+    uint32_t epochTime;
+    bool epochVoid;
+
+    static int HexDigit(char digit)
+    {
+        if (digit >= '0' && digit <= '9')
+        {
+            return digit - '0';
+        }
+        if (digit >= 'A' && digit <= 'F')
+        {
+            return digit - 'A' + 10;
+        }
+        return -1;
+    }
+
+    void Sentence(const char* text, const char* end, std::vector<GpsReading>& readings, LogDecodeCounters& counters)
+    {
+        const char* fields[16];
+        uint8_t count = 0;
+        fields[count++] = text;
+        for (const char* scan = text; scan < end && count < 15; scan++)
+        {
+            if (*scan == ',')
+            {
+                fields[count++] = scan + 1;
+            }
+        }
+        fields[count] = end + 1;
+
+        NMEA_SENTENCE sentence = IdentifyNmeaSentence(text, fields[1 < count ? 1 : 0] - 1 - text);
+        if ((sentence != NMEA_SENTENCE_RMC && sentence != NMEA_SENTENCE_GGA) || count < 10)
+        {
+            return;
+        }
+
+        NmeaField field;
+        GpsReading pending;
+        uint16_t milliseconds;
+        memset(&pending, 0, sizeof(pending));
+        ReadCsvField(field, NMEA_FIELD_Clock, fields[1], fields[2] - 1);
+        if (!field.Time(pending, &milliseconds))
+        {
+            return;
+        }
+
+        bool pendingVoid;
+        if (sentence == NMEA_SENTENCE_RMC)
+        {
+            pendingVoid = *fields[2] != 'A';
+            uint8_t decimals, longitudeDecimals;
+            ReadCsvField(field, NMEA_FIELD_Number, fields[3], fields[4] - 1);
+            bool position = field.Coordinate(&pending.latitude, &decimals, 90);
+            if (position && *fields[4] == 'S')
+            {
+                pending.latitude = -pending.latitude;
+            }
+            ReadCsvField(field, NMEA_FIELD_Number, fields[5], fields[6] - 1);
+            position = position && field.Coordinate(&pending.longitude, &longitudeDecimals, 180);
+            if (position)
+            {
+                if (*fields[6] == 'W')
+                {
+                    pending.longitude = -pending.longitude;
+                }
+                pending.flags |= GPS_READING_POSITION | (decimals << GPS_READING_DECIMALS_SHIFT);
+            }
+            ReadCsvField(field, NMEA_FIELD_Clock, fields[9], fields[10] - 1);
+            field.Date(pending);
+        }
+        else
+        {
+            uint16_t quality, satellites;
+            ReadCsvField(field, NMEA_FIELD_Number, fields[6], fields[7] - 1);
+            pendingVoid = !field.Integer(&quality) || quality == 0 || quality > 255;
+            ReadCsvField(field, NMEA_FIELD_Number, fields[7], fields[8] - 1);
+            if (field.Integer(&satellites) && satellites <= 255)
+            {
+                pending.satelliteCount = satellites;
+                pending.flags |= GPS_READING_SATELLITES;
+            }
+            ReadCsvField(field, NMEA_FIELD_Number, fields[9], fields[10] - 1);
+            if (field.Hundredths(&pending.altitude))
+            {
+                pending.flags |= GPS_READING_ALTITUDE;
+            }
+        }
+
+        uint32_t time = ((pending.dateTime & GPS_DATETIME_TIME_MASK) << 10) | milliseconds;
+        if (epochSentences && time != epochTime)
+        {
+            epochSentences = 0;
+        }
+        if (!epochSentences)
+        {
+            memset(&epoch, 0, sizeof(epoch));
+            epoch.dateTime = pending.dateTime & GPS_DATETIME_TIME_MASK;
+            epoch.flags = GPS_READING_TIME;
+            epochTime = time;
+            epochVoid = false;
+        }
+        Merge(pending);
+        epochVoid = epochVoid || pendingVoid;
+        epochSentences |= (sentence == NMEA_SENTENCE_RMC) ? 1 : 2;
+        if (epochSentences == 3)
+        {
+            epochSentences = 0;
+            if (!epochVoid)
+            {
+                readings.push_back(epoch);
+                counters.readings++;
+            }
+        }
+    }
+
+    // the fields the sentence had into the epoch, as TaskGps::MergeReading
+    void Merge(const GpsReading& reading)
+    {
+        if (reading.flags & GPS_READING_DATE)
+        {
+            epoch.dateTime = (epoch.dateTime & GPS_DATETIME_TIME_MASK) | (reading.dateTime & GPS_DATETIME_DATE_MASK);
+        }
+        if (reading.flags & GPS_READING_POSITION)
+        {
+            epoch.latitude = reading.latitude;
+            epoch.longitude = reading.longitude;
+            epoch.flags &= ~GPS_READING_DECIMALS_MASK;
+        }
+        if (reading.flags & GPS_READING_ALTITUDE)
+        {
+            epoch.altitude = reading.altitude;
+        }
+        if (reading.flags & GPS_READING_SATELLITES)
+        {
+            epoch.satelliteCount = reading.satelliteCount;
+        }
+        epoch.flags |= reading.flags;
+    }
+};
+
+// any log as the card has it, journaled or not, scalarCsv takes the reference CSV parser
+inline LogKind DecodeLog(const uint8_t* log, size_t size, const char* name, std::vector<GpsReading>& readings,
+    LogDecodeCounters& counters, bool scalarCsv = false)
+{
+    std::vector<uint8_t> payload;
+    if (IsLogJournal(log, size))
+    {
+        unsigned long records;
+        size_t blocks = UnwrapLogJournal(log, size, payload, &records);
+        counters.trailing += size - blocks * LOG_JOURNAL_SECTOR_SIZE;
+        log = payload.data();
+        size = payload.size();
+    }
+
+    LogKind kind = IdentifyLog(log, size, name);
+    switch (kind)
+    {
+    case LogKind_Bin:
+        DecodeBinLog(log, size, readings, counters);
+        break;
+    case LogKind_Track:
+        DecodeTrackLog(log, size, readings, counters);
+        break;
+    case LogKind_Raw:
+    {
+        RawLogDecoder decoder;
+        decoder.Decode(log, size, readings, counters);
+        break;
+    }
+    case LogKind_TripIndex:
+        break;
+    default:
+        if (scalarCsv)
+        {
+            DecodeCsvLogScalar(log, size, readings, counters);
+        }
+        else
+        {
+            DecodeCsvLog(log, size, readings, counters);
+        }
+        break;
+    }
+    return kind;
+}
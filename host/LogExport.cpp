@@ -0,0 +1,111 @@
+// Merges the logs of a card into time ordered tracks and writes them as GPX or GeoJSON.
+//
+//   log_export [--threads N] [--gap S] [--gpx OUT.gpx] [--geojson OUT.json] [--digest] PATH...
+//
+// A PATH that is a directory is searched for the logs the sketch writes,
+// YYMMDD-H.CSV, .BIN and .TRK in any layout and NMEAnnnn.RAW; files given
+// by name are read whatever they are called. Tracks break where no reading
+// arrived for S seconds, 300 by default. --digest prints the readings as
+// replay_bench fingerprints them, so a card can be checked against the
+// captures it was logged from. The threads default to the cores there are.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LogIngest.h"
+#include "BenchClock.h"
+
+int main(int argc, char** argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    uint32_t gapSeconds = 300;
+    const char* gpxPath = NULL;
+    const char* geoJsonPath = NULL;
+    bool digest = false;
+    std::vector<std::string> paths;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--threads") && index + 1 < argc)
+        {
+            threads = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--gap") && index + 1 < argc)
+        {
+            gapSeconds = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--gpx") && index + 1 < argc)
+        {
+            gpxPath = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--geojson") && index + 1 < argc)
+        {
+            geoJsonPath = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--digest"))
+        {
+            digest = true;
+        }
+        else if (argv[index][0] == '-')
+        {
+            paths.clear();
+            break;
+        }
+        else
+        {
+            paths.push_back(argv[index]);
+        }
+    }
+    if (paths.empty())
+    {
+        fprintf(stderr, "usage: %s [--threads N] [--gap S] [--gpx OUT.gpx] [--geojson OUT.json] [--digest] PATH...\n",
+            argv[0]);
+        return 2;
+    }
+
+    WorkPool pool(threads);
+    uint64_t startNs = BenchNanos();
+    std::vector<LogInput> logs = FindLogs(paths);
+    IngestResult result;
+    IngestLogs(logs, pool, gapSeconds, false, result);
+    uint64_t ingestNs = BenchNanos() - startNs;
+
+    fprintf(stderr, "logs      %zu, %.1f MB, %zu unreadable\n", result.files, result.bytes / 1e6, result.unreadable);
+    fprintf(stderr, "readings  %zu decoded, %zu rejected, %zu trailing bytes, %zu undated, %zu duplicates\n",
+        result.counters.readings, result.counters.rejected, result.counters.trailing, result.undated,
+        result.duplicates);
+    fprintf(stderr, "tracks    %zu of %zu readings, gap %u s\n", result.tracks.size(), result.readings.size(),
+        gapSeconds);
+    fprintf(stderr, "ingest    %.1f ms, %.0f MB/s on %u threads, %zu stolen\n", ingestNs / 1e6,
+        ingestNs ? result.bytes * 1e3 / ingestNs : 0.0, pool.Threads(), pool.Steals());
+
+    const char* outputs[] = { gpxPath, geoJsonPath };
+    for (int format = ExportFormat_Gpx; format <= ExportFormat_GeoJson; format++)
+    {
+        if (!outputs[format])
+        {
+            continue;
+        }
+        startNs = BenchNanos();
+        size_t written = ExportTracks(result, static_cast<ExportFormat>(format), outputs[format], pool);
+        uint64_t exportNs = BenchNanos() - startNs;
+        if (!written)
+        {
+            fprintf(stderr, "cannot write %s\n", outputs[format]);
+            return 1;
+        }
+        fprintf(stderr, "%-9s %.1f MB in %.1f ms\n", format == ExportFormat_Gpx ? "gpx" : "geojson",
+            written / 1e6, exportNs / 1e6);
+    }
+
+    if (digest)
+    {
+        printf("%016llx\n", static_cast<unsigned long long>(ReadingsDigest(result.readings)));
+    }
+    return result.unreadable ? 1 : 0;
+}
@@ -0,0 +1,503 @@
+// An on-disk index of a card's readings for bounding box and time range queries.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "LogIndex.h"
+
+// hours indexed before their readings are written out, bounds the memory
+// the index takes next to the readings
+#define INDEX_BATCH_HOURS 256
+
+static_assert(sizeof(LogIndexHeader) == 64, "index header layout");
+static_assert(sizeof(LogIndexPoint) == 20, "index point layout");
+static_assert(sizeof(LogIndexHour) == 40, "index hour layout");
+static_assert(sizeof(LogIndexBlock) == 40, "index block layout");
+static_assert(sizeof(LogIndexSource) == 16, "index source layout");
+
+namespace
+{
+    // the readings of one hour
+    struct IndexSpan
+    {
+        uint32_t hour;
+        size_t first;
+        size_t end;
+    };
+
+    struct IndexedHour
+    {
+        std::vector<LogIndexPoint> points;
+        std::vector<LogIndexBlock> blocks;     // firstPoint counts from the hour's first
+        LogIndexBox box;
+    };
+
+    // the low 16 bits of value in the even bits
+    uint32_t SpreadBits(uint32_t value)
+    {
+        value &= 0xffff;
+        value = (value | (value << 8)) & 0x00ff00ffUL;
+        value = (value | (value << 4)) & 0x0f0f0f0fUL;
+        value = (value | (value << 2)) & 0x33333333UL;
+        value = (value | (value << 1)) & 0x55555555UL;
+        return value;
+    }
+
+    void EmptyBox(LogIndexBox& box)
+    {
+        box.south = INT32_MAX;
+        box.west = INT32_MAX;
+        box.north = INT32_MIN;
+        box.east = INT32_MIN;
+    }
+
+    void GrowBox(LogIndexBox& box, int32_t latitude, int32_t longitude)
+    {
+        box.south = std::min(box.south, latitude);
+        box.north = std::max(box.north, latitude);
+        box.west = std::min(box.west, longitude);
+        box.east = std::max(box.east, longitude);
+    }
+
+    void GrowBox(LogIndexBox& box, const LogIndexBox& other)
+    {
+        GrowBox(box, other.south, other.west);
+        GrowBox(box, other.north, other.east);
+    }
+
+    bool LongitudeInside(const LogIndexBox& box, int32_t longitude)
+    {
+        if (box.west <= box.east)
+        {
+            return longitude >= box.west && longitude <= box.east;
+        }
+        return longitude >= box.west || longitude <= box.east;
+    }
+
+    // box never crosses the antimeridian, the query's may
+    bool BoxesOverlap(const LogIndexBox& box, const LogIndexBox& query)
+    {
+        if (box.north < query.south || box.south > query.north)
+        {
+            return false;
+        }
+        if (query.west <= query.east)
+        {
+            return box.west <= query.east && box.east >= query.west;
+        }
+        return box.east >= query.west || box.west <= query.east;
+    }
+
+    // splits an hour of readings into blocks by tile, a tile's readings stay in time order
+    void IndexHour(const std::vector<GpsReading>& readings, const IndexSpan& span, uint8_t zoom,
+        IndexedHour& indexed)
+    {
+        std::vector<std::pair<uint32_t, uint32_t> > tiles;
+        std::vector<uint16_t> ordinals(span.end - span.first, 0);
+        for (size_t index = span.first; index < span.end; index++)
+        {
+            uint32_t offset = index - span.first;
+            if (offset && readings[index - 1].dateTime == readings[index].dateTime &&
+                ordinals[offset - 1] < UINT16_MAX)
+            {
+                ordinals[offset] = ordinals[offset - 1] + 1;
+            }
+            if (readings[index].flags & GPS_READING_POSITION)
+            {
+                tiles.push_back(std::make_pair(
+                    LogIndexQuadkey(readings[index].latitude, readings[index].longitude, zoom), offset));
+            }
+        }
+        std::sort(tiles.begin(), tiles.end());
+
+        EmptyBox(indexed.box);
+        indexed.points.resize(tiles.size());
+        for (size_t tile = 0; tile < tiles.size(); tile++)
+        {
+            const GpsReading& reading = readings[span.first + tiles[tile].second];
+            LogIndexPoint& point = indexed.points[tile];
+            point.dateTime = reading.dateTime;
+            point.latitude = reading.latitude;
+            point.longitude = reading.longitude;
+            point.altitude = reading.altitude;
+            point.satelliteCount = reading.satelliteCount;
+            point.flags = reading.flags;
+            point.ordinal = ordinals[tiles[tile].second];
+
+            if (!tile || tiles[tile - 1].first != tiles[tile].first)
+            {
+                LogIndexBlock block;
+                memset(&block, 0, sizeof(block));
+                block.quadkey = tiles[tile].first;
+                block.firstPoint = tile;
+                block.firstDateTime = reading.dateTime;
+                EmptyBox(block.box);
+                indexed.blocks.push_back(block);
+            }
+            LogIndexBlock& block = indexed.blocks.back();
+            block.points++;
+            block.lastDateTime = reading.dateTime;
+            GrowBox(block.box, reading.latitude, reading.longitude);
+        }
+        for (size_t block = 0; block < indexed.blocks.size(); block++)
+        {
+            GrowBox(indexed.box, indexed.blocks[block].box);
+        }
+    }
+
+    bool WriteIndex(FILE* file, const void* data, size_t size, uint64_t* offset)
+    {
+        *offset += size;
+        return !size || fwrite(data, 1, size, file) == size;
+    }
+
+    // the tables are 8 byte aligned for their 64 bit fields
+    bool AlignIndex(FILE* file, uint64_t* offset)
+    {
+        static const uint8_t zeros[8] = { 0 };
+        return WriteIndex(file, zeros, (8 - *offset % 8) % 8, offset);
+    }
+
+    uint32_t PointSeconds(const LogIndexPoint& point)
+    {
+        return GpsDateTimeSeconds(point.dateTime);
+    }
+}
+
+uint32_t LogIndexQuadkey(int32_t latitude, int32_t longitude, uint8_t zoom)
+{
+    int64_t north = 900000000LL - std::max(-900000000L, std::min(900000000L, static_cast<long>(latitude)));
+    int64_t east = std::max(-1800000000L, std::min(1800000000L, static_cast<long>(longitude))) + 1800000000LL;
+    uint32_t row = (north << zoom) / 1800000001LL;
+    uint32_t column = (east << zoom) / 3600000001LL;
+    return (SpreadBits(row) << 1) | SpreadBits(column);
+}
+
+bool LogQueryContains(const LogQuery& query, const GpsReading& reading)
+{
+    if (!(reading.flags & GPS_READING_POSITION) || reading.latitude < query.box.south ||
+        reading.latitude > query.box.north || !LongitudeInside(query.box, reading.longitude))
+    {
+        return false;
+    }
+    uint32_t seconds = GpsDateTimeSeconds(reading.dateTime);
+    return seconds >= query.from && seconds <= query.to;
+}
+
+size_t BuildLogIndex(const IngestResult& result, const std::vector<LogInput>& logs, uint8_t zoom,
+    const char* path, WorkPool& pool)
+{
+    zoom = std::min<uint8_t>(zoom, LOG_INDEX_MAX_ZOOM);
+    const std::vector<GpsReading>& readings = result.readings;
+
+    std::vector<IndexSpan> spans;
+    for (size_t index = 0; index < readings.size(); index++)
+    {
+        uint32_t hour = GpsDateTimeSeconds(readings[index].dateTime) / 3600;
+        if (spans.empty() || spans.back().hour != hour)
+        {
+            IndexSpan span = { hour, index, index };
+            spans.push_back(span);
+        }
+        spans.back().end = index + 1;
+    }
+
+    // the logs by the hour of their name, the ones not named for one last
+    std::vector<std::pair<uint32_t, size_t> > named;
+    for (size_t log = 0; log < logs.size(); log++)
+    {
+        uint32_t hour;
+        named.push_back(std::make_pair(LogNameHour(logs[log].path, &hour) ? hour : LOG_INDEX_NO_HOUR, log));
+    }
+    std::sort(named.begin(), named.end());
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+    LogIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+    header.zoom = zoom;
+    uint64_t offset = 0;
+    bool written = WriteIndex(file, &header, sizeof(header), &offset);
+
+    std::vector<LogIndexHour> hours;
+    std::vector<LogIndexBlock> blocks;
+    for (size_t batch = 0; batch < spans.size(); batch += INDEX_BATCH_HOURS)
+    {
+        std::vector<IndexedHour> indexed(std::min<size_t>(INDEX_BATCH_HOURS, spans.size() - batch));
+        std::vector<std::function<void()> > jobs;
+        for (size_t span = 0; span < indexed.size(); span++)
+        {
+            jobs.push_back([&, span]()
+            {
+                IndexHour(readings, spans[batch + span], zoom, indexed[span]);
+            });
+        }
+        pool.Run(jobs);
+
+        for (size_t span = 0; span < indexed.size(); span++)
+        {
+            if (indexed[span].blocks.empty())
+            {
+                continue;
+            }
+            LogIndexHour hour;
+            memset(&hour, 0, sizeof(hour));
+            hour.hour = spans[batch + span].hour;
+            hour.blocks = indexed[span].blocks.size();
+            hour.firstBlock = blocks.size();
+            hour.firstSource = std::lower_bound(named.begin(), named.end(), std::make_pair(hour.hour, size_t(0))) -
+                named.begin();
+            hour.sources = std::upper_bound(named.begin(), named.end(), std::make_pair(hour.hour, SIZE_MAX)) -
+                named.begin() - hour.firstSource;
+            hour.box = indexed[span].box;
+            hours.push_back(hour);
+
+            for (size_t block = 0; block < indexed[span].blocks.size(); block++)
+            {
+                indexed[span].blocks[block].firstPoint += header.points;
+                blocks.push_back(indexed[span].blocks[block]);
+            }
+            header.points += indexed[span].points.size();
+            written = written && WriteIndex(file, indexed[span].points.data(),
+                indexed[span].points.size() * sizeof(LogIndexPoint), &offset);
+        }
+    }
+
+    std::vector<LogIndexSource> sources;
+    std::string names;
+    for (size_t source = 0; source < named.size(); source++)
+    {
+        LogIndexSource entry = { logs[named[source].second].size, named[source].first,
+            static_cast<uint32_t>(names.size()) };
+        sources.push_back(entry);
+        names += logs[named[source].second].path;
+        names += '\0';
+    }
+
+    header.hours = hours.size();
+    header.blocks = blocks.size();
+    header.sources = sources.size();
+    written = written && AlignIndex(file, &offset);
+    header.hourOffset = offset;
+    written = written && WriteIndex(file, hours.data(), hours.size() * sizeof(LogIndexHour), &offset);
+    header.blockOffset = offset;
+    written = written && WriteIndex(file, blocks.data(), blocks.size() * sizeof(LogIndexBlock), &offset);
+    header.sourceOffset = offset;
+    written = written && WriteIndex(file, sources.data(), sources.size() * sizeof(LogIndexSource), &offset);
+    header.nameOffset = offset;
+    written = written && WriteIndex(file, names.data(), names.size(), &offset);
+
+    // the header last, an index cut short never passes for a whole one
+    written = written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if (fclose(file) != 0 || !written)
+    {
+        remove(path);
+        return 0;
+    }
+    return offset;
+}
+
+LogIndexReader::LogIndexReader() :
+    _header(NULL),
+    _points(NULL),
+    _hours(NULL),
+    _blocks(NULL),
+    _sources(NULL),
+    _names(NULL),
+    _namesSize(0)
+{
+}
+
+bool LogIndexReader::Open(const char* path)
+{
+    _header = NULL;
+    if (!_file.Open(path, false) || _file.Size() < sizeof(LogIndexHeader))
+    {
+        return false;
+    }
+
+    const LogIndexHeader* header = reinterpret_cast<const LogIndexHeader*>(_file.Data());
+    size_t size = _file.Size();
+    auto fits = [size](uint64_t offset, uint64_t count, size_t entry)
+    {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / entry;
+    };
+    if (memcmp(header->magic, LOG_INDEX_MAGIC, sizeof(header->magic)) || header->zoom > LOG_INDEX_MAX_ZOOM ||
+        !fits(sizeof(LogIndexHeader), header->points, sizeof(LogIndexPoint)) ||
+        !fits(header->hourOffset, header->hours, sizeof(LogIndexHour)) ||
+        !fits(header->blockOffset, header->blocks, sizeof(LogIndexBlock)) ||
+        !fits(header->sourceOffset, header->sources, sizeof(LogIndexSource)) || header->nameOffset > size)
+    {
+        return false;
+    }
+
+    _header = header;
+    _points = reinterpret_cast<const LogIndexPoint*>(_file.Data() + sizeof(LogIndexHeader));
+    _hours = reinterpret_cast<const LogIndexHour*>(_file.Data() + header->hourOffset);
+    _blocks = reinterpret_cast<const LogIndexBlock*>(_file.Data() + header->blockOffset);
+    _sources = reinterpret_cast<const LogIndexSource*>(_file.Data() + header->sourceOffset);
+    _names = reinterpret_cast<const char*>(_file.Data() + header->nameOffset);
+    _namesSize = size - header->nameOffset;
+    return true;
+}
+
+bool LogIndexReader::Query(const LogQuery& query, std::vector<GpsReading>& readings, LogQueryStats& stats,
+    std::vector<std::string>* sources) const
+{
+    readings.clear();
+    memset(&stats, 0, sizeof(stats));
+    if (!_header)
+    {
+        return false;
+    }
+
+    const LogIndexHour* hour = std::lower_bound(_hours, _hours + _header->hours, query.from / 3600,
+        [](const LogIndexHour& entry, uint32_t value)
+    {
+        return entry.hour < value;
+    });
+    std::vector<LogIndexPoint> found;
+    for (; hour < _hours + _header->hours && hour->hour <= query.to / 3600; hour++)
+    {
+        stats.hours++;
+        stats.bytes += sizeof(LogIndexHour);
+        if (!BoxesOverlap(hour->box, query.box))
+        {
+            continue;
+        }
+        if (hour->firstBlock > _header->blocks || hour->blocks > _header->blocks - hour->firstBlock)
+        {
+            return false;
+        }
+
+        found.clear();
+        size_t matchedBlocks = 0;
+        for (const LogIndexBlock* block = _blocks + hour->firstBlock;
+            block < _blocks + hour->firstBlock + hour->blocks; block++)
+        {
+            stats.bytes += sizeof(LogIndexBlock);
+            if (!BoxesOverlap(block->box, query.box) || GpsDateTimeSeconds(block->firstDateTime) > query.to ||
+                GpsDateTimeSeconds(block->lastDateTime) < query.from)
+            {
+                continue;
+            }
+            if (block->firstPoint > _header->points || block->points > _header->points - block->firstPoint)
+            {
+                return false;
+            }
+
+            // the readings of an hour at the edge of the range are cut to it
+            const LogIndexPoint* first = _points + block->firstPoint;
+            const LogIndexPoint* end = first + block->points;
+            if (GpsDateTimeSeconds(block->firstDateTime) < query.from)
+            {
+                first = std::partition_point(first, end, [&](const LogIndexPoint& point)
+                {
+                    return PointSeconds(point) < query.from;
+                });
+            }
+            if (GpsDateTimeSeconds(block->lastDateTime) > query.to)
+            {
+                end = std::partition_point(first, end, [&](const LogIndexPoint& point)
+                {
+                    return PointSeconds(point) <= query.to;
+                });
+            }
+
+            stats.blocks++;
+            stats.points += end - first;
+            stats.bytes += (end - first) * sizeof(LogIndexPoint);
+            size_t before = found.size();
+            for (const LogIndexPoint* point = first; point < end; point++)
+            {
+                if (point->latitude >= query.box.south && point->latitude <= query.box.north &&
+                    LongitudeInside(query.box, point->longitude))
+                {
+                    found.push_back(*point);
+                }
+            }
+            matchedBlocks += found.size() > before;
+        }
+        if (found.empty())
+        {
+            continue;
+        }
+
+        // blocks are in tile order, the readings of the hour go back to time order
+        if (matchedBlocks > 1)
+        {
+            std::sort(found.begin(), found.end(), [](const LogIndexPoint& first, const LogIndexPoint& second)
+            {
+                return first.dateTime != second.dateTime ? first.dateTime < second.dateTime :
+                    first.ordinal < second.ordinal;
+            });
+        }
+        for (size_t index = 0; index < found.size(); index++)
+        {
+            GpsReading reading;
+            memset(&reading, 0, sizeof(reading));
+            reading.dateTime = found[index].dateTime;
+            reading.latitude = found[index].latitude;
+            reading.longitude = found[index].longitude;
+            reading.altitude = found[index].altitude;
+            reading.satelliteCount = found[index].satelliteCount;
+            reading.flags = found[index].flags;
+            readings.push_back(reading);
+        }
+
+        if (sources)
+        {
+            if (hour->firstSource > _header->sources || hour->sources > _header->sources - hour->firstSource)
+            {
+                return false;
+            }
+            for (uint32_t source = hour->firstSource; source < hour->firstSource + hour->sources; source++)
+            {
+                uint32_t name = _sources[source].nameOffset;
+                if (name >= _namesSize || !memchr(_names + name, '\0', _namesSize - name))
+                {
+                    return false;
+                }
+                sources->push_back(_names + name);
+            }
+        }
+    }
+    return true;
+}
+
+void ScanLogs(const std::vector<LogInput>& logs, const LogQuery& query, WorkPool& pool,
+    std::vector<GpsReading>& readings, size_t* skipped)
+{
+    // a log named for an hour holds that hour's readings, the sketch opens
+    // the next one when the hour of a reading changes
+    std::vector<LogInput> read;
+    *skipped = 0;
+    for (size_t log = 0; log < logs.size(); log++)
+    {
+        uint32_t hour;
+        if (LogNameHour(logs[log].path, &hour) && (hour < query.from / 3600 || hour > query.to / 3600))
+        {
+            (*skipped)++;
+            continue;
+        }
+        read.push_back(logs[log]);
+    }
+
+    IngestResult result;
+    IngestLogs(read, pool, UINT32_MAX, false, result);
+    readings.clear();
+    for (size_t index = 0; index < result.readings.size(); index++)
+    {
+        if (LogQueryContains(query, result.readings[index]))
+        {
+            readings.push_back(result.readings[index]);
+        }
+    }
+}
@@ -0,0 +1,168 @@
+// An on-disk index of a card's readings for bounding box and time range queries.
+//
+// The readings are bucketed by the hour, the same hours the sketch names its
+// logs by, and each hour is split into blocks by the tile of a 2^zoom by
+// 2^zoom grid of latitude and longitude the readings fall in, ordered by
+// quadkey so neighbouring tiles sit together. A block keeps its readings
+// in time order with their bounding box and time span; an hour keeps its
+// blocks' bounding box and the logs named for it. A query finds the hours
+// of its range by binary search in the mapped index, skips the blocks whose
+// box misses, and only reads the readings of the blocks that remain.
+//
+// File layout, host byte order:
+//   LogIndexHeader
+//   LogIndexPoint[points]      block by block, hour by hour
+//   LogIndexHour[hours]        in time order
+//   LogIndexBlock[blocks]      an hour's in quadkey order
+//   LogIndexSource[sources]    the logs indexed, those named for an hour by hour
+//   names                      the sources' paths, each ending in a NUL
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "LogIngest.h"
+
+#define LOG_INDEX_MAGIC "GLX1"
+#define LOG_INDEX_ZOOM 12           // tiles of about 10 by 5 km at 47 degrees
+#define LOG_INDEX_MAX_ZOOM 16       // the quadkey in 32 bits
+#define LOG_INDEX_NO_HOUR 0xffffffffUL
+
+// 1e-7 degrees, west above east crosses the antimeridian
+struct LogIndexBox
+{
+    int32_t south;
+    int32_t west;
+    int32_t north;
+    int32_t east;
+};
+
+struct LogIndexHeader
+{
+    char magic[4];
+    uint8_t zoom;
+    uint8_t reserved[3];
+    uint32_t hours;
+    uint32_t sources;
+    uint64_t blocks;
+    uint64_t points;
+    uint64_t hourOffset;
+    uint64_t blockOffset;
+    uint64_t sourceOffset;
+    uint64_t nameOffset;
+};
+
+struct LogIndexPoint
+{
+    uint32_t dateTime;
+    int32_t latitude;
+    int32_t longitude;
+    int32_t altitude;
+    uint8_t satelliteCount;
+    uint8_t flags;
+    uint16_t ordinal;       // of the readings of the same second, they keep their order
+};
+
+struct LogIndexHour
+{
+    uint32_t hour;          // since 2000-01-01
+    uint32_t blocks;
+    uint64_t firstBlock;
+    uint32_t firstSource;
+    uint32_t sources;
+    LogIndexBox box;
+};
+
+struct LogIndexBlock
+{
+    uint32_t quadkey;
+    uint32_t points;
+    uint64_t firstPoint;
+    uint32_t firstDateTime;
+    uint32_t lastDateTime;
+    LogIndexBox box;
+};
+
+struct LogIndexSource
+{
+    uint64_t size;
+    uint32_t hour;          // of its name, LOG_INDEX_NO_HOUR when not named for one
+    uint32_t nameOffset;
+};
+
+struct LogQuery
+{
+    LogIndexBox box;
+    uint32_t from;          // seconds since 2000-01-01, both included
+    uint32_t to;
+};
+
+// what a query read to answer
+struct LogQueryStats
+{
+    size_t hours;
+    size_t blocks;
+    size_t points;
+    size_t bytes;
+};
+
+// the tile of a position as the quadkey of its column and row
+uint32_t LogIndexQuadkey(int32_t latitude, int32_t longitude, uint8_t zoom);
+
+bool LogQueryContains(const LogQuery& query, const GpsReading& reading);
+
+// indexes the readings of an ingestion into path, logs are the ones it was
+// ingested from; returns the bytes written or 0 when path could not be
+// written. Readings without a position are left out, no box holds them.
+size_t BuildLogIndex(const IngestResult& result, const std::vector<LogInput>& logs, uint8_t zoom,
+    const char* path, WorkPool& pool);
+
+// queries an index through a read only mapping of it
+class LogIndexReader
+{
+public:
+    LogIndexReader();
+
+    // false when path is not an index or is cut short
+    bool Open(const char* path);
+
+    uint8_t Zoom() const
+    {
+        return _header ? _header->zoom : 0;
+    }
+
+    uint64_t Points() const
+    {
+        return _header ? _header->points : 0;
+    }
+
+    size_t Size() const
+    {
+        return _file.Size();
+    }
+
+    // the readings inside the query in time order, and the logs named for
+    // the hours they are in when sources is given; false when the index
+    // turns out to be damaged on the way
+    bool Query(const LogQuery& query, std::vector<GpsReading>& readings, LogQueryStats& stats,
+        std::vector<std::string>* sources = NULL) const;
+
+private:
+    MappedFile _file;
+    const LogIndexHeader* _header;
+    const LogIndexPoint* _points;
+    const LogIndexHour* _hours;
+    const LogIndexBlock* _blocks;
+    const LogIndexSource* _sources;
+    const char* _names;
+    size_t _namesSize;
+};
+
+// the same query without an index: reads the logs named for the hours of
+// the range, and every log not named for an hour, and keeps the readings
+// inside; skipped counts the logs left unread
+void ScanLogs(const std::vector<LogInput>& logs, const LogQuery& query, WorkPool& pool,
+    std::vector<GpsReading>& readings, size_t* skipped);
@@ -0,0 +1,251 @@
+// Indexes a card's logs and answers bounding box and time range queries from the index.
+//
+//   log_index [--threads N] [--zoom Z] --out INDEX PATH...
+//   log_index --index INDEX [--box S,W,N,E] [--from TIME] [--to TIME] [--files | --digest]
+//   log_index --scan [--box S,W,N,E] [--from TIME] [--to TIME] [--files | --digest] PATH...
+//
+// The first form decodes the logs as log_export does and writes the index,
+// tiles of zoom Z (12 by default, 16 at most). The second prints the
+// readings inside the box, degrees south, west, north, east, between the
+// two UTC times, YYYY-MM-DD with THH:MM:SS or any leading part of it; --to
+// takes the end of what it leaves out. --files prints the logs named for
+// the hours the readings are in instead, --digest their fingerprint as
+// replay_bench prints it. The third answers the same query without an
+// index, reading only the logs named for the hours of the range.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LogIndex.h"
+#include "BenchClock.h"
+
+namespace
+{
+    bool ParseCoordinate(const char* text, char end, double limit, int32_t* value, const char** next)
+    {
+        char* after;
+        double degrees = strtod(text, &after);
+        if (after == text || *after != end || !(fabs(degrees) <= limit))
+        {
+            return false;
+        }
+        *value = static_cast<int32_t>(llround(degrees * 1e7));
+        *next = after + (end ? 1 : 0);
+        return true;
+    }
+
+    bool ParseBox(const char* text, LogIndexBox* box)
+    {
+        return ParseCoordinate(text, ',', 90, &box->south, &text) &&
+            ParseCoordinate(text, ',', 180, &box->west, &text) &&
+            ParseCoordinate(text, ',', 90, &box->north, &text) &&
+            ParseCoordinate(text, '\0', 180, &box->east, &text) && box->south <= box->north;
+    }
+
+    // the first or, for end, the last second of what the text names
+    bool ParseTime(const char* text, bool end, uint32_t* seconds)
+    {
+        unsigned year, month, day, hour = 0, minute = 0, second = 0;
+        int length = 0;
+        int fields = sscanf(text, "%4u-%2u-%2u%n", &year, &month, &day, &length);
+        if (fields != 3 || year < 2000 || year > 2063 || month < 1 || month > 12 || day < 1 || day > 31)
+        {
+            return false;
+        }
+        text += length;
+        int parts = 0;
+        if (*text == 'T')
+        {
+            length = 0;
+            parts = sscanf(text, "T%2u%n:%2u%n:%2u%n", &hour, &length, &minute, &length, &second, &length);
+            text += length;
+        }
+        if (*text || parts < 0 || hour > 23 || minute > 59 || second > 59)
+        {
+            return false;
+        }
+        *seconds = GpsDateTimeSeconds(PackGpsDateTime(year - 2000, month, day, hour, minute, second));
+        if (end)
+        {
+            static const uint32_t spans[] = { 86400, 3600, 60, 1 };
+            *seconds += spans[parts] - 1;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    int zoom = LOG_INDEX_ZOOM;
+    const char* outPath = NULL;
+    const char* indexPath = NULL;
+    bool scan = false;
+    bool files = false;
+    bool digest = false;
+    LogQuery query = { { -900000000, -1800000000, 900000000, 1800000000 }, 0, UINT32_MAX };
+    std::vector<std::string> paths;
+
+    bool usage = false;
+    for (int index = 1; index < argc && !usage; index++)
+    {
+        if (!strcmp(argv[index], "--threads") && index + 1 < argc)
+        {
+            threads = atoi(argv[++index]);
+        }
+        else if (!strcmp(argv[index], "--zoom") && index + 1 < argc)
+        {
+            zoom = atoi(argv[++index]);
+            usage = zoom < 0 || zoom > LOG_INDEX_MAX_ZOOM;
+        }
+        else if (!strcmp(argv[index], "--out") && index + 1 < argc)
+        {
+            outPath = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--index") && index + 1 < argc)
+        {
+            indexPath = argv[++index];
+        }
+        else if (!strcmp(argv[index], "--scan"))
+        {
+            scan = true;
+        }
+        else if (!strcmp(argv[index], "--box") && index + 1 < argc)
+        {
+            usage = !ParseBox(argv[++index], &query.box);
+        }
+        else if (!strcmp(argv[index], "--from") && index + 1 < argc)
+        {
+            usage = !ParseTime(argv[++index], false, &query.from);
+        }
+        else if (!strcmp(argv[index], "--to") && index + 1 < argc)
+        {
+            usage = !ParseTime(argv[++index], true, &query.to);
+        }
+        else if (!strcmp(argv[index], "--files"))
+        {
+            files = true;
+        }
+        else if (!strcmp(argv[index], "--digest"))
+        {
+            digest = true;
+        }
+        else if (argv[index][0] == '-')
+        {
+            usage = true;
+        }
+        else
+        {
+            paths.push_back(argv[index]);
+        }
+    }
+    int modes = (outPath != NULL) + (indexPath != NULL) + scan;
+    if (usage || modes != 1 || paths.empty() != (indexPath != NULL) || (files && digest))
+    {
+        fprintf(stderr,
+            "usage: %s [--threads N] [--zoom Z] --out INDEX PATH...\n"
+            "       %s --index INDEX [--box S,W,N,E] [--from TIME] [--to TIME] [--files | --digest]\n"
+            "       %s --scan [--box S,W,N,E] [--from TIME] [--to TIME] [--files | --digest] PATH...\n",
+            argv[0], argv[0], argv[0]);
+        return 2;
+    }
+
+    WorkPool pool(threads);
+    uint64_t startNs = BenchNanos();
+    std::vector<GpsReading> readings;
+    std::vector<std::string> sources;
+    if (outPath)
+    {
+        std::vector<LogInput> logs = FindLogs(paths);
+        IngestResult result;
+        IngestLogs(logs, pool, UINT32_MAX, false, result);
+        uint64_t ingestNs = BenchNanos() - startNs;
+        startNs = BenchNanos();
+        size_t written = BuildLogIndex(result, logs, zoom, outPath, pool);
+        if (!written)
+        {
+            fprintf(stderr, "cannot write %s\n", outPath);
+            return 1;
+        }
+        fprintf(stderr, "logs      %zu, %.1f MB, %zu unreadable, %zu readings in %.1f ms\n", result.files,
+            result.bytes / 1e6, result.unreadable, result.readings.size(), ingestNs / 1e6);
+        fprintf(stderr, "index     %.1f MB, zoom %d, in %.1f ms\n", written / 1e6, zoom,
+            (BenchNanos() - startNs) / 1e6);
+        return result.unreadable ? 1 : 0;
+    }
+    else if (indexPath)
+    {
+        LogIndexReader reader;
+        if (!reader.Open(indexPath))
+        {
+            fprintf(stderr, "%s is not an index\n", indexPath);
+            return 1;
+        }
+        LogQueryStats stats;
+        if (!reader.Query(query, readings, stats, files ? &sources : NULL))
+        {
+            fprintf(stderr, "%s is damaged\n", indexPath);
+            return 1;
+        }
+        fprintf(stderr, "query     %zu readings in %.3f ms, read %zu hours %zu blocks %zu points, %.1f of %.1f MB\n",
+            readings.size(), (BenchNanos() - startNs) / 1e6, stats.hours, stats.blocks, stats.points,
+            stats.bytes / 1e6, reader.Size() / 1e6);
+    }
+    else
+    {
+        std::vector<LogInput> logs = FindLogs(paths);
+        size_t skipped;
+        ScanLogs(logs, query, pool, readings, &skipped);
+        fprintf(stderr, "scan      %zu readings in %.3f ms, %zu of %zu logs skipped by name\n", readings.size(),
+            (BenchNanos() - startNs) / 1e6, skipped, logs.size());
+        if (files)
+        {
+            // the logs named for the hours of the readings, as the index lists them
+            std::vector<uint32_t> hours;
+            for (size_t index = 0; index < readings.size(); index++)
+            {
+                uint32_t hour = GpsDateTimeSeconds(readings[index].dateTime) / 3600;
+                if (hours.empty() || hours.back() != hour)
+                {
+                    hours.push_back(hour);
+                }
+            }
+            for (size_t log = 0; log < logs.size(); log++)
+            {
+                uint32_t hour;
+                if (LogNameHour(logs[log].path, &hour) && std::binary_search(hours.begin(), hours.end(), hour))
+                {
+                    sources.push_back(logs[log].path);
+                }
+            }
+        }
+    }
+
+    if (files)
+    {
+        for (size_t source = 0; source < sources.size(); source++)
+        {
+            printf("%s\n", sources[source].c_str());
+        }
+    }
+    else if (digest)
+    {
+        printf("%016llx\n", static_cast<unsigned long long>(ReadingsDigest(readings)));
+    }
+    else
+    {
+        for (size_t index = 0; index < readings.size(); index++)
+        {
+            char line[CSV_LINE_SIZE];
+            fwrite(line, 1, FormatCsvReading(readings[index], line), stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,668 @@
+// Reads a card's worth of logs in parallel and writes the tracks as GPX or GeoJSON.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "LogIngest.h"
+#include "BenchClock.h"
+
+// readings formatted by one export job
+#define EXPORT_SLICE_READINGS 8192
+
+// slices formatted before they are copied out, bounds the text held in memory
+#define EXPORT_BATCH_SLICES 64
+
+MappedFile::MappedFile() :
+    _data(NULL),
+    _size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* path, bool sequential)
+{
+    Close();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) || !S_ISREG(status.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+    if (status.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void* map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(map, status.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    _data = static_cast<const uint8_t*>(map);
+    _size = status.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (_data)
+    {
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+    _data = NULL;
+    _size = 0;
+}
+
+WorkPool::WorkPool(unsigned threads) :
+    _threads(threads ? threads : 1),
+    _steals(0)
+{
+}
+
+void WorkPool::Run(const std::vector<std::function<void()> >& jobs)
+{
+    std::vector<Queue> queues(_threads);
+    for (size_t job = 0; job < jobs.size(); job++)
+    {
+        queues[job % _threads].jobs.push_back(job);
+    }
+
+    std::atomic<size_t> steals(0);
+    std::vector<std::thread> workers;
+    for (unsigned thread = 1; thread < _threads; thread++)
+    {
+        workers.emplace_back(&WorkPool::Work, this, thread, std::ref(queues), std::cref(jobs), std::ref(steals));
+    }
+    Work(0, queues, jobs, steals);
+    for (size_t index = 0; index < workers.size(); index++)
+    {
+        workers[index].join();
+    }
+    _steals += steals;
+}
+
+void WorkPool::Work(unsigned self, std::vector<Queue>& queues, const std::vector<std::function<void()> >& jobs,
+    std::atomic<size_t>& steals)
+{
+    for (;;)
+    {
+        size_t job = 0;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> guard(queues[self].lock);
+            if (!queues[self].jobs.empty())
+            {
+                job = queues[self].jobs.front();
+                queues[self].jobs.pop_front();
+                found = true;
+            }
+        }
+        for (unsigned offset = 1; !found && offset < _threads; offset++)
+        {
+            Queue& other = queues[(self + offset) % _threads];
+            std::lock_guard<std::mutex> guard(other.lock);
+            if (!other.jobs.empty())
+            {
+                job = other.jobs.back();
+                other.jobs.pop_back();
+                found = true;
+                steals++;
+            }
+        }
+        if (!found)
+        {
+            // no job is added during a run, every queue is empty
+            return;
+        }
+        jobs[job]();
+    }
+}
+
+namespace
+{
+    bool IsDigits(const std::string& text, size_t first, size_t count)
+    {
+        for (size_t index = first; index < first + count; index++)
+        {
+            if (text[index] < '0' || text[index] > '9')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // YYMMDD-H.CSV, .BIN or .TRK with H from A to X, or NMEAnnnn.RAW
+    bool IsLogName(const std::string& name)
+    {
+        if (name.size() != 12 || name[8] != '.')
+        {
+            return false;
+        }
+        std::string extension = name.substr(9);
+        if (IsDigits(name, 0, 6) && name[6] == '-' && name[7] >= 'A' && name[7] <= 'X')
+        {
+            return extension == "CSV" || extension == "BIN" || extension == "TRK";
+        }
+        return name.compare(0, 4, "NMEA") == 0 && IsDigits(name, 4, 4) && extension == "RAW";
+    }
+
+    bool SameReading(const GpsReading& first, const GpsReading& second)
+    {
+        return first.dateTime == second.dateTime && first.latitude == second.latitude &&
+            first.longitude == second.longitude && first.altitude == second.altitude &&
+            first.satelliteCount == second.satelliteCount && first.flags == second.flags;
+    }
+
+    bool Dated(const GpsReading& reading)
+    {
+        return (reading.flags & (GPS_READING_DATE | GPS_READING_TIME)) == (GPS_READING_DATE | GPS_READING_TIME);
+    }
+}
+
+std::vector<LogInput> FindLogs(const std::vector<std::string>& paths)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<LogInput> logs;
+    for (size_t index = 0; index < paths.size(); index++)
+    {
+        std::error_code error;
+        if (!fs::is_directory(paths[index], error))
+        {
+            LogInput log = { paths[index], static_cast<size_t>(fs::file_size(paths[index], error)) };
+            logs.push_back(log);
+            continue;
+        }
+
+        std::vector<LogInput> found;
+        for (fs::recursive_directory_iterator entry(paths[index], fs::directory_options::skip_permission_denied, error), end;
+            !error && entry != end; entry.increment(error))
+        {
+            if (entry->is_regular_file(error) && IsLogName(entry->path().filename().string()))
+            {
+                LogInput log = { entry->path().string(), static_cast<size_t>(entry->file_size(error)) };
+                found.push_back(log);
+            }
+        }
+        std::sort(found.begin(), found.end(), [](const LogInput& first, const LogInput& second)
+        {
+            return first.path < second.path;
+        });
+        logs.insert(logs.end(), found.begin(), found.end());
+    }
+    return logs;
+}
+
+bool LogNameHour(const std::string& path, uint32_t* hour)
+{
+    std::string name = std::filesystem::path(path).filename().string();
+    if (!IsLogName(name) || name[6] != '-')
+    {
+        return false;
+    }
+    uint8_t month = (name[2] - '0') * 10 + name[3] - '0';
+    uint8_t day = (name[4] - '0') * 10 + name[5] - '0';
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+    {
+        return false;
+    }
+    uint8_t year = (name[0] - '0') * 10 + name[1] - '0';
+    *hour = GpsDateTimeSeconds(PackGpsDateTime(year, month, day, name[7] - 'A', 0, 0)) / 3600;
+    return true;
+}
+
+void IngestLogs(const std::vector<LogInput>& logs, WorkPool& pool, uint32_t gapSeconds, bool scalarCsv,
+    IngestResult& result)
+{
+    result.readings.clear();
+    result.tracks.clear();
+    memset(&result.counters, 0, sizeof(result.counters));
+    result.files = logs.size();
+    result.bytes = 0;
+    result.unreadable = 0;
+    result.undated = 0;
+    result.duplicates = 0;
+
+    // largest first, the small ones fill in at the end
+    std::vector<size_t> order(logs.size());
+    for (size_t index = 0; index < logs.size(); index++)
+    {
+        order[index] = index;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t first, size_t second)
+    {
+        return logs[first].size > logs[second].size;
+    });
+
+    std::vector<std::vector<GpsReading> > decoded(logs.size());
+    std::vector<LogDecodeCounters> counters(logs.size());
+    std::vector<size_t> bytes(logs.size(), 0);
+    std::vector<char> unreadable(logs.size(), 0);
+    std::vector<std::function<void()> > jobs;
+    for (size_t index = 0; index < order.size(); index++)
+    {
+        size_t log = order[index];
+        jobs.push_back([&, log]()
+        {
+            memset(&counters[log], 0, sizeof(counters[log]));
+            MappedFile file;
+            if (!file.Open(logs[log].path.c_str()))
+            {
+                unreadable[log] = 1;
+                return;
+            }
+            bytes[log] = file.Size();
+            // a CSV line is about 50 bytes, the binary records are smaller
+            decoded[log].reserve(file.Size() / 48 + 16);
+            if (DecodeLog(file.Data(), file.Size(), logs[log].path.c_str(), decoded[log], counters[log],
+                scalarCsv) == LogKind_TripIndex)
+            {
+                unreadable[log] = 1;
+            }
+        });
+    }
+    pool.Run(jobs);
+
+    size_t total = 0;
+    for (size_t log = 0; log < logs.size(); log++)
+    {
+        result.counters.readings += counters[log].readings;
+        result.counters.rejected += counters[log].rejected;
+        result.counters.trailing += counters[log].trailing;
+        result.bytes += bytes[log];
+        result.unreadable += unreadable[log];
+        total += decoded[log].size();
+    }
+
+    // the logs in the order of their first dated reading, usually the
+    // whole merge as hourly logs do not overlap
+    std::vector<std::pair<uint32_t, size_t> > starts;
+    for (size_t log = 0; log < logs.size(); log++)
+    {
+        for (size_t index = 0; index < decoded[log].size(); index++)
+        {
+            if (Dated(decoded[log][index]))
+            {
+                starts.push_back(std::make_pair(decoded[log][index].dateTime, log));
+                break;
+            }
+        }
+    }
+    std::sort(starts.begin(), starts.end());
+
+    std::vector<GpsReading>& readings = result.readings;
+    readings.reserve(total);
+    for (size_t start = 0; start < starts.size(); start++)
+    {
+        std::vector<GpsReading>& log = decoded[starts[start].second];
+        for (size_t index = 0; index < log.size(); index++)
+        {
+            if (Dated(log[index]))
+            {
+                readings.push_back(log[index]);
+            }
+        }
+        std::vector<GpsReading>().swap(log);
+    }
+    result.undated = total - readings.size();
+
+    // the packed date and time sorts in time order
+    auto earlier = [](const GpsReading& first, const GpsReading& second)
+    {
+        return first.dateTime < second.dateTime;
+    };
+    if (!std::is_sorted(readings.begin(), readings.end(), earlier))
+    {
+        std::stable_sort(readings.begin(), readings.end(), earlier);
+    }
+
+    // a second logged twice keeps its readings once, faster receivers
+    // make more than one reading a second and those all stay
+    size_t kept = 0;
+    size_t second = 0;
+    for (size_t index = 0; index < readings.size(); index++)
+    {
+        if (kept && readings[kept - 1].dateTime != readings[index].dateTime)
+        {
+            second = kept;
+        }
+        bool duplicate = false;
+        for (size_t previous = second; previous < kept && !duplicate; previous++)
+        {
+            duplicate = SameReading(readings[previous], readings[index]);
+        }
+        if (duplicate)
+        {
+            result.duplicates++;
+            continue;
+        }
+        readings[kept++] = readings[index];
+    }
+    readings.resize(kept);
+
+    size_t first = 0;
+    uint32_t lastSeconds = 0;
+    for (size_t index = 0; index < readings.size(); index++)
+    {
+        uint32_t seconds = GpsDateTimeSeconds(readings[index].dateTime);
+        if (index > first && seconds - lastSeconds > gapSeconds)
+        {
+            LogTrack track = { first, index };
+            result.tracks.push_back(track);
+            first = index;
+        }
+        lastSeconds = seconds;
+    }
+    if (first < readings.size())
+    {
+        LogTrack track = { first, readings.size() };
+        result.tracks.push_back(track);
+    }
+}
+
+uint64_t ReadingsDigest(const std::vector<GpsReading>& readings)
+{
+    uint64_t digest = BenchDigestSeed;
+    for (size_t index = 0; index < readings.size(); index++)
+    {
+        char line[CSV_LINE_SIZE];
+        uint8_t length = FormatCsvReading(readings[index], line);
+        digest = BenchDigest(digest, line, length);
+    }
+    return digest;
+}
+
+namespace
+{
+    // part of a track formatted by one job, with the track's opening and
+    // closing when it is the first or the last part
+    struct ExportSlice
+    {
+        size_t track;       // index into the tracks exported
+        size_t first;
+        size_t end;
+        bool opens;
+        bool closes;
+        bool follows;       // a point of the track comes before the slice
+    };
+
+    // 1e-7 degrees as [-]d.ddddddd, no floating point on the way
+    char* AppendDegrees(char* out, int32_t value)
+    {
+        uint32_t magnitude = value < 0 ? -static_cast<uint32_t>(value) : value;
+        if (value < 0)
+        {
+            *out++ = '-';
+        }
+        out = AppendCsvNumber(out, magnitude / 10000000UL);
+        *out++ = '.';
+        return AppendCsvDigits(out, magnitude % 10000000UL, 7);
+    }
+
+    // centimeters as [-]m.cc
+    char* AppendMeters(char* out, int32_t value)
+    {
+        uint32_t magnitude = value < 0 ? -static_cast<uint32_t>(value) : value;
+        if (value < 0)
+        {
+            *out++ = '-';
+        }
+        out = AppendCsvNumber(out, magnitude / 100);
+        *out++ = '.';
+        return AppendCsvDigits(out, magnitude % 100, 2);
+    }
+
+    // 2017-06-17T07:43:18Z
+    char* AppendTime(char* out, uint32_t dateTime)
+    {
+        out = AppendCsvDigits(out, 2000 + GpsDateTimeYear(dateTime), 4);
+        *out++ = '-';
+        out = AppendCsvDigits(out, GpsDateTimeMonth(dateTime), 2);
+        *out++ = '-';
+        out = AppendCsvDigits(out, GpsDateTimeDay(dateTime), 2);
+        *out++ = 'T';
+        out = AppendCsvDigits(out, GpsDateTimeHour(dateTime), 2);
+        *out++ = ':';
+        out = AppendCsvDigits(out, GpsDateTimeMinute(dateTime), 2);
+        *out++ = ':';
+        out = AppendCsvDigits(out, GpsDateTimeSecond(dateTime), 2);
+        *out++ = 'Z';
+        return out;
+    }
+
+    char* AppendText(char* out, const char* text)
+    {
+        size_t length = strlen(text);
+        memcpy(out, text, length);
+        return out + length;
+    }
+
+    void AppendGpxSlice(const IngestResult& result, const LogTrack& track, const ExportSlice& slice, std::string& text)
+    {
+        char buffer[192];
+        if (slice.opens)
+        {
+            char* end = AppendText(buffer, "<trk><name>");
+            end = AppendTime(end, result.readings[track.first].dateTime);
+            end = AppendText(end, "</name><trkseg>\n");
+            text.append(buffer, end - buffer);
+        }
+        for (size_t index = slice.first; index < slice.end; index++)
+        {
+            const GpsReading& reading = result.readings[index];
+            if (!(reading.flags & GPS_READING_POSITION))
+            {
+                continue;
+            }
+            char* end = AppendText(buffer, "<trkpt lat=\"");
+            end = AppendDegrees(end, reading.latitude);
+            end = AppendText(end, "\" lon=\"");
+            end = AppendDegrees(end, reading.longitude);
+            end = AppendText(end, "\">");
+            if (reading.flags & GPS_READING_ALTITUDE)
+            {
+                end = AppendText(end, "<ele>");
+                end = AppendMeters(end, reading.altitude);
+                end = AppendText(end, "</ele>");
+            }
+            end = AppendText(end, "<time>");
+            end = AppendTime(end, reading.dateTime);
+            end = AppendText(end, "</time>");
+            if (reading.flags & GPS_READING_SATELLITES)
+            {
+                end = AppendText(end, "<sat>");
+                end = AppendCsvNumber(end, reading.satelliteCount);
+                end = AppendText(end, "</sat>");
+            }
+            end = AppendText(end, "</trkpt>\n");
+            text.append(buffer, end - buffer);
+        }
+        if (slice.closes)
+        {
+            text.append("</trkseg></trk>\n");
+        }
+    }
+
+    void AppendGeoJsonSlice(const IngestResult& result, const LogTrack& track, const ExportSlice& slice,
+        size_t positions, std::string& text)
+    {
+        char buffer[192];
+        if (slice.opens)
+        {
+            char* end = AppendText(buffer, slice.track ? ",\n" : "");
+            end = AppendText(end, "{\"type\":\"Feature\",\"properties\":{\"start\":\"");
+            end = AppendTime(end, result.readings[track.first].dateTime);
+            end = AppendText(end, "\",\"end\":\"");
+            end = AppendTime(end, result.readings[track.end - 1].dateTime);
+            end = AppendText(end, "\",\"points\":");
+            end = AppendCsvNumber(end, positions);
+            end = AppendText(end, "},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[\n");
+            text.append(buffer, end - buffer);
+        }
+        bool follows = slice.follows;
+        for (size_t index = slice.first; index < slice.end; index++)
+        {
+            const GpsReading& reading = result.readings[index];
+            if (!(reading.flags & GPS_READING_POSITION))
+            {
+                continue;
+            }
+            char* end = AppendText(buffer, follows ? ",\n[" : "[");
+            end = AppendDegrees(end, reading.longitude);
+            *end++ = ',';
+            end = AppendDegrees(end, reading.latitude);
+            if (reading.flags & GPS_READING_ALTITUDE)
+            {
+                *end++ = ',';
+                end = AppendMeters(end, reading.altitude);
+            }
+            *end++ = ']';
+            text.append(buffer, end - buffer);
+            follows = true;
+        }
+        if (slice.closes)
+        {
+            text.append("\n]}}");
+        }
+    }
+
+    // texts onto the end of the file through a mapping, copied on pool
+    bool AppendMapped(int fd, size_t& offset, const std::vector<std::string>& texts, WorkPool& pool)
+    {
+        std::vector<size_t> starts(texts.size());
+        size_t total = 0;
+        for (size_t index = 0; index < texts.size(); index++)
+        {
+            starts[index] = total;
+            total += texts[index].size();
+        }
+        if (!total)
+        {
+            return true;
+        }
+        if (ftruncate(fd, offset + total))
+        {
+            return false;
+        }
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t mapStart = offset / page * page;
+        size_t mapSize = offset + total - mapStart;
+        void* map = mmap(NULL, mapSize, PROT_WRITE, MAP_SHARED, fd, mapStart);
+        if (map == MAP_FAILED)
+        {
+            return false;
+        }
+        char* base = static_cast<char*>(map) + (offset - mapStart);
+        std::vector<std::function<void()> > jobs;
+        for (size_t index = 0; index < texts.size(); index++)
+        {
+            jobs.push_back([&, index]()
+            {
+                memcpy(base + starts[index], texts[index].data(), texts[index].size());
+            });
+        }
+        pool.Run(jobs);
+        munmap(map, mapSize);
+        offset += total;
+        return true;
+    }
+}
+
+size_t ExportTracks(const IngestResult& result, ExportFormat format, const char* path, WorkPool& pool)
+{
+    // tracks of at least two positions, in slices
+    std::vector<LogTrack> tracks;
+    std::vector<size_t> positions;
+    std::vector<ExportSlice> slices;
+    for (size_t index = 0; index < result.tracks.size(); index++)
+    {
+        const LogTrack& track = result.tracks[index];
+        size_t count = 0;
+        std::vector<ExportSlice> trackSlices;
+        for (size_t first = track.first; first < track.end; first += EXPORT_SLICE_READINGS)
+        {
+            ExportSlice slice = { tracks.size(), first, std::min(first + EXPORT_SLICE_READINGS, track.end),
+                first == track.first, false, count != 0 };
+            for (size_t reading = slice.first; reading < slice.end; reading++)
+            {
+                count += (result.readings[reading].flags & GPS_READING_POSITION) ? 1 : 0;
+            }
+            trackSlices.push_back(slice);
+        }
+        if (count < 2)
+        {
+            continue;
+        }
+        trackSlices.back().closes = true;
+        slices.insert(slices.end(), trackSlices.begin(), trackSlices.end());
+        tracks.push_back(track);
+        positions.push_back(count);
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    size_t offset = 0;
+    std::vector<std::string> texts(1);
+    texts[0] = (format == ExportFormat_Gpx) ?
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<gpx version=\"1.1\" creator=\"log_export\" xmlns=\"http://www.topografix.com/GPX/1/1\">\n" :
+        "{\"type\":\"FeatureCollection\",\"features\":[\n";
+    bool written = AppendMapped(fd, offset, texts, pool);
+
+    for (size_t batch = 0; written && batch < slices.size(); batch += EXPORT_BATCH_SLICES)
+    {
+        size_t count = std::min(slices.size() - batch, static_cast<size_t>(EXPORT_BATCH_SLICES));
+        texts.assign(count, std::string());
+        std::vector<std::function<void()> > jobs;
+        for (size_t index = 0; index < count; index++)
+        {
+            jobs.push_back([&, index]()
+            {
+                const ExportSlice& slice = slices[batch + index];
+                std::string& text = texts[index];
+                text.reserve((slice.end - slice.first) * 128 + 256);
+                if (format == ExportFormat_Gpx)
+                {
+                    AppendGpxSlice(result, tracks[slice.track], slice, text);
+                }
+                else
+                {
+                    AppendGeoJsonSlice(result, tracks[slice.track], slice, positions[slice.track], text);
+                }
+            });
+        }
+        pool.Run(jobs);
+        written = AppendMapped(fd, offset, texts, pool);
+    }
+
+    texts.assign(1, (format == ExportFormat_Gpx) ? "</gpx>\n" : "\n]}\n");
+    written = written && AppendMapped(fd, offset, texts, pool);
+    close(fd);
+    return written ? offset : 0;
+}
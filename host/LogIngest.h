@@ -0,0 +1,149 @@
+// Reads a card's worth of logs in parallel and writes the tracks as GPX or GeoJSON.
+//
+// Every log is mapped read only and decoded by LogDecode.h on a WorkPool,
+// one job per file, largest first. The readings are merged in time order,
+// readings of the same second logged twice (a CSV and a BIN of the same
+// hour, say) are kept once, and tracks break where no reading arrived for
+// gapSeconds. The export formats slices of the tracks on the pool and copies
+// them through a mapping of the output file, a batch at a time so the text
+// never has to fit in memory at once. The output does not depend on the
+// number of threads.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LogDecode.h"
+
+// a file mapped read only, empty when it is empty or could not be mapped
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // sequential when the file is read through, otherwise read ahead is off
+    bool Open(const char* path, bool sequential = true);
+    void Close();
+
+    const uint8_t* Data() const
+    {
+        return _data;
+    }
+
+    size_t Size() const
+    {
+        return _size;
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// jobs dealt out to a queue per thread; a thread that runs out takes the
+// last job of the first busy queue after its own, so a few large files at
+// the front of one queue do not leave the others idle
+class WorkPool
+{
+public:
+    explicit WorkPool(unsigned threads);
+
+    // runs every job, returns once all have finished
+    void Run(const std::vector<std::function<void()> >& jobs);
+
+    unsigned Threads() const
+    {
+        return _threads;
+    }
+
+    // jobs taken from another thread's queue, over all runs
+    size_t Steals() const
+    {
+        return _steals;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    unsigned _threads;
+    size_t _steals;
+
+    void Work(unsigned self, std::vector<Queue>& queues, const std::vector<std::function<void()> >& jobs,
+        std::atomic<size_t>& steals);
+};
+
+struct LogInput
+{
+    std::string path;
+    size_t size;
+};
+
+// the files given, and the logs named as the sketch names them under the
+// directories given: YYMMDD-H.CSV, .BIN and .TRK, and NMEAnnnn.RAW
+std::vector<LogInput> FindLogs(const std::vector<std::string>& paths);
+
+// the first and one past the last reading of a track
+struct LogTrack
+{
+    size_t first;
+    size_t end;
+};
+
+struct IngestResult
+{
+    std::vector<GpsReading> readings;   // in time order
+    std::vector<LogTrack> tracks;
+    LogDecodeCounters counters;
+    size_t files;
+    size_t bytes;
+    size_t unreadable;  // files that could not be mapped or are not logs
+    size_t undated;     // readings without a date, they cannot be placed
+    size_t duplicates;  // readings of a second already read from another log
+};
+
+// decodes the logs on pool and merges them into tracks, scalarCsv takes the
+// reference parser for CSV
+void IngestLogs(const std::vector<LogInput>& logs, WorkPool& pool, uint32_t gapSeconds, bool scalarCsv,
+    IngestResult& result);
+
+enum ExportFormat
+{
+    ExportFormat_Gpx,
+    ExportFormat_GeoJson
+};
+
+// the tracks with at least two positions into path, returns the bytes
+// written or 0 when path could not be written
+size_t ExportTracks(const IngestResult& result, ExportFormat format, const char* path, WorkPool& pool);
+
+// the packed date and time of a reading, year from 2000
+inline uint32_t PackGpsDateTime(uint8_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute,
+    uint8_t second)
+{
+    return (static_cast<uint32_t>(year) << GPS_DATETIME_YEAR_SHIFT) |
+        (static_cast<uint32_t>(month) << GPS_DATETIME_MONTH_SHIFT) |
+        (static_cast<uint32_t>(day) << GPS_DATETIME_DAY_SHIFT) |
+        (static_cast<uint32_t>(hour) << GPS_DATETIME_HOUR_SHIFT) |
+        (static_cast<uint32_t>(minute) << GPS_DATETIME_MINUTE_SHIFT) | second;
+}
+
+// hours since 2000-01-01 of a log named YYMMDD-H.EXT, false for other names
+bool LogNameHour(const std::string& path, uint32_t* hour);
+
+// FNV-1a of the readings as CSV lines, what replay_bench prints for the parser
+uint64_t ReadingsDigest(const std::vector<GpsReading>& readings);
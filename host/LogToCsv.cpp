@@ -0,0 +1,187 @@
+// Converts BIN and TRK logs from the card back into the CSV the logger used to write.
+//
+//   log_to_csv FILE.BIN|FILE.TRK|FILE.CSV|TRIPS.IDX [OUT.CSV]
+//
+// The format is taken from the file header. Without an output file the CSV
+// goes to stdout. Every reading is formatted by the same FormatCsvReading the
+// sketch uses for CSV logs, so logs of the same readings in any format convert
+// to identical text. A journaled log (LOG_JOURNAL) is unwrapped first, the
+// newest copy of each of its sectors in order, and a journaled CSV log comes
+// out as it was logged.
+// TRIPS.IDX (LOG_TRIPS) comes out as a line per trip: start and end UTC,
+// the box in degrees, meters, top speed in km/h, and the log and offset of
+// its first reading and the log and offset past its last, logs named without
+// their extension. A record cut short at the end is left out.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Arduino.h"
+
+#include "LogDecode.h"
+
+namespace
+{
+    void WriteCsv(const std::vector<GpsReading>& readings, FILE* out)
+    {
+        for (size_t index = 0; index < readings.size(); index++)
+        {
+            char line[CSV_LINE_SIZE];
+            fwrite(line, 1, FormatCsvReading(readings[index], line), out);
+        }
+    }
+
+    void PrintTime(uint32_t dateTime, FILE* out)
+    {
+        fprintf(out, "20%02u-%02u-%02uT%02u:%02u:%02uZ", GpsDateTimeYear(dateTime), GpsDateTimeMonth(dateTime),
+            GpsDateTimeDay(dateTime), GpsDateTimeHour(dateTime), GpsDateTimeMinute(dateTime),
+            GpsDateTimeSecond(dateTime));
+    }
+
+    // YYMMDD-H, the log the sketch wrote the reading to
+    void PrintLogName(uint32_t dateTime, FILE* out)
+    {
+        fprintf(out, "%02u%02u%02u-%c", GpsDateTimeYear(dateTime), GpsDateTimeMonth(dateTime),
+            GpsDateTimeDay(dateTime), 'A' + GpsDateTimeHour(dateTime));
+    }
+
+    size_t WriteTrips(const std::vector<uint8_t>& index, FILE* out)
+    {
+        fprintf(out, "start,end,south,west,north,east,meters,top_kmh,start_log,start_offset,end_log,end_offset\n");
+        size_t trips = 0;
+        for (size_t offset = TRIP_RECORD_SIZE; offset + TRIP_RECORD_SIZE <= index.size(); offset += TRIP_RECORD_SIZE)
+        {
+            TripSummary trip;
+            UnpackTripRecord(&index[offset], trip);
+            PrintTime(trip.startDateTime, out);
+            fputc(',', out);
+            PrintTime(trip.endDateTime, out);
+            fprintf(out, ",%.7f,%.7f,%.7f,%.7f,%lu,%.1f,", trip.south / 1e7, trip.west / 1e7, trip.north / 1e7,
+                trip.east / 1e7, static_cast<unsigned long>(trip.distanceM), trip.maxSpeedCms * 0.036);
+            PrintLogName(trip.startDateTime, out);
+            fprintf(out, ",%lu,", static_cast<unsigned long>(trip.startOffset));
+            PrintLogName(trip.endDateTime, out);
+            fprintf(out, ",%lu\n", static_cast<unsigned long>(trip.endOffset));
+            trips++;
+        }
+        return trips;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s FILE.BIN|FILE.TRK|FILE.CSV|TRIPS.IDX [OUT.CSV]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> log;
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    int value;
+    while ((value = fgetc(in)) != EOF)
+    {
+        log.push_back(static_cast<uint8_t>(value));
+    }
+    fclose(in);
+
+    if (IdentifyLog(log.data(), log.size(), argv[1]) == LogKind_TripIndex)
+    {
+        FILE* out = (argc == 3) ? fopen(argv[2], "wb") : stdout;
+        if (!out)
+        {
+            fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+        size_t trips = WriteTrips(log, out);
+        if (log.size() % TRIP_RECORD_SIZE)
+        {
+            fprintf(stderr, "%s: ignoring %zu trailing bytes\n", argv[1], log.size() % TRIP_RECORD_SIZE);
+        }
+        if (out != stdout)
+        {
+            fclose(out);
+            fprintf(stderr, "%zu trips\n", trips);
+        }
+        return 0;
+    }
+
+    bool journal = IsLogJournal(log.data(), log.size());
+    if (journal)
+    {
+        size_t size = log.size();
+        std::vector<uint8_t> payload;
+        unsigned long records;
+        size_t blocks = UnwrapLogJournal(log.data(), log.size(), payload, &records);
+        log.swap(payload);
+        fprintf(stderr, "%s: journal of %lu records in %zu blocks", argv[1], records, blocks);
+        if (blocks * LOG_JOURNAL_SECTOR_SIZE < size)
+        {
+            fprintf(stderr, ", ignoring %zu bytes after them", size - blocks * LOG_JOURNAL_SECTOR_SIZE);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    bool bin = log.size() >= BIN_RECORD_SIZE && IsBinHeader(&log[0]);
+    bool track = log.size() >= TRACK_HEADER_SIZE && IsTrackHeader(&log[0]);
+    if (journal && !bin && !track)
+    {
+        // CSV, already what the logger wrote
+        FILE* out = (argc == 3) ? fopen(argv[2], "wb") : stdout;
+        if (!out)
+        {
+            fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+        fwrite(log.data(), 1, log.size(), out);
+        if (out != stdout)
+        {
+            fclose(out);
+        }
+        return 0;
+    }
+    if (!bin && !track)
+    {
+        fprintf(stderr, "%s is not a version %d BIN or version %d TRK log\n",
+            argv[1], BIN_FORMAT_VERSION, TRACK_FORMAT_VERSION);
+        return 1;
+    }
+
+    FILE* out = (argc == 3) ? fopen(argv[2], "wb") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<GpsReading> readings;
+    LogDecodeCounters counters = { 0, 0, 0 };
+    if (bin)
+    {
+        DecodeBinLog(log.data(), log.size(), readings, counters);
+    }
+    else
+    {
+        DecodeTrackLog(log.data(), log.size(), readings, counters);
+    }
+    WriteCsv(readings, out);
+    if (counters.trailing)
+    {
+        // a record cut short by power loss before the file was closed
+        fprintf(stderr, "%s: ignoring %zu trailing bytes\n", argv[1], counters.trailing);
+    }
+
+    if (out != stdout)
+    {
+        fclose(out);
+        fprintf(stderr, "%zu readings\n", counters.readings);
+    }
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Runs the receiver configuration of TaskGps against simulated receivers.
+//
+//   receiver_bench capture.nmea...
+//
+// Built once per receiver setup (see the Makefile), as GpsReceiver.h is
+// configured at compile time. The same capture is played by a SimReceiver
+// that answers every command, one that loses the first command and one that
+// takes no commands at all. Reports what the configuration did to the line:
+// bytes and sentences per epoch before and after, parser cycles per epoch, and
+// checks that the readings logged are exactly those of an unconfigured replay.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+
+#include "TaskGps.h"
+#include "BenchPipeline.h"
+#include "LogFormat.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+#include "SimReceiver.h"
+
+#if GPS_RECEIVER == GPS_RECEIVER_UBLOX
+#define SIM_PROTOCOL SimReceiver::Protocol_Ublox
+#define RECEIVER_NAME "u-blox"
+#else
+#define SIM_PROTOCOL SimReceiver::Protocol_Mtk
+#define RECEIVER_NAME "MTK"
+#endif
+
+namespace
+{
+    struct Readings
+    {
+        uint64_t count;
+        uint64_t digest;
+    };
+
+    Readings s_readings;
+
+    void OnBenchReading(const GpsReading& reading)
+    {
+        if (reading.flags & GPS_READING_TIME)
+        {
+            char line[CSV_LINE_SIZE];
+            uint8_t length = FormatCsvReading(reading, line);
+            s_readings.digest = BenchDigest(s_readings.digest, line, length);
+            s_readings.count++;
+        }
+    }
+
+    void OnBenchBatch()
+    {
+    }
+
+    void OnBenchFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+    }
+
+    void ResetSimulation(HostSim::UartLine* line)
+    {
+        HostSim::SetNowUs(0);
+        memset(&HostSim::Uart(), 0, sizeof(HostSim::Uart()));
+        HostSim::SetUartLine(line);
+        s_readings.count = 0;
+        s_readings.digest = BenchDigestSeed;
+    }
+
+    // the capture straight into the parser, no commands get anywhere
+    Readings RunReference(const std::vector<std::string>& captures)
+    {
+        CaptureLine line;
+        for (size_t index = 0; index < captures.size(); index++)
+        {
+            line.Load(captures[index]);
+        }
+        line.SetFlood(true);
+        ResetSimulation(&line);
+
+        BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+        pipeline.Start();
+        while (!line.Finished())
+        {
+            pipeline.Loop();
+        }
+        pipeline.Finish();
+        return s_readings;
+    }
+
+    struct Scenario
+    {
+        const char* name;
+        uint32_t ignoreCommands;
+        bool silent;
+    };
+
+    struct Outcome
+    {
+        Readings readings;
+        GpsConfigCounters config;
+        SimReceiver::Stats receiver;
+        SimReceiver::Stats atConfigured;    // receiver counters when the last command was done
+        uint64_t configuredUs;
+        uint64_t received;
+        uint64_t lostSending;
+        uint64_t overflowed;
+        uint64_t cyclesBefore;
+        uint64_t cyclesAfter;
+        uint32_t baud;
+        uint32_t intervalMs;
+        uint8_t gsvRate;
+    };
+
+    bool RunScenario(const Scenario& scenario, const std::vector<std::string>& captures, Outcome* outcome)
+    {
+        SimReceiver receiver(SIM_PROTOCOL);
+        for (size_t index = 0; index < captures.size(); index++)
+        {
+            if (!receiver.Load(captures[index]))
+            {
+                fprintf(stderr, "cannot read %s\n", captures[index].c_str());
+                return false;
+            }
+        }
+        receiver.SetIgnoreCommands(scenario.ignoreCommands);
+        receiver.SetSilent(scenario.silent);
+        ResetSimulation(&receiver);
+
+        memset(outcome, 0, sizeof(*outcome));
+        BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+        pipeline.Start();
+
+        bool configuring = true;
+        uint64_t endUs = 0;
+        while (!receiver.Finished() || HostSim::NowUs() <= endUs + 2000000)
+        {
+            if (!receiver.Finished())
+            {
+                endUs = HostSim::NowUs();
+            }
+
+            uint64_t startCycles = BenchCycles();
+            pipeline.Loop();
+            uint64_t cycles = BenchCycles() - startCycles;
+
+            if (configuring)
+            {
+                outcome->cyclesBefore += cycles;
+                if (!pipeline.taskGps.Configuring())
+                {
+                    configuring = false;
+                    outcome->atConfigured = receiver.Counters();
+                    outcome->configuredUs = HostSim::NowUs();
+                }
+            }
+            else
+            {
+                outcome->cyclesAfter += cycles;
+            }
+        }
+        pipeline.Finish();
+
+        outcome->readings = s_readings;
+        outcome->config = pipeline.taskGps.ConfigCounters();
+        outcome->receiver = receiver.Counters();
+        outcome->received = HostSim::Uart().received;
+        outcome->lostSending = HostSim::Uart().lostSending;
+        outcome->overflowed = HostSim::Uart().overflowed;
+        outcome->baud = receiver.Baud();
+        outcome->intervalMs = receiver.IntervalMs();
+        outcome->gsvRate = receiver.Rate("GSV");
+        return true;
+    }
+
+    double PerEpoch(uint64_t value, uint64_t epochs)
+    {
+        return epochs ? static_cast<double>(value) / epochs : 0.0;
+    }
+
+    void PrintOutcome(const Scenario& scenario, const Outcome& outcome)
+    {
+        const SimReceiver::Stats& all = outcome.receiver;
+        const SimReceiver::Stats& before = outcome.atConfigured;
+        uint64_t epochsAfter = all.epochsSent - before.epochsSent;
+
+        printf("%s\n", scenario.name);
+        printf("  commands acked/refused/timed out  %u/%u/%u\n",
+            outcome.config.acked, outcome.config.refused, outcome.config.timedOut);
+        printf("  receiver commands seen/ignored    %u/%u\n", all.commands, all.ignored);
+        printf("  configured after                  %.1f s\n", outcome.configuredUs / 1e6);
+        printf("  receiver baud, interval           %lu, %lu ms\n",
+            static_cast<unsigned long>(outcome.baud), static_cast<unsigned long>(outcome.intervalMs));
+        printf("  bytes/epoch before, after         %.1f, %.1f\n",
+            PerEpoch(before.bytesSent, before.epochsSent), PerEpoch(all.bytesSent - before.bytesSent, epochsAfter));
+        printf("  sentences/epoch before, after     %.2f, %.2f\n",
+            PerEpoch(before.sentencesSent, before.epochsSent), PerEpoch(all.sentencesSent - before.sentencesSent, epochsAfter));
+        printf("  host cycles/epoch before, after   %.0f, %.0f\n",
+            PerEpoch(outcome.cyclesBefore, before.epochsSent), PerEpoch(outcome.cyclesAfter, epochsAfter));
+        printf("  bytes parsed                      %llu\n", static_cast<unsigned long long>(outcome.received));
+        printf("  bytes lost sending, overflowed    %llu, %llu\n",
+            static_cast<unsigned long long>(outcome.lostSending), static_cast<unsigned long long>(outcome.overflowed));
+        printf("  readings                          %llu (%016llx)\n",
+            static_cast<unsigned long long>(outcome.readings.count), static_cast<unsigned long long>(outcome.readings.digest));
+    }
+
+    bool Check(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            printf("  FAILED: %s\n", what);
+        }
+        return condition;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> captures(argv + 1, argv + argc);
+    if (captures.empty())
+    {
+        fprintf(stderr, "usage: %s capture...\n", argv[0]);
+        return 2;
+    }
+
+    printf("receiver %s, %u commands, baud %d -> %d, interval %d ms\n", RECEIVER_NAME,
+        static_cast<unsigned>(GPS_CONFIG_COMMAND_COUNT), GPS_BAUD, GPS_CONFIG_BAUD ? GPS_CONFIG_BAUD : GPS_BAUD,
+        GPS_CONFIG_INTERVAL_MS ? GPS_CONFIG_INTERVAL_MS : 1000);
+
+    Readings reference = RunReference(captures);
+    printf("reference readings                  %llu (%016llx)\n",
+        static_cast<unsigned long long>(reference.count), static_cast<unsigned long long>(reference.digest));
+
+    const Scenario scenarios[] =
+    {
+        { "cooperative receiver", 0, false },
+        { "first command lost", 1, false },
+        { "receiver ignores commands", 0, true },
+    };
+
+    bool ok = true;
+    for (size_t index = 0; index < sizeof(scenarios) / sizeof(scenarios[0]); index++)
+    {
+        const Scenario& scenario = scenarios[index];
+        Outcome outcome;
+        if (!RunScenario(scenario, captures, &outcome))
+        {
+            return 1;
+        }
+        PrintOutcome(scenario, outcome);
+
+        // commands only go out between bursts
+        ok &= Check(outcome.lostSending == 0, "bytes lost while sending");
+        if (scenario.silent)
+        {
+            // the baud command is given up on at the first noise, the others time out
+            ok &= Check(outcome.config.refused == (GPS_CONFIG_BAUD ? 1 : 0), "baud switch refused once");
+            ok &= Check(outcome.config.timedOut + outcome.config.refused == GPS_CONFIG_COMMAND_COUNT,
+                "every other command times out");
+            ok &= Check(outcome.gsvRate == 1, "receiver left as it was");
+
+            // probing a baud the receiver never switched to costs one fix at most
+            ok &= Check(GPS_CONFIG_BAUD ? outcome.readings.count + 1 >= reference.count :
+                outcome.readings.digest == reference.digest, "readings of the unconfigured replay");
+        }
+        else
+        {
+            ok &= Check(outcome.config.acked == GPS_CONFIG_COMMAND_COUNT, "every command acknowledged");
+            ok &= Check(outcome.receiver.ignored == scenario.ignoreCommands, "lost command retried");
+            ok &= Check(outcome.gsvRate == 0, "unused sentences off");
+            ok &= Check(outcome.baud == (GPS_CONFIG_BAUD ? GPS_CONFIG_BAUD : GPS_BAUD), "receiver baud");
+            ok &= Check(outcome.intervalMs == (GPS_CONFIG_INTERVAL_MS ? GPS_CONFIG_INTERVAL_MS : 1000), "fix interval");
+            ok &= Check(outcome.readings.digest == reference.digest, "readings of the unconfigured replay");
+        }
+    }
+
+    printf("%s\n", ok ? "configuration ok" : "configuration FAILED");
+    return ok ? 0 : 1;
+}
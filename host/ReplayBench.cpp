@@ -0,0 +1,394 @@
+// Replays NMEA captures through TaskGps on the host.
+//
+//   replay_bench [options] capture.nmea...
+//
+//   --mode parser   TaskGps alone, readings collected by the bench (default)
+//   --mode sketch   the whole LocationLogger sketch including the SD write path
+//   --baud N        line speed the capture is replayed at (9600)
+//   --flood         no byte timing, measure raw parser throughput
+//   --out DIR       directory standing in for the SD card (sketch mode)
+//   --dump FILE     write the readings as CSV lines (parser mode)
+//   --corrupt N     damage about one byte in N to exercise checksum rejection
+//   --stall MS      SD card housekeeping of MS every 16 block writes (sketch mode)
+//   --wake          bytes arriving end TaskManager's sleep like the RX interrupt
+//                   does, and report wakeups and duty cycle (sketch mode)
+//   --card-late MS  no card until MS after power up, readings spool in the
+//                   queue meanwhile (sketch mode)
+//
+// Bytes arrive at the rate the receiver sends them and TaskGps runs from
+// TaskManager every 2 ms of simulated time, so serial overflows and the
+// readings produced match what the board would see. Host cycles are only
+// counted inside TaskManager::Loop, i.e. the parser plus the serial stand-in.
+//
+// replay_bench_uart is the same bench built with GPS_PORT_UART, the receiver
+// on the hardware UART and its interrupt fed ring instead of SoftwareSerial.
+// replay_bench_raw is built with GPS_RAW_CAPTURE at 115200 baud, the card
+// should then hold the captures byte for byte in NMEA0000.RAW.
+// replay_bench_tickless is built with TASK_TICKLESS, idle tasks sleeping
+// until a wake source or TASK_IDLE_MS; compare it with replay_bench --wake.
+//
+// The duty cycle adds to the simulated time spent awake (SD card, sending)
+// what the simulation does not charge for: the RX interrupt per byte, a
+// whole frame with interrupts off for SoftwareSerial, parsing per byte, and
+// the wakeups and task updates at the rough cost they have at 8 MHz.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+#include "SdFat.h"
+#include "NeoPixelBus.h"
+
+#include "TaskGps.h"
+#include "TaskSdCard.h"
+#include "LogFormat.h"
+#include "BenchPipeline.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+
+// sketch entry points and scheduler, see Sketch.cpp
+void setup();
+void loop();
+extern TaskManager taskManager;
+extern TaskGps taskGps;
+extern ReadingQueue readingQueue;
+extern TaskSdCard taskSdCard;
+extern uint32_t firstFixLoggedMs;
+
+namespace
+{
+    struct ParserResult
+    {
+        uint64_t batches;
+        uint64_t readings;
+        uint64_t emptyReadings;
+        uint64_t fixChanges;
+        uint64_t digest;
+        FILE* dump;
+    };
+
+    ParserResult s_result = { 0, 0, 0, 0, BenchDigestSeed, NULL };
+
+    void OnBenchReading(const GpsReading& reading)
+    {
+        if (!(reading.flags & GPS_READING_TIME))
+        {
+            s_result.emptyReadings++;
+            return;
+        }
+
+        // same layout OnWriteReading writes to the card
+        char line[CSV_LINE_SIZE];
+        uint8_t length = FormatCsvReading(reading, line);
+        s_result.digest = BenchDigest(s_result.digest, line, length);
+        s_result.readings++;
+        if (s_result.dump)
+        {
+            fwrite(line, 1, length, s_result.dump);
+        }
+    }
+
+    void OnBenchBatch()
+    {
+        s_result.batches++;
+    }
+
+    void OnBenchFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+        s_result.fixChanges++;
+    }
+
+    struct Options
+    {
+        std::string mode;
+        uint32_t baud;
+        bool flood;
+        std::string outDir;
+        std::string dumpPath;
+        uint32_t corruptEvery;
+        uint32_t stallMs;
+        bool wake;
+        uint32_t cardLateMs;
+        std::vector<std::string> captures;
+    };
+
+    bool ParseOptions(int argc, char** argv, Options* options)
+    {
+        options->mode = "parser";
+        options->baud = 9600;
+        options->flood = false;
+        options->outDir = "replay-card";
+        options->corruptEvery = 0;
+        options->stallMs = 0;
+        options->wake = false;
+        options->cardLateMs = 0;
+
+        for (int index = 1; index < argc; index++)
+        {
+            std::string arg = argv[index];
+            bool hasValue = index + 1 < argc;
+            if (arg == "--mode" && hasValue)
+            {
+                options->mode = argv[++index];
+            }
+            else if (arg == "--baud" && hasValue)
+            {
+                options->baud = static_cast<uint32_t>(atoi(argv[++index]));
+            }
+            else if (arg == "--flood")
+            {
+                options->flood = true;
+            }
+            else if (arg == "--out" && hasValue)
+            {
+                options->outDir = argv[++index];
+            }
+            else if (arg == "--dump" && hasValue)
+            {
+                options->dumpPath = argv[++index];
+            }
+            else if (arg == "--corrupt" && hasValue)
+            {
+                options->corruptEvery = static_cast<uint32_t>(atoi(argv[++index]));
+            }
+            else if (arg == "--stall" && hasValue)
+            {
+                options->stallMs = static_cast<uint32_t>(atoi(argv[++index]));
+            }
+            else if (arg == "--card-late" && hasValue)
+            {
+                options->cardLateMs = static_cast<uint32_t>(atoi(argv[++index]));
+            }
+            else if (arg == "--wake")
+            {
+                options->wake = true;
+            }
+            else if (arg[0] == '-')
+            {
+                return false;
+            }
+            else
+            {
+                options->captures.push_back(arg);
+            }
+        }
+        return !options->captures.empty() && (options->mode == "parser" || options->mode == "sketch");
+    }
+
+    void PrintLine(const CaptureLine& line, uint64_t simulatedUs)
+    {
+        const HostSim::UartStats& uart = HostSim::Uart();
+        printf("capture bytes        %zu\n", line.Bytes().size());
+        printf("sentences            %zu\n", line.SentenceCount());
+        printf("simulated time       %.3f s\n", simulatedUs / 1e6);
+        printf("bytes received       %llu\n", static_cast<unsigned long long>(uart.received));
+        printf("bytes overflowed     %llu\n", static_cast<unsigned long long>(uart.overflowed));
+        printf("bytes not listening  %llu\n", static_cast<unsigned long long>(uart.notListening));
+        printf("bytes lost sending   %llu\n", static_cast<unsigned long long>(uart.lostSending));
+    }
+
+    void PrintSentences(const GpsSentenceCounters& counters, const GpsEpochCounters& epochs)
+    {
+        printf("sentences accepted   %lu\n", static_cast<unsigned long>(counters.accepted));
+        printf("sentences rejected   %lu\n", static_cast<unsigned long>(counters.rejected));
+        printf("sentences truncated  %lu\n", static_cast<unsigned long>(counters.truncated));
+        printf("port overflows       %lu\n", static_cast<unsigned long>(counters.overflows));
+    #if GPS_PORT == GPS_PORT_UART
+        printf("uart ring peak       %u of %u\n", GpsUartRing().Peak(), GpsRxRing::Size());
+    #endif
+        printf("epochs completed     %lu\n", static_cast<unsigned long>(epochs.completed));
+        printf("epochs voided        %lu\n", static_cast<unsigned long>(epochs.voided));
+        printf("epochs abandoned     %lu\n", static_cast<unsigned long>(epochs.abandoned));
+    }
+
+    void PrintQueue(const ReadingQueue& queue)
+    {
+        const ReadingQueueCounters& counters = queue.Counters();
+        printf("slots published      %lu\n", static_cast<unsigned long>(counters.published));
+        printf("slots peak queued    %u of %u\n", counters.peakQueued, READING_SLOTS - 1);
+        printf("readings dropped     %lu\n", static_cast<unsigned long>(counters.dropped));
+    }
+
+    // CPU time on the board the simulated clock does not advance for
+    const double WakeUs = 10.0;         // out of sleep and once over the task list
+    const double UpdateUs = 20.0;       // an OnUpdate that finds little to do
+    const double ParseUsPerByte = 15.0;
+    const double UartIsrUs = 4.0;       // SoftwareSerial instead holds the CPU for the frame
+
+    void PrintPower(uint64_t simulatedUs, uint64_t updates, uint32_t baud)
+    {
+        const HostSim::SleepStats& sleep = HostSim::Sleep();
+        const HostSim::UartStats& uart = HostSim::Uart();
+        double seconds = simulatedUs / 1e6;
+        uint64_t interrupts = uart.received + uart.overflowed + uart.notListening + uart.lostSending;
+    #if GPS_PORT == GPS_PORT_UART
+        double isrUs = UartIsrUs;
+        (void)baud;
+    #else
+        double isrUs = 10e6 / baud;
+    #endif
+        double awakeUs = static_cast<double>(simulatedUs - sleep.sleptUs);
+        double busyUs = awakeUs + sleep.sleeps * WakeUs + updates * UpdateUs + interrupts * isrUs + uart.received * ParseUsPerByte;
+        printf("wakeups/s            %.1f\n", sleep.sleeps / seconds);
+        printf("wakeups by rx/s      %.1f\n", sleep.interruptWakes / seconds);
+        printf("task updates/s       %.1f\n", updates / seconds);
+        printf("rx interrupts/s      %.1f\n", interrupts / seconds);
+        printf("awake simulated      %.2f %%\n", awakeUs * 100.0 / simulatedUs);
+        printf("duty cycle           %.2f %%\n", (busyUs < simulatedUs ? busyUs : simulatedUs) * 100.0 / simulatedUs);
+    }
+
+    int RunParser(CaptureLine& line, const Options& options)
+    {
+        if (!options.dumpPath.empty())
+        {
+            s_result.dump = fopen(options.dumpPath.c_str(), "wb");
+        }
+
+        BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+        pipeline.Start();
+
+        uint64_t cycles = 0;
+        uint64_t nanos = 0;
+        uint64_t endUs = options.flood ? 0 : line.EndUs();
+        while (!line.Finished() || HostSim::NowUs() <= endUs + 2000)
+        {
+            uint64_t startCycles = BenchCycles();
+            uint64_t startNanos = BenchNanos();
+            pipeline.Loop();
+            cycles += BenchCycles() - startCycles;
+            nanos += BenchNanos() - startNanos;
+        }
+
+        // flush the partial batch like a safe eject would
+        pipeline.Finish();
+
+        if (s_result.dump)
+        {
+            fclose(s_result.dump);
+        }
+
+        size_t sentences = line.SentenceCount();
+        PrintLine(line, HostSim::NowUs());
+        PrintSentences(pipeline.taskGps.SentenceCounters(), pipeline.taskGps.EpochCounters());
+        PrintQueue(pipeline.queue);
+        printf("task updates         %llu\n", static_cast<unsigned long long>(pipeline.taskManager.UpdateCount()));
+        printf("reading batches      %llu\n", static_cast<unsigned long long>(s_result.batches));
+        printf("readings             %llu\n", static_cast<unsigned long long>(s_result.readings));
+        printf("readings empty time  %llu\n", static_cast<unsigned long long>(s_result.emptyReadings));
+        printf("fix changes          %llu\n", static_cast<unsigned long long>(s_result.fixChanges));
+        printf("host parse time      %.3f ms\n", nanos / 1e6);
+        printf("host bytes/sec       %.0f\n", nanos ? line.Bytes().size() * 1e9 / nanos : 0.0);
+        printf("host cycles/sentence %.0f\n", sentences ? static_cast<double>(cycles) / sentences : 0.0);
+        printf("host cycles/byte     %.1f\n", line.Bytes().size() ? static_cast<double>(cycles) / line.Bytes().size() : 0.0);
+        printf("readings digest      %016llx\n", static_cast<unsigned long long>(s_result.digest));
+        return 0;
+    }
+
+    int RunSketch(CaptureLine& line, const Options& options)
+    {
+        HostSd::SetRoot(options.outDir.c_str());
+        if (options.stallMs)
+        {
+            HostSd::Timings().stallEveryWrites = 16;
+            HostSd::Timings().stallUs = options.stallMs * 1000;
+        }
+
+        HostSim::SetInterruptWake(options.wake);
+        HostSd::SetCardPresent(!options.cardLateMs);
+        setup();
+
+        uint64_t endUs = line.EndUs();
+        while (!line.Finished() || HostSim::NowUs() <= endUs + 2000)
+        {
+            if (!HostSd::CardPresent() && HostSim::NowUs() >= options.cardLateMs * 1000ULL)
+            {
+                HostSd::SetCardPresent(true);
+            }
+            loop();
+        }
+
+        // safe eject to flush the last readings, button on pin 2
+        HostSim::SetPinLevel(2, LOW);
+        uint64_t releaseUs = HostSim::NowUs() + 200000;
+        while (HostSim::NowUs() < releaseUs)
+        {
+            loop();
+        }
+        HostSim::SetPinLevel(2, HIGH);
+        // tickless, the last slot waits for the writer's heartbeat once the port is quiet
+        uint64_t settleUs = HostSim::NowUs() + 200000 + (TASK_TICKLESS ? TASK_IDLE_MS * 1000ULL : 0);
+        while (HostSim::NowUs() < settleUs)
+        {
+            loop();
+        }
+
+        const HostSd::Stats& sd = HostSd::Counters();
+        PrintLine(line, HostSim::NowUs());
+        PrintSentences(taskGps.SentenceCounters(), taskGps.EpochCounters());
+        PrintQueue(readingQueue);
+        printf("sd opens             %llu\n", static_cast<unsigned long long>(sd.opens));
+        printf("sd closes            %llu\n", static_cast<unsigned long long>(sd.closes));
+        printf("sd syncs             %llu\n", static_cast<unsigned long long>(sd.syncs));
+        printf("sd dir entry writes  %llu\n", static_cast<unsigned long long>(sd.dirEntryWrites));
+        printf("sd write calls       %llu\n", static_cast<unsigned long long>(sd.writeCalls));
+        printf("sd bytes written     %llu\n", static_cast<unsigned long long>(sd.bytesWritten));
+        printf("sd block reads       %llu\n", static_cast<unsigned long long>(sd.blockReads));
+        printf("sd block writes      %llu\n", static_cast<unsigned long long>(sd.blockWrites));
+        printf("sd dir blocks        %llu\n", static_cast<unsigned long long>(sd.dirBlocksScanned));
+        printf("sd cluster allocs    %llu\n", static_cast<unsigned long long>(sd.clusterAllocs));
+        printf("sd card stalls       %llu\n", static_cast<unsigned long long>(sd.stalls));
+        printf("sd busy              %.3f s\n", sd.busyUs / 1e6);
+        printf("sd longest call      %.1f ms\n", sd.maxCallUs / 1e3);
+        printf("longest task update  %.1f ms\n", taskManager.MaxUpdateUs() / 1e3);
+    #if GPS_RAW_CAPTURE
+        printf("raw bytes captured   %lu\n", static_cast<unsigned long>(taskGps.RawCaptured()));
+    #endif
+        printf("sd mount attempts    %u\n", taskSdCard.Attempts());
+        printf("card mounted         %.3f s\n", taskSdCard.MountedMs() / 1e3);
+        printf("first fix logged     %.3f s\n", firstFixLoggedMs / 1e3);
+        printf("led shows/min        %.1f\n", HostSim::NeoPixelShows() * 60e6 / HostSim::NowUs());
+        if (options.wake)
+        {
+            PrintPower(HostSim::NowUs(), taskManager.UpdateCount(), options.baud);
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "usage: %s [--mode parser|sketch] [--baud N] [--flood] [--out DIR] [--dump FILE] [--corrupt N] [--stall MS] [--wake] [--card-late MS] capture...\n", argv[0]);
+        return 2;
+    }
+
+    CaptureLine line;
+    for (size_t index = 0; index < options.captures.size(); index++)
+    {
+        if (!line.Load(options.captures[index]))
+        {
+            fprintf(stderr, "cannot read %s\n", options.captures[index].c_str());
+            return 1;
+        }
+    }
+    line.SetBaud(options.baud);
+    line.SetFlood(options.flood && options.mode == "parser");
+    if (options.corruptEvery)
+    {
+        printf("bytes corrupted      %zu\n", line.Corrupt(options.corruptEvery, 1));
+    }
+    HostSim::SetUartLine(&line);
+
+    return (options.mode == "sketch") ? RunSketch(line, options) : RunParser(line, options);
+}
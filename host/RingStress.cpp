@@ -0,0 +1,223 @@
+// Stress test of SerialRing with a real producer and consumer thread.
+//
+//   ring_stress [--bytes N] [--seconds S]
+//
+// The producer thread stands in for the receive interrupt, the consumer for
+// TaskGps. Both yield while they wait so the test also runs on one core,
+// where it still interleaves them at arbitrary points. Three runs, each must
+// pass:
+//
+//   lossless  the producer retries when the ring is full, the consumer must
+//             get every byte of a long pseudo random stream in order, for
+//             several ring sizes including both index widths
+//   dropping  the producer never waits, like the interrupt; every byte is
+//             either delivered in order or counted as overflowed
+//   stall     the producer paced at GPS_LINE_BAUD in real time, the consumer
+//             stopping for GPS_RX_STALL_MS between drains like an SD card
+//             write; the GPS_RX_RING_SIZE ring must never overflow
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Arduino.h"
+
+#include "GpsReceiver.h"
+#include "GpsUart.h"
+
+namespace
+{
+    // the stream both sides can recompute from a byte's position
+    inline uint8_t StreamByte(uint64_t position)
+    {
+        uint64_t value = position * 0x9e3779b97f4a7c15ull;
+        return static_cast<uint8_t>(value >> 56);
+    }
+
+    template <uint16_t SIZE> bool RunLossless(uint64_t count)
+    {
+        static SerialRing<SIZE> ring;
+        ring.Clear();
+        std::atomic<bool> failed(false);
+
+        std::thread producer([&]()
+        {
+            for (uint64_t position = 0; position < count && !failed; position++)
+            {
+                while (!ring.Push(StreamByte(position)) && !failed)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        uint64_t received = 0;
+        uint64_t mismatch = count;
+        while (received < count && !failed)
+        {
+            int value = ring.Pop();
+            if (value < 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if (value != StreamByte(received))
+            {
+                mismatch = received;
+                failed = true;
+            }
+            received++;
+        }
+        producer.join();
+
+        bool ok = !failed && ring.Available() == 0;
+        printf("lossless  ring %5u  %llu bytes  retried full %u  peak %u  %s",
+            SIZE, static_cast<unsigned long long>(received), ring.Overflowed(), ring.Peak(), ok ? "ok\n" : "FAILED");
+        if (!ok)
+        {
+            printf(" at byte %llu\n", static_cast<unsigned long long>(mismatch));
+        }
+        return ok;
+    }
+
+    // positions travel as 4 byte little endian words so the consumer can tell
+    // where a gap was, a word is only pushed whole
+    template <uint16_t SIZE> bool RunDropping(uint64_t words)
+    {
+        static SerialRing<SIZE> ring;
+        ring.Clear();
+        std::atomic<bool> done(false);
+        uint64_t dropped = 0;
+
+        std::thread producer([&]()
+        {
+            for (uint64_t word = 0; word < words; word++)
+            {
+                if (ring.Free() < 4)
+                {
+                    dropped++;
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    ring.Push(static_cast<uint8_t>(word >> shift));
+                }
+            }
+            done = true;
+        });
+
+        uint64_t received = 0;
+        uint64_t previous = 0;
+        bool ordered = true;
+        while (!done || ring.Available())
+        {
+            if (ring.Available() < 4)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            uint32_t word = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                word |= static_cast<uint32_t>(ring.Pop()) << shift;
+            }
+            if (received && word <= previous)
+            {
+                ordered = false;
+            }
+            previous = word;
+            received++;
+        }
+        producer.join();
+
+        bool ok = ordered && received + dropped == words && ring.Overflowed() == 0;
+        printf("dropping  ring %5u  %llu words  delivered %llu  dropped %llu  %s\n", SIZE,
+            static_cast<unsigned long long>(words), static_cast<unsigned long long>(received),
+            static_cast<unsigned long long>(dropped), ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    bool RunStall(double seconds)
+    {
+        static GpsRxRing ring;
+        ring.Clear();
+        typedef std::chrono::steady_clock Clock;
+        const std::chrono::nanoseconds byteTime(10000000000ll / GPS_LINE_BAUD);
+        const uint64_t count = static_cast<uint64_t>(seconds * GPS_LINE_BAUD / 10);
+        std::atomic<bool> done(false);
+
+        std::thread producer([&]()
+        {
+            Clock::time_point due = Clock::now();
+            for (uint64_t position = 0; position < count; position++)
+            {
+                due += byteTime;
+                while (Clock::now() < due)
+                {
+                    std::this_thread::yield();
+                }
+                ring.Push(StreamByte(position));
+            }
+            done = true;
+        });
+
+        uint64_t received = 0;
+        uint32_t stalls = 0;
+        bool ordered = true;
+        while (!done || ring.Available())
+        {
+            int value;
+            while ((value = ring.Pop()) >= 0)
+            {
+                ordered &= (value == StreamByte(received));
+                received++;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(GPS_RX_STALL_MS));
+            stalls++;
+        }
+        producer.join();
+
+        bool ok = ordered && received == count && ring.Overflowed() == 0;
+        printf("stall     ring %5u  %d baud  %u stalls of %d ms  %llu bytes  peak %u  overflowed %u  %s\n",
+            GpsRxRing::Size(), GPS_LINE_BAUD, stalls, GPS_RX_STALL_MS, static_cast<unsigned long long>(received),
+            ring.Peak(), ring.Overflowed(), ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t bytes = 4000000;
+    double seconds = 2.0;
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--bytes") && index + 1 < argc)
+        {
+            bytes = strtoull(argv[++index], NULL, 10);
+        }
+        else if (!strcmp(argv[index], "--seconds") && index + 1 < argc)
+        {
+            seconds = atof(argv[++index]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--bytes N] [--seconds S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    ok &= RunLossless<16>(bytes);
+    ok &= RunLossless<128>(bytes);
+    ok &= RunLossless<256>(bytes);
+    ok &= RunLossless<1024>(bytes);
+    ok &= RunDropping<64>(bytes / 4);
+    ok &= RunDropping<1024>(bytes / 4);
+    ok &= RunStall(seconds);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+// Measures sentence identification, the work done for every '$' in the stream.
+//
+//   sentence_bench [--repeat N] capture.nmea...
+//
+// The address fields of all sentences in the captures, plus one of every
+// talker and type the lookup knows, are identified by IdentifyNmeaSentence and
+// by a copy of the branch tree TaskGps used before it. Reports host time and
+// cycles per sentence for both and how many addresses each recognised.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+#include "NmeaSentence.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+
+namespace
+{
+    // the former TaskGps::IdentifiedSentence, GP and GN talkers only, the
+    // result is its enum value or -1
+    int LegacyIdentify(const char* segmentBuffer)
+    {
+        if (segmentBuffer[0] == 'B')
+        {
+            if (segmentBuffer[1] == 'N')
+            {
+            }
+        }
+        else if (segmentBuffer[0] == 'G')
+        {
+            if (segmentBuffer[1] == 'P')
+            {
+                if (segmentBuffer[2] == 'R')
+                {
+                    return 0;
+                }
+                else if (segmentBuffer[2] == 'G')
+                {
+                    if (segmentBuffer[3] == 'G')
+                    {
+                        return 2;
+                    }
+                    else if (segmentBuffer[3] == 'S')
+                    {
+                        if (segmentBuffer[4] == 'A')
+                        {
+                            return 3;
+                        }
+                        else if (segmentBuffer[4] == 'V')
+                        {
+                            return 4;
+                        }
+                    }
+                    else if (segmentBuffer[3] == 'L')
+                    {
+                        return 5;
+                    }
+                }
+                else if (segmentBuffer[2] == 'V')
+                {
+                    return 1;
+                }
+            }
+            else if (segmentBuffer[1] == 'N')
+            {
+                if (segmentBuffer[2] == 'R')
+                {
+                    return 9;
+                }
+                else if (segmentBuffer[2] == 'G')
+                {
+                    if (segmentBuffer[3] == 'G')
+                    {
+                        return 10;
+                    }
+                    else if (segmentBuffer[3] == 'S')
+                    {
+                        if (segmentBuffer[4] == 'A')
+                        {
+                            return 13;
+                        }
+                        else if (segmentBuffer[4] == 'V')
+                        {
+                            return 12;
+                        }
+                    }
+                    else if (segmentBuffer[3] == 'L')
+                    {
+                        return 6;
+                    }
+                }
+                else if (segmentBuffer[2] == 'V')
+                {
+                    return 11;
+                }
+            }
+        }
+        return -1;
+    }
+
+    struct Address
+    {
+        char text[8];
+        uint8_t length;
+    };
+
+    void AddAddress(std::vector<Address>& addresses, const char* text, size_t length)
+    {
+        Address address;
+        memset(&address, 0, sizeof(address));
+        address.length = static_cast<uint8_t>(length < sizeof(address.text) ? length : sizeof(address.text) - 1);
+        memcpy(address.text, text, address.length);
+        addresses.push_back(address);
+    }
+
+    void AddCaptureAddresses(std::vector<Address>& addresses, const std::vector<uint8_t>& bytes)
+    {
+        for (size_t index = 0; index < bytes.size(); index++)
+        {
+            if (bytes[index] != '$')
+            {
+                continue;
+            }
+            size_t end = index + 1;
+            while (end < bytes.size() && bytes[end] != ',' && bytes[end] != '*' && bytes[end] != '\r')
+            {
+                end++;
+            }
+            AddAddress(addresses, reinterpret_cast<const char*>(&bytes[index + 1]), end - index - 1);
+        }
+    }
+
+    struct Result
+    {
+        double nanos;
+        double cycles;
+        size_t recognised;
+        int checksum;
+    };
+
+    template <typename Identify>
+    Result Measure(const std::vector<Address>& addresses, int repeat, Identify identify)
+    {
+        Result result = { 0, 0, 0, 0 };
+        for (size_t index = 0; index < addresses.size(); index++)
+        {
+            if (identify(addresses[index]) >= 0)
+            {
+                result.recognised++;
+            }
+        }
+
+        uint64_t startNanos = BenchNanos();
+        uint64_t startCycles = BenchCycles();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            for (size_t index = 0; index < addresses.size(); index++)
+            {
+                result.checksum += identify(addresses[index]);
+            }
+        }
+        double count = static_cast<double>(addresses.size()) * repeat;
+        result.cycles = (BenchCycles() - startCycles) / count;
+        result.nanos = (BenchNanos() - startNanos) / count;
+        return result;
+    }
+
+    void PrintResult(const char* label, const Result& result, size_t total)
+    {
+        printf("%-7s %6.2f ns/sentence  %6.1f cycles/sentence  recognised %zu of %zu  (%d)\n",
+            label, result.nanos, result.cycles, result.recognised, total, result.checksum);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<Address> addresses;
+    int repeat = 2000;
+
+    for (int index = 1; index < argc; index++)
+    {
+        CaptureLine line;
+        if (!strcmp(argv[index], "--repeat") && index + 1 < argc)
+        {
+            repeat = atoi(argv[++index]);
+        }
+        else if (line.Load(argv[index]))
+        {
+            AddCaptureAddresses(addresses, line.Bytes());
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s\n", argv[index]);
+            return 1;
+        }
+    }
+    if (repeat < 1)
+    {
+        fprintf(stderr, "usage: %s [--repeat N] capture...\n", argv[0]);
+        return 2;
+    }
+    size_t captured = addresses.size();
+
+    // every talker with every type, as a multi constellation receiver may send
+    for (int talker = 0; talker < NMEA_TALKER_COUNT; talker++)
+    {
+        for (int kind = 0; kind < NMEA_SENTENCE_COUNT; kind++)
+        {
+            char text[6];
+            memcpy(text, NmeaTalkers[talker], 2);
+            memcpy(text + 2, NmeaSentenceTypes[kind], 3);
+            AddAddress(addresses, text, 5);
+        }
+    }
+    AddAddress(addresses, "PMTK001", 7);
+    AddAddress(addresses, "PUBX", 4);
+    AddAddress(addresses, "GPXYZ", 5);
+
+    printf("addresses %zu (%zu from captures)\n", addresses.size(), captured);
+    Result table = Measure(addresses, repeat, [](const Address& address)
+    {
+        return static_cast<int>(IdentifyNmeaSentence(address.text, address.length));
+    });
+    Result tree = Measure(addresses, repeat, [](const Address& address)
+    {
+        return LegacyIdentify(address.text);
+    });
+    PrintResult("table", table, addresses.size());
+    PrintResult("tree", tree, addresses.size());
+
+    // the known sentences are 5 characters, the rest must not be recognised
+    size_t expected = captured + NMEA_TALKER_COUNT * NMEA_SENTENCE_COUNT;
+    bool ok = table.recognised == expected;
+    printf("table   %s\n", ok ? "recognises every known talker and type" : "MISSES known sentences");
+    return ok ? 0 : 1;
+}
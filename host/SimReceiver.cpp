@@ -0,0 +1,398 @@
+// Simulated configurable GPS receiver, see SimReceiver.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SimReceiver.h"
+
+namespace
+{
+    // PMTK314 fields in order, the rest of the 19 are types nobody sends here
+    const char* const MtkRateTypes[] = { "GLL", "RMC", "VTG", "GGA", "GSA", "GSV" };
+
+    // u-blox NMEA message ids, class 0xF0
+    const char* UbxNmeaType(uint8_t id)
+    {
+        switch (id)
+        {
+        case 0x00: return "GGA";
+        case 0x01: return "GLL";
+        case 0x02: return "GSA";
+        case 0x03: return "GSV";
+        case 0x04: return "RMC";
+        case 0x05: return "VTG";
+        case 0x08: return "ZDA";
+        case 0x0d: return "GNS";
+        default: return NULL;
+        }
+    }
+
+    // receivers answer a command after processing it, not mid byte
+    const uint64_t AnswerDelayNs = 5000000;
+
+    uint8_t NmeaChecksum(const std::string& body)
+    {
+        uint8_t checksum = 0;
+        for (size_t index = 0; index < body.size(); index++)
+        {
+            checksum ^= static_cast<uint8_t>(body[index]);
+        }
+        return checksum;
+    }
+
+    std::string NmeaSentence(const std::string& body)
+    {
+        char tail[8];
+        snprintf(tail, sizeof(tail), "*%02X\r\n", NmeaChecksum(body));
+        return "$" + body + tail;
+    }
+}
+
+SimReceiver::SimReceiver(Protocol protocol) :
+    _protocol(protocol),
+    _baud(9600),
+    _localBaud(9600),
+    _intervalMs(1000),
+    _ignoreCommands(0),
+    _silent(false),
+    _frontNs(0),
+    _lineFreeNs(0),
+    _nextEpoch(0),
+    _nextEpochNs(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool SimReceiver::Load(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] != '$' || strlen(line) < 7)
+        {
+            continue;
+        }
+
+        Sentence sentence;
+        sentence.type.assign(line + 3, 3);
+        sentence.text = line;
+        if (sentence.type == "RMC" || _epochs.empty())
+        {
+            _epochs.push_back(std::vector<Sentence>());
+        }
+        _epochs.back().push_back(sentence);
+    }
+    fclose(file);
+    return true;
+}
+
+void SimReceiver::SetIgnoreCommands(uint32_t count)
+{
+    _ignoreCommands = count;
+}
+
+void SimReceiver::SetSilent(bool silent)
+{
+    _silent = silent;
+}
+
+uint8_t SimReceiver::Rate(const std::string& type) const
+{
+    std::map<std::string, uint8_t>::const_iterator found = _rates.find(type);
+    return (found == _rates.end()) ? 1 : found->second;
+}
+
+uint64_t SimReceiver::ByteNs() const
+{
+    // 8N1 framing, ten bits per byte
+    return 10000000000ull / _baud;
+}
+
+void SimReceiver::Enqueue(const std::string& bytes, uint64_t startNs)
+{
+    if (bytes.empty())
+    {
+        return;
+    }
+    if (_queue.empty())
+    {
+        _frontNs = ((_lineFreeNs > startNs) ? _lineFreeNs : startNs) + ByteNs();
+    }
+    _queue.insert(_queue.end(), bytes.begin(), bytes.end());
+}
+
+void SimReceiver::SendDueEpochs(uint64_t nowNs)
+{
+    while (_nextEpoch < _epochs.size() && _nextEpochNs <= nowNs)
+    {
+        std::string burst;
+        const std::vector<Sentence>& epoch = _epochs[_nextEpoch];
+        for (size_t index = 0; index < epoch.size(); index++)
+        {
+            uint8_t rate = Rate(epoch[index].type);
+            if (rate && (_stats.epochsSent % rate) == 0)
+            {
+                burst += epoch[index].text;
+                _stats.sentencesSent++;
+            }
+        }
+        Enqueue(burst, _nextEpochNs);
+        _stats.epochsSent++;
+        _nextEpoch++;
+        _nextEpochNs += static_cast<uint64_t>(_intervalMs) * 1000000;
+    }
+}
+
+bool SimReceiver::Receive(uint64_t nowUs, uint8_t* value)
+{
+    uint64_t nowNs = nowUs * 1000;
+    SendDueEpochs(nowNs);
+    if (_queue.empty() || _frontNs > nowNs)
+    {
+        return false;
+    }
+
+    *value = _queue.front();
+    if (_localBaud != _baud)
+    {
+        // sampled at the wrong speed, the sketch sees garbage
+        *value = static_cast<uint8_t>(*value * 7 + 0x5b);
+    }
+    _queue.pop_front();
+    _lineFreeNs = _frontNs;
+    _frontNs += ByteNs();
+    _stats.bytesSent++;
+    return true;
+}
+
+bool SimReceiver::Finished() const
+{
+    return _nextEpoch >= _epochs.size() && _queue.empty();
+}
+
+void SimReceiver::SetLocalBaud(uint32_t baud)
+{
+    _localBaud = baud;
+}
+
+void SimReceiver::Answer(const std::string& bytes, uint64_t nowUs)
+{
+    Enqueue(bytes, nowUs * 1000 + AnswerDelayNs);
+}
+
+void SimReceiver::Transmit(uint8_t value, uint64_t nowUs)
+{
+    if (_silent || _localBaud != _baud)
+    {
+        // not understood, or framing errors at the receiver
+        _command.clear();
+        return;
+    }
+
+    if (_command.empty() && value != '$' && value != 0xb5)
+    {
+        return;
+    }
+    _command.push_back(value);
+
+    if (_command[0] == '$')
+    {
+        if (value != '\n')
+        {
+            if (_command.size() > 200)
+            {
+                _command.clear();
+            }
+            return;
+        }
+
+        std::string text(_command.begin(), _command.end());
+        _command.clear();
+        size_t star = text.find('*');
+        if (_protocol != Protocol_Mtk || star == std::string::npos || star + 3 > text.size())
+        {
+            return;
+        }
+        std::string body = text.substr(1, star - 1);
+        if (strtoul(text.substr(star + 1, 2).c_str(), NULL, 16) != NmeaChecksum(body) ||
+                body.compare(0, 4, "PMTK") != 0)
+        {
+            return;
+        }
+        _stats.commands++;
+        if (_ignoreCommands)
+        {
+            _ignoreCommands--;
+            _stats.ignored++;
+            return;
+        }
+        HandleMtk(body, nowUs);
+        return;
+    }
+
+    // UBX: sync, sync, class, id, length, payload, two checksum bytes
+    if (_command.size() == 2 && value != 0x62)
+    {
+        _command.clear();
+        return;
+    }
+    if (_command.size() < 6)
+    {
+        return;
+    }
+    size_t length = _command[4] | (_command[5] << 8);
+    if (_command.size() < 8 + length)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> frame;
+    frame.swap(_command);
+    uint8_t checkA = 0;
+    uint8_t checkB = 0;
+    for (size_t index = 2; index < 6 + length; index++)
+    {
+        checkA += frame[index];
+        checkB += checkA;
+    }
+    if (_protocol != Protocol_Ublox || frame[6 + length] != checkA || frame[7 + length] != checkB)
+    {
+        return;
+    }
+    _stats.commands++;
+    if (_ignoreCommands)
+    {
+        _ignoreCommands--;
+        _stats.ignored++;
+        return;
+    }
+    HandleUbx(frame[2], frame[3], std::vector<uint8_t>(frame.begin() + 6, frame.begin() + 6 + length), nowUs);
+}
+
+void SimReceiver::HandleMtk(const std::string& body, uint64_t nowUs)
+{
+    std::string command = body.substr(4, 3);
+    std::vector<std::string> fields;
+    size_t start = 8;
+    while (start <= body.size())
+    {
+        size_t comma = body.find(',', start);
+        if (comma == std::string::npos)
+        {
+            comma = body.size();
+        }
+        fields.push_back(body.substr(start, comma - start));
+        start = comma + 1;
+    }
+
+    char flag = '1';
+    if (command == "314" && fields.size() == 19)
+    {
+        for (size_t index = 0; index < sizeof(MtkRateTypes) / sizeof(MtkRateTypes[0]); index++)
+        {
+            _rates[MtkRateTypes[index]] = static_cast<uint8_t>(atoi(fields[index].c_str()));
+        }
+        flag = '3';
+    }
+    else if (command == "220" && fields.size() == 1)
+    {
+        int interval = atoi(fields[0].c_str());
+        flag = '0';
+        if (interval >= 100 && interval <= 10000)
+        {
+            _intervalMs = interval;
+            flag = '3';
+        }
+    }
+    else if (command == "251" && fields.size() == 1)
+    {
+        // switches straight away without answering
+        _baud = static_cast<uint32_t>(atoi(fields[0].c_str()));
+        _stats.acked++;
+        return;
+    }
+
+    if (flag == '3')
+    {
+        _stats.acked++;
+    }
+    else
+    {
+        _stats.refused++;
+    }
+    Answer(NmeaSentence("PMTK001," + command + "," + flag), nowUs);
+}
+
+std::string SimReceiver::UbxFrame(uint8_t messageClass, uint8_t id, const std::vector<uint8_t>& payload) const
+{
+    std::string frame;
+    frame += static_cast<char>(0xb5);
+    frame += static_cast<char>(0x62);
+    frame += static_cast<char>(messageClass);
+    frame += static_cast<char>(id);
+    frame += static_cast<char>(payload.size() & 0xff);
+    frame += static_cast<char>(payload.size() >> 8);
+    frame.append(payload.begin(), payload.end());
+
+    uint8_t checkA = 0;
+    uint8_t checkB = 0;
+    for (size_t index = 2; index < frame.size(); index++)
+    {
+        checkA += static_cast<uint8_t>(frame[index]);
+        checkB += checkA;
+    }
+    frame += static_cast<char>(checkA);
+    frame += static_cast<char>(checkB);
+    return frame;
+}
+
+void SimReceiver::HandleUbx(uint8_t messageClass, uint8_t id, const std::vector<uint8_t>& payload, uint64_t nowUs)
+{
+    bool ok = false;
+    if (messageClass == 0x06 && id == 0x01 && payload.size() == 3 && payload[0] == 0xf0)
+    {
+        // CFG-MSG, rate on the port it came in on
+        const char* type = UbxNmeaType(payload[1]);
+        if (type)
+        {
+            _rates[type] = payload[2];
+            ok = true;
+        }
+    }
+    else if (messageClass == 0x06 && id == 0x08 && payload.size() == 6)
+    {
+        // CFG-RATE
+        uint32_t interval = payload[0] | (payload[1] << 8);
+        if (interval >= 50)
+        {
+            _intervalMs = interval;
+            ok = true;
+        }
+    }
+    else if (messageClass == 0x06 && id == 0x00 && payload.size() == 20 && payload[0] == 1)
+    {
+        // CFG-PRT for UART1, the acknowledgement already goes out at the new speed
+        _baud = payload[8] | (payload[9] << 8) | (payload[10] << 16) | (static_cast<uint32_t>(payload[11]) << 24);
+        ok = true;
+    }
+
+    if (ok)
+    {
+        _stats.acked++;
+    }
+    else
+    {
+        _stats.refused++;
+    }
+    std::vector<uint8_t> answer;
+    answer.push_back(messageClass);
+    answer.push_back(id);
+    Answer(UbxFrame(0x05, ok ? 0x01 : 0x00, answer), nowUs);
+}
@@ -0,0 +1,106 @@
+// A GPS receiver on the simulated serial line that understands configuration.
+//
+// The fixes come from a capture, one epoch (the sentences from one RMC to the
+// next) per fix interval. Commands the sketch sends are answered the way an
+// MTK receiver (PMTK text) or a u-blox receiver (UBX binary) would: sentence
+// rates, fix interval and baud change what goes out on the line afterwards.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HostSim.h"
+
+class SimReceiver : public HostSim::UartLine
+{
+public:
+    enum Protocol
+    {
+        Protocol_Mtk,
+        Protocol_Ublox
+    };
+
+    struct Stats
+    {
+        uint64_t bytesSent;
+        uint64_t sentencesSent;
+        uint64_t epochsSent;
+        uint32_t commands;      // well formed commands in the receiver's protocol
+        uint32_t ignored;       // of those, dropped as if garbled on the wire
+        uint32_t acked;
+        uint32_t refused;
+    };
+
+    explicit SimReceiver(Protocol protocol);
+
+    bool Load(const std::string& path);
+
+    // drop this many commands before answering any
+    void SetIgnoreCommands(uint32_t count);
+
+    // a receiver that takes no commands at all
+    void SetSilent(bool silent);
+
+    virtual bool Receive(uint64_t nowUs, uint8_t* value);
+    virtual void Transmit(uint8_t value, uint64_t nowUs);
+    virtual void SetLocalBaud(uint32_t baud);
+    virtual bool Finished() const;
+
+    uint32_t Baud() const
+    {
+        return _baud;
+    }
+
+    uint32_t IntervalMs() const
+    {
+        return _intervalMs;
+    }
+
+    const Stats& Counters() const
+    {
+        return _stats;
+    }
+
+    // fixes a sentence type goes out on, 0 off, 1 every fix
+    uint8_t Rate(const std::string& type) const;
+
+private:
+    struct Sentence
+    {
+        std::string type;
+        std::string text;   // with CR LF
+    };
+
+    Protocol _protocol;
+    std::vector<std::vector<Sentence> > _epochs;
+    std::map<std::string, uint8_t> _rates;
+    uint32_t _baud;
+    uint32_t _localBaud;
+    uint32_t _intervalMs;
+    uint32_t _ignoreCommands;
+    bool _silent;
+    Stats _stats;
+
+    // bytes on their way to the sketch, the front one arrives at _frontNs
+    std::deque<uint8_t> _queue;
+    uint64_t _frontNs;
+    uint64_t _lineFreeNs;
+    size_t _nextEpoch;
+    uint64_t _nextEpochNs;
+
+    // bytes received from the sketch
+    std::vector<uint8_t> _command;
+
+    uint64_t ByteNs() const;
+    void Enqueue(const std::string& bytes, uint64_t startNs);
+    void SendDueEpochs(uint64_t nowNs);
+    void Answer(const std::string& bytes, uint64_t nowUs);
+    void HandleMtk(const std::string& body, uint64_t nowUs);
+    void HandleUbx(uint8_t messageClass, uint8_t id, const std::vector<uint8_t>& payload, uint64_t nowUs);
+    std::string UbxFrame(uint8_t messageClass, uint8_t id, const std::vector<uint8_t>& payload) const;
+};
@@ -0,0 +1,13 @@
+// Builds LocationLogger.ino for the host against the stand-in libraries.
+//
+// The Arduino builder generates prototypes for every sketch function; a plain
+// compiler does not, so the ones used before their definition are listed here.
+
+#include "Arduino.h"
+
+bool OpenFile(uint32_t dateTime);
+void WriteStatsFile();
+void WriteTripFile();
+bool OpenRawFile();
+
+#include "../LocationLogger.ino"
@@ -0,0 +1,196 @@
+// A card of hourly logs made up for the benchmarks that need more than the captures.
+//
+// A drive of 1 Hz readings wandering within a degree of 47N 122W, every 7th
+// hour missing so the tracks break, every 8th hour logged as BIN and the one
+// after as TRK, the rest CSV, and now and then a file that ends in a line
+// cut short. Positions are ones the CSV reads back exactly, so every format
+// decodes to the readings generated.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "LogIngest.h"
+#include "BenchClock.h"
+
+// the corner the drive stays north west of, 1e-7 degrees
+#define SYNTHETIC_LATITUDE 470000000L
+#define SYNTHETIC_LONGITUDE -1220000000L
+
+struct SyntheticDrive
+{
+    uint32_t seed;
+    uint32_t latitudeMinutes;   // 1e-5 minutes north of 47 degrees
+    uint32_t longitudeMinutes;  // 1e-5 minutes west of 122 degrees
+    int32_t altitude;           // centimeters, whole decimeters as CSV keeps them
+    int32_t headingNorth;       // 1e-5 minutes a second
+    int32_t headingWest;
+};
+
+struct SyntheticCard
+{
+    uint64_t digest;        // of the readings in time order, as ReadingsDigest
+    size_t readings;
+    size_t files;
+    size_t bytes;
+    uint32_t firstSeconds;  // since 2000, of the first and last reading
+    uint32_t lastSeconds;
+};
+
+inline uint32_t SyntheticRandom(SyntheticDrive& drive)
+{
+    drive.seed = drive.seed * 1664525UL + 1013904223UL;
+    return drive.seed >> 8;
+}
+
+// what NmeaField makes of the minutes text, so the CSV reads back the same
+inline int32_t SyntheticCoordinate(uint32_t degrees, uint32_t minutes)
+{
+    return degrees * 10000000L + (minutes * 100 + 30) / 60;
+}
+
+inline GpsReading SyntheticReading(SyntheticDrive& drive, uint32_t dateTime, size_t count)
+{
+    if (SyntheticRandom(drive) % 60 == 0)
+    {
+        drive.headingNorth = static_cast<int32_t>(SyntheticRandom(drive) % 2001) - 1000;
+        drive.headingWest = static_cast<int32_t>(SyntheticRandom(drive) % 2001) - 1000;
+    }
+    // stays within a degree of the start, about 110 by 75 km
+    drive.latitudeMinutes = (drive.latitudeMinutes + 6000000 + drive.headingNorth) % 6000000;
+    drive.longitudeMinutes = (drive.longitudeMinutes + 6000000 + drive.headingWest) % 6000000;
+    drive.altitude += (static_cast<int32_t>(SyntheticRandom(drive) % 21) - 10) * 10;
+
+    GpsReading reading;
+    memset(&reading, 0, sizeof(reading));
+    reading.dateTime = dateTime;
+    reading.flags = GPS_READING_TIME | GPS_READING_DATE;
+    if (count % 997 != 0)
+    {
+        reading.latitude = SyntheticCoordinate(SYNTHETIC_LATITUDE / 10000000L, drive.latitudeMinutes);
+        reading.longitude = -SyntheticCoordinate(-SYNTHETIC_LONGITUDE / 10000000L, drive.longitudeMinutes);
+        reading.flags |= GPS_READING_POSITION | (5 << GPS_READING_DECIMALS_SHIFT);
+    }
+    if (count % 499 != 0)
+    {
+        reading.altitude = drive.altitude;
+        reading.flags |= GPS_READING_ALTITUDE;
+    }
+    reading.satelliteCount = 4 + SyntheticRandom(drive) % 11;
+    reading.flags |= GPS_READING_SATELLITES;
+    return reading;
+}
+
+inline bool WriteSyntheticFile(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return fclose(file) == 0 && written;
+}
+
+// logs of about targetBytes under root in the months layout, from June 2017 on
+inline bool WriteSyntheticCard(const std::string& root, size_t targetBytes, SyntheticCard& card)
+{
+    static const uint8_t daysInMonth[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    SyntheticDrive drive = { 12345, 3529427, 1184810, 5480, 300, -200 };
+    uint8_t year = 17, month = 6, day = 1, hour = 0;
+    size_t hours = 0;
+    memset(&card, 0, sizeof(card));
+    card.digest = BenchDigestSeed;
+
+    while (card.bytes < targetBytes)
+    {
+        if (hours++ % 7 != 6)
+        {
+            char name[32];
+            char directory[16];
+            snprintf(directory, sizeof(directory), "%04u/%02u", 2000 + year, month);
+            const char* extension = (hours % 8 == 0) ? "BIN" : (hours % 8 == 1) ? "TRK" : "CSV";
+            snprintf(name, sizeof(name), "%02u%02u%02u-%c.%s", year, month, day, 'A' + hour, extension);
+            std::filesystem::create_directories(root + "/" + directory);
+
+            std::vector<uint8_t> log;
+            TrackEncoder encoder;
+            if (extension[0] == 'B')
+            {
+                log.resize(BIN_RECORD_SIZE);
+                PackBinHeader(log.data());
+            }
+            else if (extension[0] == 'T')
+            {
+                log.resize(TRACK_HEADER_SIZE);
+                PackTrackHeader(log.data());
+            }
+
+            for (uint32_t second = 0; second < 3600; second++)
+            {
+                uint32_t dateTime = PackGpsDateTime(year, month, day, hour, second / 60, second % 60);
+                GpsReading reading = SyntheticReading(drive, dateTime, card.readings++);
+
+                char line[CSV_LINE_SIZE];
+                uint8_t length = FormatCsvReading(reading, line);
+                card.digest = BenchDigest(card.digest, line, length);
+
+                uint8_t record[TRACK_RECORD_MAX_SIZE > BIN_RECORD_SIZE ? TRACK_RECORD_MAX_SIZE : BIN_RECORD_SIZE];
+                if (extension[0] == 'B')
+                {
+                    PackBinReading(reading, record);
+                    log.insert(log.end(), record, record + BIN_RECORD_SIZE);
+                }
+                else if (extension[0] == 'T')
+                {
+                    log.insert(log.end(), record, record + encoder.Encode(reading, record));
+                }
+                else
+                {
+                    log.insert(log.end(), line, line + length);
+                }
+
+                card.lastSeconds = GpsDateTimeSeconds(dateTime);
+                if (card.readings == 1)
+                {
+                    card.firstSeconds = card.lastSeconds;
+                }
+            }
+            if (extension[0] == 'C' && card.files % 50 == 3)
+            {
+                // the power went during a line
+                static const char cut[] = "170601,1200";
+                log.insert(log.end(), cut, cut + sizeof(cut) - 1);
+            }
+            if (!WriteSyntheticFile(root + "/" + directory + "/" + name, log))
+            {
+                fprintf(stderr, "cannot write %s/%s/%s\n", root.c_str(), directory, name);
+                return false;
+            }
+            card.bytes += log.size();
+            card.files++;
+        }
+
+        if (++hour == 24)
+        {
+            hour = 0;
+            uint8_t days = daysInMonth[month - 1] + ((month == 2 && year % 4 == 0) ? 1 : 0);
+            if (++day > days)
+            {
+                day = 1;
+                if (++month > 12)
+                {
+                    month = 1;
+                    year++;
+                }
+            }
+        }
+    }
+    return true;
+}
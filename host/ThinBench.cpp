@@ -0,0 +1,213 @@
+// Measures the track thinning against the unthinned readings.
+//
+//   thin_bench [--repeat N] capture.nmea...
+//
+// The captures are parsed by TaskGps, then the readings are run through
+// TrackThinner at a range of tolerances. Reports the readings retained and
+// why the others went, the slots of READING_SLOT_SIZE the writer would
+// have written, and how far any reading dropped lies from the thinned
+// track, measured in meters in floating point on the host. Fails when that
+// deviation exceeds twice the tolerance: a dead-banded fix lies within the
+// tolerance of one that may itself be the tolerance off the line.
+
+#define ARDUINO_PRO_MINI
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+
+#include "TaskGps.h"
+#include "BenchPipeline.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+
+namespace
+{
+    std::vector<GpsReading> s_readings;
+
+    void OnBenchReading(const GpsReading& reading)
+    {
+        s_readings.push_back(reading);
+    }
+
+    void OnBenchBatch()
+    {
+    }
+
+    void OnBenchFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+    }
+
+    // meters east and north of origin, equirectangular at its latitude
+    void Meters(const GpsReading& origin, const GpsReading& reading, double& x, double& y)
+    {
+        const double metersPerUnit = 6371008.8 * M_PI / 180.0 / 1e7;
+        x = (reading.longitude - origin.longitude) * metersPerUnit * cos(origin.latitude / 1e7 * M_PI / 180.0);
+        y = (reading.latitude - origin.latitude) * metersPerUnit;
+    }
+
+    double SegmentDistance(const GpsReading& first, const GpsReading& last, const GpsReading& point)
+    {
+        double lastX, lastY, pointX, pointY;
+        Meters(first, last, lastX, lastY);
+        Meters(first, point, pointX, pointY);
+        double length = lastX * lastX + lastY * lastY;
+        double along = length > 0 ? (pointX * lastX + pointY * lastY) / length : 0;
+        along = along < 0 ? 0 : (along > 1 ? 1 : along);
+        return hypot(pointX - along * lastX, pointY - along * lastY);
+    }
+
+    // indexes into s_readings of the readings kept
+    std::vector<size_t> Thin(uint16_t toleranceM, TrackThinCounters& counters)
+    {
+        std::vector<size_t> kept;
+        TrackThinner thinner(toleranceM);
+        size_t next = 0;
+        for (size_t index = 0; index <= s_readings.size(); index++)
+        {
+            bool ready = index < s_readings.size() ? thinner.Add(s_readings[index]) : thinner.Flush();
+            if (!ready)
+            {
+                continue;
+            }
+            while (const GpsReading* reading = thinner.Next())
+            {
+                // the thinner keeps the order, times are unique
+                while (next < s_readings.size() && memcmp(&s_readings[next], reading, sizeof(GpsReading)))
+                {
+                    next++;
+                }
+                kept.push_back(next++);
+            }
+        }
+        counters = thinner.Counters();
+        return kept;
+    }
+
+    // the worst distance of a dropped reading to the kept ones either side of it
+    double MaxDeviation(const std::vector<size_t>& kept, double& sum, size_t& dropped)
+    {
+        double worst = 0;
+        sum = 0;
+        dropped = 0;
+        for (size_t segment = 0; segment + 1 < kept.size(); segment++)
+        {
+            const GpsReading& first = s_readings[kept[segment]];
+            const GpsReading& last = s_readings[kept[segment + 1]];
+            for (size_t index = kept[segment] + 1; index < kept[segment + 1]; index++)
+            {
+                if (!(s_readings[index].flags & GPS_READING_POSITION) ||
+                    !(first.flags & GPS_READING_POSITION) || !(last.flags & GPS_READING_POSITION))
+                {
+                    continue;
+                }
+                double distance = SegmentDistance(first, last, s_readings[index]);
+                worst = distance > worst ? distance : worst;
+                sum += distance;
+                dropped++;
+            }
+        }
+        return worst;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    CaptureLine line;
+    bool haveCapture = false;
+    int repeat = 200;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--repeat") && index + 1 < argc)
+        {
+            repeat = atoi(argv[++index]);
+        }
+        else if (line.Load(argv[index]))
+        {
+            haveCapture = true;
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s\n", argv[index]);
+            return 1;
+        }
+    }
+    if (!haveCapture || repeat < 1)
+    {
+        fprintf(stderr, "usage: %s [--repeat N] capture...\n", argv[0]);
+        return 2;
+    }
+
+    line.SetFlood(true);
+    HostSim::SetUartLine(&line);
+    {
+        BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+        pipeline.Start();
+        while (!line.Finished())
+        {
+            pipeline.Loop();
+        }
+        pipeline.Finish();
+    }
+
+    if (s_readings.empty())
+    {
+        fprintf(stderr, "no readings in the captures\n");
+        return 1;
+    }
+    double readings = static_cast<double>(s_readings.size());
+    size_t slots = (s_readings.size() + READING_SLOT_SIZE - 1) / READING_SLOT_SIZE;
+    printf("readings %zu, %zu slots, window %u, gap %u s\n", s_readings.size(), slots,
+        LOG_THIN_WINDOW, LOG_THIN_GAP_S);
+
+    static const uint16_t tolerances[] = { 1, 2, LOG_THIN_TOLERANCE_M, 10, 25 };
+    bool ok = true;
+    for (size_t index = 0; index < sizeof(tolerances) / sizeof(tolerances[0]); index++)
+    {
+        TrackThinCounters counters;
+        std::vector<size_t> kept = Thin(tolerances[index], counters);
+        double sum;
+        size_t dropped;
+        double worst = MaxDeviation(kept, sum, dropped);
+        bool within = worst <= 2.0 * tolerances[index] && counters.kept == kept.size();
+        ok = ok && within;
+
+        char label[16];
+        snprintf(label, sizeof(label), "%u m", tolerances[index]);
+        printf("%-6s kept %4zu  ratio %5.3f  dead-band %4u  simplified %4u  slots %3zu  "
+            "deviation max %5.2f m mean %5.2f m  %s\n",
+            label, kept.size(), kept.size() / readings, counters.deadBand, counters.simplified,
+            (kept.size() + READING_SLOT_SIZE - 1) / READING_SLOT_SIZE,
+            worst, dropped ? sum / dropped : 0.0, within ? "ok" : "FAIL");
+    }
+
+    // throughput at the default tolerance
+    size_t kept = 0;
+    uint64_t startNs = BenchNanos();
+    for (int pass = 0; pass < repeat; pass++)
+    {
+        TrackThinner thinner;
+        for (size_t index = 0; index <= s_readings.size(); index++)
+        {
+            if (index < s_readings.size() ? thinner.Add(s_readings[index]) : thinner.Flush())
+            {
+                while (thinner.Next())
+                {
+                    kept++;
+                }
+            }
+        }
+    }
+    uint64_t thinNs = BenchNanos() - startNs;
+    printf("thin     %6.1f ns/reading (%zu kept)\n", thinNs / static_cast<double>(repeat) / readings, kept);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+// Measures the delta encoded track format against the CSV and BIN logs.
+//
+//   track_bench [--repeat N] capture.nmea...
+//
+// The captures are parsed by TaskGps, then the readings with a time are
+// encoded as CSV, BIN and TRK with a range of keyframe intervals. Reports
+// bytes per fix and the ratio to CSV, encoder and decoder throughput on the
+// host, and checks that every TRK stream decodes back to the same readings.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+
+#include "TaskGps.h"
+#include "BenchPipeline.h"
+#include "LogFormat.h"
+#include "TrackFormat.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+
+namespace
+{
+    std::vector<GpsReading> s_readings;
+
+    void OnBenchReading(const GpsReading& reading)
+    {
+        if (reading.flags & GPS_READING_TIME)
+        {
+            s_readings.push_back(reading);
+        }
+    }
+
+    void OnBenchBatch()
+    {
+    }
+
+    void OnBenchFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+    }
+
+    bool SameReading(const GpsReading& left, const GpsReading& right)
+    {
+        return left.dateTime == right.dateTime &&
+            left.latitude == right.latitude &&
+            left.longitude == right.longitude &&
+            left.altitude == right.altitude &&
+            left.satelliteCount == right.satelliteCount &&
+            left.flags == right.flags;
+    }
+
+    size_t EncodeTrack(uint16_t interval, std::vector<uint8_t>& track)
+    {
+        track.resize(TRACK_HEADER_SIZE + s_readings.size() * TRACK_RECORD_MAX_SIZE);
+        PackTrackHeader(&track[0]);
+        size_t size = TRACK_HEADER_SIZE;
+
+        TrackEncoder encoder(interval);
+        for (size_t index = 0; index < s_readings.size(); index++)
+        {
+            size += encoder.Encode(s_readings[index], &track[size]);
+        }
+        track.resize(size);
+        return size;
+    }
+
+    // returns the readings decoded, stops at the first that differs
+    size_t DecodeTrack(const std::vector<uint8_t>& track, bool verify)
+    {
+        TrackDecoder decoder;
+        const uint8_t* data = &track[0] + TRACK_HEADER_SIZE;
+        const uint8_t* end = &track[0] + track.size();
+        size_t count = 0;
+        while (data < end)
+        {
+            GpsReading reading;
+            uint8_t length = decoder.Decode(data, end, reading);
+            if (!length)
+            {
+                break;
+            }
+            data += length;
+            if (verify && (count >= s_readings.size() || !SameReading(reading, s_readings[count])))
+            {
+                break;
+            }
+            count++;
+        }
+        return count;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    CaptureLine line;
+    bool haveCapture = false;
+    int repeat = 200;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--repeat") && index + 1 < argc)
+        {
+            repeat = atoi(argv[++index]);
+        }
+        else if (line.Load(argv[index]))
+        {
+            haveCapture = true;
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s\n", argv[index]);
+            return 1;
+        }
+    }
+    if (!haveCapture || repeat < 1)
+    {
+        fprintf(stderr, "usage: %s [--repeat N] capture...\n", argv[0]);
+        return 2;
+    }
+
+    line.SetFlood(true);
+    HostSim::SetUartLine(&line);
+    {
+        BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+        pipeline.Start();
+        while (!line.Finished())
+        {
+            pipeline.Loop();
+        }
+        pipeline.Finish();
+    }
+
+    if (s_readings.empty())
+    {
+        fprintf(stderr, "no readings in the captures\n");
+        return 1;
+    }
+    double fixes = static_cast<double>(s_readings.size());
+
+    size_t csvBytes = 0;
+    for (size_t index = 0; index < s_readings.size(); index++)
+    {
+        char csv[CSV_LINE_SIZE];
+        csvBytes += FormatCsvReading(s_readings[index], csv);
+    }
+    size_t binBytes = BIN_RECORD_SIZE * (s_readings.size() + 1);
+
+    printf("fixes    %zu\n", s_readings.size());
+    printf("%-8s %8zu bytes  %6.2f bytes/fix  ratio %5.2f\n", "csv", csvBytes, csvBytes / fixes, 1.0);
+    printf("%-8s %8zu bytes  %6.2f bytes/fix  ratio %5.2f\n", "bin", binBytes, binBytes / fixes,
+        static_cast<double>(csvBytes) / binBytes);
+
+    static const uint16_t intervals[] = { 1, 10, TRACK_KEYFRAME_INTERVAL, 300, 3600 };
+    bool ok = true;
+    for (size_t index = 0; index < sizeof(intervals) / sizeof(intervals[0]); index++)
+    {
+        std::vector<uint8_t> track;
+        size_t trackBytes = EncodeTrack(intervals[index], track);
+        bool roundTrip = DecodeTrack(track, true) == s_readings.size();
+        ok = ok && roundTrip;
+
+        char label[16];
+        snprintf(label, sizeof(label), "trk/%u", intervals[index]);
+        printf("%-8s %8zu bytes  %6.2f bytes/fix  ratio %5.2f  %s\n", label, trackBytes, trackBytes / fixes,
+            static_cast<double>(csvBytes) / trackBytes, roundTrip ? "round trip ok" : "ROUND TRIP FAILED");
+    }
+
+    // throughput at the interval the sketch uses
+    std::vector<uint8_t> track;
+    uint64_t digest = BenchDigestSeed;
+    uint64_t startNs = BenchNanos();
+    for (int pass = 0; pass < repeat; pass++)
+    {
+        EncodeTrack(TRACK_KEYFRAME_INTERVAL, track);
+        digest = BenchDigest(digest, &track[0], track.size());
+    }
+    uint64_t encodeNs = BenchNanos() - startNs;
+
+    size_t decoded = 0;
+    startNs = BenchNanos();
+    for (int pass = 0; pass < repeat; pass++)
+    {
+        decoded += DecodeTrack(track, false);
+    }
+    uint64_t decodeNs = BenchNanos() - startNs;
+
+    double passes = static_cast<double>(repeat);
+    printf("encode   %6.1f ns/fix  %7.1f MB/s out\n", encodeNs / passes / fixes,
+        track.size() * passes * 1e3 / encodeNs);
+    printf("decode   %6.1f ns/fix  %7.1f MB/s in\n", decodeNs / passes / fixes,
+        track.size() * passes * 1e3 / decodeNs);
+    printf("digest   %016llx (%zu decoded)\n", static_cast<unsigned long long>(digest), decoded);
+    return ok ? 0 : 1;
+}
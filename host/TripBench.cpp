@@ -0,0 +1,435 @@
+// Checks TripDetector against scripted days and measures what it costs per reading.
+//
+//   trip_bench [--repeat N]
+//
+// The first day is 1 Hz fixes from late evening UTC: parked, a drive
+// across midnight with a minute at the lights, parked, a walk too slow to be
+// a trip, a drive through a two minute tunnel, parked, the logger off for an
+// hour, and a short drive to the end of logging, with one fix in it thrown
+// 5 km off. The second is a drive east across the antimeridian on Taveuni.
+// Parked, a fix wanders by up to a few meters as receivers do. The readings
+// are logged as the sketch logs CSV, into a buffer per hourly file, and fed
+// to the detector with their record offsets. Fails unless it finds the
+// scripted drives, each starting and ending within a few seconds of the
+// script, its distance within 1% of the path driven and its top speed within
+// 2%, its box the one of its fixes, west of its first fix and east of it,
+// and its offsets on the lines of its first and last reading.
+
+#define ARDUINO_PRO_MINI
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+#include "GpsReading.h"
+#include "LogFormat.h"
+#include "TrackThinner.h"
+#include "TripDetector.h"
+
+#include "BenchClock.h"
+
+namespace
+{
+    enum Phase
+    {
+        Phase_Parked,
+        Phase_Drive,
+        Phase_Walk,
+        Phase_Off       // no fixes
+    };
+
+    struct Step
+    {
+        Phase phase;
+        uint32_t seconds;
+        double speed;       // m/s, the top one of a drive
+        double heading;     // degrees from north
+    };
+
+    // a drive speeds up over 20 s, keeps its speed with a swerve now and
+    // then, and slows down over the last 20 s
+    const Step Day[] =
+    {
+        { Phase_Parked, 600, 0, 0 },
+        { Phase_Drive, 420, 14, 30 },
+        { Phase_Parked, 60, 0, 0 },         // the lights
+        { Phase_Drive, 480, 20, 120 },
+        { Phase_Parked, 1200, 0, 0 },
+        { Phase_Walk, 600, 1.2, 200 },
+        { Phase_Drive, 500, 25, 300 },
+        { Phase_Off, 120, 25, 300 },        // the tunnel, still driving
+        { Phase_Drive, 600, 25, 280 },
+        { Phase_Parked, 300, 0, 0 },
+        { Phase_Off, 3600, 0, 0 },
+        { Phase_Drive, 300, 11, 90 },
+    };
+
+    const Step Antimeridian[] =
+    {
+        { Phase_Parked, 300, 0, 0 },
+        { Phase_Drive, 600, 15, 80 },
+        { Phase_Parked, 300, 0, 0 },
+    };
+
+    // the drives the detector should find, by the steps they span
+    struct ExpectedTrip
+    {
+        size_t firstStep;
+        size_t lastStep;
+    };
+
+    const ExpectedTrip DayTrips[] = { { 1, 3 }, { 6, 8 }, { 11, 11 } };
+    const ExpectedTrip AntimeridianTrips[] = { { 1, 1 } };
+
+    struct Scenario
+    {
+        const char* name;
+        const Step* steps;
+        size_t stepCount;
+        const ExpectedTrip* trips;
+        size_t tripCount;
+        double latitude;        // where it starts
+        double longitude;
+        uint8_t hour;           // UTC on 2017-06-17
+        uint8_t minute;
+        bool glitch;            // a fix 5 km off in the last drive
+    };
+
+    #define SCENARIO_STEPS(steps) steps, sizeof(steps) / sizeof(steps[0])
+
+    const Scenario Scenarios[] =
+    {
+        { "day", SCENARIO_STEPS(Day), SCENARIO_STEPS(DayTrips), 47.59, -122.2, 23, 35, true },
+        { "antimeridian", SCENARIO_STEPS(Antimeridian), SCENARIO_STEPS(AntimeridianTrips), -16.83, 179.96, 4, 0,
+            false },
+    };
+
+    const double MetersPerDegree = 6371008.8 * M_PI / 180.0;
+
+    struct ScriptedFix
+    {
+        GpsReading reading;
+        size_t step;
+        double speed;       // m/s over the second before
+        double path;        // meters driven since the start of the script
+    };
+
+    uint32_t Random(uint32_t& seed)
+    {
+        seed = seed * 1664525UL + 1013904223UL;
+        return seed >> 8;
+    }
+
+    // meters a parked fix moves in a second, up to 30 cm either way
+    double Wander(uint32_t& seed)
+    {
+        return (static_cast<int>(Random(seed) % 61) - 30) / 100.0;
+    }
+
+    uint32_t NextSecond(uint32_t dateTime)
+    {
+        static const uint8_t daysInMonth[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        uint8_t year = GpsDateTimeYear(dateTime);
+        uint8_t month = GpsDateTimeMonth(dateTime);
+        uint8_t day = GpsDateTimeDay(dateTime);
+        uint8_t hour = GpsDateTimeHour(dateTime);
+        uint8_t minute = GpsDateTimeMinute(dateTime);
+        uint8_t second = GpsDateTimeSecond(dateTime);
+        if (++second == 60 && (second = 0, ++minute == 60) && (minute = 0, ++hour == 24) &&
+            (hour = 0, ++day > daysInMonth[month - 1]) && (day = 1, ++month > 12))
+        {
+            month = 1;
+            year++;
+        }
+        return (static_cast<uint32_t>(year) << GPS_DATETIME_YEAR_SHIFT) |
+            (static_cast<uint32_t>(month) << GPS_DATETIME_MONTH_SHIFT) |
+            (static_cast<uint32_t>(day) << GPS_DATETIME_DAY_SHIFT) |
+            (static_cast<uint32_t>(hour) << GPS_DATETIME_HOUR_SHIFT) |
+            (static_cast<uint32_t>(minute) << GPS_DATETIME_MINUTE_SHIFT) | second;
+    }
+
+    // 1e-7 degrees, within the half turns either side
+    int32_t WrapLongitude(int64_t longitude)
+    {
+        while (longitude > 1800000000LL)
+        {
+            longitude -= 3600000000LL;
+        }
+        while (longitude < -1800000000LL)
+        {
+            longitude += 3600000000LL;
+        }
+        return static_cast<int32_t>(longitude);
+    }
+
+    // the script as fixes, with the path and speed each was scripted at
+    std::vector<ScriptedFix> RunScript(const Scenario& scenario)
+    {
+        const Step* steps = scenario.steps;
+        std::vector<ScriptedFix> fixes;
+        uint32_t dateTime = (17UL << GPS_DATETIME_YEAR_SHIFT) | (6UL << GPS_DATETIME_MONTH_SHIFT) |
+            (17UL << GPS_DATETIME_DAY_SHIFT) | (static_cast<uint32_t>(scenario.hour) << GPS_DATETIME_HOUR_SHIFT) |
+            (static_cast<uint32_t>(scenario.minute) << GPS_DATETIME_MINUTE_SHIFT);
+        double latitude = scenario.latitude;
+        double longitude = scenario.longitude;
+        double path = 0;
+        double wanderNorth = 0, wanderEast = 0;     // meters, of a parked fix
+        uint32_t seed = 4711;
+
+        for (size_t step = 0; step < scenario.stepCount; step++)
+        {
+            for (uint32_t second = 1; second <= steps[step].seconds; second++)
+            {
+                dateTime = NextSecond(dateTime);
+                double speed = steps[step].speed;
+                if (steps[step].phase == Phase_Drive)
+                {
+                    uint32_t toEnd = steps[step].seconds - second;
+                    speed *= std::min(1.0, std::min(second / 20.0, toEnd / 20.0));
+                }
+                else if (steps[step].phase == Phase_Parked)
+                {
+                    speed = 0;
+                }
+                double heading = (steps[step].heading + (second / 60 % 2 ? 25 : 0)) * M_PI / 180;
+                latitude += speed * cos(heading) / MetersPerDegree;
+                longitude += speed * sin(heading) / MetersPerDegree / cos(latitude * M_PI / 180);
+                path += speed;
+
+                if (steps[step].phase == Phase_Off)
+                {
+                    continue;
+                }
+                if (steps[step].phase == Phase_Parked)
+                {
+                    // a slow wander within 3 m of where it stands
+                    wanderNorth = std::max(-3.0, std::min(3.0, wanderNorth + Wander(seed)));
+                    wanderEast = std::max(-3.0, std::min(3.0, wanderEast + Wander(seed)));
+                }
+                else
+                {
+                    wanderNorth = wanderEast = 0;
+                }
+
+                ScriptedFix fix;
+                memset(&fix.reading, 0, sizeof(fix.reading));
+                fix.reading.dateTime = dateTime;
+                fix.reading.latitude = lround((latitude + wanderNorth / MetersPerDegree) * 1e7);
+                fix.reading.longitude = WrapLongitude(llround((longitude + wanderEast / MetersPerDegree /
+                    cos(latitude * M_PI / 180)) * 1e7));
+                fix.reading.altitude = 5000;
+                fix.reading.satelliteCount = 9;
+                fix.reading.flags = GPS_READING_TIME | GPS_READING_DATE | GPS_READING_POSITION |
+                    GPS_READING_ALTITUDE | GPS_READING_SATELLITES | (5 << GPS_READING_DECIMALS_SHIFT);
+                fix.step = step;
+                fix.speed = speed;
+                fix.path = path;
+                fixes.push_back(fix);
+            }
+        }
+
+        if (scenario.glitch)
+        {
+            // thrown off by 5 km for a second in the middle of the last drive
+            fixes[fixes.size() - 150].reading.latitude += 450000;
+        }
+        return fixes;
+    }
+
+    // "YYMMDD-H" of a reading, the log the sketch puts it in
+    std::string LogName(uint32_t dateTime)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "%02u%02u%02u-%c", GpsDateTimeYear(dateTime), GpsDateTimeMonth(dateTime),
+            GpsDateTimeDay(dateTime), 'A' + GpsDateTimeHour(dateTime));
+        return name;
+    }
+
+    std::string TimeOfDay(uint32_t dateTime)
+    {
+        char time[16];
+        snprintf(time, sizeof(time), "%02u:%02u:%02u", GpsDateTimeHour(dateTime), GpsDateTimeMinute(dateTime),
+            GpsDateTimeSecond(dateTime));
+        return time;
+    }
+
+    std::string CsvLine(const GpsReading& reading)
+    {
+        char line[CSV_LINE_SIZE];
+        return std::string(line, FormatCsvReading(reading, line));
+    }
+
+    // the fix a trip's start or end time names
+    const ScriptedFix* FindFix(const std::vector<ScriptedFix>& fixes, uint32_t dateTime)
+    {
+        for (size_t index = 0; index < fixes.size(); index++)
+        {
+            if (fixes[index].reading.dateTime == dateTime)
+            {
+                return &fixes[index];
+            }
+        }
+        return NULL;
+    }
+
+    // seconds of the script from its start to the first second of a step
+    uint32_t StepStart(const Scenario& scenario, size_t step)
+    {
+        uint32_t seconds = 0;
+        for (size_t index = 0; index < step; index++)
+        {
+            seconds += scenario.steps[index].seconds;
+        }
+        return seconds;
+    }
+
+    // east of one longitude to the other the short way round
+    int64_t LongitudeOffset(int32_t to, int32_t from)
+    {
+        int64_t east = static_cast<int64_t>(to) - from;
+        return east > 1800000000LL ? east - 3600000000LL : east < -1800000000LL ? east + 3600000000LL : east;
+    }
+
+    bool CheckScenario(const Scenario& scenario, const std::vector<ScriptedFix>& fixes)
+    {
+        uint32_t scriptStart = GpsDateTimeSeconds(fixes[0].reading.dateTime) - 1;
+
+        // logged as the sketch logs CSV, the detector told where each line went
+        std::map<std::string, std::string> logs;
+        std::vector<TripSummary> trips;
+        TripDetector detector;
+        for (size_t index = 0; index < fixes.size(); index++)
+        {
+            std::string& log = logs[LogName(fixes[index].reading.dateTime)];
+            uint32_t start = log.size();
+            log += CsvLine(fixes[index].reading);
+            if (detector.Add(fixes[index].reading, start, log.size()))
+            {
+                trips.push_back(detector.Summary());
+            }
+        }
+        if (detector.Flush())
+        {
+            trips.push_back(detector.Summary());
+        }
+
+        bool ok = trips.size() == scenario.tripCount;
+        printf("%s  readings %zu in %zu hourly logs, %zu trips, %zu expected\n", scenario.name, fixes.size(),
+            logs.size(), trips.size(), scenario.tripCount);
+        for (size_t trip = 0; trip < trips.size() && trip < scenario.tripCount; trip++)
+        {
+            const TripSummary& summary = trips[trip];
+            const ScriptedFix* first = FindFix(fixes, summary.startDateTime);
+            const ScriptedFix* last = FindFix(fixes, summary.endDateTime);
+            if (!first || !last)
+            {
+                printf("trip %zu starts or ends on no fix\n", trip);
+                ok = false;
+                continue;
+            }
+
+            // the script's drive, from the last parked second to the last moving one
+            uint32_t scriptedStart = scriptStart + StepStart(scenario, scenario.trips[trip].firstStep);
+            uint32_t scriptedEnd = scriptStart + StepStart(scenario, scenario.trips[trip].lastStep + 1) - 1;
+            int32_t startError = static_cast<int32_t>(GpsDateTimeSeconds(summary.startDateTime) - scriptedStart);
+            int32_t endError = static_cast<int32_t>(GpsDateTimeSeconds(summary.endDateTime) - scriptedEnd);
+
+            double driven = last->path - first->path;
+            double topSpeed = 0;
+            int32_t south = INT32_MAX, north = INT32_MIN;
+            int64_t west = INT64_MAX, east = INT64_MIN;
+            for (const ScriptedFix* fix = first; fix <= last; fix++)
+            {
+                if (fix > first && fix->reading.dateTime != NextSecond((fix - 1)->reading.dateTime))
+                {
+                    continue;   // after a gap or the glitch, not a speed the detector measured
+                }
+                if (fix->reading.latitude - (fix - 1)->reading.latitude > 400000)
+                {
+                    continue;
+                }
+                topSpeed = std::max(topSpeed, fix->speed);
+                south = std::min(south, fix->reading.latitude);
+                north = std::max(north, fix->reading.latitude);
+                int64_t offset = LongitudeOffset(fix->reading.longitude, first->reading.longitude);
+                west = std::min(west, offset);
+                east = std::max(east, offset);
+            }
+            double distanceError = (summary.distanceM - driven) / driven;
+            double speedError = (summary.maxSpeedCms / 100.0 - topSpeed) / topSpeed;
+            bool boxOk = summary.south == south && summary.north == north &&
+                summary.west == WrapLongitude(first->reading.longitude + west) &&
+                summary.east == WrapLongitude(first->reading.longitude + east);
+
+            const std::string& startLog = logs[LogName(summary.startDateTime)];
+            const std::string& endLog = logs[LogName(summary.endDateTime)];
+            std::string startLine = CsvLine(first->reading);
+            std::string endLine = CsvLine(last->reading);
+            bool offsetsOk = startLog.compare(summary.startOffset, startLine.size(), startLine) == 0 &&
+                summary.endOffset >= endLine.size() &&
+                endLog.compare(summary.endOffset - endLine.size(), endLine.size(), endLine) == 0;
+
+            bool tripOk = abs(startError) <= 5 && abs(endError) <= 5 && fabs(distanceError) <= 0.01 &&
+                fabs(speedError) <= 0.02 && boxOk && offsetsOk;
+            ok = ok && tripOk;
+            printf("trip %zu  %s %s +%u to %s %s +%u  start %+d s end %+d s  %u m, driven %.0f (%+.2f%%)  "
+                "top %.1f km/h, scripted %.1f (%+.2f%%)  box %.4f to %.4f east %s  offsets %s\n", trip,
+                LogName(summary.startDateTime).c_str(), TimeOfDay(summary.startDateTime).c_str(),
+                summary.startOffset, LogName(summary.endDateTime).c_str(), TimeOfDay(summary.endDateTime).c_str(),
+                summary.endOffset, startError, endError, summary.distanceM, driven, distanceError * 100,
+                summary.maxSpeedCms * 0.036, topSpeed * 3.6, speedError * 100, summary.west / 1e7,
+                summary.east / 1e7, boxOk ? "ok" : "WRONG", offsetsOk ? "ok" : "WRONG");
+        }
+        return ok;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 200;
+    if (argc == 3 && !strcmp(argv[1], "--repeat"))
+    {
+        repeat = atoi(argv[2]);
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [--repeat N]\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    for (size_t scenario = 0; scenario < sizeof(Scenarios) / sizeof(Scenarios[0]); scenario++)
+    {
+        ok = CheckScenario(Scenarios[scenario], RunScript(Scenarios[scenario])) && ok;
+    }
+
+    // what it costs the sketch per reading logged, over the first day
+    std::vector<ScriptedFix> fixes = RunScript(Scenarios[0]);
+    uint64_t startCycles = BenchCycles();
+    uint64_t startNs = BenchNanos();
+    size_t found = 0;
+    for (int run = 0; run < repeat; run++)
+    {
+        TripDetector timed;
+        for (size_t index = 0; index < fixes.size(); index++)
+        {
+            found += timed.Add(fixes[index].reading, index, index + 1);
+        }
+        found += timed.Flush();
+    }
+    uint64_t cycles = BenchCycles() - startCycles;
+    uint64_t ns = BenchNanos() - startNs;
+    double adds = static_cast<double>(fixes.size()) * repeat;
+    printf("host %.1f ns, %.0f cycles per reading, %zu trips a run  detector %zu bytes\n", ns / adds, cycles / adds,
+        repeat ? found / repeat : 0, sizeof(TripDetector));
+
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,356 @@
+// Compares the log formats and SD write paths for reading batches on the host.
+//
+//   writer_bench [--out DIR] capture.nmea...
+//
+// The capture is parsed by TaskGps first, then every batch is written to the
+// simulated card: once with a print() call per field into a preallocated file
+// (the write path before sector buffering), then through LogFile as CSV, BIN
+// and TRK records. Reports simulated SD time, host time and bytes per reading,
+// checks that the printed and sector CSV files are byte for byte identical and
+// that the BIN and TRK files convert back to the same CSV.
+
+#define ARDUINO_PRO_MINI
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Task.h"
+#include "SdFat.h"
+
+#include "TaskGps.h"
+#include "BenchPipeline.h"
+#include "LogFile.h"
+#include "LogFormat.h"
+#include "TrackFormat.h"
+
+#include "BenchClock.h"
+#include "Capture.h"
+
+namespace
+{
+    struct Batch
+    {
+        std::vector<GpsReading> readings;
+    };
+
+    std::vector<Batch> s_batches;
+
+    Batch s_batch;
+
+    void OnBenchReading(const GpsReading& reading)
+    {
+        s_batch.readings.push_back(reading);
+    }
+
+    void OnBenchBatch()
+    {
+        s_batches.push_back(s_batch);
+        s_batch.readings.clear();
+    }
+
+    void OnBenchFixChanged(GPSFIXTYPE gpsFixType)
+    {
+        (void)gpsFixType;
+    }
+
+    bool HasTime(const GpsReading& reading)
+    {
+        return (reading.flags & GPS_READING_TIME) != 0;
+    }
+
+    struct PathResult
+    {
+        uint64_t simulatedUs;
+        uint64_t maxBatchUs;
+        uint64_t hostNs;
+        uint64_t blockWrites;
+        uint64_t writeCalls;
+        uint64_t bytes;
+        uint64_t readings;
+    };
+
+    // the CSV line split back into its fields
+    void PrintFields(Print& out, const char* line, uint8_t length)
+    {
+        const char* field = line;
+        const char* end = line + length - 2;
+        for (const char* scan = line; scan <= end; scan++)
+        {
+            if (scan == end || *scan == ',')
+            {
+                out.write(reinterpret_cast<const uint8_t*>(field), scan - field);
+                if (scan == end)
+                {
+                    out.println();
+                }
+                else
+                {
+                    out.print(',');
+                }
+                field = scan + 1;
+            }
+        }
+    }
+
+    // field by field prints, one SdFat write per print
+    PathResult WritePrinted(const char* name)
+    {
+        PathResult result = { 0, 0, 0, 0, 0, 0, 0 };
+        HostSd::ResetCounters();
+
+        SdFile file;
+        file.createContiguous(name, LOG_PREALLOCATE_BYTES);
+
+        for (size_t index = 0; index < s_batches.size(); index++)
+        {
+            uint64_t startUs = HostSim::NowUs();
+            uint64_t startNs = BenchNanos();
+            const std::vector<GpsReading>& readings = s_batches[index].readings;
+            for (size_t i = 0; i < readings.size(); i++)
+            {
+                if (!HasTime(readings[i]))
+                {
+                    continue;
+                }
+                char line[CSV_LINE_SIZE];
+                uint8_t length = FormatCsvReading(readings[i], line);
+                PrintFields(file, line, length);
+                result.readings++;
+            }
+            result.hostNs += BenchNanos() - startNs;
+            uint64_t batchUs = HostSim::NowUs() - startUs;
+            result.simulatedUs += batchUs;
+            if (batchUs > result.maxBatchUs)
+            {
+                result.maxBatchUs = batchUs;
+            }
+        }
+
+        result.bytes = file.curPosition();
+        file.truncate(file.curPosition());
+        file.close();
+        result.blockWrites = HostSd::Counters().blockWrites;
+        result.writeCalls = HostSd::Counters().writeCalls;
+        return result;
+    }
+
+    // one formatted line or packed record per reading into the sector buffer
+    PathResult WriteSectors(SdFat& sd, const char* name, uint8_t format)
+    {
+        PathResult result = { 0, 0, 0, 0, 0, 0, 0 };
+        HostSd::ResetCounters();
+
+        LogFile logFile(sd, (format == LOG_FORMAT_BIN) ? BIN_RECORD_SIZE : 1);
+        logFile.Open(name);
+        if (format == LOG_FORMAT_BIN)
+        {
+            uint8_t header[BIN_RECORD_SIZE];
+            PackBinHeader(header);
+            logFile.write(header, BIN_RECORD_SIZE);
+        }
+        else if (format == LOG_FORMAT_TRK)
+        {
+            uint8_t header[TRACK_HEADER_SIZE];
+            PackTrackHeader(header);
+            logFile.write(header, TRACK_HEADER_SIZE);
+        }
+        TrackEncoder trackEncoder;
+
+        for (size_t index = 0; index < s_batches.size(); index++)
+        {
+            uint64_t startUs = HostSim::NowUs();
+            uint64_t startNs = BenchNanos();
+            const std::vector<GpsReading>& readings = s_batches[index].readings;
+            for (size_t i = 0; i < readings.size(); i++)
+            {
+                if (!HasTime(readings[i]))
+                {
+                    continue;
+                }
+                if (format == LOG_FORMAT_BIN)
+                {
+                    uint8_t record[BIN_RECORD_SIZE];
+                    PackBinReading(readings[i], record);
+                    logFile.write(record, BIN_RECORD_SIZE);
+                }
+                else if (format == LOG_FORMAT_TRK)
+                {
+                    uint8_t record[TRACK_RECORD_MAX_SIZE];
+                    uint8_t length = trackEncoder.Encode(readings[i], record);
+                    logFile.write(record, length);
+                }
+                else
+                {
+                    char line[CSV_LINE_SIZE];
+                    uint8_t length = FormatCsvReading(readings[i], line);
+                    logFile.write(line, length);
+                }
+                result.readings++;
+            }
+            result.hostNs += BenchNanos() - startNs;
+            uint64_t batchUs = HostSim::NowUs() - startUs;
+            result.simulatedUs += batchUs;
+            if (batchUs > result.maxBatchUs)
+            {
+                result.maxBatchUs = batchUs;
+            }
+        }
+
+        result.bytes = logFile.Position();
+        logFile.Close();
+        result.blockWrites = HostSd::Counters().blockWrites;
+        result.writeCalls = HostSd::Counters().writeCalls;
+        return result;
+    }
+
+    std::vector<uint8_t> ReadHostFile(const std::string& path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file)
+        {
+            int value;
+            while ((value = fgetc(file)) != EOF)
+            {
+                bytes.push_back(static_cast<uint8_t>(value));
+            }
+            fclose(file);
+        }
+        return bytes;
+    }
+
+    void AppendCsv(const GpsReading& reading, std::vector<uint8_t>& csv)
+    {
+        char line[CSV_LINE_SIZE];
+        uint8_t length = FormatCsvReading(reading, line);
+        csv.insert(csv.end(), line, line + length);
+    }
+
+    // what log_to_csv does, header checked and every record formatted again
+    std::vector<uint8_t> BinToCsv(const std::vector<uint8_t>& bin)
+    {
+        std::vector<uint8_t> csv;
+        if (bin.size() < BIN_RECORD_SIZE || !IsBinHeader(&bin[0]))
+        {
+            return csv;
+        }
+        for (size_t offset = BIN_RECORD_SIZE; offset + BIN_RECORD_SIZE <= bin.size(); offset += BIN_RECORD_SIZE)
+        {
+            GpsReading reading;
+            UnpackBinReading(&bin[offset], reading);
+            AppendCsv(reading, csv);
+        }
+        return csv;
+    }
+
+    std::vector<uint8_t> TrackToCsv(const std::vector<uint8_t>& track)
+    {
+        std::vector<uint8_t> csv;
+        if (track.size() < TRACK_HEADER_SIZE || !IsTrackHeader(&track[0]))
+        {
+            return csv;
+        }
+        TrackDecoder decoder;
+        const uint8_t* data = &track[0] + TRACK_HEADER_SIZE;
+        const uint8_t* end = &track[0] + track.size();
+        GpsReading reading;
+        uint8_t length;
+        while ((length = decoder.Decode(data, end, reading)) != 0)
+        {
+            data += length;
+            if (decoder.Synced())
+            {
+                AppendCsv(reading, csv);
+            }
+        }
+        return csv;
+    }
+
+    void PrintResult(const char* label, const PathResult& result)
+    {
+        double batches = s_batches.empty() ? 1.0 : static_cast<double>(s_batches.size());
+        double readings = result.readings ? static_cast<double>(result.readings) : 1.0;
+        printf("%-8s sd time/batch %8.2f ms  max %7.2f ms  host %8.0f ns/batch  write calls %6llu  block writes %5llu  bytes/reading %5.1f\n",
+            label,
+            result.simulatedUs / batches / 1e3,
+            result.maxBatchUs / 1e3,
+            result.hostNs / batches,
+            static_cast<unsigned long long>(result.writeCalls),
+            static_cast<unsigned long long>(result.blockWrites),
+            result.bytes / readings);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string outDir = "writer-card";
+    CaptureLine line;
+    bool haveCapture = false;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (!strcmp(argv[index], "--out") && index + 1 < argc)
+        {
+            outDir = argv[++index];
+        }
+        else if (line.Load(argv[index]))
+        {
+            haveCapture = true;
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s\n", argv[index]);
+            return 1;
+        }
+    }
+    if (!haveCapture)
+    {
+        fprintf(stderr, "usage: %s [--out DIR] capture...\n", argv[0]);
+        return 2;
+    }
+
+    line.SetFlood(true);
+    HostSim::SetUartLine(&line);
+    {
+        BenchPipeline pipeline(OnBenchReading, OnBenchBatch, OnBenchFixChanged);
+        pipeline.Start();
+        while (!line.Finished())
+        {
+            pipeline.Loop();
+        }
+        pipeline.Finish();
+    }
+
+    HostSd::SetRoot(outDir.c_str());
+    SdFat sd;
+    sd.begin();
+    sd.remove("PRINTED.CSV");
+    sd.remove("SECTORS.CSV");
+    sd.remove("SECTORS.BIN");
+    sd.remove("SECTORS.TRK");
+
+    PathResult printed = WritePrinted("PRINTED.CSV");
+    PathResult csv = WriteSectors(sd, "SECTORS.CSV", LOG_FORMAT_CSV);
+    PathResult bin = WriteSectors(sd, "SECTORS.BIN", LOG_FORMAT_BIN);
+    PathResult trk = WriteSectors(sd, "SECTORS.TRK", LOG_FORMAT_TRK);
+
+    printf("batches  %zu of %d readings\n", s_batches.size(), READING_SLOT_SIZE);
+    PrintResult("print", printed);
+    PrintResult("csv", csv);
+    PrintResult("bin", bin);
+    PrintResult("trk", trk);
+
+    std::vector<uint8_t> printedCsv = ReadHostFile(outDir + "/PRINTED.CSV");
+    std::vector<uint8_t> sectorCsv = ReadHostFile(outDir + "/SECTORS.CSV");
+    bool same = printedCsv == sectorCsv;
+    bool binConverted = sectorCsv == BinToCsv(ReadHostFile(outDir + "/SECTORS.BIN"));
+    bool trkConverted = sectorCsv == TrackToCsv(ReadHostFile(outDir + "/SECTORS.TRK"));
+    printf("csv      %s\n", same ? "identical" : "DIFFERENT");
+    printf("bin      %s\n", binConverted ? "converts to identical csv" : "converts to DIFFERENT csv");
+    printf("trk      %s\n", trkConverted ? "converts to identical csv" : "converts to DIFFERENT csv");
+    return (same && binConverted && trkConverted) ? 0 : 1;
+}
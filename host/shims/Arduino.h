@@ -0,0 +1,235 @@
+// Host stand-in for the parts of the Arduino core the sketch uses.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HostSim.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t*>(addr))
+#define pgm_read_dword(addr) (*reinterpret_cast<const uint32_t*>(addr))
+#define pgm_read_ptr(addr) (const_cast<void*>(*reinterpret_cast<const void* const*>(addr)))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strncmp_P strncmp
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+inline unsigned long micros()
+{
+    return static_cast<unsigned long>(HostSim::NowUs());
+}
+
+inline unsigned long millis()
+{
+    return static_cast<unsigned long>(HostSim::NowUs() / 1000);
+}
+
+inline void delay(unsigned long ms)
+{
+    HostSim::AdvanceUs(static_cast<uint64_t>(ms) * 1000);
+}
+
+inline void delayMicroseconds(unsigned int us)
+{
+    HostSim::AdvanceUs(us);
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+inline int digitalRead(uint8_t pin)
+{
+    return HostSim::PinLevel(pin);
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level)
+{
+    HostSim::SetPinLevel(pin, level);
+}
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+// any pin can interrupt on the host, the handler runs when its level changes
+#define digitalPinToInterrupt(pin) (static_cast<int>(pin))
+
+inline void attachInterrupt(int interrupt, void (*handler)(), int mode)
+{
+    (void)mode;
+    HostSim::AttachPinInterrupt(static_cast<uint8_t>(interrupt), handler);
+}
+
+inline void detachInterrupt(int interrupt)
+{
+    HostSim::AttachPinInterrupt(static_cast<uint8_t>(interrupt), NULL);
+}
+
+inline void yield()
+{
+}
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t value) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t count = 0;
+        while (size--)
+        {
+            count += write(*buffer++);
+        }
+        return count;
+    }
+
+    size_t write(const char* text)
+    {
+        return write(reinterpret_cast<const uint8_t*>(text), strlen(text));
+    }
+
+    size_t write(const char* buffer, size_t size)
+    {
+        return write(reinterpret_cast<const uint8_t*>(buffer), size);
+    }
+
+    size_t print(const __FlashStringHelper* text)
+    {
+        return write(reinterpret_cast<const char*>(text));
+    }
+
+    size_t print(const char* text)
+    {
+        return write(text);
+    }
+
+    size_t print(char value)
+    {
+        return write(static_cast<uint8_t>(value));
+    }
+
+    size_t print(unsigned char value, int base = DEC)
+    {
+        return print(static_cast<unsigned long>(value), base);
+    }
+
+    size_t print(int value, int base = DEC)
+    {
+        return print(static_cast<long>(value), base);
+    }
+
+    size_t print(unsigned int value, int base = DEC)
+    {
+        return print(static_cast<unsigned long>(value), base);
+    }
+
+    size_t print(long value, int base = DEC)
+    {
+        char text[24];
+        snprintf(text, sizeof(text), (base == HEX) ? "%lX" : "%ld", value);
+        return write(text);
+    }
+
+    size_t print(unsigned long value, int base = DEC)
+    {
+        char text[24];
+        snprintf(text, sizeof(text), (base == HEX) ? "%lX" : "%lu", value);
+        return write(text);
+    }
+
+    size_t println()
+    {
+        return write("\r\n");
+    }
+
+    template <typename T> size_t println(T value)
+    {
+        size_t count = print(value);
+        return count + println();
+    }
+
+    template <typename T> size_t println(T value, int base)
+    {
+        size_t count = print(value, base);
+        return count + println();
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud)
+    {
+        (void)baud;
+    }
+
+    operator bool() const
+    {
+        return true;
+    }
+
+    virtual int available()
+    {
+        return 0;
+    }
+
+    virtual int read()
+    {
+        return -1;
+    }
+
+    virtual int peek()
+    {
+        return -1;
+    }
+
+    using Print::write;
+
+    virtual size_t write(uint8_t value)
+    {
+        if (HostSim::SerialEcho())
+        {
+            putchar(value);
+        }
+        return 1;
+    }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,174 @@
+// Host implementation of the simulated board state, see HostSim.h.
+
+#include "Arduino.h"
+#include "SoftwareSerial.h"
+
+#include <vector>
+
+HardwareSerial Serial;
+SoftwareSerial* SoftwareSerial::s_active = NULL;
+
+namespace
+{
+    uint64_t s_nowUs = 0;
+    uint8_t s_pinLevels[64];
+    bool s_pinLevelsInit = false;
+    bool s_serialEcho = false;
+    HostSim::UartLine* s_uartLine = NULL;
+    HostSim::UartStats s_uartStats = { 0, 0, 0, 0 };
+    void (*s_pinInterrupts[64])() = { NULL };
+    bool s_interruptWake = false;
+    HostSim::SleepStats s_sleepStats = { 0, 0, 0 };
+
+    struct PinEvent
+    {
+        uint64_t atUs;
+        uint8_t pin;
+        uint8_t level;
+    };
+
+    // in time order
+    std::vector<PinEvent> s_pinEvents;
+
+    void ApplyPinEvents()
+    {
+        size_t applied = 0;
+        while (applied < s_pinEvents.size() && s_pinEvents[applied].atUs <= s_nowUs)
+        {
+            HostSim::SetPinLevel(s_pinEvents[applied].pin, s_pinEvents[applied].level);
+            applied++;
+        }
+        s_pinEvents.erase(s_pinEvents.begin(), s_pinEvents.begin() + applied);
+    }
+
+    // the next scheduled change of a pin with an interrupt attached
+    uint64_t NextPinInterruptUs()
+    {
+        for (size_t index = 0; index < s_pinEvents.size(); index++)
+        {
+            if (s_pinInterrupts[s_pinEvents[index].pin % 64])
+            {
+                return s_pinEvents[index].atUs;
+            }
+        }
+        return UINT64_MAX;
+    }
+}
+
+namespace HostSim
+{
+    uint64_t NowUs()
+    {
+        return s_nowUs;
+    }
+
+    void AdvanceUs(uint64_t us)
+    {
+        s_nowUs += us;
+        ApplyPinEvents();
+    }
+
+    void SetNowUs(uint64_t us)
+    {
+        s_nowUs = us;
+        ApplyPinEvents();
+    }
+
+    void SleepUs(uint64_t us)
+    {
+        if (!us)
+        {
+            return;
+        }
+        uint64_t wakeUs = s_nowUs + us;
+        if (s_interruptWake)
+        {
+            uint64_t interruptUs = NextPinInterruptUs();
+            if (s_uartLine)
+            {
+                uint64_t arrivalUs = s_uartLine->NextArrivalUs(s_nowUs);
+                interruptUs = (arrivalUs < interruptUs) ? arrivalUs : interruptUs;
+            }
+            if (interruptUs < wakeUs)
+            {
+                wakeUs = interruptUs > s_nowUs ? interruptUs : s_nowUs;
+                s_sleepStats.interruptWakes++;
+            }
+        }
+        s_sleepStats.sleeps++;
+        s_sleepStats.sleptUs += wakeUs - s_nowUs;
+        s_nowUs = wakeUs;
+        ApplyPinEvents();
+    }
+
+    void SetInterruptWake(bool wake)
+    {
+        s_interruptWake = wake;
+    }
+
+    SleepStats& Sleep()
+    {
+        return s_sleepStats;
+    }
+
+    void SetPinLevel(uint8_t pin, uint8_t level)
+    {
+        bool changed = PinLevel(pin) != level;
+        s_pinLevels[pin % 64] = level;
+        if (changed && s_pinInterrupts[pin % 64])
+        {
+            s_pinInterrupts[pin % 64]();
+        }
+    }
+
+    uint8_t PinLevel(uint8_t pin)
+    {
+        if (!s_pinLevelsInit)
+        {
+            memset(s_pinLevels, HIGH, sizeof(s_pinLevels));
+            s_pinLevelsInit = true;
+        }
+        return s_pinLevels[pin % 64];
+    }
+
+    void AttachPinInterrupt(uint8_t pin, void (*handler)())
+    {
+        s_pinInterrupts[pin % 64] = handler;
+    }
+
+    void SchedulePinLevel(uint8_t pin, uint8_t level, uint64_t atUs)
+    {
+        PinEvent event = { atUs, pin, level };
+        std::vector<PinEvent>::iterator position = s_pinEvents.begin();
+        while (position != s_pinEvents.end() && position->atUs <= atUs)
+        {
+            ++position;
+        }
+        s_pinEvents.insert(position, event);
+    }
+
+    void SetSerialEcho(bool echo)
+    {
+        s_serialEcho = echo;
+    }
+
+    bool SerialEcho()
+    {
+        return s_serialEcho;
+    }
+
+    void SetUartLine(UartLine* line)
+    {
+        s_uartLine = line;
+    }
+
+    UartLine* GetUartLine()
+    {
+        return s_uartLine;
+    }
+
+    UartStats& Uart()
+    {
+        return s_uartStats;
+    }
+}
@@ -0,0 +1,103 @@
+// Simulated board state shared by the host stand-ins for the Arduino libraries.
+//
+// Time only moves when something advances it: TaskManager sleeping until the
+// next task is due, delay(), or a modelled SD card operation. That lets a
+// replay run an hour of NMEA in a fraction of a second while still showing
+// which bytes would have been lost while the sketch was busy.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace HostSim
+{
+    uint64_t NowUs();
+    void AdvanceUs(uint64_t us);
+    void SetNowUs(uint64_t us);
+
+    // Idle until us from now, what TaskManager does between tasks. With
+    // interrupt wake on the sleep ends early when a byte arrives on the UART
+    // line or a scheduled level change reaches a pin with an interrupt
+    // attached, like the interrupt ends sleep_cpu() on the board; off by
+    // default so replays keep their fixed polling.
+    void SleepUs(uint64_t us);
+    void SetInterruptWake(bool wake);
+
+    struct SleepStats
+    {
+        uint64_t sleeps;            // SleepUs calls that slept at all
+        uint64_t interruptWakes;    // of them ended early by a wake source
+        uint64_t sleptUs;
+    };
+
+    SleepStats& Sleep();
+
+    // level returned by digitalRead(), pins default to HIGH (pulled up, button open)
+    void SetPinLevel(uint8_t pin, uint8_t level);
+    uint8_t PinLevel(uint8_t pin);
+
+    // called when SetPinLevel changes the level of pin, NULL to detach
+    void AttachPinInterrupt(uint8_t pin, void (*handler)());
+
+    // pin goes to level once the simulated time reaches atUs
+    void SchedulePinLevel(uint8_t pin, uint8_t level, uint64_t atUs);
+
+    // echo Serial output of the sketch to stdout
+    void SetSerialEcho(bool echo);
+    bool SerialEcho();
+
+    // The wire between the GPS receiver and the sketch's serial port.
+    class UartLine
+    {
+    public:
+        virtual ~UartLine() {}
+
+        // retrieve the next byte that has arrived on the wire at or before nowUs
+        virtual bool Receive(uint64_t nowUs, uint8_t* value) = 0;
+
+        // byte sent by the sketch towards the receiver
+        virtual void Transmit(uint8_t value, uint64_t nowUs)
+        {
+            (void)value;
+            (void)nowUs;
+        }
+
+        // baud the sketch opened its port with
+        virtual void SetLocalBaud(uint32_t baud)
+        {
+            (void)baud;
+        }
+
+        // keep bytes on the wire while the receive buffer is full instead of
+        // dropping them, for throughput measurements without timing
+        virtual bool HoldsWhenFull() const
+        {
+            return false;
+        }
+
+        // when the first byte after afterUs arrives, for waking a sleep,
+        // UINT64_MAX when none will or the line has no timing
+        virtual uint64_t NextArrivalUs(uint64_t afterUs)
+        {
+            (void)afterUs;
+            return UINT64_MAX;
+        }
+
+        // no more bytes will ever arrive
+        virtual bool Finished() const = 0;
+    };
+
+    void SetUartLine(UartLine* line);
+    UartLine* GetUartLine();
+
+    struct UartStats
+    {
+        uint64_t received;     // bytes placed in the receive buffer
+        uint64_t overflowed;   // bytes dropped because the receive buffer was full
+        uint64_t notListening; // bytes that arrived while the port was not listening
+        uint64_t lostSending;  // bytes that arrived while the port was sending
+    };
+
+    UartStats& Uart();
+}
@@ -0,0 +1,69 @@
+// Host stand-in for the hardware UART behind GpsUart.
+//
+// The receive interrupt is modelled by Poll(): every byte that has arrived on
+// the HostSim::UartLine by now goes into the ring in arrival order, so a
+// sketch that is busy for too long overflows the ring exactly where the
+// interrupt would have. Unlike SoftwareSerial nothing is lost while sending,
+// the UART receives on its own.
+
+#pragma once
+
+#include "Arduino.h"
+
+namespace HostUart
+{
+    inline uint32_t& Baud()
+    {
+        static uint32_t baud = 9600;
+        return baud;
+    }
+
+    inline void Begin(uint32_t baud)
+    {
+        Baud() = baud;
+        HostSim::UartLine* line = HostSim::GetUartLine();
+        if (line)
+        {
+            line->SetLocalBaud(baud);
+        }
+    }
+
+    template <typename Ring> void Poll(Ring& ring, bool listening)
+    {
+        HostSim::UartLine* line = HostSim::GetUartLine();
+        if (!line)
+        {
+            return;
+        }
+
+        uint64_t now = HostSim::NowUs();
+        bool hold = line->HoldsWhenFull();
+        uint8_t value;
+        while (!(hold && listening && ring.Free() == 0) && line->Receive(now, &value))
+        {
+            if (!listening)
+            {
+                HostSim::Uart().notListening++;
+            }
+            else if (ring.Push(value))
+            {
+                HostSim::Uart().received++;
+            }
+            else
+            {
+                HostSim::Uart().overflowed++;
+            }
+        }
+    }
+
+    template <typename Ring> void Write(Ring& ring, bool listening, uint8_t value)
+    {
+        HostSim::UartLine* line = HostSim::GetUartLine();
+        if (line)
+        {
+            Poll(ring, listening);
+            line->Transmit(value, HostSim::NowUs());
+            HostSim::AdvanceUs(10000000ull / Baud());
+        }
+    }
+}
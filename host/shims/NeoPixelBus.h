@@ -0,0 +1,85 @@
+// Host stand-in for NeoPixelBus, keeps the pixel colors and counts Show() calls.
+
+#pragma once
+
+#include "Arduino.h"
+
+struct RgbColor
+{
+    RgbColor() : R(0), G(0), B(0) {}
+    RgbColor(uint8_t r, uint8_t g, uint8_t b) : R(r), G(g), B(b) {}
+    explicit RgbColor(uint8_t brightness) : R(brightness), G(brightness), B(brightness) {}
+
+    bool operator==(const RgbColor& other) const
+    {
+        return R == other.R && G == other.G && B == other.B;
+    }
+
+    bool operator!=(const RgbColor& other) const
+    {
+        return !(*this == other);
+    }
+
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+};
+
+class NeoGrbwFeature {};
+class NeoWs2813Method {};
+
+namespace HostSim
+{
+    // Show() calls made by all strips, each one blocks interrupts on the board
+    inline uint64_t& NeoPixelShows()
+    {
+        static uint64_t shows = 0;
+        return shows;
+    }
+
+    // the first pixel as the last Show() sent it, what the LED looks like
+    inline RgbColor& NeoPixelShown()
+    {
+        static RgbColor shown;
+        return shown;
+    }
+}
+
+template <typename T_COLOR_FEATURE, typename T_METHOD> class NeoPixelBus
+{
+public:
+    NeoPixelBus(uint16_t countPixels, uint8_t pin) :
+        _count(countPixels)
+    {
+        (void)pin;
+    }
+
+    void Begin()
+    {
+    }
+
+    void Show()
+    {
+        // a single pixel WS2813 frame, 32 bits at 800KHz plus latch
+        HostSim::NeoPixelShows()++;
+        HostSim::NeoPixelShown() = _pixels[0];
+        HostSim::AdvanceUs(_count * 40 + 300);
+    }
+
+    void SetPixelColor(uint16_t indexPixel, RgbColor color)
+    {
+        if (indexPixel < 8)
+        {
+            _pixels[indexPixel] = color;
+        }
+    }
+
+    RgbColor GetPixelColor(uint16_t indexPixel) const
+    {
+        return (indexPixel < 8) ? _pixels[indexPixel] : RgbColor();
+    }
+
+private:
+    uint16_t _count;
+    RgbColor _pixels[8];
+};
@@ -0,0 +1,1017 @@
+// Host implementation of the SdFat stand-in, see SdFat.h for the model.
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "SdFat.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::string s_root = ".";
+    std::string s_cwd;
+    bool s_cardPresent = true;
+    uint32_t s_nextContiguousBlock = 0x10000;
+
+    HostSd::Timing s_timing = {
+        1000,   // blockReadUs
+        1200,   // blockWriteUs
+        40,     // callOverheadUs
+        500,    // copyNsPerByte
+        64,     // clusterBlocks, 32KB clusters
+        128,    // stallEveryWrites
+        100000, // stallUs
+        50000,  // beginUs
+        0       // rootEntryLimit
+    };
+
+    HostSd::Stats s_stats;
+
+    uint64_t s_copyNs; // sub microsecond copy cost carried between calls
+
+    // power cut injection, see HostSd::CutPowerAfter
+    struct Power
+    {
+        bool armed;
+        bool cut;
+        uint64_t blocksLeft;
+        uint16_t tornBytes;
+    };
+
+    Power s_power = { false, false, 0, 0 };
+
+    // one block, or part of one, onto the card unless the power is gone
+    void PersistBlock(FILE* fp, const void* data, size_t length, uint32_t offset)
+    {
+        if (s_power.cut)
+        {
+            return;
+        }
+        if (s_power.armed && --s_power.blocksLeft == 0)
+        {
+            s_power.cut = true;
+            if (length > s_power.tornBytes)
+            {
+                length = s_power.tornBytes;
+            }
+        }
+        if (length)
+        {
+            ssize_t written = pwrite(fileno(fp), data, length, offset);
+            (void)written;
+        }
+    }
+
+    void PersistSize(FILE* fp, uint32_t length)
+    {
+        if (!s_power.cut)
+        {
+            fflush(fp);
+            int result = ftruncate(fileno(fp), length);
+            (void)result;
+        }
+    }
+}
+
+struct FatFile::State
+{
+    std::string cardPath;
+    std::string hostPath;
+    FILE* fp;
+    bool dir;
+    uint8_t flags;
+    uint32_t pos;
+    uint32_t size;
+    uint32_t dirSize;      // size recorded in the directory entry
+    uint32_t allocClusters;
+    bool contiguous;
+    uint32_t firstBlock;
+};
+
+namespace
+{
+    // the single block cache SdFat keeps per volume
+    struct VolumeCache
+    {
+        FatFile::State* owner;
+        uint32_t block;
+        bool dirty;
+        uint8_t data[FAT_BLOCK_SIZE];
+    };
+
+    VolumeCache s_cache = { NULL, 0, false, { 0 } };
+
+    std::vector<FatFile::State*> s_openFiles;
+
+    // measures one public api call for the stats
+    class CallScope
+    {
+    public:
+        CallScope() :
+            _start(HostSim::NowUs())
+        {
+            HostSim::AdvanceUs(s_timing.callOverheadUs);
+        }
+
+        ~CallScope()
+        {
+            uint64_t spent = HostSim::NowUs() - _start;
+            s_stats.busyUs += spent;
+            if (spent > s_stats.maxCallUs)
+            {
+                s_stats.maxCallUs = spent;
+            }
+        }
+
+        uint64_t Elapsed() const
+        {
+            return HostSim::NowUs() - _start;
+        }
+
+    private:
+        uint64_t _start;
+    };
+
+    void ChargeBlockRead(uint32_t count = 1)
+    {
+        s_stats.blockReads += count;
+        HostSim::AdvanceUs(static_cast<uint64_t>(s_timing.blockReadUs) * count);
+    }
+
+    void ChargeBlockWrite(uint32_t count = 1)
+    {
+        while (count--)
+        {
+            s_stats.blockWrites++;
+            HostSim::AdvanceUs(s_timing.blockWriteUs);
+            if (s_timing.stallEveryWrites && (s_stats.blockWrites % s_timing.stallEveryWrites) == 0)
+            {
+                s_stats.stalls++;
+                HostSim::AdvanceUs(s_timing.stallUs);
+            }
+        }
+    }
+
+    void ChargeCopy(size_t bytes)
+    {
+        s_copyNs += static_cast<uint64_t>(bytes) * s_timing.copyNsPerByte;
+        HostSim::AdvanceUs(s_copyNs / 1000);
+        s_copyNs %= 1000;
+    }
+
+    uint32_t ClusterBytes()
+    {
+        return s_timing.clusterBlocks * FAT_BLOCK_SIZE;
+    }
+
+    std::string JoinCardPath(const std::string& base, const char* path)
+    {
+        std::string result = (path[0] == '/') ? std::string() : base;
+        std::string component;
+        for (const char* scan = path; ; scan++)
+        {
+            if (*scan == '/' || *scan == '\0')
+            {
+                if (component == "..")
+                {
+                    size_t slash = result.find_last_of('/');
+                    result = (slash == std::string::npos) ? std::string() : result.substr(0, slash);
+                }
+                else if (!component.empty() && component != ".")
+                {
+                    result = result.empty() ? component : result + "/" + component;
+                }
+                component.clear();
+                if (*scan == '\0')
+                {
+                    break;
+                }
+            }
+            else
+            {
+                component += *scan;
+            }
+        }
+        return result;
+    }
+
+    std::string HostPathOf(const std::string& cardPath)
+    {
+        return cardPath.empty() ? s_root : s_root + "/" + cardPath;
+    }
+
+    std::string ParentOf(const std::string& cardPath)
+    {
+        size_t slash = cardPath.find_last_of('/');
+        return (slash == std::string::npos) ? std::string() : cardPath.substr(0, slash);
+    }
+
+    uint32_t DirEntryCount(const std::string& cardPath)
+    {
+        std::error_code error;
+        uint32_t count = cardPath.empty() ? 0 : 2; // dot entries
+        for (fs::directory_iterator it(HostPathOf(cardPath), error), end; !error && it != end; it.increment(error))
+        {
+            count++;
+        }
+        return count;
+    }
+
+    uint32_t DirBlocks(uint32_t entries)
+    {
+        return (entries + 15) / 16;
+    }
+
+    // directory search cost for finding (or not finding) one entry in a directory
+    void ChargeDirSearch(const std::string& dirCardPath, bool found)
+    {
+        uint32_t entries = DirEntryCount(dirCardPath);
+        uint32_t blocks = found ? DirBlocks(entries / 2 + 1) : DirBlocks(entries + 1);
+        if (blocks == 0)
+        {
+            blocks = 1;
+        }
+        s_stats.dirBlocksScanned += blocks;
+        ChargeBlockRead(blocks);
+    }
+
+    // walk all intermediate directories of a path starting at a directory
+    void ChargePathWalk(const std::string& startDir, const std::string& cardPath)
+    {
+        std::string dir = startDir;
+        std::string rest = startDir.empty() ? cardPath : cardPath.substr(startDir.size() + 1);
+        size_t slash;
+        while ((slash = rest.find('/')) != std::string::npos)
+        {
+            ChargeDirSearch(dir, true);
+            dir = dir.empty() ? rest.substr(0, slash) : dir + "/" + rest.substr(0, slash);
+            rest = rest.substr(slash + 1);
+        }
+    }
+
+    void FlushCache()
+    {
+        if (s_cache.owner && s_cache.dirty)
+        {
+            FatFile::State* state = s_cache.owner;
+            uint32_t start = s_cache.block * FAT_BLOCK_SIZE;
+            uint32_t end = start + FAT_BLOCK_SIZE;
+            if (!state->contiguous && end > state->size)
+            {
+                end = state->size;
+            }
+            if (end > start)
+            {
+                PersistBlock(state->fp, s_cache.data, end - start, start);
+            }
+            ChargeBlockWrite();
+        }
+        s_cache.dirty = false;
+    }
+
+    void DropCache(FatFile::State* state)
+    {
+        if (s_cache.owner == state)
+        {
+            FlushCache();
+            s_cache.owner = NULL;
+        }
+    }
+
+    void LoadCache(FatFile::State* state, uint32_t block, bool readNeeded)
+    {
+        if (s_cache.owner == state && s_cache.block == block)
+        {
+            return;
+        }
+        FlushCache();
+        memset(s_cache.data, 0, sizeof(s_cache.data));
+        if (readNeeded)
+        {
+            ssize_t got = pread(fileno(state->fp), s_cache.data, FAT_BLOCK_SIZE, static_cast<off_t>(block) * FAT_BLOCK_SIZE);
+            (void)got;
+            ChargeBlockRead();
+        }
+        s_cache.owner = state;
+        s_cache.block = block;
+        s_cache.dirty = false;
+    }
+
+    bool EnsureAllocated(FatFile::State* state, uint32_t length)
+    {
+        uint32_t needed = (length + ClusterBytes() - 1) / ClusterBytes();
+        while (state->allocClusters < needed)
+        {
+            // search the FAT for a free cluster and link it in both FAT copies
+            state->allocClusters++;
+            s_stats.clusterAllocs++;
+            ChargeBlockRead();
+            ChargeBlockWrite(2);
+        }
+        return true;
+    }
+
+    // write the directory entry of the file, read-modify-write of one block
+    void UpdateDirEntry(FatFile::State* state)
+    {
+        s_stats.dirEntryWrites++;
+        ChargeBlockRead();
+        ChargeBlockWrite();
+        state->dirSize = state->size;
+    }
+}
+
+namespace HostSd
+{
+    void SetRoot(const char* path)
+    {
+        s_root = path;
+        fs::create_directories(s_root);
+    }
+
+    const char* Root()
+    {
+        return s_root.c_str();
+    }
+
+    Timing& Timings()
+    {
+        return s_timing;
+    }
+
+    Stats& Counters()
+    {
+        return s_stats;
+    }
+
+    void ResetCounters()
+    {
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+
+    void SetCardPresent(bool present)
+    {
+        s_cardPresent = present;
+    }
+
+    bool CardPresent()
+    {
+        return s_cardPresent;
+    }
+
+    void CutPowerAfter(uint64_t blockWrites, uint16_t tornBytes)
+    {
+        s_power.armed = blockWrites != 0;
+        s_power.cut = false;
+        s_power.blocksLeft = blockWrites;
+        s_power.tornBytes = tornBytes;
+    }
+
+    bool PowerCut()
+    {
+        return s_power.cut;
+    }
+
+    void RestorePower()
+    {
+        // the board restarts, whatever the cache held is gone
+        s_cache.owner = NULL;
+        s_cache.dirty = false;
+        s_power.armed = false;
+        s_power.cut = false;
+    }
+}
+
+FatFile::FatFile() :
+    m_state(NULL)
+{
+}
+
+FatFile::FatFile(const char* path, uint8_t oflag) :
+    m_state(NULL)
+{
+    open(path, oflag);
+}
+
+FatFile::~FatFile()
+{
+    if (m_state)
+    {
+        DropCache(m_state);
+        if (m_state->fp)
+        {
+            fclose(m_state->fp);
+        }
+        delete m_state;
+    }
+}
+
+bool FatFile::open(const char* path, uint8_t oflag)
+{
+    if (isOpen())
+    {
+        return false;
+    }
+
+    // paths are resolved from the root, intermediate directories are charged
+    // as part of the relative open
+    FatFile root;
+    root.m_state = new State();
+    root.m_state->fp = NULL;
+    root.m_state->dir = true;
+    root.m_state->hostPath = s_root;
+
+    std::string cardPath = JoinCardPath(s_cwd, path);
+    if (cardPath.empty())
+    {
+        m_state = root.m_state;
+        root.m_state = NULL;
+        s_stats.opens++;
+        return true;
+    }
+    return open(&root, cardPath.c_str(), oflag);
+}
+
+bool FatFile::open(FatFile* dirFile, const char* path, uint8_t oflag)
+{
+    if (isOpen() || !dirFile || !dirFile->isDir() || !s_cardPresent)
+    {
+        return false;
+    }
+
+    CallScope scope;
+    std::string cardPath = JoinCardPath(dirFile->m_state->cardPath, path);
+    std::string parent = ParentOf(cardPath);
+    ChargePathWalk(dirFile->m_state->cardPath, cardPath);
+
+    std::string hostPath = HostPathOf(cardPath);
+    std::error_code error;
+    bool exists = fs::exists(hostPath, error);
+    bool isDirectory = exists && fs::is_directory(hostPath, error);
+
+    ChargeDirSearch(parent, exists);
+    s_stats.opens++;
+
+    if (exists && (oflag & O_CREAT) && (oflag & O_EXCL))
+    {
+        s_stats.openUs += scope.Elapsed();
+        return false;
+    }
+    if (!exists && !(oflag & O_CREAT))
+    {
+        s_stats.openUs += scope.Elapsed();
+        return false;
+    }
+    if (!exists && parent.empty() && s_timing.rootEntryLimit && DirEntryCount(parent) >= s_timing.rootEntryLimit)
+    {
+        s_stats.openUs += scope.Elapsed();
+        return false;
+    }
+    if (isDirectory && (oflag & O_WRITE))
+    {
+        s_stats.openUs += scope.Elapsed();
+        return false;
+    }
+
+    State* state = new State();
+    state->cardPath = cardPath;
+    state->hostPath = hostPath;
+    state->fp = NULL;
+    state->dir = isDirectory;
+    state->flags = oflag;
+    state->pos = 0;
+    state->size = 0;
+    state->dirSize = 0;
+    state->allocClusters = 0;
+    state->contiguous = false;
+    state->firstBlock = 0;
+
+    if (!isDirectory)
+    {
+        state->fp = fopen(hostPath.c_str(), exists ? "r+b" : "w+b");
+        if (!state->fp)
+        {
+            delete state;
+            s_stats.openUs += scope.Elapsed();
+            return false;
+        }
+
+        if (!exists)
+        {
+            // new directory entry
+            ChargeBlockWrite();
+        }
+
+        struct stat info;
+        fstat(fileno(state->fp), &info);
+        state->size = static_cast<uint32_t>(info.st_size);
+        state->dirSize = state->size;
+        state->allocClusters = (state->size + ClusterBytes() - 1) / ClusterBytes();
+
+        if ((oflag & O_TRUNC) && (oflag & O_WRITE) && state->size)
+        {
+            state->size = 0;
+            state->allocClusters = 0;
+            PersistSize(state->fp, 0);
+            UpdateDirEntry(state);
+        }
+        if (oflag & O_AT_END)
+        {
+            state->pos = state->size;
+        }
+    }
+
+    m_state = state;
+    s_openFiles.push_back(state);
+    s_stats.openUs += scope.Elapsed();
+    return true;
+}
+
+bool FatFile::close()
+{
+    if (!m_state)
+    {
+        return false;
+    }
+    bool result = true;
+    if (!m_state->dir)
+    {
+        result = sync();
+        fclose(m_state->fp);
+        s_stats.closes++;
+    }
+    DropCache(m_state);
+    for (size_t index = 0; index < s_openFiles.size(); index++)
+    {
+        if (s_openFiles[index] == m_state)
+        {
+            s_openFiles.erase(s_openFiles.begin() + index);
+            break;
+        }
+    }
+    delete m_state;
+    m_state = NULL;
+    return result;
+}
+
+bool FatFile::isOpen() const
+{
+    return m_state != NULL;
+}
+
+bool FatFile::isDir() const
+{
+    return m_state && m_state->dir;
+}
+
+bool FatFile::isFile() const
+{
+    return m_state && !m_state->dir;
+}
+
+int FatFile::read()
+{
+    uint8_t value;
+    return (read(&value, 1) == 1) ? value : -1;
+}
+
+int FatFile::read(void* buf, size_t nbyte)
+{
+    if (!isFile() || !(m_state->flags & O_READ))
+    {
+        return -1;
+    }
+
+    CallScope scope;
+    uint8_t* dest = static_cast<uint8_t*>(buf);
+    size_t count = 0;
+    while (count < nbyte && m_state->pos < m_state->size)
+    {
+        uint32_t block = m_state->pos / FAT_BLOCK_SIZE;
+        uint32_t offset = m_state->pos % FAT_BLOCK_SIZE;
+        uint32_t chunk = FAT_BLOCK_SIZE - offset;
+        if (chunk > nbyte - count)
+        {
+            chunk = nbyte - count;
+        }
+        if (chunk > m_state->size - m_state->pos)
+        {
+            chunk = m_state->size - m_state->pos;
+        }
+
+        if (offset == 0 && chunk == FAT_BLOCK_SIZE && !(s_cache.owner == m_state && s_cache.block == block))
+        {
+            // whole block directly into the callers buffer
+            ssize_t got = pread(fileno(m_state->fp), dest + count, FAT_BLOCK_SIZE, static_cast<off_t>(block) * FAT_BLOCK_SIZE);
+            (void)got;
+            ChargeBlockRead();
+        }
+        else
+        {
+            LoadCache(m_state, block, true);
+            memcpy(dest + count, s_cache.data + offset, chunk);
+            ChargeCopy(chunk);
+        }
+        count += chunk;
+        m_state->pos += chunk;
+    }
+    return static_cast<int>(count);
+}
+
+int FatFile::write(const void* buf, size_t nbyte)
+{
+    if (!isFile() || !(m_state->flags & O_WRITE))
+    {
+        return -1;
+    }
+
+    CallScope scope;
+    s_stats.writeCalls++;
+
+    if (m_state->flags & O_APPEND)
+    {
+        m_state->pos = m_state->size;
+    }
+
+    const uint8_t* src = static_cast<const uint8_t*>(buf);
+    size_t count = 0;
+    while (count < nbyte)
+    {
+        uint32_t block = m_state->pos / FAT_BLOCK_SIZE;
+        uint32_t offset = m_state->pos % FAT_BLOCK_SIZE;
+        uint32_t chunk = FAT_BLOCK_SIZE - offset;
+        if (chunk > nbyte - count)
+        {
+            chunk = nbyte - count;
+        }
+
+        EnsureAllocated(m_state, m_state->pos + chunk);
+
+        if (offset == 0 && chunk == FAT_BLOCK_SIZE)
+        {
+            // full aligned block goes straight to the card, no cache copy
+            if (s_cache.owner == m_state && s_cache.block == block)
+            {
+                s_cache.owner = NULL;
+                s_cache.dirty = false;
+            }
+            PersistBlock(m_state->fp, src + count, FAT_BLOCK_SIZE, block * FAT_BLOCK_SIZE);
+            ChargeBlockWrite();
+        }
+        else
+        {
+            // partial block, a block past the end of file needs no read
+            bool readNeeded = !(offset == 0 && m_state->pos >= m_state->size);
+            LoadCache(m_state, block, readNeeded);
+            memcpy(s_cache.data + offset, src + count, chunk);
+            s_cache.dirty = true;
+            ChargeCopy(chunk);
+        }
+
+        count += chunk;
+        m_state->pos += chunk;
+        if (m_state->pos > m_state->size)
+        {
+            // grown past a preallocated run, further clusters come from the FAT
+            m_state->size = m_state->pos;
+            m_state->contiguous = false;
+        }
+    }
+
+    s_stats.bytesWritten += count;
+
+    if (m_state->flags & O_SYNC)
+    {
+        sync();
+    }
+    return static_cast<int>(count);
+}
+
+bool FatFile::seekSet(uint32_t pos)
+{
+    if (!isFile() || pos > m_state->size)
+    {
+        return false;
+    }
+    m_state->pos = pos;
+    return true;
+}
+
+bool FatFile::seekCur(int32_t offset)
+{
+    return isFile() && seekSet(m_state->pos + offset);
+}
+
+bool FatFile::seekEnd(int32_t offset)
+{
+    return isFile() && seekSet(m_state->size + offset);
+}
+
+uint32_t FatFile::curPosition() const
+{
+    return m_state ? m_state->pos : 0;
+}
+
+uint32_t FatFile::fileSize() const
+{
+    return m_state ? m_state->size : 0;
+}
+
+bool FatFile::sync()
+{
+    if (!isFile())
+    {
+        return false;
+    }
+
+    CallScope scope;
+    s_stats.syncs++;
+    if (s_cache.owner == m_state)
+    {
+        FlushCache();
+    }
+    if (m_state->flags & O_WRITE)
+    {
+        UpdateDirEntry(m_state);
+        if (!m_state->contiguous)
+        {
+            PersistSize(m_state->fp, m_state->size);
+        }
+        else if (!s_power.cut)
+        {
+            fflush(m_state->fp);
+        }
+    }
+    return true;
+}
+
+bool FatFile::truncate(uint32_t length)
+{
+    if (!isFile() || !(m_state->flags & O_WRITE) || length > m_state->size)
+    {
+        return false;
+    }
+
+    CallScope scope;
+    if (s_cache.owner == m_state)
+    {
+        FlushCache();
+        s_cache.owner = NULL;
+    }
+
+    uint32_t keep = (length + ClusterBytes() - 1) / ClusterBytes();
+    if (keep < m_state->allocClusters)
+    {
+        // free the tail of the chain in both FAT copies
+        ChargeBlockRead();
+        ChargeBlockWrite(2);
+        m_state->allocClusters = keep;
+    }
+
+    m_state->size = length;
+    m_state->contiguous = false;
+    if (m_state->pos > length)
+    {
+        m_state->pos = length;
+    }
+    PersistSize(m_state->fp, length);
+    UpdateDirEntry(m_state);
+    return true;
+}
+
+bool FatFile::remove()
+{
+    if (!isFile() || !(m_state->flags & O_WRITE))
+    {
+        return false;
+    }
+    std::string hostPath = m_state->hostPath;
+    {
+        CallScope scope;
+        DropCache(m_state);
+        s_cache.owner = NULL;
+        ChargeBlockRead();
+        ChargeBlockWrite(3);
+    }
+    close();
+    std::error_code error;
+    return fs::remove(hostPath, error);
+}
+
+bool FatFile::openNext(FatFile* dirFile, uint8_t oflag)
+{
+    if (isOpen() || !dirFile || !dirFile->isDir() || !s_cardPresent)
+    {
+        return false;
+    }
+
+    // entries in a stable order, the directory position counts them
+    std::vector<std::string> names;
+    std::error_code error;
+    for (fs::directory_iterator it(dirFile->m_state->hostPath, error), end; !error && it != end; it.increment(error))
+    {
+        names.push_back(it->path().filename().string());
+    }
+    std::sort(names.begin(), names.end());
+
+    uint32_t index = dirFile->m_state->pos;
+    if (index >= names.size())
+    {
+        return false;
+    }
+    dirFile->m_state->pos++;
+    if (index % 16 == 0)
+    {
+        CallScope scope;
+        s_stats.dirBlocksScanned++;
+        ChargeBlockRead();
+    }
+    return open(dirFile, names[index].c_str(), oflag);
+}
+
+bool FatFile::getName(char* name, size_t size)
+{
+    if (!isOpen() || size == 0)
+    {
+        return false;
+    }
+    std::string last = m_state->cardPath.substr(m_state->cardPath.rfind('/') + 1);
+    if (last.size() >= size)
+    {
+        return false;
+    }
+    strcpy(name, last.c_str());
+    return true;
+}
+
+bool FatFile::createContiguous(const char* path, uint32_t size)
+{
+    FatFile dir;
+    std::string cardPath = JoinCardPath(s_cwd, path);
+    std::string parent = ParentOf(cardPath);
+    if (!dir.open(parent.empty() ? "/" : ("/" + parent).c_str(), O_READ))
+    {
+        return false;
+    }
+    std::string leaf = parent.empty() ? cardPath : cardPath.substr(parent.size() + 1);
+    return createContiguous(&dir, leaf.c_str(), size);
+}
+
+bool FatFile::createContiguous(FatFile* dirFile, const char* path, uint32_t size)
+{
+    if (size == 0 || !open(dirFile, path, O_CREAT | O_EXCL | O_RDWR))
+    {
+        return false;
+    }
+
+    CallScope scope;
+    uint32_t clusters = (size + ClusterBytes() - 1) / ClusterBytes();
+    uint32_t fatBlocks = (clusters + 127) / 128;
+
+    // search for a free run, then chain it in both FAT copies
+    ChargeBlockRead(fatBlocks);
+    ChargeBlockWrite(fatBlocks * 2);
+    s_stats.clusterAllocs += clusters;
+
+    m_state->allocClusters = clusters;
+    m_state->size = size;
+    m_state->contiguous = true;
+    m_state->firstBlock = s_nextContiguousBlock;
+    s_nextContiguousBlock += clusters * s_timing.clusterBlocks;
+
+    PersistSize(m_state->fp, size);
+    UpdateDirEntry(m_state);
+    return true;
+}
+
+bool FatFile::contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock)
+{
+    if (!isFile() || !m_state->contiguous)
+    {
+        return false;
+    }
+    *bgnBlock = m_state->firstBlock;
+    *endBlock = m_state->firstBlock + (m_state->size + FAT_BLOCK_SIZE - 1) / FAT_BLOCK_SIZE - 1;
+    return true;
+}
+
+const char* FatFile::hostPath() const
+{
+    return m_state ? m_state->hostPath.c_str() : "";
+}
+
+bool SdSpiCard::erase(uint32_t firstBlock, uint32_t lastBlock)
+{
+    if (lastBlock < firstBlock)
+    {
+        return false;
+    }
+
+    CallScope scope;
+    HostSim::AdvanceUs(2000 + (lastBlock - firstBlock + 1) / 8);
+
+    for (size_t index = 0; index < s_openFiles.size(); index++)
+    {
+        FatFile::State* state = s_openFiles[index];
+        if (!state->contiguous || state->firstBlock > lastBlock)
+        {
+            continue;
+        }
+        uint32_t blocks = (state->size + FAT_BLOCK_SIZE - 1) / FAT_BLOCK_SIZE;
+        if (firstBlock >= state->firstBlock + blocks)
+        {
+            continue;
+        }
+
+        uint32_t from = (firstBlock > state->firstBlock) ? firstBlock - state->firstBlock : 0;
+        uint32_t to = lastBlock - state->firstBlock + 1;
+        if (to > blocks)
+        {
+            to = blocks;
+        }
+        if (s_cache.owner == state && s_cache.block >= from && s_cache.block < to)
+        {
+            s_cache.owner = NULL;
+            s_cache.dirty = false;
+        }
+
+        std::vector<uint8_t> zeros(FAT_BLOCK_SIZE, 0);
+        for (uint32_t block = from; block < to && !s_power.cut; block++)
+        {
+            ssize_t written = pwrite(fileno(state->fp), zeros.data(), FAT_BLOCK_SIZE, static_cast<off_t>(block) * FAT_BLOCK_SIZE);
+            (void)written;
+        }
+    }
+    return true;
+}
+
+bool SdFat::begin(uint8_t csPin, uint8_t spiSpeed)
+{
+    (void)csPin;
+    (void)spiSpeed;
+
+    HostSim::AdvanceUs(s_cardPresent ? s_timing.beginUs : 5000);
+    s_cwd.clear();
+    return s_cardPresent;
+}
+
+bool SdFat::exists(const char* path)
+{
+    std::string cardPath = JoinCardPath(s_cwd, path);
+    CallScope scope;
+    ChargePathWalk(std::string(), cardPath);
+    std::error_code error;
+    bool found = fs::exists(HostPathOf(cardPath), error);
+    ChargeDirSearch(ParentOf(cardPath), found);
+    return found;
+}
+
+bool SdFat::mkdir(const char* path, bool pFlag)
+{
+    std::string cardPath = JoinCardPath(s_cwd, path);
+    CallScope scope;
+    std::error_code error;
+    std::string hostPath = HostPathOf(cardPath);
+    if (fs::exists(hostPath, error))
+    {
+        return false;
+    }
+    if (!pFlag && !fs::exists(HostPathOf(ParentOf(cardPath)), error))
+    {
+        return false;
+    }
+    ChargePathWalk(std::string(), cardPath);
+    ChargeDirSearch(ParentOf(cardPath), false);
+    // new entry, new cluster for the directory, dot entries
+    ChargeBlockRead();
+    ChargeBlockWrite(4);
+    return fs::create_directories(hostPath, error);
+}
+
+bool SdFat::remove(const char* path)
+{
+    FatFile file;
+    if (!file.open(path, O_WRITE))
+    {
+        return false;
+    }
+    return file.remove();
+}
+
+bool SdFat::chdir(const char* path)
+{
+    std::string cardPath = JoinCardPath(s_cwd, path);
+    std::error_code error;
+    if (!fs::is_directory(HostPathOf(cardPath), error))
+    {
+        return false;
+    }
+    s_cwd = cardPath;
+    return true;
+}
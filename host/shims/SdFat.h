@@ -0,0 +1,198 @@
+// Host stand-in for the SdFat 1.x API used by the sketch.
+//
+// Files live in a directory on the host (HostSd::SetRoot) so the logs can be
+// inspected after a replay. Every call also charges the simulated clock with
+// the SPI/card time the same operation costs on the board: block reads and
+// writes through the single volume cache, directory searches, cluster
+// allocation, directory entry updates on sync, and the occasional long busy
+// period cards take for internal housekeeping. The numbers are a model, good
+// for comparing write strategies against each other, not absolute timings.
+
+#pragma once
+
+#include "Arduino.h"
+
+#undef O_RDONLY
+#undef O_WRONLY
+#undef O_RDWR
+#undef O_ACCMODE
+#undef O_APPEND
+#undef O_SYNC
+#undef O_TRUNC
+#undef O_CREAT
+#undef O_EXCL
+
+#define O_READ    0X01
+#define O_RDONLY  O_READ
+#define O_WRITE   0X02
+#define O_WRONLY  O_WRITE
+#define O_RDWR    (O_READ | O_WRITE)
+#define O_ACCMODE (O_READ | O_WRITE)
+#define O_APPEND  0X04
+#define O_SYNC    0X08
+#define O_TRUNC   0X10
+#define O_AT_END  0X20
+#define O_CREAT   0X40
+#define O_EXCL    0X80
+
+#define SPI_FULL_SPEED 0
+#define SPI_HALF_SPEED 1
+
+#define FAT_BLOCK_SIZE 512
+
+namespace HostSd
+{
+    struct Timing
+    {
+        uint32_t blockReadUs;       // one 512 byte block read incl. command overhead
+        uint32_t blockWriteUs;      // one 512 byte block write incl. busy wait
+        uint32_t callOverheadUs;    // fixed cost of entering a file api call
+        uint32_t copyNsPerByte;     // copying through the cache on the MCU
+        uint32_t clusterBlocks;     // blocks per cluster
+        uint32_t stallEveryWrites;  // card housekeeping every n block writes, 0 off
+        uint32_t stallUs;           // length of such a housekeeping stall
+        uint32_t beginUs;           // card init on a successful begin()
+        uint16_t rootEntryLimit;    // FAT16 style fixed root directory, 0 no limit
+    };
+
+    struct Stats
+    {
+        uint64_t blockReads;
+        uint64_t blockWrites;
+        uint64_t writeCalls;
+        uint64_t opens;
+        uint64_t closes;
+        uint64_t syncs;
+        uint64_t dirEntryWrites;    // directory entry rewritten, on sync, truncate and create
+        uint64_t dirBlocksScanned;
+        uint64_t clusterAllocs;
+        uint64_t stalls;
+        uint64_t bytesWritten;
+        uint64_t busyUs;       // total simulated time spent inside SdFat
+        uint64_t maxCallUs;    // longest single api call
+        uint64_t openUs;       // simulated time spent inside open()
+    };
+
+    void SetRoot(const char* path);
+    const char* Root();
+
+    Timing& Timings();
+    Stats& Counters();
+    void ResetCounters();
+
+    // card presence as seen by begin(), for insert/eject scenarios
+    void SetCardPresent(bool present);
+    bool CardPresent();
+
+    // power fails while the blockWrites'th block from now is written: that
+    // block only gets its first tornBytes onto the card, and nothing written,
+    // truncated or erased after it does, cached blocks included
+    void CutPowerAfter(uint64_t blockWrites, uint16_t tornBytes);
+    bool PowerCut();
+    void RestorePower();
+}
+
+class FatFile;
+
+class SdSpiCard
+{
+public:
+    bool erase(uint32_t firstBlock, uint32_t lastBlock);
+    bool eraseSingleBlockEnable()
+    {
+        return true;
+    }
+};
+
+class FatFile
+{
+public:
+    FatFile();
+    FatFile(const char* path, uint8_t oflag);
+    virtual ~FatFile();
+
+    bool open(const char* path, uint8_t oflag = O_READ);
+    bool open(FatFile* dirFile, const char* path, uint8_t oflag);
+    bool close();
+    bool isOpen() const;
+    bool isDir() const;
+    bool isFile() const;
+
+    int read();
+    int read(void* buf, size_t nbyte);
+    int write(const void* buf, size_t nbyte);
+
+    bool seekSet(uint32_t pos);
+    bool seekCur(int32_t offset);
+    bool seekEnd(int32_t offset = 0);
+    uint32_t curPosition() const;
+    uint32_t fileSize() const;
+
+    bool sync();
+    bool truncate(uint32_t length);
+    bool remove();
+
+    // the entry after the last one opened this way in dirFile
+    bool openNext(FatFile* dirFile, uint8_t oflag = O_READ);
+    bool getName(char* name, size_t size);
+
+    bool createContiguous(const char* path, uint32_t size);
+    bool createContiguous(FatFile* dirFile, const char* path, uint32_t size);
+    bool contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock);
+
+    // host only, path of the backing file on the host
+    const char* hostPath() const;
+
+    // host only, opaque per open file state
+    struct State;
+
+protected:
+    State* m_state;
+};
+
+typedef FatFile SdBaseFile;
+
+class SdFile : public FatFile, public Print
+{
+public:
+    SdFile() {}
+    SdFile(const char* path, uint8_t oflag) : FatFile(path, oflag) {}
+
+    using FatFile::write;
+    using Print::write;
+
+    virtual size_t write(uint8_t b)
+    {
+        return FatFile::write(&b, 1) == 1 ? 1 : 0;
+    }
+
+    virtual size_t write(const uint8_t* buf, size_t size)
+    {
+        int result = FatFile::write(buf, size);
+        return result < 0 ? 0 : static_cast<size_t>(result);
+    }
+
+    int write(const char* str)
+    {
+        return FatFile::write(str, strlen(str));
+    }
+};
+
+class SdFat
+{
+public:
+    bool begin(uint8_t csPin = 10, uint8_t spiSpeed = SPI_FULL_SPEED);
+
+    bool exists(const char* path);
+    bool mkdir(const char* path, bool pFlag = true);
+    bool remove(const char* path);
+    bool chdir(const char* path = "/");
+
+    SdSpiCard* card()
+    {
+        return &m_card;
+    }
+
+private:
+    SdSpiCard m_card;
+};
@@ -0,0 +1,177 @@
+// Host stand-in for SoftwareSerial.
+//
+// Bytes come off the HostSim::UartLine as simulated time passes and land in
+// the same 64 byte receive buffer the AVR library uses, so a sketch that is
+// busy for too long overflows exactly as it would on the board. Sending
+// blocks for the byte time and, as on the board where interrupts are off
+// meanwhile, anything arriving during it is lost.
+
+#pragma once
+
+#include "Arduino.h"
+
+#ifndef _SS_MAX_RX_BUFF
+#define _SS_MAX_RX_BUFF 64
+#endif
+
+class SoftwareSerial : public Stream
+{
+public:
+    SoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverseLogic = false) :
+        _head(0),
+        _tail(0),
+        _overflow(false),
+        _listening(false),
+        _baud(9600)
+    {
+        (void)receivePin;
+        (void)transmitPin;
+        (void)inverseLogic;
+    }
+
+    void begin(long speed)
+    {
+        _baud = static_cast<uint32_t>(speed);
+        HostSim::UartLine* line = HostSim::GetUartLine();
+        if (line)
+        {
+            line->SetLocalBaud(static_cast<uint32_t>(speed));
+        }
+        listen();
+    }
+
+    void end()
+    {
+        stopListening();
+    }
+
+    bool listen()
+    {
+        bool wasListening = _listening;
+        if (s_active && s_active != this)
+        {
+            s_active->_listening = false;
+        }
+        s_active = this;
+        _listening = true;
+        _head = _tail = 0;
+        _overflow = false;
+        return !wasListening;
+    }
+
+    bool isListening()
+    {
+        return _listening;
+    }
+
+    bool stopListening()
+    {
+        Pump();
+        if (s_active == this)
+        {
+            s_active = NULL;
+        }
+        bool wasListening = _listening;
+        _listening = false;
+        return wasListening;
+    }
+
+    bool overflow()
+    {
+        bool result = _overflow;
+        _overflow = false;
+        return result;
+    }
+
+    virtual int available()
+    {
+        Pump();
+        return (_tail + _SS_MAX_RX_BUFF - _head) % _SS_MAX_RX_BUFF;
+    }
+
+    virtual int read()
+    {
+        Pump();
+        if (_head == _tail)
+        {
+            return -1;
+        }
+        uint8_t value = _buffer[_head];
+        _head = (_head + 1) % _SS_MAX_RX_BUFF;
+        return value;
+    }
+
+    virtual int peek()
+    {
+        Pump();
+        if (_head == _tail)
+        {
+            return -1;
+        }
+        return _buffer[_head];
+    }
+
+    using Print::write;
+
+    virtual size_t write(uint8_t value)
+    {
+        HostSim::UartLine* line = HostSim::GetUartLine();
+        if (line)
+        {
+            Pump();
+            line->Transmit(value, HostSim::NowUs());
+            HostSim::AdvanceUs(10000000ull / (_baud ? _baud : 9600));
+
+            uint8_t lost;
+            while (!line->HoldsWhenFull() && line->Receive(HostSim::NowUs(), &lost))
+            {
+                HostSim::Uart().lostSending++;
+            }
+        }
+        return 1;
+    }
+
+private:
+    static SoftwareSerial* s_active;
+
+    uint8_t _buffer[_SS_MAX_RX_BUFF];
+    uint8_t _head;
+    uint8_t _tail;
+    bool _overflow;
+    bool _listening;
+    uint32_t _baud;
+
+    // move everything that has arrived on the wire by now into the buffer
+    void Pump()
+    {
+        HostSim::UartLine* line = HostSim::GetUartLine();
+        if (!line)
+        {
+            return;
+        }
+
+        uint64_t now = HostSim::NowUs();
+        bool hold = line->HoldsWhenFull();
+        uint8_t value;
+        while (!(hold && _listening && ((_tail + 1) % _SS_MAX_RX_BUFF) == _head) &&
+                line->Receive(now, &value))
+        {
+            if (!_listening)
+            {
+                HostSim::Uart().notListening++;
+                continue;
+            }
+
+            uint8_t next = (_tail + 1) % _SS_MAX_RX_BUFF;
+            if (next == _head)
+            {
+                _overflow = true;
+                HostSim::Uart().overflowed++;
+                continue;
+            }
+            _buffer[_tail] = value;
+            _tail = next;
+            HostSim::Uart().received++;
+        }
+    }
+};
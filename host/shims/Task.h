@@ -0,0 +1,227 @@
+// Host stand-in for the Task library (Task, TaskManager).
+//
+// Follows the library's cooperative model: tasks are polled in start order,
+// OnUpdate receives the time since its last update, stopping is deferred to
+// the next Loop() and Loop() idles until the next task is due. Idling here
+// advances the simulated clock instead of sleeping, see HostSim::SleepUs().
+
+#pragma once
+
+#include "Arduino.h"
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+#define MsToTaskTime(ms) (static_cast<uint32_t>(ms))
+#define TaskTimeToMs(t) (static_cast<uint32_t>(t))
+#define TaskTimeAccuracy 1
+
+enum TaskState
+{
+    TaskState_Stopped,
+    TaskState_Running,
+    TaskState_Stopping
+};
+
+class Task
+{
+public:
+    Task(uint32_t timeInterval) :
+        _remainingTime(0),
+        _timeInterval(timeInterval),
+        _pNext(NULL),
+        _taskState(TaskState_Stopped)
+    {
+    }
+
+    virtual ~Task() {}
+
+    void setTimeInterval(uint32_t timeInterval)
+    {
+        _timeInterval = timeInterval;
+        if (_taskState == TaskState_Running)
+        {
+            _remainingTime = timeInterval;
+        }
+    }
+
+    uint32_t getTimeInterval()
+    {
+        return _timeInterval;
+    }
+
+    TaskState getTaskState()
+    {
+        return _taskState;
+    }
+
+protected:
+    virtual bool OnStart()
+    {
+        return true;
+    }
+
+    virtual void OnStop()
+    {
+    }
+
+    virtual void OnUpdate(uint32_t deltaTime)
+    {
+        (void)deltaTime;
+    }
+
+    uint32_t _remainingTime;
+    uint32_t _timeInterval;
+
+private:
+    friend class TaskManager;
+    Task* _pNext;
+    TaskState _taskState;
+};
+
+class TaskManager
+{
+public:
+    TaskManager() :
+        _pFirstTask(NULL),
+        _pLastTask(NULL),
+        _lastTick(0),
+        _updates(0),
+        _maxUpdateUs(0)
+    {
+    }
+
+    void StartTask(Task* pTask)
+    {
+        if (pTask->_taskState == TaskState_Running)
+        {
+            return;
+        }
+
+        bool linked = false;
+        for (Task* pScan = _pFirstTask; pScan != NULL; pScan = pScan->_pNext)
+        {
+            linked |= (pScan == pTask);
+        }
+
+        if (!linked)
+        {
+            pTask->_pNext = NULL;
+            if (_pLastTask)
+            {
+                _pLastTask->_pNext = pTask;
+            }
+            else
+            {
+                _pFirstTask = pTask;
+            }
+            _pLastTask = pTask;
+        }
+
+        if (pTask->OnStart())
+        {
+            pTask->_remainingTime = pTask->_timeInterval;
+            pTask->_taskState = TaskState_Running;
+        }
+    }
+
+    void StopTask(Task* pTask)
+    {
+        if (pTask->_taskState == TaskState_Running)
+        {
+            pTask->_taskState = TaskState_Stopping;
+        }
+    }
+
+    void ResetTask(Task* pTask)
+    {
+        pTask->_remainingTime = pTask->_timeInterval;
+    }
+
+    void Loop(uint16_t watchdogTimeOutFlag = WDTO_500MS)
+    {
+        (void)watchdogTimeOutFlag;
+
+        uint32_t currentTick = millis();
+        uint32_t deltaTime = currentTick - _lastTick;
+        uint32_t nextWakeTime = static_cast<uint32_t>(-1);
+
+        _lastTick = currentTick;
+
+        for (Task* pTask = _pFirstTask; pTask != NULL; pTask = pTask->_pNext)
+        {
+            if (pTask->_taskState == TaskState_Running)
+            {
+                if (deltaTime >= pTask->_remainingTime)
+                {
+                    uint32_t taskDelta = pTask->_timeInterval + (deltaTime - pTask->_remainingTime);
+                    pTask->_remainingTime = pTask->_timeInterval;
+                    _updates++;
+                    uint64_t updateStartUs = HostSim::NowUs();
+                    pTask->OnUpdate(taskDelta);
+                    uint64_t updateUs = HostSim::NowUs() - updateStartUs;
+                    if (updateUs > _maxUpdateUs)
+                    {
+                        _maxUpdateUs = updateUs;
+                    }
+                }
+                else
+                {
+                    pTask->_remainingTime -= deltaTime;
+                }
+
+                if (pTask->_remainingTime < nextWakeTime)
+                {
+                    nextWakeTime = pTask->_remainingTime;
+                }
+            }
+            else if (pTask->_taskState == TaskState_Stopping)
+            {
+                pTask->_taskState = TaskState_Stopped;
+                pTask->OnStop();
+            }
+        }
+
+        // account for the time the updates themselves took
+        uint32_t spent = millis() - currentTick;
+        if (nextWakeTime == static_cast<uint32_t>(-1))
+        {
+            nextWakeTime = TaskTimeAccuracy;
+        }
+        if (nextWakeTime > spent)
+        {
+            HostSim::SleepUs(static_cast<uint64_t>(nextWakeTime - spent) * 1000);
+        }
+        else if (spent == 0)
+        {
+            HostSim::AdvanceUs(TaskTimeAccuracy * 1000);
+        }
+    }
+
+    // number of OnUpdate calls made, host only
+    uint64_t UpdateCount() const
+    {
+        return _updates;
+    }
+
+    // longest simulated time a single OnUpdate blocked the loop, host only
+    uint64_t MaxUpdateUs() const
+    {
+        return _maxUpdateUs;
+    }
+
+private:
+    Task* _pFirstTask;
+    Task* _pLastTask;
+    uint32_t _lastTick;
+    uint64_t _updates;
+    uint64_t _maxUpdateUs;
+};